@@ -30,10 +30,12 @@
 
 #include <prosoft/core/config/config_platform.h>
 
+#include <cstdint>
 #include <functional>
 #include <iomanip>
 #include <iostream>
 #include <system_error>
+#include <vector>
 
 // clang-format off
 namespace prosoft { namespace filesystem { inline namespace v1 {
@@ -239,6 +241,8 @@ public:
         : m_owner(std::move(o))
         , m_times(t)
         , m_size(sz)
+        , m_device()
+        , m_inode()
         , m_type(ft)
         , m_perms(p) {}
     file_status(file_type ft, perms p, file_size_type sz, const owner_type& o, const times_type& t)
@@ -294,11 +298,30 @@ public:
     void size(file_size_type sz) noexcept {
         m_size = sz;
     }
+    
+    // Together they identify the file. Windows: the volume serial number and file index.
+    std::uint64_t device() const noexcept {
+        return m_device;
+    }
+    
+    void device(std::uint64_t dev) noexcept {
+        m_device = dev;
+    }
+    
+    std::uint64_t inode() const noexcept {
+        return m_inode;
+    }
+    
+    void inode(std::uint64_t ino) noexcept {
+        m_inode = ino;
+    }
 
 private:
     owner_type m_owner; // extension
     times_type m_times; // extension
     file_size_type m_size; // extension
+    std::uint64_t m_device; // extension
+    std::uint64_t m_inode; // extension
     file_type m_type;
     perms m_perms;
 };
@@ -309,7 +332,9 @@ path current_path(error_code&);
 void current_path(const path&);
 void current_path(const path&, error_code&);
 
-path absolute(const path&, const path& base = current_path());
+// The current path is only needed (and retrieved) for a relative path.
+path absolute(const path&);
+path absolute(const path&, const path& base);
 #if !_WIN32
 inline path system_complete(const path& p) {
     return absolute(p);
@@ -325,11 +350,11 @@ path system_complete(const path&, error_code&);
 
 // As an extension, canonical will expand an initial '~' char to home_directory_path().
 // As an extension for WIN32, canonical will create extended-length paths for a path that is >= MAX_PATH.
-path canonical(const path&, const path& base = current_path());
+// Ditto for the current path.
+path canonical(const path&);
+path canonical(const path&, error_code&);
+path canonical(const path&, const path& base);
 path canonical(const path&, const path& base, error_code&);
-inline path canonical(const path& p, error_code& ec) {
-    return canonical(p, current_path(ec), ec);
-}
 // As an extension, canonical behaves as weakly_canonical for nonexistent path members.
 inline path weakly_canonical(const path& p) {
     return canonical(p);
@@ -338,6 +363,15 @@ inline path weakly_canonical(const path& p, error_code& ec) {
     return canonical(p, ec);
 }
 
+// Extension: canonicalizes paths in place, as canonical() does. A path is left as is on error.
+// Resolved directories are shared by the batch, so a path in an already resolved directory costs a single lstat (unless it's a symlink).
+// A new directory is resolved through its nearest resolved ancestor with one lstat per level; symlinks and missing directories use canonical().
+void canonicalize(path* paths, std::size_t count, error_code* ecs);
+inline void canonicalize(std::vector<path>& paths, std::vector<error_code>& ecs) {
+    ecs.resize(paths.size());
+    canonicalize(paths.data(), paths.size(), ecs.data());
+}
+
 // perms are an extension and ignored on Windows. perms:all is the std. default.
 bool create_directories(const path&, perms perm = perms::all);
 bool create_directories(const path&, perms, error_code&) noexcept;
@@ -376,16 +410,99 @@ bool equivalent(const path&, const path&, error_code&) noexcept;
 bool remove(const path&);
 bool remove(const path&, error_code&) noexcept;
 
+// Returns the number of paths removed, -1 on error. Mount points in the tree are not removed (and are an error).
+// See filesystem_batch.hpp for a parallel version.
+std::uintmax_t remove_all(const path&);
+std::uintmax_t remove_all(const path&, error_code&);
+
 void rename(const path&, const path&);
 void rename(const path&, const path&, error_code&) noexcept;
 
+enum class copy_options : unsigned {
+    none = 0,
+    // existing target file
+    skip_existing = 0x1,
+    overwrite_existing = 0x2,
+    update_existing = 0x4,
+    // subdirectories
+    recursive = 0x8,
+    // symlinks
+    copy_symlinks = 0x10,
+    skip_symlinks = 0x20,
+    // form of copying
+    directories_only = 0x40,
+    create_symlinks = 0x80,
+    create_hard_links = 0x100,
+    
+    // Extensions -- metadata copied along with the content. Otherwise a new file has the source perms (less the umask).
+    copy_times = 0x1000,
+    copy_perms = 0x2000,
+    copy_acl = 0x4000,
+    copy_xattrs = 0x8000, // ignored on Windows
+    copy_metadata = copy_times|copy_perms|copy_acl|copy_xattrs,
+};
+PS_ENUM_BITMASK_OPS(copy_options);
+
+struct copy_config { // extension
+    // Called as the content of a file is copied with the bytes copied so far and the size of the file.
+    // Return false to stop the copy, which then fails with ECANCELED (ERROR_REQUEST_ABORTED on Windows).
+    using progress_type = std::function<bool (const path& from, file_size_type copied, file_size_type size)>;
+    progress_type progress;
+    // Used when the content can't be copied by the system. 0 == default (1MB)
+    std::size_t buffer_size;
+    
+    copy_config()
+        : progress()
+        , buffer_size() {}
+    ~copy_config() = default;
+    PS_DEFAULT_COPY(copy_config);
+    PS_DEFAULT_MOVE(copy_config);
+};
+
+// Linux: the content is cloned (reflink) if the filesystem supports it, otherwise it's copied by the kernel (copy_file_range, sendfile).
+// A read/write loop is the last resort. Only the data of a sparse file is copied, the target keeps the holes (see file_extents).
+// As an extension, a target created by a failed copy is removed.
+bool copy_file(const path& from, const path& to, copy_options, const copy_config&);
+bool copy_file(const path& from, const path& to, copy_options, const copy_config&, error_code&);
+inline bool copy_file(const path& from, const path& to, copy_options opts) {
+    return copy_file(from, to, opts, copy_config{});
+}
+inline bool copy_file(const path& from, const path& to, copy_options opts, error_code& ec) {
+    return copy_file(from, to, opts, copy_config{}, ec);
+}
+inline bool copy_file(const path& from, const path& to) {
+    return copy_file(from, to, copy_options::none);
+}
+inline bool copy_file(const path& from, const path& to, error_code& ec) {
+    return copy_file(from, to, copy_options::none, ec);
+}
+
+// Metadata options also apply to directories, their times are set after their content is copied.
+void copy(const path& from, const path& to, copy_options, const copy_config&);
+void copy(const path& from, const path& to, copy_options, const copy_config&, error_code&);
+inline void copy(const path& from, const path& to, copy_options opts) {
+    copy(from, to, opts, copy_config{});
+}
+inline void copy(const path& from, const path& to, copy_options opts, error_code& ec) {
+    copy(from, to, opts, copy_config{}, ec);
+}
+inline void copy(const path& from, const path& to) {
+    copy(from, to, copy_options::none);
+}
+inline void copy(const path& from, const path& to, error_code& ec) {
+    copy(from, to, copy_options::none, ec);
+}
+
+// What status() fills in besides the type, the rest of the status is left at its default.
 enum class status_info {
     basic = 0,
-    perms = 0x1,
+    perms = 0x1, // Windows: requires the ACL and owner
     times = 0x2,
     size = 0x4,
+    owner = 0x8,
+    inode = 0x10, // device and inode
     
-    all = basic|perms|times|size,
+    all = basic|perms|times|size|owner|inode,
 };
 PS_ENUM_BITMASK_OPS(status_info);
 
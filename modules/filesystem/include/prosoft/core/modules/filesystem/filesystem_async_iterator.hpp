@@ -0,0 +1,95 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef PS_CORE_FILESYSTEM_ASYNC_ITERATOR_HPP
+#define PS_CORE_FILESYSTEM_ASYNC_ITERATOR_HPP
+
+// Callback based asynchronous directory iteration for clients (e.g. event loops) that can't block on slow (network) filesystems.
+// Directory reads run on a bounded pool of worker threads. While the consumer handles a batch, idle workers read ahead the next directories.
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+using directory_entries = std::vector<directory_entry>;
+
+struct async_iterator_config : public ifilesystem::iterator_config {
+    // Max entries per callback.
+    std::size_t batch_size;
+    // Max concurrent directory reads.
+    unsigned threads;
+
+    async_iterator_config() noexcept
+        : ifilesystem::iterator_config()
+        , batch_size(256)
+        , threads(4) {}
+    ~async_iterator_config() = default;
+    PS_DEFAULT_COPY(async_iterator_config);
+    PS_DEFAULT_MOVE(async_iterator_config);
+};
+
+// Dropping the handle does not cancel the iteration.
+class async_iteration {
+public:
+    virtual ~async_iteration() = default;
+    PS_DISABLE_COPY(async_iteration);
+    PS_DISABLE_MOVE(async_iteration);
+
+    // Stops delivering entries. Reads in progress are abandoned and the completion callback receives operation_canceled.
+    virtual void cancel() noexcept = 0;
+    // Blocks until the completion callback has returned. Must not be called from a callback.
+    virtual void wait() = 0;
+    virtual bool done() const noexcept = 0;
+
+protected:
+    async_iteration() = default;
+};
+
+using async_iteration_ptr = std::shared_ptr<async_iteration>;
+using async_entries_callback = std::function<void (directory_entries&&)>;
+using async_completion_callback = std::function<void (const error_code&)>;
+
+// Iteration is recursive unless directory_options::skip_subdirectory_descendants is set. Other options behave as with the synchronous iterators.
+// Entries of a directory are delivered in order, but entries from different directories may be interleaved (and there is no postorder).
+// XXX: callbacks occur in the background and are serialized. They should not throw, an exception cancels the iteration.
+// Errors (including failing to open the root) are reported to the completion callback, which is always called exactly once.
+// If no thread could be started, the completion callback is called before returning the error.
+// Invalid args are only reported by the returned error, and the completion callback is not called.
+async_iteration_ptr iterate_async(const path&, directory_options, const async_iterator_config&, async_entries_callback, async_completion_callback, error_code&);
+async_iteration_ptr iterate_async(const path&, directory_options, const async_iterator_config&, async_entries_callback, async_completion_callback);
+inline async_iteration_ptr iterate_async(const path& p, async_entries_callback ecb, async_completion_callback ccb) {
+    return iterate_async(p, directory_options::none, async_iterator_config{}, std::move(ecb), std::move(ccb));
+}
+
+} // v1
+} // filesystem
+} // prosoft
+
+#endif // PS_CORE_FILESYSTEM_ASYNC_ITERATOR_HPP
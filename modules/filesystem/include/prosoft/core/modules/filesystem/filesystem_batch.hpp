@@ -0,0 +1,115 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef PS_CORE_FILESYSTEM_BATCH_HPP
+#define PS_CORE_FILESYSTEM_BATCH_HPP
+
+// Batch status/open for large entry sets (e.g. everything found by a recursive_directory_iterator).
+// On Linux the calls are submitted through io_uring when the kernel supports it. Otherwise, they are spread over a pool of threads.
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+struct batch_config {
+    // Fallback pool size. 0 == hardware concurrency
+    unsigned threads;
+    // remove_all: directory descriptors kept open (in addition to one per thread). 0 == default
+    unsigned max_open;
+    // Disables io_uring (for testing and comparison)
+    bool use_threads;
+
+    constexpr batch_config() noexcept
+        : threads()
+        , max_open()
+        , use_threads() {}
+    ~batch_config() = default;
+    PS_DEFAULT_COPY(batch_config);
+    PS_DEFAULT_MOVE(batch_config);
+};
+
+// Results and errors are in submission order and match what status()/symlink_status() returns for each path.
+// Paths and results are count sized arrays.
+void batch_status(const path* paths, std::size_t count, status_info, file_status* results, error_code* ecs, const batch_config& = batch_config{});
+void batch_symlink_status(const path* paths, std::size_t count, status_info, file_status* results, error_code* ecs, const batch_config& = batch_config{});
+
+inline std::vector<file_status> batch_status(const std::vector<path>& paths, status_info what, std::vector<error_code>& ecs) {
+    std::vector<file_status> results(paths.size());
+    ecs.resize(paths.size());
+    batch_status(paths.data(), paths.size(), what, results.data(), ecs.data());
+    return results;
+}
+
+inline std::vector<file_status> batch_symlink_status(const std::vector<path>& paths, status_info what, std::vector<error_code>& ecs) {
+    std::vector<file_status> results(paths.size());
+    ecs.resize(paths.size());
+    batch_symlink_status(paths.data(), paths.size(), what, results.data(), ecs.data());
+    return results;
+}
+
+#if !_WIN32
+// Returns native descriptors in submission order (-1 on error). The caller owns the descriptors.
+// O_CLOEXEC is always added to the native open flags. Created files use 0666 (less the umask).
+void batch_open(const path* paths, std::size_t count, int flags, int* fds, error_code* ecs, const batch_config& = batch_config{});
+
+inline std::vector<int> batch_open(const std::vector<path>& paths, int flags, std::vector<error_code>& ecs) {
+    std::vector<int> fds(paths.size(), -1);
+    ecs.resize(paths.size());
+    batch_open(paths.data(), paths.size(), flags, fds.data(), ecs.data());
+    return fds;
+}
+#endif
+
+// Removes a tree by spreading its directories over a pool of threads, see remove_all() for the result.
+// Windows: same as remove_all().
+std::uintmax_t remove_all(const path&, const batch_config&);
+std::uintmax_t remove_all(const path&, const batch_config&, error_code&);
+
+enum class metadata_options : unsigned {
+    none = 0,
+    perms = 0x1,
+    owner = 0x2, // changing the user requires privileges
+    times = 0x4, // access and modification
+    acl = 0x8,
+    all = perms|owner|times|acl,
+};
+PS_ENUM_BITMASK_OPS(metadata_options);
+
+// Applies the metadata of each entry in from to the entry with the same relative path in to (including the roots).
+// Both trees are walked in lockstep by a pool of threads. Entries missing from to or of another type are skipped, as is metadata that already matches.
+// Symlinks are not followed and mount points are not descended. Returns the number of entries changed, -1 on error.
+// Windows: not supported.
+std::uintmax_t clone_metadata(const path& from, const path& to, metadata_options, const batch_config& = batch_config{});
+std::uintmax_t clone_metadata(const path& from, const path& to, metadata_options, const batch_config&, error_code&);
+
+} // v1
+} // filesystem
+} // prosoft
+
+#endif // PS_CORE_FILESYSTEM_BATCH_HPP
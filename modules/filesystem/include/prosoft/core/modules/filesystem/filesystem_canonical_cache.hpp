@@ -0,0 +1,116 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef PS_CORE_FILESYSTEM_CANONICAL_CACHE_HPP
+#define PS_CORE_FILESYSTEM_CANONICAL_CACHE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "filesystem_path.hpp"
+#include "filesystem_primatives.hpp"
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+// Opt-in cache of canonical directory paths for long running processes.
+// A directory path (made absolute) is mapped to its canonical path along with the identity (device + inode) and ctime of the directory it resolved to.
+// A cached path is used as long as the path still leads to the same unchanged directory, so a retargeted symlink or a moved directory is resolved again.
+// XXX: a rename of one of the directory's ancestors is not detected.
+// Non-directories are resolved as their cached parent and their name (unless they're a symlink).
+// The cache is thread safe and may be shared by multiple iterators. It is not consulted on Windows.
+class canonical_cache {
+public:
+    using counter_type = std::uint64_t;
+
+    canonical_cache() = default;
+    ~canonical_cache() = default;
+    PS_DISABLE_COPY(canonical_cache);
+    PS_DISABLE_MOVE(canonical_cache);
+
+    // Same result as canonical().
+    path canonical(const path&);
+    path canonical(const path&, error_code&);
+
+    void clear();
+
+    size_t size() const;
+
+    counter_type hits() const noexcept {
+        return m_hits.load();
+    }
+
+    counter_type misses() const noexcept {
+        return m_misses.load();
+    }
+
+private:
+    struct stamp {
+        std::uint64_t dev;
+        std::uint64_t ino;
+        std::int64_t ctime; // ns since epoch
+    };
+
+    struct value_type {
+        stamp m_stamp;
+        path m_path;
+    };
+
+    path resolve(const path&, error_code&);
+    path resolve_dir(const path&, const stamp&, error_code&);
+
+    mutable std::mutex m_lock;
+    std::unordered_map<path::string_type, value_type> m_dirs;
+    std::atomic<counter_type> m_hits{0};
+    std::atomic<counter_type> m_misses{0};
+};
+
+using canonical_cache_ptr = std::shared_ptr<canonical_cache>;
+
+inline path canonical(const path& p, canonical_cache& c) {
+    return c.canonical(p);
+}
+
+inline path canonical(const path& p, canonical_cache& c, error_code& ec) {
+    return c.canonical(p, ec);
+}
+
+inline path weakly_canonical(const path& p, canonical_cache& c) {
+    return c.canonical(p);
+}
+
+inline path weakly_canonical(const path& p, canonical_cache& c, error_code& ec) {
+    return c.canonical(p, ec);
+}
+
+} // v1
+} // filesystem
+} // prosoft
+
+#endif // PS_CORE_FILESYSTEM_CANONICAL_CACHE_HPP
@@ -0,0 +1,72 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#ifndef PS_CORE_FILESYSTEM_CHANGE_HUB_HPP
+#define PS_CORE_FILESYSTEM_CHANGE_HUB_HPP
+
+#include "filesystem_change_monitor.hpp"
+
+#if PS_HAVE_FILESYSTEM_CHANGE_MONITOR
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+class change_hub_state;
+
+// Shares system monitors between registrations of the same or overlapping trees, so the system delivers each event once.
+// A registration is served by an existing monitor of its path (or of a containing tree if that monitor is recursive)
+// that has at least its events and no more than its latency. Otherwise a new monitor is created for the registration.
+// Events are dispatched through a prefix tree of the registered paths, and each registration's events, latency and
+// max_pending_events are applied before its callback. A monitor is stopped with its last registration.
+// Registrations are stopped with stop() as usual. Notification paths are canonical.
+// change_config::state and change_config::journal are not supported.
+class change_hub {
+public:
+    change_hub();
+    ~change_hub(); // stops all registrations
+    PS_DISABLE_COPY(change_hub);
+    PS_DISABLE_MOVE(change_hub);
+    
+    change_registration monitor(const path&, const change_config&, change_callback, error_code&);
+    change_registration monitor(const path&, const change_config&, change_callback);
+    
+#if PS_HAVE_RECURISIVE_FILESYSTEM_CHANGE_MONITOR
+    change_registration recursive_monitor(const path&, const change_config&, change_callback, error_code&);
+    change_registration recursive_monitor(const path&, const change_config&, change_callback);
+#endif
+    
+    // The number of system monitors in use.
+    std::size_t monitors() const;
+    
+private:
+    std::shared_ptr<change_hub_state> m_state;
+};
+
+} // v1
+} // filesystem
+} // prosoft
+
+#endif // PS_HAVE_FILESYSTEM_CHANGE_MONITOR
+#endif // PS_CORE_FILESYSTEM_CHANGE_HUB_HPP
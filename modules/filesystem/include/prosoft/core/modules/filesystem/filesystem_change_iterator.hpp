@@ -30,6 +30,7 @@
 #include <vector>
 
 #include "filesystem_have_change_monitor.hpp"
+#include "filesystem_path_filter.hpp"
 
 #define PS_HAVE_FILESYSTEM_CHANGE_ITERATOR PS_HAVE_RECURISIVE_FILESYSTEM_CHANGE_MONITOR
 #if PS_HAVE_FILESYSTEM_CHANGE_ITERATOR
@@ -40,6 +41,8 @@ inline namespace v1 {
 
 class change_registration; // forward
 class change_notification;
+struct change_counters;
+enum class change_monitor_backend : unsigned;
 
 struct change_iterator_config {
     // For notification of a change in the iterator (either new content or EOF).
@@ -50,22 +53,35 @@ struct change_iterator_config {
     using filter_type = const change_notification*(*)(const change_notification&);
     using filters_type = std::vector<filter_type>;
     filters_type filters;
+    // Applied before the above filters, a change is ignored if neither of its paths are included.
+    path_filter_ptr filter;
     // Passed on to FS monitor.
     using latency_type = std::chrono::milliseconds;
     latency_type latency;
     using serialize_type = std::string;
     serialize_type serialize_data;
+    // Passed on to FS monitor (see change_config::max_pending_events), which cancels the iterator if exceeded.
+    // The iterator is also canceled if more than this many paths are waiting to be consumed. 0 is unlimited.
+    std::size_t max_pending;
+    // Passed on to FS monitor, e.g. polling for a network filesystem. The default is the platform backend.
+    change_monitor_backend backend;
     
     static constexpr latency_type default_latency() { return latency_type{1000L}; }
     
     change_iterator_config(latency_type l = default_latency())
         : callback()
         , filters()
-        , latency(l) {}
+        , filter()
+        , latency(l)
+        , max_pending()
+        , backend() {}
     change_iterator_config(callback_type cb, filters_type f, latency_type l = default_latency())
         : callback(std::move(cb))
         , filters(std::move(f))
-        , latency(l) {}
+        , filter()
+        , latency(l)
+        , max_pending()
+        , backend() {}
     ~change_iterator_config() = default;
     PS_DEFAULT_COPY(change_iterator_config);
     PS_DEFAULT_MOVE(change_iterator_config);
@@ -88,8 +104,10 @@ struct change_iterator_traits {
     static bool canceled(const basic_iterator<change_iterator_traits>&);
     static bool equal_to(const basic_iterator<change_iterator_traits>&, const change_registration&);
     static std::vector<path> extract_paths(basic_iterator<change_iterator_traits>&);
+    static std::vector<path> extract_paths(basic_iterator<change_iterator_traits>&, size_t max);
     using serialize_type = typename change_iterator_config::serialize_type;
     static serialize_type serialize(const basic_iterator<change_iterator_traits>&);
+    static change_counters counters(const basic_iterator<change_iterator_traits>&);
 };
 
 iterator_state_ptr make_iterator_state(const path&, directory_options, change_iterator_traits::configuration_type&&, error_code&);
@@ -114,12 +132,21 @@ inline std::vector<path> extract_paths(ifilesystem::change_iterator_t& i) {
     return ifilesystem::change_iterator_traits::extract_paths(i);
 }
 
+// Ditto, but grabs at most max paths. The rest remain available to the iterator.
+inline std::vector<path> extract_paths(ifilesystem::change_iterator_t& i, size_t max) {
+    return ifilesystem::change_iterator_traits::extract_paths(i, max);
+}
+
 // XXX: this is very coarse, really only useful when an empty path is returned (IOW, the FS is idle)
 // For fine control (event level) you should use the change monitor API directly
 inline ifilesystem::change_iterator_traits::serialize_type serialize(const ifilesystem::change_iterator_t& i) {
     return ifilesystem::change_iterator_traits::serialize(i);
 }
 
+// Events lost to change_iterator_config::max_pending.
+// Collapsed events are counted by the monitor, dropped also includes paths discarded by the iterator.
+change_counters counters(const ifilesystem::change_iterator_t&);
+
 // for finding the iterator from a callback
 inline bool operator==(const ifilesystem::change_iterator_t& i, const change_registration& cr) {
     return ifilesystem::change_iterator_traits::equal_to(i, cr);
@@ -0,0 +1,121 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#ifndef PS_CORE_FILESYSTEM_CHANGE_JOURNAL_HPP
+#define PS_CORE_FILESYSTEM_CHANGE_JOURNAL_HPP
+
+// Persistent record of the notifications delivered by a change monitor, so a client can resume from a serialized state
+// after a restart (Linux's equivalent of FSEvents' event history).
+// When change_config::journal is set, every batch is appended before it is delivered and the monitor's state serializes
+// to a journal position. Thawing that state (with the same journal) replays the events recorded after the position.
+// Changes made while no monitor was recording are NOT in the journal. A tree_manifest diff can be used to cover that gap.
+
+#include <cstdint>
+#include <mutex>
+
+#include "filesystem_change_monitor.hpp"
+
+#define PS_HAVE_FILESYSTEM_CHANGE_JOURNAL (PS_HAVE_FILESYSTEM_CHANGE_MONITOR && __linux__)
+#if PS_HAVE_FILESYSTEM_CHANGE_JOURNAL
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+// The journal file is append-only and memory mapped. Records are written in native byte order.
+// Recorded events are synced to disk at periodic checkpoints, events after the last checkpoint may be lost in a crash.
+// Once the records exceed the size limit, the oldest checkpointed records are discarded so the newest half remains.
+// A journal can only be open in one process at a time and only record the events of one monitor at a time,
+// a monitor can't be started with a journal that's in use by another (einval). It is thread safe.
+class change_journal {
+public:
+    using id_type = std::uint64_t;
+    using position_type = std::uint64_t;
+    
+    static constexpr std::uint64_t default_max_size = 64 * 1024 * 1024;
+    
+    explicit change_journal(const path&, std::uint64_t max_size = default_max_size); // 0 is unlimited
+    change_journal(const path&, error_code&); // opens an existing journal or creates a new one
+    change_journal(const path&, std::uint64_t max_size, error_code&);
+    ~change_journal();
+    PS_DISABLE_COPY(change_journal);
+    PS_DISABLE_MOVE(change_journal);
+    
+    explicit operator bool() const noexcept {
+        return m_map != nullptr;
+    }
+    
+    // Unique for each journal (and reset).
+    id_type id() const noexcept;
+    
+    change_event_id last_event_id() const noexcept;
+    
+    // The end of the recorded events. Passed to replay() to skip the records before it.
+    position_type position() const noexcept;
+    
+    // Event ids must be greater than last_event_id().
+    void append(const change_notifications&, error_code&);
+    
+    // Forces recorded events to disk. This is also done periodically by append().
+    void checkpoint();
+    void checkpoint(error_code&);
+    
+    // Appends the events recorded after the given event id (registration ids are not recorded).
+    // Fails with einval if some of those events were discarded to keep the journal within its size limit.
+    void replay(change_event_id, change_notifications&, error_code&) const;
+    // Ditto, but starts at a position() taken when the event id was the last event.
+    void replay(change_event_id, position_type, change_notifications&, error_code&) const;
+    
+    // Discards all events. The journal gets a new id, so states serialized before the reset can no longer be thawed.
+    void reset();
+    void reset(error_code&);
+    
+    // Used by change monitors, as each monitor numbers its own events. Returns false if another monitor is recording.
+    bool attach() noexcept;
+    void detach() noexcept;
+    
+private:
+    void open(error_code&);
+    void close() noexcept;
+    bool reserve(size_t, error_code&);
+    void recover();
+    void sync(error_code&);
+    void compact(error_code&);
+    
+    path m_path;
+    mutable std::mutex m_lock;
+    char* m_map = nullptr;
+    size_t m_size = 0;
+    std::uint64_t m_maxsize;
+    std::int64_t m_lastsync = 0; // steady clock ns
+    int m_fd = -1;
+    bool m_attached = false;
+};
+
+} // v1
+} // filesystem
+} // prosoft
+
+#endif // PS_HAVE_FILESYSTEM_CHANGE_JOURNAL
+#endif // PS_CORE_FILESYSTEM_CHANGE_JOURNAL_HPP
@@ -35,7 +35,6 @@
 // https://github.com/bdkjones/fseventsbug/wiki/realpath()-And-FSEvents
 
 #include "filesystem_have_change_monitor.hpp"
-#if PS_HAVE_FILESYSTEM_CHANGE_MONITOR
 
 #include <chrono>
 #include <cstdint>
@@ -72,6 +71,7 @@ enum class change_event : unsigned {
     // A full rescan of the tree is suggested.
     // This may be set in conjuction with canceled due to an error (in which case the rescan is required),
     // or it may be a standalone event that contains a path in the tree that has been hidden or exposed due to a volume mount/unmount.
+    // A standalone event is also used for a directory whose events were collapsed due to change_config::max_pending_events.
     rescan = 1<<29,
     
     // Special flag indicating the event (created or removed) was a side effect of change made outside of the watched tree.
@@ -194,6 +194,9 @@ inline bool canceled(const change_notification& n) noexcept {
 using change_notifications = std::deque<change_notification>;
 using change_callback = std::function<void (change_notifications&&)>;
 
+// The notification types above are also used by non-monitor change sources (e.g. tree manifests).
+#if PS_HAVE_FILESYSTEM_CHANGE_MONITOR
+
 // System specific state.
 struct change_token;
 
@@ -204,6 +207,12 @@ enum change_thaw_options : unsigned {
 };
 PS_ENUM_BITMASK_OPS(change_thaw_options);
 
+// Events lost to change_config::max_pending_events.
+struct change_counters {
+    std::uint64_t collapsed; // events merged into a rescan of their parent directory
+    std::uint64_t dropped; // events (including directory rescans) merged into a rescan of the monitored path
+};
+
 struct change_state {
     virtual ~change_state() = default;
     PS_DISABLE_COPY(change_state);
@@ -213,6 +222,10 @@ struct change_state {
         return 0;
     }
     
+    virtual change_counters counters() const {
+        return change_counters{};
+    }
+    
     // Serialization may throw!
     PS_WARN_UNUSED_RESULT
     virtual std::string serialize() const {
@@ -294,6 +307,13 @@ public:
         }
         return "";
     }
+    
+    change_counters counters() const {
+        if (auto p = m_state.lock()) {
+            return p->counters();
+        }
+        return change_counters{};
+    }
 };
 
 inline bool operator==(const change_registration& lhs, const change_notification& rhs) {
@@ -304,17 +324,47 @@ inline bool operator==(const change_notification& lhs, const change_registration
     return operator==(rhs, lhs);
 }
 
+enum class change_monitor_backend : unsigned {
+    platform, // the system default (FSEvents, inotify)
+    // Linux: a recursive monitor uses a single fanotify mark for the whole filesystem instead of an inotify watch per directory.
+    // This requires CAP_SYS_ADMIN (and Linux 5.17), otherwise the system default is used.
+    filesystem,
+    // Polls a stat index of the tree, for filesystems without change notifications (e.g. NFS, SMB, FUSE).
+    // Unchanged directories are not re-read and idle directories are polled less often.
+    // The notification latency is the shortest poll interval.
+    // All polling monitors are polled by a single thread, so one that blocks (e.g. a hung NFS server) delays every other.
+    polling,
+};
+
+class change_journal; // see filesystem_change_journal.hpp
+
 struct change_config {
     using latency_type = std::chrono::milliseconds;
     change_state* state;
+    // Linux: records delivered events so the monitor state can be serialized and later replayed. Must outlive the monitor
+    // and can only be used by one monitor at a time.
+    change_journal* journal;
     latency_type notification_latency; // how often to post notifications, a larger # allows notifications to be coalesced into fewer callbacks
     change_event events;
+    change_monitor_backend backend;
+    // Once this many events are pending delivery, they are collapsed into a rescan of each parent directory.
+    // If there are still too many, a single rescan of the monitored path is delivered instead. 0 is unlimited.
+    std::size_t max_pending_events;
+    // Folds the events for a path within the latency period in the order they occurred.
+    // e.g. a file created and then removed is not reported and repeated modifications are a single event.
+    // Otherwise events for a path may still be merged, but with the flags of every event set.
+    // The polling backend only reports the difference between polls, so its events are always folded.
+    bool coalesce_events;
     unsigned reserved_flags;
     
     constexpr change_config() noexcept
         : state()
+        , journal()
         , notification_latency(1000)
         , events(change_event::all)
+        , backend(change_monitor_backend::platform)
+        , max_pending_events()
+        , coalesce_events()
         , reserved_flags() {}
     ~change_config() = default;
     PS_DEFAULT_COPY(change_config);
@@ -369,9 +419,10 @@ public:
     }
 };
 
+#endif // PS_HAVE_FILESYSTEM_CHANGE_MONITOR
+
 } // v1
 } // filesystem
 } // prosoft
 
-#endif // PS_HAVE_FILESYSTEM_CHANGE_MONITOR
 #endif // PS_CORE_FILESYSTEM_CHANGE_MONITOR_HPP
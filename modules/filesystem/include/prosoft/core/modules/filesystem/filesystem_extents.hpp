@@ -0,0 +1,77 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef PS_CORE_FILESYSTEM_EXTENTS_HPP
+#define PS_CORE_FILESYSTEM_EXTENTS_HPP
+
+// Sparse file support. Holes read as zeros, so readers and copiers only need to visit the data extents.
+
+#include <vector>
+
+#include "filesystem_path.hpp"
+#include "filesystem_primatives.hpp"
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+struct file_extent {
+    file_size_type offset;
+    file_size_type length;
+};
+
+using file_extents_type = std::vector<file_extent>;
+
+// The data extents of a file in offset order. Holes are omitted, therefore a file with no data (or a 0 size) has no extents.
+// Linux: SEEK_DATA/SEEK_HOLE, falling back to FIEMAP.
+// The whole file is a single extent when holes can't be found (e.g. Windows, or a filesystem without sparse support).
+file_extents_type file_extents(const path&);
+file_extents_type file_extents(const path&, error_code&);
+
+// Allocates storage for size bytes so later writes won't fail for lack of space, and extends the file to size if it's smaller.
+// The file is created if it doesn't exist. A larger file is not truncated.
+// Linux: fallocate, or posix_fallocate if the filesystem doesn't support it.
+void allocate(const path&, file_size_type size);
+void allocate(const path&, file_size_type size, error_code&);
+
+#if !_WIN32
+// Descriptor variants. The file offset is not changed.
+file_extents_type file_extents(int fd, error_code&);
+void allocate(int fd, file_size_type size, error_code&);
+#endif
+
+inline file_size_type data_size(const file_extents_type& extents) noexcept {
+    file_size_type sz = 0;
+    for (const auto& e : extents) {
+        sz += e.length;
+    }
+    return sz;
+}
+
+} // v1
+} // filesystem
+} // prosoft
+
+#endif // PS_CORE_FILESYSTEM_EXTENTS_HPP
@@ -33,6 +33,10 @@
 #include <type_traits>
 
 #include "filesystem_primatives.hpp"
+#include "filesystem_canonical_cache.hpp"
+#include "filesystem_listing_cache.hpp"
+#include "filesystem_path_filter.hpp"
+#include "filesystem_xattr.hpp"
 
 namespace prosoft {
 namespace filesystem {
@@ -61,14 +65,16 @@ public:
         : m_path()
         , m_type(file_type::none)
         , m_size(unknown_size)
-        , m_last_write(PS_FS_ENTRY_INVALID_TIME_VALUE) {
+        , m_last_write(PS_FS_ENTRY_INVALID_TIME_VALUE)
+        , m_xattrs() {
     }
     
     explicit directory_entry(const path_type& p)
         : m_path(p)
         , m_type(file_type::none)
         , m_size(unknown_size)
-        , m_last_write(PS_FS_ENTRY_INVALID_TIME_VALUE) {
+        , m_last_write(PS_FS_ENTRY_INVALID_TIME_VALUE)
+        , m_xattrs() {
     }
     
     ~directory_entry() = default;
@@ -77,14 +83,16 @@ public:
         : m_path(other.m_path)
         , m_type(other.m_type.load())
         , m_size(other.m_size.load())
-        , m_last_write(other.m_last_write.load()) {
+        , m_last_write(other.m_last_write.load())
+        , m_xattrs(other.m_xattrs) {
     }
     
     directory_entry(directory_entry&& other) noexcept(std::is_nothrow_move_constructible<path_type>::value)
         : m_path(std::move(other.m_path))
         , m_type(other.m_type.load())
         , m_size(other.m_size.load())
-        , m_last_write(other.m_last_write.load()) {
+        , m_last_write(other.m_last_write.load())
+        , m_xattrs(std::move(other.m_xattrs)) {
     }
     
     directory_entry& operator=(const directory_entry& other) {
@@ -92,6 +100,7 @@ public:
         m_type = other.m_type.load();
         m_size = other.m_size.load();
         m_last_write = other.m_last_write.load();
+        m_xattrs = other.m_xattrs;
         return *this;
     }
     
@@ -100,6 +109,7 @@ public:
         m_type = other.m_type.load();
         m_size = other.m_size.load();
         m_last_write = other.m_last_write.load();
+        m_xattrs = std::move(other.m_xattrs);
         return *this;
     }
     
@@ -108,7 +118,8 @@ public:
         : m_path(std::move(p))
         , m_type(file_type::none)
         , m_size(unknown_size)
-        , m_last_write(PS_FS_ENTRY_INVALID_TIME_VALUE) {
+        , m_last_write(PS_FS_ENTRY_INVALID_TIME_VALUE)
+        , m_xattrs() {
     }
     
     void assign(path_type&& p) {
@@ -119,12 +130,19 @@ public:
     
     void assign(path_type&& p, error_code& ec) {
         m_path = std::move(p);
+        m_xattrs.reset();
         refresh(ec);
     }
     
     bool empty() const noexcept(noexcept(std::declval<path_type>().empty())) {
         return m_path.empty();
     }
+    
+    // Extended attributes read during iteration with directory_options::include_xattrs, null otherwise.
+    // The set is not updated by refresh().
+    const xattr_set_ptr& xattrs() const noexcept {
+        return m_xattrs;
+    }
     // Extensions //
 
     void assign(const path_type& p) {
@@ -135,6 +153,7 @@ public:
     
     void assign(const path_type& p, error_code& ec) {
         m_path = p;
+        m_xattrs.reset();
         refresh(ec);
     }
 
@@ -146,6 +165,7 @@ public:
     
     void replace_filename(const path_type& p, error_code& ec) {
         m_path.replace_filename(p);
+        m_xattrs.reset();
         refresh(ec);
     }
 
@@ -159,6 +179,7 @@ public:
     
     PS_WARN_UNUSED_RESULT path_type path() && noexcept(std::is_nothrow_move_constructible<path_type>::value) {
         clear_cache();
+        m_xattrs.reset();
         return path_type{std::move(m_path)};
     }
 
@@ -209,7 +230,8 @@ public:
         : m_path()
         , m_type(ft)
         , m_size(fsz)
-        , m_last_write(ftime.count()) {
+        , m_last_write(ftime.count())
+        , m_xattrs() {
     }
     void assign_no_refresh(const path_type& p) {
         m_path = p;
@@ -222,6 +244,7 @@ private:
     std::atomic<file_type> mutable m_type;
     std::atomic<file_size_type> mutable m_size;
     std::atomic<file_time_type::duration::rep> mutable m_last_write;
+    xattr_set_ptr m_xattrs;
 
     template <typename T>
     T load(std::atomic<T>& aval, T badVal) const {
@@ -294,6 +317,8 @@ enum class directory_options : unsigned {
     // However, unlike NSDE, we only skip "._" files that have a sibling of the same name. Orphan "._" files are always returned.
     // If for some reason you want paired "._" files too, set this. Normally it should not be set as the system automatically handles pairs.
     include_apple_double_files = 1U<<25, // macOS
+    // Read each entry's extended attributes (see directory_entry::xattrs()). Errors are ignored. Not supported by async_iterator.
+    include_xattrs = 1U<<26,
 
     // Internal state
     reserved_state_will_recurse = 1U<<29,
@@ -316,12 +341,14 @@ struct cache_info {
     file_size_type fsize;
     file_time_type fwrite_time;
 #endif
+    xattr_set_ptr xattrs;
     cache_info()
         : ftype(file_type::none)
 #if _WIN32
         , fsize(directory_entry::unknown_size)
         , fwrite_time(times::make_invalid())
 #endif
+        , xattrs()
     {
     }
 };
@@ -376,6 +403,7 @@ public:
             m_current.m_last_write = cinfo.fwrite_time.time_since_epoch().count();
         }
 #endif
+        m_current.m_xattrs = std::move(cinfo.xattrs);
     }
     
     PS_WARN_UNUSED_RESULT directory_entry extract() noexcept(std::is_nothrow_move_constructible<directory_entry>::value) {
@@ -397,7 +425,15 @@ public:
 
 using iterator_state_ptr = std::shared_ptr<ifilesystem::iterator_state>;
 
-struct iterator_config {};
+struct iterator_config {
+    // Optional cross-scan listing cache (not supported on Windows).
+    directory_listing_cache_ptr listing_cache;
+    // Optional filter, excluded entries are not returned and excluded directories are not descended into.
+    // A directory that only contains included entries (filter_match::ancestor) is descended into but not returned.
+    path_filter_ptr filter;
+    // Optional cache for resolving followed directory symlinks (directory_options::follow_directory_symlink).
+    canonical_cache_ptr canonical_cache;
+};
 
 struct iterator_traits {
     static constexpr directory_options required = directory_options::skip_subdirectory_descendants;
@@ -0,0 +1,138 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef PS_CORE_FILESYSTEM_LISTING_CACHE_HPP
+#define PS_CORE_FILESYSTEM_LISTING_CACHE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "filesystem_path.hpp"
+#include "filesystem_primatives.hpp"
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+// Cross-scan cache of raw directory listings.
+// When a directory's identity (device + inode) and its ctime/mtime are unchanged since it was recorded,
+// an iterator configured with the cache replays the recorded entries instead of reading the directory.
+// Directories changed within the last couple of seconds are never recorded as the timestamps may not yet reflect a pending change.
+// The cache is thread safe and may be shared by multiple iterators. It is not consulted on Windows.
+class directory_listing_cache {
+public:
+    struct stamp {
+        std::uint64_t dev;
+        std::uint64_t ino;
+        std::int64_t ctime; // ns since epoch
+        std::int64_t mtime; // ns since epoch
+    };
+
+    struct entry {
+        native_string_type name; // raw name bytes, not validated
+        file_type type; // type as reported by the directory read, may be unknown
+    };
+
+    using listing = std::vector<entry>;
+    using listing_ptr = std::shared_ptr<const listing>;
+    using counter_type = std::uint64_t;
+
+    directory_listing_cache() = default;
+    // Convenience to load a persisted cache. A missing or invalid store results in an empty cache.
+    explicit directory_listing_cache(const path&);
+    ~directory_listing_cache() = default;
+    PS_DISABLE_COPY(directory_listing_cache);
+    PS_DISABLE_MOVE(directory_listing_cache);
+
+    // Replaces the current contents with a store previously written by save().
+    void load(const path&);
+    void load(const path&, error_code&);
+
+    // The store is written to a temporary file and then renamed over the destination.
+    void save(const path&) const;
+    void save(const path&, error_code&) const;
+
+    // Returns null if the stamp does not match the cached directory.
+    listing_ptr find(const stamp&) const;
+    void insert(const stamp&, listing&&);
+
+    void erase(const stamp&);
+    void clear();
+
+    size_t size() const;
+
+    counter_type hits() const noexcept {
+        return m_hits.load();
+    }
+
+    counter_type misses() const noexcept {
+        return m_misses.load();
+    }
+
+private:
+    struct key_hash {
+        size_t operator()(const stamp& s) const noexcept {
+            return std::hash<std::uint64_t>{}(s.ino ^ (s.dev << 1));
+        }
+    };
+
+    struct key_equal {
+        bool operator()(const stamp& a, const stamp& b) const noexcept {
+            return a.dev == b.dev && a.ino == b.ino;
+        }
+    };
+
+    struct value_type {
+        stamp m_stamp;
+        listing_ptr m_listing;
+    };
+
+    using map_type = std::unordered_map<stamp, value_type, key_hash, key_equal>;
+
+    mutable std::mutex m_lock;
+    map_type m_listings;
+    mutable std::atomic<counter_type> m_hits{0};
+    mutable std::atomic<counter_type> m_misses{0};
+};
+
+using directory_listing_cache_ptr = std::shared_ptr<directory_listing_cache>;
+
+inline bool operator==(const directory_listing_cache::stamp& lhs, const directory_listing_cache::stamp& rhs) noexcept {
+    return lhs.dev == rhs.dev && lhs.ino == rhs.ino && lhs.ctime == rhs.ctime && lhs.mtime == rhs.mtime;
+}
+
+inline bool operator!=(const directory_listing_cache::stamp& lhs, const directory_listing_cache::stamp& rhs) noexcept {
+    return !operator==(lhs, rhs);
+}
+
+} // v1
+} // filesystem
+} // prosoft
+
+#endif // PS_CORE_FILESYSTEM_LISTING_CACHE_HPP
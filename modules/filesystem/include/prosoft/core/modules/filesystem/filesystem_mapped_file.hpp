@@ -0,0 +1,219 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef PS_CORE_FILESYSTEM_MAPPED_FILE_HPP
+#define PS_CORE_FILESYSTEM_MAPPED_FILE_HPP
+
+// Memory mapped file I/O.
+// A mapped_file is the open file and each mapped_region is a view (window) of it.
+// Regions remain valid after the file is closed.
+
+#include <cstddef>
+#include <utility>
+
+#include "filesystem_path.hpp"
+#include "filesystem_primatives.hpp"
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+enum class map_mode {
+    read_only,
+    copy_on_write, // writes are private to the region and never reach the file
+};
+
+// Hints are best effort, unsupported hints are ignored.
+enum class map_advice : unsigned {
+    none = 0x0,
+    sequential = 0x1,
+    random = 0x2,
+    will_need = 0x4, // start reading the region in
+    large_pages = 0x8, // Linux: transparent huge pages
+};
+PS_ENUM_BITMASK_OPS(map_advice);
+
+class mapped_file;
+
+class mapped_region {
+public:
+    mapped_region() noexcept
+        : m_base()
+        , m_map_size()
+        , m_data()
+        , m_size()
+        , m_offset() {
+    }
+    
+    ~mapped_region() {
+        unmap();
+    }
+    
+    PS_DISABLE_COPY(mapped_region);
+    
+    mapped_region(mapped_region&& other) noexcept
+        : mapped_region() {
+        swap(other);
+    }
+    
+    mapped_region& operator=(mapped_region&& other) noexcept {
+        mapped_region tmp{std::move(other)};
+        swap(tmp);
+        return *this;
+    }
+    
+    void swap(mapped_region& other) noexcept {
+        std::swap(m_base, other.m_base);
+        std::swap(m_map_size, other.m_map_size);
+        std::swap(m_data, other.m_data);
+        std::swap(m_size, other.m_size);
+        std::swap(m_offset, other.m_offset);
+    }
+    
+    // Only copy_on_write regions may be written to.
+    char* data() noexcept {
+        return m_data;
+    }
+    
+    const char* data() const noexcept {
+        return m_data;
+    }
+    
+    std::size_t size() const noexcept {
+        return m_size;
+    }
+    
+    bool empty() const noexcept {
+        return 0 == m_size;
+    }
+    
+    // The file offset of data().
+    file_size_type offset() const noexcept {
+        return m_offset;
+    }
+    
+    const char* begin() const noexcept {
+        return m_data;
+    }
+    
+    const char* end() const noexcept {
+        return m_data + m_size;
+    }
+    
+    void advise(map_advice);
+    void advise(map_advice, error_code&);
+    
+    void unmap() noexcept;
+    
+private:
+    friend class mapped_file;
+    void* m_base; // page aligned
+    std::size_t m_map_size;
+    char* m_data;
+    std::size_t m_size;
+    file_size_type m_offset;
+};
+
+class mapped_file {
+public:
+    mapped_file() noexcept
+        : m_file(invalid_file)
+        , m_size()
+        , m_mode(map_mode::read_only) {
+    }
+    
+    explicit mapped_file(const path&, map_mode = map_mode::read_only);
+    mapped_file(const path&, map_mode, error_code&);
+    
+    ~mapped_file() {
+        close();
+    }
+    
+    PS_DISABLE_COPY(mapped_file);
+    
+    mapped_file(mapped_file&& other) noexcept
+        : mapped_file() {
+        swap(other);
+    }
+    
+    mapped_file& operator=(mapped_file&& other) noexcept {
+        mapped_file tmp{std::move(other)};
+        swap(tmp);
+        return *this;
+    }
+    
+    void swap(mapped_file& other) noexcept {
+        std::swap(m_file, other.m_file);
+        std::swap(m_size, other.m_size);
+        std::swap(m_mode, other.m_mode);
+    }
+    
+    void open(const path&, map_mode);
+    void open(const path&, map_mode, error_code&);
+    void close() noexcept;
+    
+    bool is_open() const noexcept {
+        return invalid_file != m_file;
+    }
+    
+    // The size when opened.
+    file_size_type size() const noexcept {
+        return m_size;
+    }
+    
+    map_mode mode() const noexcept {
+        return m_mode;
+    }
+    
+    // Maps size bytes from offset, which doesn't need to be aligned. The size is clipped to the end of the file and 0 maps to the end.
+    // A file larger than the address space must be mapped in windows.
+    mapped_region map(file_size_type offset = 0, std::size_t size = 0, map_advice = map_advice::none) const;
+    mapped_region map(file_size_type offset, std::size_t size, map_advice, error_code&) const;
+    
+    // Moves a region to a new window, the old window is unmapped first so only one is mapped at a time.
+    void remap(mapped_region&, file_size_type offset, std::size_t size, map_advice = map_advice::none) const;
+    void remap(mapped_region&, file_size_type offset, std::size_t size, map_advice, error_code&) const;
+    
+    // The alignment of a mapping's file offset (page size, or the allocation granularity on Windows).
+    static std::size_t granularity() noexcept;
+    
+private:
+#if !_WIN32
+    using native_handle_type = int;
+    static constexpr native_handle_type invalid_file = -1;
+#else
+    using native_handle_type = void*; // HANDLE
+    static constexpr native_handle_type invalid_file = nullptr;
+#endif
+    native_handle_type m_file;
+    file_size_type m_size;
+    map_mode m_mode;
+};
+
+} // v1
+} // filesystem
+} // prosoft
+
+#endif // PS_CORE_FILESYSTEM_MAPPED_FILE_HPP
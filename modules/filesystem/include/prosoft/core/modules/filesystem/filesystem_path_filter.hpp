@@ -0,0 +1,114 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#ifndef PS_CORE_FILESYSTEM_PATH_FILTER_HPP
+#define PS_CORE_FILESYSTEM_PATH_FILTER_HPP
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "filesystem_path.hpp"
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+enum class filter_match : unsigned char {
+    excluded,
+    included,
+    ancestor, // excluded, but something it contains may be included
+};
+
+// Include/exclude rules compiled into a prefix tree of path components, so a path is matched in one pass over its components.
+// A rule with a separator is anchored: a path prefix, optionally ending with a glob ('*' and '?') for the name of anything within it.
+// A rule without a separator is a name or glob matched against every component.
+//   "/a/b"        /a/b and everything within it
+//   "/a/b/*.tmp"  anything within /a/b named *.tmp (and everything within that)
+//   "*.tmp"       anything named *.tmp
+// The deepest matching rule decides, and at the same depth an exclusion wins.
+// A path that no rule matches is included unless there are include rules.
+class path_filter {
+public:
+    using char_type = path::encoding_value_type;
+    using string_type = std::basic_string<char_type>;
+    
+    path_filter();
+    ~path_filter() = default;
+    PS_DEFAULT_COPY(path_filter);
+    PS_DEFAULT_MOVE(path_filter);
+    
+    // Throws std::invalid_argument if the rule is empty or has a glob before its last component.
+    void include(const path&);
+    void exclude(const path&);
+    
+    bool empty() const noexcept {
+        return m_rules == 0;
+    }
+    
+    filter_match match(const path&) const;
+    
+    bool operator()(const path& p) const {
+        return match(p) == filter_match::included;
+    }
+    
+private:
+    enum class rule : unsigned char {
+        none,
+        include,
+        exclude,
+    };
+    
+    struct node {
+        std::unordered_map<string_type, std::size_t> m_children; // component -> node index
+        // Name rules apply to every component below the node.
+        std::unordered_map<string_type, rule> m_names;
+        std::unordered_map<string_type, rule> m_extensions; // "*.ext" globs, by ".ext"
+        std::vector<std::pair<string_type, rule>> m_globs;
+        rule m_prefix = rule::none;
+        bool m_include_names = false;
+        bool m_includes_below = false; // an include rule for this node or a descendant
+        
+        bool has_names() const noexcept {
+            return !m_names.empty() || !m_extensions.empty() || !m_globs.empty();
+        }
+        
+        rule match_name(const string_type&) const;
+    };
+    
+    void add(const path&, rule);
+    
+    std::vector<node> m_nodes; // [0] is the root
+    std::size_t m_rules;
+    std::size_t m_includes;
+};
+
+using path_filter_ptr = std::shared_ptr<const path_filter>;
+
+} // v1
+} // filesystem
+} // prosoft
+
+#endif // PS_CORE_FILESYSTEM_PATH_FILTER_HPP
@@ -0,0 +1,147 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef PS_CORE_FILESYSTEM_TREE_HASHER_HPP
+#define PS_CORE_FILESYSTEM_TREE_HASHER_HPP
+
+// Content digests and duplicate detection for the regular files of a tree.
+// Files are narrowed in stages so most are never read in full:
+//  1. files are grouped by size, a file with a unique size has no duplicate
+//  2. files of the same size are grouped by a digest of their first and last 4KB
+//  3. only files that still match are hashed in full
+// Each stage is spread over a pool of threads.
+// Digests are XXH64 (seed 0) and are kept between scans (and may be saved) so an unchanged file is not read again.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "filesystem_path.hpp"
+#include "filesystem_primatives.hpp"
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+struct tree_hasher_config {
+    // 0 == hardware concurrency
+    unsigned threads;
+    // Smaller files are ignored. 0 includes empty files, which are all duplicates of each other.
+    file_size_type min_size;
+    // The read size of full digests. 0 == default (1MB)
+    std::size_t buffer_size;
+    // Map files instead of reading them. This saves a copy for large files, but a file truncated while mapped raises SIGBUS.
+    bool map_files;
+
+    constexpr tree_hasher_config() noexcept
+        : threads()
+        , min_size(1)
+        , buffer_size()
+        , map_files() {}
+    ~tree_hasher_config() = default;
+    PS_DEFAULT_COPY(tree_hasher_config);
+    PS_DEFAULT_MOVE(tree_hasher_config);
+};
+
+class tree_hasher {
+public:
+    using size_type = std::size_t;
+    using digest_type = std::uint64_t;
+    using group_type = std::vector<size_type>; // indexes into files()
+
+    static constexpr std::size_t edge_size = 4096;
+
+    struct file_info {
+        path file;
+        file_size_type size;
+        std::int64_t mtime; // ns since epoch
+        std::uint64_t device;
+        std::uint64_t inode;
+        digest_type edge_digest; // first and last edge_size bytes, or the whole file if smaller than 2 edges
+        digest_type digest;
+        bool has_edge_digest;
+        bool has_digest;
+    };
+
+    tree_hasher() = default;
+    ~tree_hasher() = default;
+    PS_DEFAULT_COPY(tree_hasher);
+    PS_DEFAULT_MOVE(tree_hasher);
+
+    // Replaces the files with those found under root. Symlinks are not followed.
+    // Hard links are read once and share the digests of the first path found. Holes in sparse files are not read.
+    // Digests from the previous scan (or load) are reused when the path, size, mtime, device and inode are unchanged.
+    // Files that can't be read (e.g. permission denied or removed during the scan) are listed without digests.
+    // Not supported on Windows.
+    void scan(const path& root, const tree_hasher_config& = tree_hasher_config{});
+    void scan(const path& root, const tree_hasher_config&, error_code&);
+
+    static tree_hasher load(const path&);
+    static tree_hasher load(const path&, error_code&);
+
+    // The store is written to a temporary file and then renamed over the destination.
+    void save(const path&) const;
+    void save(const path&, error_code&) const;
+
+    const path& root() const noexcept {
+        return m_root;
+    }
+
+    const std::vector<file_info>& files() const noexcept {
+        return m_files;
+    }
+
+    // Groups of two or more files with the same size and digest, largest files first.
+    // Each file is listed once, by the first of its hard links.
+    // Digests are not cryptographic, compare the content before acting on a match if a (very unlikely) collision matters.
+    const std::vector<group_type>& duplicates() const noexcept {
+        return m_duplicates;
+    }
+
+    // The digests reused by the last scan.
+    size_type reused() const noexcept {
+        return m_reused;
+    }
+
+    static digest_type hash(const void*, std::size_t, digest_type seed = 0) noexcept;
+
+    // Not supported on Windows.
+    static digest_type hash(const path&);
+    static digest_type hash(const path&, error_code&);
+
+private:
+    void group();
+
+    path m_root;
+    std::vector<file_info> m_files;
+    std::vector<group_type> m_duplicates;
+    size_type m_reused = 0;
+};
+
+} // v1
+} // filesystem
+} // prosoft
+
+#endif // PS_CORE_FILESYSTEM_TREE_HASHER_HPP
@@ -0,0 +1,168 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef PS_CORE_FILESYSTEM_TREE_MANIFEST_HPP
+#define PS_CORE_FILESYSTEM_TREE_MANIFEST_HPP
+
+// Portable "what changed since the last scan" support.
+// A manifest records the state of every entry in a tree at the time of capture.
+// Comparing two manifests of the same tree produces the change notifications a change monitor would have (mostly) delivered.
+// This works on any filesystem (including network mounts) at the cost of a full enumeration per capture.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "filesystem_change_monitor.hpp"
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+// Entries are stored in columns (one vector per field) sorted by relative path hash.
+// Symlinks are recorded, not followed. The root itself is not recorded.
+class tree_manifest {
+public:
+    using size_type = std::size_t;
+    using hash_type = std::uint64_t;
+
+    tree_manifest() = default;
+    ~tree_manifest() = default;
+    PS_DEFAULT_COPY(tree_manifest);
+    PS_DEFAULT_MOVE(tree_manifest);
+
+    // Not supported on Windows.
+    static tree_manifest capture(const path& root);
+    static tree_manifest capture(const path& root, error_code&);
+
+    static tree_manifest load(const path&);
+    static tree_manifest load(const path&, error_code&);
+
+    // The store is written to a temporary file and then renamed over the destination.
+    void save(const path&) const;
+    void save(const path&, error_code&) const;
+
+    const path& root() const noexcept {
+        return m_root;
+    }
+
+    size_type size() const noexcept {
+        return m_hashes.size();
+    }
+
+    bool empty() const noexcept {
+        return m_hashes.empty();
+    }
+
+    // Column access
+
+    hash_type path_hash(size_type i) const {
+        return m_hashes[i];
+    }
+
+    std::uint64_t device(size_type i) const {
+        return m_devs[i];
+    }
+
+    std::uint64_t inode(size_type i) const {
+        return m_inodes[i];
+    }
+
+    file_size_type file_size(size_type i) const {
+        return m_sizes[i];
+    }
+
+    std::int64_t mtime(size_type i) const { // ns since epoch
+        return m_mtimes[i];
+    }
+
+    std::uint32_t mode(size_type i) const { // native mode bits
+        return m_modes[i];
+    }
+
+    file_type type(size_type i) const;
+
+    path relative_path(size_type i) const;
+
+    // Returns size() if not found.
+    size_type find(const path& relative) const;
+
+    static hash_type hash(const char*, size_t) noexcept;
+
+private:
+    friend class manifest_differ;
+
+    const char* name(size_type i) const noexcept {
+        return m_names.data() + m_name_offsets[i];
+    }
+
+    size_t name_size(size_type i) const noexcept {
+        return static_cast<size_t>(m_name_offsets[i + 1] - m_name_offsets[i]);
+    }
+
+    path m_root;
+    std::vector<hash_type> m_hashes;
+    std::vector<std::uint64_t> m_devs;
+    std::vector<std::uint64_t> m_inodes;
+    std::vector<std::uint64_t> m_sizes;
+    std::vector<std::int64_t> m_mtimes;
+    std::vector<std::uint32_t> m_modes;
+    std::vector<std::uint64_t> m_name_offsets; // size() + 1 offsets into m_names
+    std::string m_names; // relative path bytes
+};
+
+struct manifest_diff_config {
+    // Max notifications per callback. Bounds the notification memory held at any one time.
+    std::size_t batch_size;
+    // 0 == hardware concurrency
+    unsigned threads;
+
+    constexpr manifest_diff_config() noexcept
+        : batch_size(1024)
+        , threads() {}
+    ~manifest_diff_config() = default;
+    PS_DEFAULT_COPY(manifest_diff_config);
+    PS_DEFAULT_MOVE(manifest_diff_config);
+};
+
+// Compares two manifests of the same tree (from == older, to == newer).
+// Notification paths are absolute (joined with the manifest root). Renames are inferred from the device/inode of removed and created entries.
+// A file that was renamed and modified between captures is reported as removed and created.
+// Directory timestamps are ignored as they're implied by the child notifications.
+// Notifications are delivered in batches in no particular order. Callbacks are serialized, but may occur on a worker thread.
+// An exception thrown by the callback cancels the diff and is rethrown to the caller.
+void diff(const tree_manifest& from, const tree_manifest& to, const manifest_diff_config&, const change_callback&);
+
+inline void diff(const tree_manifest& from, const tree_manifest& to, const change_callback& cb) {
+    diff(from, to, manifest_diff_config{}, cb);
+}
+
+change_notifications diff(const tree_manifest& from, const tree_manifest& to);
+
+} // v1
+} // filesystem
+} // prosoft
+
+#endif // PS_CORE_FILESYSTEM_TREE_MANIFEST_HPP
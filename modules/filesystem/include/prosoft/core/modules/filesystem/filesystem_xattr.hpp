@@ -0,0 +1,129 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef PS_CORE_FILESYSTEM_XATTR_HPP
+#define PS_CORE_FILESYSTEM_XATTR_HPP
+
+// Extended attributes (Linux, macOS). Names and values are raw bytes and symlinks are followed (as status() does).
+// Windows: not supported (ENOTSUP), alternate data streams are opened by path.
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "filesystem_path.hpp"
+#include "filesystem_primatives.hpp"
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+namespace ifilesystem {
+struct xattr_reader;
+}
+
+// All of a file's extended attributes read into a single buffer: one list call and (usually) one get call per name.
+// Names and values point into the buffer, so the set is not copyable.
+class xattr_set {
+public:
+    struct entry {
+        const char* name; // null terminated
+        const char* value;
+        std::size_t size;
+    };
+    using const_iterator = std::vector<entry>::const_iterator;
+
+    xattr_set() = default;
+    ~xattr_set() = default;
+    PS_DISABLE_COPY(xattr_set);
+    PS_DEFAULT_MOVE(xattr_set);
+
+    std::size_t size() const noexcept {
+        return m_entries.size();
+    }
+
+    bool empty() const noexcept {
+        return m_entries.empty();
+    }
+
+    const entry& operator[](std::size_t i) const noexcept {
+        return m_entries[i];
+    }
+
+    const_iterator begin() const noexcept {
+        return m_entries.begin();
+    }
+
+    const_iterator end() const noexcept {
+        return m_entries.end();
+    }
+
+    // Returns null if the name was not found.
+    const entry* find(const char* name) const noexcept;
+
+private:
+    friend struct ifilesystem::xattr_reader;
+    std::vector<char> m_data;
+    std::vector<entry> m_entries;
+};
+
+using xattr_set_ptr = std::shared_ptr<const xattr_set>;
+
+std::vector<std::string> list_xattrs(const path&);
+std::vector<std::string> list_xattrs(const path&, error_code&);
+
+std::string get_xattr(const path&, const std::string& name);
+std::string get_xattr(const path&, const std::string& name, error_code&);
+
+void set_xattr(const path&, const std::string& name, const void* value, std::size_t size);
+void set_xattr(const path&, const std::string& name, const void* value, std::size_t size, error_code&);
+inline void set_xattr(const path& p, const std::string& name, const std::string& value) {
+    set_xattr(p, name, value.data(), value.size());
+}
+inline void set_xattr(const path& p, const std::string& name, const std::string& value, error_code& ec) {
+    set_xattr(p, name, value.data(), value.size(), ec);
+}
+
+void remove_xattr(const path&, const std::string& name);
+void remove_xattr(const path&, const std::string& name, error_code&);
+
+xattr_set get_xattrs(const path&);
+xattr_set get_xattrs(const path&, error_code&);
+
+#if !_WIN32
+// Descriptor variants.
+std::vector<std::string> list_xattrs(int fd, error_code&);
+std::string get_xattr(int fd, const std::string& name, error_code&);
+void set_xattr(int fd, const std::string& name, const void* value, std::size_t size, error_code&);
+void remove_xattr(int fd, const std::string& name, error_code&);
+xattr_set get_xattrs(int fd, error_code&);
+#endif
+
+} // v1
+} // filesystem
+} // prosoft
+
+#endif // PS_CORE_FILESYSTEM_XATTR_HPP
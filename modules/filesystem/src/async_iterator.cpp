@@ -0,0 +1,271 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <prosoft/core/config/config_platform.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_async_iterator.hpp>
+#include "filesystem_private.hpp"
+
+namespace {
+
+// Each worker reads a whole directory with a (non-recursive) directory_iterator and queues the subdirectories it finds.
+// Pending directories are taken LIFO to keep the queue (depth first) small.
+class async_state : public fs::async_iteration, public std::enable_shared_from_this<async_state> {
+    const fs::directory_options m_opts;
+    const fs::ifilesystem::iterator_config m_config;
+    const size_t m_batch_size;
+    fs::async_entries_callback m_entries;
+    fs::async_completion_callback m_completion;
+
+    mutable std::mutex m_lock;
+    std::condition_variable m_cond;
+    std::vector<fs::path> m_dirs;
+    fs::error_code m_error;
+    unsigned m_running; // live workers
+    unsigned m_reading; // workers reading a directory
+    bool m_done;
+    std::atomic<bool> m_canceled;
+
+    std::mutex m_deliver_lock; // serializes callbacks
+
+    bool recursive() const noexcept {
+        return !is_set(m_opts & fs::directory_options::skip_subdirectory_descendants);
+    }
+
+    void fail(const fs::error_code& ec) {
+        std::lock_guard<std::mutex> lg{m_lock};
+        if (!m_error) {
+            m_error = ec;
+        }
+        m_canceled = true;
+        m_cond.notify_all();
+    }
+
+    void deliver(fs::directory_entries& batch) {
+        {
+            std::lock_guard<std::mutex> lg{m_deliver_lock};
+            if (!m_canceled) {
+                try {
+                    m_entries(std::move(batch));
+                } catch (...) {
+                    fs::error_code ec;
+                    fs::ifilesystem::error(ECANCELED, ec);
+                    fail(ec);
+                }
+            }
+        }
+        batch.clear();
+    }
+
+    void push_if_recursive(const fs::directory_entry& e, std::vector<fs::path>& subdirs) const {
+        fs::error_code ec;
+        fs::path dir;
+        if (e.is_directory(ec)) {
+            dir = e.path();
+        } else if (is_set(m_opts & fs::directory_options::follow_directory_symlink) && e.is_symlink(ec) && fs::is_directory(e.path(), ec)) {
+            dir = m_config.canonical_cache ? m_config.canonical_cache->canonical(e.path(), ec) : fs::canonical(e.path(), ec);
+        }
+
+        if (!dir.empty()
+            && !(!is_set(m_opts & fs::directory_options::follow_mountpoints) && fs::is_mountpoint(dir, ec))
+            && !(is_set(m_opts & fs::directory_options::skip_package_content_descendants) && fs::is_package(dir, ec))) {
+            subdirs.emplace_back(std::move(dir));
+        }
+    }
+
+    void read(const fs::path& dir, fs::directory_entries& batch, std::vector<fs::path>& subdirs, fs::error_code& ec) {
+        fs::directory_iterator i{dir, m_opts, fs::ifilesystem::iterator_config{m_config}, ec};
+        for (; !ec && i != end(i) && !m_canceled; i.increment(ec)) {
+            auto e = i.extract();
+            if (recursive()) {
+                push_if_recursive(e, subdirs);
+            }
+            batch.emplace_back(std::move(e));
+            if (batch.size() >= m_batch_size) {
+                deliver(batch);
+            }
+        }
+        if (ec && is_set(m_opts & fs::directory_options::skip_permission_denied) && ec == fs::ifilesystem::permission_denied_error()) {
+            ec.clear();
+        }
+    }
+
+    void finish() {
+        {
+            std::lock_guard<std::mutex> lg{m_lock};
+            if (--m_running > 0) {
+                return;
+            }
+        }
+
+        fs::error_code ec;
+        {
+            std::lock_guard<std::mutex> lg{m_lock};
+            ec = m_error;
+        }
+        PSIgnoreCppException(m_completion(ec));
+
+        std::lock_guard<std::mutex> lg{m_lock};
+        m_done = true;
+        m_cond.notify_all();
+    }
+
+public:
+    async_state(const fs::path& p, fs::directory_options opts, const fs::async_iterator_config& cfg, fs::async_entries_callback&& ecb, fs::async_completion_callback&& ccb)
+        : m_opts(opts)
+        , m_config(cfg)
+        , m_batch_size(std::max(cfg.batch_size, size_t{1}))
+        , m_entries(std::move(ecb))
+        , m_completion(std::move(ccb))
+        , m_dirs{p}
+        , m_running()
+        , m_reading()
+        , m_done()
+        , m_canceled() {}
+    virtual ~async_state() = default;
+
+    void start(unsigned nthreads, fs::error_code& ec) {
+        m_running = nthreads;
+        auto self = shared_from_this();
+        for (unsigned t = 0; t < nthreads; ++t) {
+            try {
+                std::thread{[self] {
+                    self->work();
+                }}.detach();
+            } catch (const std::system_error& e) {
+                if (0 == t) { // nothing started
+                    m_running = 0;
+                    ec = e.code();
+                    PSIgnoreCppException(m_completion(ec));
+                    std::lock_guard<std::mutex> lg{m_lock};
+                    m_done = true;
+                    return;
+                }
+                finish();
+            }
+        }
+        ec.clear();
+    }
+
+    void work() {
+        fs::directory_entries batch;
+        std::vector<fs::path> subdirs;
+        std::unique_lock<std::mutex> lk{m_lock};
+        for (;;) {
+            if (!batch.empty() && (m_dirs.empty() || m_canceled)) {
+                // Don't sit on entries while waiting for more work.
+                lk.unlock();
+                deliver(batch);
+                lk.lock();
+                continue;
+            }
+
+            m_cond.wait(lk, [this] {
+                return m_canceled || !m_dirs.empty() || 0 == m_reading;
+            });
+            if (m_canceled || m_dirs.empty()) {
+                break;
+            }
+
+            auto dir = std::move(m_dirs.back());
+            m_dirs.pop_back();
+            ++m_reading;
+            lk.unlock();
+
+            fs::error_code ec;
+            try {
+                read(dir, batch, subdirs, ec);
+            } catch (...) {
+                fs::ifilesystem::error(ECANCELED, ec);
+            }
+
+            lk.lock();
+            --m_reading;
+            if (!ec) {
+                m_dirs.insert(m_dirs.end(), std::make_move_iterator(subdirs.rbegin()), std::make_move_iterator(subdirs.rend()));
+            } else if (!m_error) {
+                m_error = ec;
+                m_canceled = true;
+            }
+            subdirs.clear();
+            m_cond.notify_all();
+        }
+        lk.unlock();
+
+        finish();
+    }
+
+    virtual void cancel() noexcept override {
+        fs::error_code ec;
+        fs::ifilesystem::error(ECANCELED, ec);
+        fail(ec);
+    }
+
+    virtual void wait() override {
+        std::unique_lock<std::mutex> lk{m_lock};
+        m_cond.wait(lk, [this] {
+            return m_done;
+        });
+    }
+
+    virtual bool done() const noexcept override {
+        std::lock_guard<std::mutex> lg{m_lock};
+        return m_done;
+    }
+};
+
+} // anon
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+async_iteration_ptr iterate_async(const path& p, directory_options opts, const async_iterator_config& cfg, async_entries_callback ecb, async_completion_callback ccb, error_code& ec) {
+    if (p.empty() || !ecb || !ccb) {
+        ec = einval();
+        return async_iteration_ptr{};
+    }
+
+    auto s = std::make_shared<async_state>(p, make_public(opts), cfg, std::move(ecb), std::move(ccb));
+    s->start(std::max(cfg.threads, 1U), ec);
+    return !ec ? s : async_iteration_ptr{};
+}
+
+async_iteration_ptr iterate_async(const path& p, directory_options opts, const async_iterator_config& cfg, async_entries_callback ecb, async_completion_callback ccb) {
+    error_code ec;
+    auto s = iterate_async(p, opts, cfg, std::move(ecb), std::move(ccb), ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not start async iteration", p, ec));
+    return s;
+}
+
+} // v1
+} // filesystem
+} // prosoft
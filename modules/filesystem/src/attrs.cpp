@@ -43,9 +43,18 @@
 #endif
 #if PS_FS_HAVE_MNTENT_H
 #include <mntent.h>
+#if __linux__
+#include <fcntl.h>
+#include <poll.h>
+#endif
 #endif
 
 #include <limits>
+#if PS_FS_HAVE_MNTENT_H && __linux__
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#endif
 
 #include <prosoft/core/include/uniform_access.hpp>
 #include <prosoft/core/include/unique_resource.hpp>
@@ -115,6 +124,87 @@ bool has_flag(const path& p, unsigned f, error_code& ec) {
 }
 #endif
 
+#if PS_FS_HAVE_MNTENT_H && __linux__
+// Device to mount directory map built from "/proc/mounts".
+// The kernel signals a mount table change by raising POLLPRI on "/proc/self/mountinfo", so the map is only rebuilt after a change.
+class mount_table {
+public:
+    static mount_table& instance() {
+        static mount_table mt;
+        return mt;
+    }
+    
+    // Returns false if the table is not available, in which case the caller should scan the mount table directly.
+    bool find(dev_t dev, path& mp) {
+        if (m_fd < 0) {
+            return false;
+        }
+        
+        std::lock_guard<std::mutex> lg{m_lock};
+        struct pollfd pfd{m_fd, POLLPRI, 0};
+        if (!m_valid || (::poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLPRI|POLLERR)))) {
+            if (!load()) {
+                return false;
+            }
+        }
+        
+        auto i = m_mounts.find(dev);
+        if (i != m_mounts.end()) {
+            mp = path{i->second};
+        } else {
+            mp.clear();
+        }
+        return true;
+    }
+    
+    ~mount_table() {
+        if (m_fd >= 0) {
+            (void)::close(m_fd);
+        }
+    }
+    
+    PS_DISABLE_COPY(mount_table);
+    PS_DISABLE_MOVE(mount_table);
+    
+private:
+    mount_table()
+        : m_fd(::open("/proc/self/mountinfo", O_RDONLY|O_CLOEXEC)) {}
+    
+    bool load() {
+        m_valid = false;
+        m_mounts.clear();
+        
+        // Reading to EOF acknowledges the change event.
+        char buf[4096];
+        if (::lseek(m_fd, 0, SEEK_SET) < 0) {
+            return false;
+        }
+        for (ssize_t n; (n = ::read(m_fd, buf, sizeof(buf))) != 0;) {
+            if (n < 0 && EINTR != errno) {
+                return false;
+            }
+        }
+        
+        if (auto mt = unique_file{::setmntent("/proc/mounts", "r")}) {
+            struct mntent me;
+            struct stat sb;
+            while (::getmntent_r(mt.get(), &me, buf, sizeof(buf))) {
+                if (0 == ::stat(me.mnt_dir, &sb)) {
+                    m_mounts.emplace(sb.st_dev, me.mnt_dir); // first entry wins, same as a direct scan
+                }
+            }
+            m_valid = true;
+        }
+        return m_valid;
+    }
+    
+    std::mutex m_lock;
+    std::unordered_map<dev_t, std::string> m_mounts;
+    int m_fd;
+    bool m_valid{false};
+};
+#endif // PS_FS_HAVE_MNTENT_H && __linux__
+
 inline bool is_dotfile(const path& p) {
     const auto leaf = p.filename();
     return (!leaf.empty() && leaf.native()[0] == path::dot); // first condition should not be necessary, but just to be safe
@@ -227,6 +317,15 @@ path mount_path(const path& p, error_code& ec) {
     #endif
     struct stat sb;
     if (0 == ::stat(p.c_str(), &sb)) {
+        #if __linux__
+        path mp;
+        if (mount_table::instance().find(sb.st_dev, mp)) {
+            if (mp.empty()) {
+                ifilesystem::error(ENOENT, ec);
+            }
+            return mp;
+        }
+        #endif
         if (auto mt = unique_file{::setmntent(mtab, "r")}) {
             constexpr size_t bufSize = 4096;
             auto buf = make_malloc_throw<char>(bufSize);
@@ -0,0 +1,865 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <prosoft/core/config/config.h>
+
+#include "fsconfig.h"
+
+#if !_WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <sys/acl.h>
+#if __linux__
+#include <acl/libacl.h>
+#endif
+#endif
+
+#if PS_FS_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <numeric>
+#include <string>
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_batch.hpp>
+#include "filesystem_private.hpp"
+#include "batch_private.hpp"
+#include "fsstore_private.hpp"
+
+namespace {
+
+// Below this the setup cost of a ring is not worth it.
+constexpr size_t min_batch = 16;
+
+// Each call is cheap, so threads claim them in chunks.
+constexpr size_t batch_chunk = 64;
+
+#if PS_FS_HAVE_IO_URING
+
+// Minimal io_uring submission/completion loop (no liburing dependency).
+class uring {
+    int m_fd;
+    unsigned m_entries;
+    void* m_sq_ring;
+    size_t m_sq_ring_size;
+    void* m_cq_ring;
+    size_t m_cq_ring_size;
+    ::io_uring_sqe* m_sqes;
+    size_t m_sqes_size;
+
+    unsigned* m_sq_head;
+    unsigned* m_sq_tail;
+    unsigned* m_sq_mask;
+    unsigned* m_sq_array;
+    unsigned* m_cq_head;
+    unsigned* m_cq_tail;
+    unsigned* m_cq_mask;
+    ::io_uring_cqe* m_cqes;
+
+    template <typename T>
+    static T* at(void* base, unsigned off) noexcept {
+        return reinterpret_cast<T*>(static_cast<char*>(base) + off);
+    }
+
+    int enter(unsigned submit, unsigned wait) noexcept {
+        return static_cast<int>(::syscall(__NR_io_uring_enter, m_fd, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+    }
+
+    // user_data is the entry index and the slot it's using
+    static constexpr unsigned slot_shift = 48;
+
+    template <class Complete>
+    size_t reap(Complete& complete, std::vector<unsigned>& slots) {
+        size_t n = 0;
+        auto head = *m_cq_head;
+        const auto tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head, ++n) {
+            const auto& cqe = m_cqes[head & *m_cq_mask];
+            const auto slot = static_cast<unsigned>(cqe.user_data >> slot_shift);
+            complete(static_cast<size_t>(cqe.user_data & ((std::uint64_t{1} << slot_shift) - 1)), slot, cqe.res);
+            slots.push_back(slot);
+        }
+        __atomic_store_n(m_cq_head, head, __ATOMIC_RELEASE);
+        return n;
+    }
+
+public:
+    explicit uring(unsigned entries) noexcept
+        : m_fd(-1)
+        , m_entries()
+        , m_sq_ring(MAP_FAILED)
+        , m_sq_ring_size()
+        , m_cq_ring(MAP_FAILED)
+        , m_cq_ring_size()
+        , m_sqes(static_cast<::io_uring_sqe*>(MAP_FAILED))
+        , m_sqes_size() {
+        ::io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        m_fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+        if (m_fd < 0) {
+            return;
+        }
+
+        m_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        m_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(::io_uring_cqe);
+        const bool single = 0 != (params.features & IORING_FEAT_SINGLE_MMAP);
+        if (single) {
+            m_sq_ring_size = m_cq_ring_size = std::max(m_sq_ring_size, m_cq_ring_size);
+        }
+        m_sq_ring = ::mmap(nullptr, m_sq_ring_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+        if (MAP_FAILED == m_sq_ring) {
+            return;
+        }
+        if (!single) {
+            m_cq_ring = ::mmap(nullptr, m_cq_ring_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+            if (MAP_FAILED == m_cq_ring) {
+                return;
+            }
+        }
+        m_sqes_size = params.sq_entries * sizeof(::io_uring_sqe);
+        m_sqes = static_cast<::io_uring_sqe*>(::mmap(nullptr, m_sqes_size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, m_fd, IORING_OFF_SQES));
+        if (MAP_FAILED == static_cast<void*>(m_sqes)) {
+            return;
+        }
+
+        auto cq = single ? m_sq_ring : m_cq_ring;
+        m_sq_head = at<unsigned>(m_sq_ring, params.sq_off.head);
+        m_sq_tail = at<unsigned>(m_sq_ring, params.sq_off.tail);
+        m_sq_mask = at<unsigned>(m_sq_ring, params.sq_off.ring_mask);
+        m_sq_array = at<unsigned>(m_sq_ring, params.sq_off.array);
+        m_cq_head = at<unsigned>(cq, params.cq_off.head);
+        m_cq_tail = at<unsigned>(cq, params.cq_off.tail);
+        m_cq_mask = at<unsigned>(cq, params.cq_off.ring_mask);
+        m_cqes = at<::io_uring_cqe>(cq, params.cq_off.cqes);
+        m_entries = params.sq_entries;
+    }
+
+    ~uring() {
+        if (MAP_FAILED != static_cast<void*>(m_sqes)) {
+            (void)::munmap(m_sqes, m_sqes_size);
+        }
+        if (MAP_FAILED != m_cq_ring) {
+            (void)::munmap(m_cq_ring, m_cq_ring_size);
+        }
+        if (MAP_FAILED != m_sq_ring) {
+            (void)::munmap(m_sq_ring, m_sq_ring_size);
+        }
+        if (m_fd >= 0) {
+            (void)::close(m_fd);
+        }
+    }
+    PS_DISABLE_COPY(uring);
+    PS_DISABLE_MOVE(uring);
+
+    explicit operator bool() const noexcept {
+        return m_entries > 0;
+    }
+
+    // Max requests in flight. Requests use a slot in [0, entries()) which can be used to index per request buffers.
+    unsigned entries() const noexcept {
+        return m_entries;
+    }
+
+    bool supports(unsigned op) const {
+        constexpr unsigned nops = 256;
+        std::vector<char> buf(sizeof(::io_uring_probe) + nops * sizeof(::io_uring_probe_op));
+        auto probe = reinterpret_cast<::io_uring_probe*>(buf.data());
+        if (::syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_PROBE, probe, nops) < 0) {
+            return false;
+        }
+        return op <= probe->last_op && 0 != (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+    }
+
+    // prep(i, slot, sqe) fills the request for entry i, complete(i, slot, res) receives its result.
+    // Returns false if the ring failed, in which case some entries may not have completed.
+    template <class Prep, class Complete>
+    bool run(size_t count, Prep prep, Complete complete) {
+        std::vector<unsigned> slots(m_entries);
+        std::iota(slots.rbegin(), slots.rend(), 0U);
+        size_t next = 0, done = 0;
+        unsigned pending = 0; // queued, not yet submitted
+        unsigned inflight = 0;
+        while (done < count) {
+            auto tail = *m_sq_tail;
+            for (; next < count && !slots.empty(); ++next, ++tail, ++pending) {
+                const auto slot = slots.back();
+                slots.pop_back();
+                const auto idx = tail & *m_sq_mask;
+                auto sqe = &m_sqes[idx];
+                std::memset(sqe, 0, sizeof(*sqe));
+                prep(next, slot, sqe);
+                sqe->user_data = (std::uint64_t{slot} << slot_shift) | next;
+                m_sq_array[idx] = idx;
+            }
+            __atomic_store_n(m_sq_tail, tail, __ATOMIC_RELEASE);
+
+            const auto r = enter(pending, 1);
+            if (r >= 0) {
+                pending -= static_cast<unsigned>(r);
+                inflight += static_cast<unsigned>(r);
+            } else if (EINTR != errno && EAGAIN != errno && EBUSY != errno) {
+                // Drain what the kernel owns before giving up so it doesn't write to released buffers.
+                while (inflight > 0) {
+                    const auto n = reap(complete, slots);
+                    inflight -= static_cast<unsigned>(n);
+                    done += n;
+                    if (0 == n && enter(0, 1) < 0 && EINTR != errno) {
+                        break;
+                    }
+                }
+                return false;
+            }
+
+            const auto n = reap(complete, slots);
+            inflight -= static_cast<unsigned>(n);
+            done += n;
+        }
+        return true;
+    }
+};
+
+unsigned ring_size(size_t count) noexcept {
+    return static_cast<unsigned>(std::min<size_t>(count, 256));
+}
+
+bool ring_status(const fs::path* paths, size_t count, fs::status_info what, fs::file_status* results, fs::error_code* ecs, int flags) {
+    uring ring{ring_size(count)};
+    if (!ring || !ring.supports(IORING_OP_STATX)) {
+        return false;
+    }
+
+    const unsigned mask = fs::ifilesystem::statx_mask(what);
+    std::vector<bool> completed(count);
+    std::vector<struct ::statx> bufs(ring.entries());
+    const auto ok = ring.run(count, [&](size_t i, unsigned slot, ::io_uring_sqe* sqe) {
+        sqe->opcode = IORING_OP_STATX;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = reinterpret_cast<std::uintptr_t>(paths[i].c_str());
+        sqe->len = mask;
+        sqe->off = reinterpret_cast<std::uintptr_t>(&bufs[slot]);
+        sqe->statx_flags = static_cast<std::uint32_t>(flags);
+    }, [&](size_t i, unsigned slot, int res) {
+        completed[i] = true;
+        if (res >= 0) {
+            ecs[i].clear();
+            results[i] = fs::ifilesystem::make_status(bufs[slot], what);
+        } else {
+            ecs[i].assign(-res, std::system_category());
+            results[i] = fs::ifilesystem::make_status(ecs[i]);
+        }
+    });
+
+    if (!ok) { // finish what's left the slow way
+        for (size_t i = 0; i < count; ++i) {
+            if (!completed[i]) {
+                results[i] = (flags & AT_SYMLINK_NOFOLLOW) ? fs::symlink_status(paths[i], what, ecs[i]) : fs::status(paths[i], what, ecs[i]);
+            }
+        }
+    }
+    return true;
+}
+
+#endif // PS_FS_HAVE_IO_URING
+
+#if !_WIN32
+int open_file(const fs::path& p, int flags, fs::error_code& ec) {
+    int fd;
+    do {
+        fd = ::open(p.c_str(), flags|O_CLOEXEC, 0666);
+    } while (fd < 0 && EINTR == errno);
+    if (fd >= 0) {
+        ec.clear();
+    } else {
+        fs::ifilesystem::system_error(ec);
+    }
+    return fd;
+}
+#endif
+
+#if !_WIN32
+// A directory being emptied by remover.
+struct remove_dir {
+    std::shared_ptr<remove_dir> m_parent;
+    std::string m_path;
+    size_t m_name; // offset in m_path
+    std::atomic<size_t> m_pending; // subdirs not yet removed, +1 while listing
+    int m_fd; // kept for removing subdirs, -1 if not kept
+
+    remove_dir(std::shared_ptr<remove_dir> parent, std::string&& p, size_t name)
+        : m_parent(std::move(parent))
+        , m_path(std::move(p))
+        , m_name(name)
+        , m_pending(1)
+        , m_fd(-1) {}
+    ~remove_dir() {
+        if (m_fd >= 0) {
+            (void)::close(m_fd);
+        }
+    }
+    PS_DISABLE_COPY(remove_dir);
+    PS_DISABLE_MOVE(remove_dir);
+
+    const char* name() const noexcept {
+        return m_path.c_str() + m_name;
+    }
+};
+
+// Leaves are unlinked relative to their dir and a dir is removed by the thread that removes its last subdir.
+// A dir's descriptor is kept open until its subdirs are removed as long as the budget allows, otherwise its subdirs are opened and removed by path.
+class remover : public fs::ifilesystem::dir_pool<remove_dir> {
+    std::atomic<std::uintmax_t> m_removed;
+    std::atomic<int> m_budget; // descriptors that may be kept open
+    dev_t m_dev;
+
+public:
+    remover(unsigned budget, dev_t dev)
+        : m_removed(0)
+        , m_budget(static_cast<int>(budget))
+        , m_dev(dev) {}
+
+    std::uintmax_t operator()(const fs::path& root, unsigned nthreads, fs::error_code& ec) {
+        ec = run(std::make_shared<remove_dir>(nullptr, std::string{root.c_str()}, 0), nthreads);
+        return m_removed.load();
+    }
+
+private:
+    bool acquire() noexcept {
+        for (auto n = m_budget.load(); n > 0;) {
+            if (m_budget.compare_exchange_weak(n, n - 1)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    int open(const remove_dir& d) const noexcept {
+        constexpr int flags = O_RDONLY|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC;
+        const auto& parent = d.m_parent;
+        return parent && parent->m_fd >= 0 ? ::openat(parent->m_fd, d.name(), flags) : ::open(d.m_path.c_str(), flags);
+    }
+
+    void list(const dir_ptr& d) override {
+        const int fd = open(*d);
+        if (fd < 0) {
+            if (ENOENT == errno) {
+                done(d);
+            } else {
+                fail(errno);
+            }
+            return;
+        }
+
+        struct ::stat sb;
+        if (0 != ::fstat(fd, &sb) || sb.st_dev != m_dev) {
+            // Mount points are not descended, removing it will fail.
+            (void)::close(fd);
+            done(d);
+            return;
+        }
+
+        // Subdirs use the descriptor once they are queued, so it must be kept before listing.
+        if (acquire()) {
+            d->m_fd = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+            if (d->m_fd < 0) {
+                ++m_budget;
+            }
+        }
+
+        ::DIR* dir = ::fdopendir(fd);
+        if (!dir) {
+            fail(errno);
+            (void)::close(fd);
+            return;
+        }
+
+        while (!failed()) {
+            errno = 0;
+            const auto ent = ::readdir(dir);
+            if (!ent) {
+                if (0 != errno) {
+                    fail(errno);
+                }
+                break;
+            }
+
+            const char* name = ent->d_name;
+            if ('.' == name[0] && (0 == name[1] || ('.' == name[1] && 0 == name[2]))) {
+                continue;
+            }
+
+            bool isdir = DT_DIR == ent->d_type;
+            if (DT_UNKNOWN == ent->d_type) {
+                struct ::stat esb;
+                isdir = 0 == ::fstatat(fd, name, &esb, AT_SYMLINK_NOFOLLOW) && S_ISDIR(esb.st_mode);
+            }
+
+            if (isdir) {
+                std::string p;
+                p.reserve(d->m_path.size() + 1 + std::strlen(name));
+                p.append(d->m_path).append(1, '/');
+                const auto pos = p.size();
+                p.append(name);
+                ++d->m_pending;
+                push(std::make_shared<remove_dir>(d, std::move(p), pos));
+            } else if (0 == ::unlinkat(fd, name, 0)) {
+                ++m_removed;
+            } else if (ENOENT != errno) {
+                fail(errno);
+            }
+        }
+        (void)::closedir(dir);
+
+        if (!failed()) {
+            done(d);
+        }
+    }
+
+    // Removes the dir if this was the last thing pending, and then its parent if that was the last subdir.
+    void done(dir_ptr d) {
+        while (d && 1 == d->m_pending.fetch_sub(1)) {
+            if (d->m_fd >= 0) {
+                (void)::close(d->m_fd);
+                d->m_fd = -1;
+                ++m_budget;
+            }
+            auto parent = std::move(d->m_parent);
+            const int err = parent && parent->m_fd >= 0 ? ::unlinkat(parent->m_fd, d->name(), AT_REMOVEDIR) : ::rmdir(d->m_path.c_str());
+            if (0 == err) {
+                ++m_removed;
+            } else if (ENOENT != errno) {
+                fail(errno);
+                return;
+            }
+            d = std::move(parent);
+        }
+    }
+};
+
+// A directory being walked by cloner, the path is relative to the roots.
+struct clone_dir {
+    std::shared_ptr<clone_dir> m_parent;
+    std::string m_path;
+    struct ::stat m_from;
+    struct ::stat m_to;
+    std::atomic<size_t> m_pending; // subdirs not yet done, +1 while listing
+
+    clone_dir(std::shared_ptr<clone_dir> parent, std::string&& p, const struct ::stat& from, const struct ::stat& to)
+        : m_parent(std::move(parent))
+        , m_path(std::move(p))
+        , m_from(from)
+        , m_to(to)
+        , m_pending(1) {}
+    ~clone_dir() = default;
+    PS_DISABLE_COPY(clone_dir);
+    PS_DISABLE_MOVE(clone_dir);
+};
+
+inline bool same_time(const struct ::timespec& t1, const struct ::timespec& t2) noexcept {
+    return t1.tv_sec == t2.tv_sec && t1.tv_nsec == t2.tv_nsec;
+}
+
+// Metadata is set relative to the dir descriptors and only if the cached stats differ.
+// A dir is done after its subdirs as its new perms could prevent walking it.
+class cloner : public fs::ifilesystem::dir_pool<clone_dir> {
+    const fs::path& m_from_root;
+    const fs::path& m_to_root;
+    int m_from;
+    int m_to;
+    fs::metadata_options m_opts;
+    dev_t m_dev;
+    std::atomic<std::uintmax_t> m_changed;
+
+public:
+    cloner(const fs::path& from, const fs::path& to, int fromfd, int tofd, fs::metadata_options opts, dev_t dev)
+        : m_from_root(from)
+        , m_to_root(to)
+        , m_from(fromfd)
+        , m_to(tofd)
+        , m_opts(opts)
+        , m_dev(dev)
+        , m_changed(0) {}
+
+    std::uintmax_t operator()(const struct ::stat& from, const struct ::stat& to, unsigned nthreads, fs::error_code& ec) {
+        ec = run(std::make_shared<clone_dir>(nullptr, std::string{"."}, from, to), nthreads);
+        return m_changed.load();
+    }
+
+    // For a root that is not a dir, the descriptors are for the parents.
+    std::uintmax_t operator()(const char* fname, const char* tname, const struct ::stat& from, const struct ::stat& to, fs::error_code& ec) {
+        apply(m_from, fname, m_to, tname, nullptr, from, to);
+        ec = first_error();
+        return m_changed.load();
+    }
+
+private:
+    bool is(fs::metadata_options o) const noexcept {
+        return is_set(m_opts & o);
+    }
+
+    static std::string relative(const std::string& dir, const char* name) {
+        return "." == dir ? std::string{name} : dir + '/' + name;
+    }
+
+    void list(const dir_ptr& d) override {
+        constexpr int flags = O_RDONLY|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC;
+        const int from = ::openat(m_from, d->m_path.c_str(), flags);
+        if (from < 0) {
+            fail(errno);
+            return;
+        }
+        fs::ifilesystem::fd_close to{::openat(m_to, d->m_path.c_str(), flags)};
+        ::DIR* dir = to.fd >= 0 ? ::fdopendir(from) : nullptr;
+        if (!dir) {
+            fail(errno);
+            (void)::close(from);
+            return;
+        }
+
+        while (!failed()) {
+            errno = 0;
+            const auto ent = ::readdir(dir);
+            if (!ent) {
+                if (0 != errno) {
+                    fail(errno);
+                }
+                break;
+            }
+
+            const char* name = ent->d_name;
+            if ('.' == name[0] && (0 == name[1] || ('.' == name[1] && 0 == name[2]))) {
+                continue;
+            }
+
+            struct ::stat fsb;
+            struct ::stat tsb;
+            if (0 != ::fstatat(from, name, &fsb, AT_SYMLINK_NOFOLLOW) || 0 != ::fstatat(to.fd, name, &tsb, AT_SYMLINK_NOFOLLOW)) {
+                if (ENOENT != errno) {
+                    fail(errno);
+                }
+                continue;
+            }
+            if (0 != ((fsb.st_mode ^ tsb.st_mode) & S_IFMT)) {
+                continue;
+            }
+
+            if (S_ISDIR(fsb.st_mode) && fsb.st_dev == m_dev) {
+                ++d->m_pending;
+                push(std::make_shared<clone_dir>(d, relative(d->m_path, name), fsb, tsb));
+            } else {
+                apply(from, name, to.fd, name, d->m_path.c_str(), fsb, tsb); // files and mount points
+            }
+        }
+        // Reading the dir may have changed its access time.
+        (void)::fstat(from, &d->m_from);
+        (void)::closedir(dir);
+
+        if (!failed()) {
+            done(d);
+        }
+    }
+
+    // Applies the dir if this was the last thing pending, and then its parent if that was the last subdir.
+    void done(dir_ptr d) {
+        while (d && 1 == d->m_pending.fetch_sub(1) && !failed()) {
+            const auto p = d->m_path.c_str();
+            apply(m_from, p, m_to, p, ".", d->m_from, d->m_to);
+            d = d->m_parent;
+        }
+    }
+
+    // dir is the entry's parent relative to the roots, or null if the roots are files and the descriptors are for their parents.
+    void apply(int from, const char* fname, int to, const char* name, const char* dir, const struct ::stat& f, const struct ::stat& t) {
+        bool changed = false;
+        if (is(fs::metadata_options::owner) && (f.st_uid != t.st_uid || f.st_gid != t.st_gid)) {
+            if (0 != ::fchownat(to, name, f.st_uid, f.st_gid, AT_SYMLINK_NOFOLLOW)) {
+                fail(errno);
+                return;
+            }
+            changed = true;
+        }
+        // Symlink perms can't be changed on Linux and are ignored elsewhere.
+        // A chown may clear the setuid/setgid bits.
+        if (is(fs::metadata_options::perms) && !S_ISLNK(f.st_mode) && (0 != ((f.st_mode ^ t.st_mode) & 07777) || (changed && 0 != (f.st_mode & 06000)))) {
+            if (0 != ::fchmodat(to, name, f.st_mode & 07777, 0)) {
+                fail(errno);
+                return;
+            }
+            changed = true;
+        }
+        if (is(fs::metadata_options::acl) && (S_ISREG(f.st_mode) || S_ISDIR(f.st_mode))) { // after the perms as they may change the ACL mask
+            changed = clone_acl(from, fname, to, name, dir, S_ISDIR(f.st_mode)) || changed;
+            if (failed()) {
+                return;
+            }
+        }
+#if __APPLE__
+        const struct ::timespec times[2] = {f.st_atimespec, f.st_mtimespec};
+        const bool same_times = same_time(f.st_atimespec, t.st_atimespec) && same_time(f.st_mtimespec, t.st_mtimespec);
+#else
+        const struct ::timespec times[2] = {f.st_atim, f.st_mtim};
+        const bool same_times = same_time(f.st_atim, t.st_atim) && same_time(f.st_mtim, t.st_mtim);
+#endif
+        if (is(fs::metadata_options::times) && !same_times) {
+            if (0 != ::utimensat(to, name, times, AT_SYMLINK_NOFOLLOW)) {
+                fail(errno);
+                return;
+            }
+            changed = true;
+        }
+        if (changed) {
+            ++m_changed;
+        }
+    }
+
+    fs::path entry_path(const fs::path& root, const char* dir, const char* name) const {
+        return dir ? root / fs::path{relative(dir, name)} : root;
+    }
+
+    // Returns true if the target ACL changed.
+    // An entry that can't be opened (e.g. no read permission) is set by path, as are Linux default ACLs which have no descriptor API.
+    bool clone_acl(int from, const char* fname, int to, const char* tname, const char* dir, bool isdir) {
+#if __APPLE__
+        constexpr ::acl_type_t kind = ACL_TYPE_EXTENDED;
+#else
+        constexpr ::acl_type_t kind = ACL_TYPE_ACCESS;
+#endif
+        constexpr int flags = O_RDONLY|O_NOFOLLOW|O_NONBLOCK|O_CLOEXEC;
+        fs::ifilesystem::fd_close ffd{::openat(from, fname, flags)};
+        if (ffd.fd < 0 && EACCES != errno) {
+            fail(errno);
+            return false;
+        }
+        fs::ifilesystem::fd_close tfd{::openat(to, tname, flags)};
+        if (tfd.fd < 0 && EACCES != errno) {
+            fail(errno);
+            return false;
+        }
+        fs::path fp, tp;
+        if (ffd.fd < 0 || tfd.fd < 0 || isdir) {
+            fp = entry_path(m_from_root, dir, fname);
+            tp = entry_path(m_to_root, dir, tname);
+        }
+
+        fs::ifilesystem::unique_acl a{ffd.fd >= 0 ? ::acl_get_fd(ffd.fd) : ::acl_get_file(fp.c_str(), kind)};
+        if (!a) {
+            // macOS returns ENOENT if there is no ACL
+            if (ENOTSUP != errno && ENOENT != errno) {
+                fail(errno);
+            }
+            return false;
+        }
+        bool changed = false;
+#if __linux__
+        fs::ifilesystem::unique_acl current{tfd.fd >= 0 ? ::acl_get_fd(tfd.fd) : ::acl_get_file(tp.c_str(), kind)};
+        if (!current || 0 != ::acl_cmp(a.get(), current.get())) {
+#endif
+            if (0 != (tfd.fd >= 0 ? ::acl_set_fd(tfd.fd, a.get()) : ::acl_set_file(tp.c_str(), kind, a.get()))) {
+                fail(errno);
+                return false;
+            }
+            changed = true;
+#if __linux__
+        }
+
+        if (isdir) {
+            fs::ifilesystem::unique_acl def{::acl_get_file(fp.c_str(), ACL_TYPE_DEFAULT)};
+            if (!def) {
+                fail(errno);
+                return changed;
+            }
+            current.reset(::acl_get_file(tp.c_str(), ACL_TYPE_DEFAULT));
+            // An empty default ACL removes the target's.
+            if (!current || 0 != ::acl_cmp(def.get(), current.get())) {
+                if (0 != ::acl_set_file(tp.c_str(), ACL_TYPE_DEFAULT, def.get())) {
+                    fail(errno);
+                    return changed;
+                }
+                changed = true;
+            }
+        }
+#endif
+        return changed;
+    }
+};
+#endif // !_WIN32
+
+} // anon
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+void batch_status(const path* paths, std::size_t count, status_info what, file_status* results, error_code* ecs, const batch_config& cfg) {
+#if PS_FS_HAVE_IO_URING
+    if (count >= min_batch && !cfg.use_threads && ring_status(paths, count, what, results, ecs, 0)) {
+        return;
+    }
+#endif
+    ifilesystem::parallel_for(count, cfg.threads, batch_chunk, [=](size_t i) {
+        results[i] = status(paths[i], what, ecs[i]);
+    });
+}
+
+void batch_symlink_status(const path* paths, std::size_t count, status_info what, file_status* results, error_code* ecs, const batch_config& cfg) {
+#if PS_FS_HAVE_IO_URING
+    if (count >= min_batch && !cfg.use_threads && ring_status(paths, count, what, results, ecs, AT_SYMLINK_NOFOLLOW)) {
+        return;
+    }
+#endif
+    ifilesystem::parallel_for(count, cfg.threads, batch_chunk, [=](size_t i) {
+        results[i] = symlink_status(paths[i], what, ecs[i]);
+    });
+}
+
+#if !_WIN32
+void batch_open(const path* paths, std::size_t count, int flags, int* fds, error_code* ecs, const batch_config& cfg) {
+#if PS_FS_HAVE_IO_URING
+    if (count >= min_batch && !cfg.use_threads) {
+        uring ring{ring_size(count)};
+        if (ring && ring.supports(IORING_OP_OPENAT)) {
+            std::vector<bool> completed(count);
+            const auto ok = ring.run(count, [=](size_t i, unsigned, ::io_uring_sqe* sqe) {
+                sqe->opcode = IORING_OP_OPENAT;
+                sqe->fd = AT_FDCWD;
+                sqe->addr = reinterpret_cast<std::uintptr_t>(paths[i].c_str());
+                sqe->len = 0666;
+                sqe->open_flags = static_cast<std::uint32_t>(flags|O_CLOEXEC);
+            }, [&](size_t i, unsigned, int res) {
+                completed[i] = true;
+                if (res >= 0) {
+                    fds[i] = res;
+                    ecs[i].clear();
+                } else {
+                    fds[i] = -1;
+                    ecs[i].assign(-res, std::system_category());
+                }
+            });
+            if (!ok) {
+                for (size_t i = 0; i < count; ++i) {
+                    if (!completed[i]) {
+                        fds[i] = open_file(paths[i], flags, ecs[i]);
+                    }
+                }
+            }
+            return;
+        }
+    }
+#endif
+    ifilesystem::parallel_for(count, cfg.threads, batch_chunk, [=](size_t i) {
+        fds[i] = open_file(paths[i], flags, ecs[i]);
+    });
+}
+#endif // !_WIN32
+
+std::uintmax_t remove_all(const path& p, const batch_config& cfg) {
+    error_code ec;
+    const auto n = remove_all(p, cfg, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not remove path", p, ec));
+    return n;
+}
+
+std::uintmax_t remove_all(const path& p, const batch_config& cfg, error_code& ec) {
+#if !_WIN32
+    struct ::stat sb;
+    if (0 != ::lstat(p.c_str(), &sb)) {
+        if (ENOENT == errno) {
+            ec.clear();
+            return 0;
+        }
+        ifilesystem::system_error(ec);
+        return static_cast<std::uintmax_t>(-1);
+    }
+    if (!S_ISDIR(sb.st_mode)) {
+        return remove(p, ec) ? 1 : static_cast<std::uintmax_t>(-1);
+    }
+
+    constexpr unsigned default_open = 256;
+    const auto n = remover{cfg.max_open > 0 ? cfg.max_open : default_open, sb.st_dev}(p, cfg.threads, ec);
+    return ec ? static_cast<std::uintmax_t>(-1) : n;
+#else
+    (void)cfg;
+    return remove_all(p, ec);
+#endif
+}
+
+std::uintmax_t clone_metadata(const path& from, const path& to, metadata_options opts, const batch_config& cfg) {
+    error_code ec;
+    const auto n = clone_metadata(from, to, opts, cfg, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not clone metadata", from, to, ec));
+    return n;
+}
+
+std::uintmax_t clone_metadata(const path& from, const path& to, metadata_options opts, const batch_config& cfg, error_code& ec) {
+    ec.clear();
+#if !_WIN32
+    struct ::stat fsb;
+    struct ::stat tsb;
+    if (0 != ::lstat(from.c_str(), &fsb) || 0 != ::lstat(to.c_str(), &tsb)) {
+        ifilesystem::system_error(ec);
+        return static_cast<std::uintmax_t>(-1);
+    }
+    if (0 != ((fsb.st_mode ^ tsb.st_mode) & S_IFMT)) {
+        ec = einval();
+        return static_cast<std::uintmax_t>(-1);
+    }
+
+    const bool dir = S_ISDIR(fsb.st_mode);
+    auto parent = [](const path& p) {
+        return p.has_parent_path() ? p.parent_path() : path{PS_TEXT(".")};
+    };
+    constexpr int flags = O_RDONLY|O_DIRECTORY|O_CLOEXEC;
+    ifilesystem::fd_close f{::open(dir ? from.c_str() : parent(from).c_str(), flags)};
+    ifilesystem::fd_close t{::open(dir ? to.c_str() : parent(to).c_str(), flags)};
+    if (f.fd < 0 || t.fd < 0) {
+        ifilesystem::system_error(ec);
+        return static_cast<std::uintmax_t>(-1);
+    }
+
+    cloner c{from, to, f.fd, t.fd, opts, fsb.st_dev};
+    const auto n = dir ? c(fsb, tsb, cfg.threads, ec) : c(from.filename().c_str(), to.filename().c_str(), fsb, tsb, ec);
+    return ec ? static_cast<std::uintmax_t>(-1) : n;
+#else
+    (void)from;
+    (void)to;
+    (void)opts;
+    (void)cfg;
+    ec = error_code{ERROR_NOT_SUPPORTED, filesystem_category()};
+    return static_cast<std::uintmax_t>(-1);
+#endif
+}
+
+} // v1
+} // filesystem
+} // prosoft
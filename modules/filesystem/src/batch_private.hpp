@@ -0,0 +1,195 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef PS_CORE_BATCH_PRIVATE_HPP
+#define PS_CORE_BATCH_PRIVATE_HPP
+
+// Thread helpers for the batch operations.
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+namespace ifilesystem {
+
+// Directories are listed on any of the threads and listing a dir queues its subdirs.
+// The first error stops the walk.
+template <typename Dir>
+class dir_pool {
+public:
+    using dir_ptr = std::shared_ptr<Dir>;
+
+    dir_pool()
+        : m_failed(false)
+        , m_active(0) {}
+    virtual ~dir_pool() = default;
+    PS_DISABLE_COPY(dir_pool);
+    PS_DISABLE_MOVE(dir_pool);
+
+protected:
+    // Returns the first error.
+    error_code run(dir_ptr root, unsigned nthreads) {
+        if (0 == nthreads) {
+            nthreads = std::max(std::thread::hardware_concurrency(), 1U);
+        }
+        m_queue.push_back(std::move(root));
+        std::vector<std::thread> workers;
+        try {
+            for (unsigned t = 1; t < nthreads; ++t) {
+                workers.emplace_back([this] { work(); });
+            }
+        } catch (...) {
+            // The calling thread will process the remaining dirs.
+        }
+        work();
+        for (auto& t : workers) {
+            t.join();
+        }
+        m_queue.clear();
+        return m_ec;
+    }
+
+    void push(dir_ptr&& d) {
+        {
+            std::lock_guard<std::mutex> lg{m_lock};
+            m_queue.push_back(std::move(d));
+        }
+        m_cond.notify_one();
+    }
+
+    void fail(int err) {
+        std::lock_guard<std::mutex> lg{m_lock};
+        if (!m_failed.exchange(true)) {
+            error(err, m_ec);
+        }
+    }
+
+    bool failed() const noexcept {
+        return m_failed;
+    }
+
+    error_code first_error() {
+        std::lock_guard<std::mutex> lg{m_lock};
+        return m_ec;
+    }
+
+    virtual void list(const dir_ptr&) = 0;
+
+private:
+    void work() {
+        for (;;) {
+            dir_ptr d;
+            {
+                std::unique_lock<std::mutex> lg{m_lock};
+                m_cond.wait(lg, [this] { return !m_queue.empty() || 0 == m_active; });
+                if (m_queue.empty()) {
+                    return;
+                }
+                d = std::move(m_queue.front());
+                m_queue.pop_front();
+                ++m_active;
+            }
+
+            if (!m_failed) {
+                list(d);
+            }
+
+            std::lock_guard<std::mutex> lg{m_lock};
+            if (0 == --m_active && m_queue.empty()) {
+                m_cond.notify_all();
+            }
+        }
+    }
+
+    std::mutex m_lock;
+    std::condition_variable m_cond;
+    std::deque<dir_ptr> m_queue;
+    error_code m_ec; // first error
+    std::atomic<bool> m_failed;
+    unsigned m_active; // dirs being listed
+};
+
+// Runs fn(i) for [0, count) on up to nthreads threads (including the caller), 0 uses the hardware concurrency.
+// Indexes are claimed chunk at a time, so no more threads are started than there are chunks.
+// The first exception stops the remaining work and is rethrown once the threads are done.
+template <class Fn>
+void parallel_for(size_t count, unsigned nthreads, size_t chunk, Fn fn) {
+    if (0 == nthreads) {
+        nthreads = std::max(std::thread::hardware_concurrency(), 1U);
+    }
+    const auto chunks = (count + chunk - 1) / chunk;
+
+    std::atomic<size_t> next{0};
+    std::mutex lock;
+    std::exception_ptr error;
+    auto work = [&] {
+        try {
+            for (auto i = next.fetch_add(chunk); i < count; i = next.fetch_add(chunk)) {
+                const auto e = std::min(i + chunk, count);
+                for (; i < e; ++i) {
+                    fn(i);
+                }
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lg{lock};
+            if (!error) {
+                error = std::current_exception();
+            }
+            next = count;
+        }
+    };
+
+    std::vector<std::thread> workers;
+    try {
+        for (size_t t = 1; t < std::min<size_t>(nthreads, chunks); ++t) {
+            workers.emplace_back(work);
+        }
+    } catch (...) {
+        // The calling thread will process the remaining indexes.
+    }
+    work();
+    for (auto& t : workers) {
+        t.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+} // ifilesystem
+} // v1
+} // filesystem
+} // prosoft
+
+#endif // PS_CORE_BATCH_PRIVATE_HPP
@@ -0,0 +1,214 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include <prosoft/core/config/config.h>
+
+#include "fsconfig.h"
+
+#if !_WIN32
+#include <sys/errno.h>
+#include <sys/stat.h>
+#endif
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_canonical_cache.hpp>
+#include "filesystem_private.hpp"
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+path canonical_cache::canonical(const path& p) {
+    error_code ec;
+    path rp = canonical(p, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not create a canonical path", p, ec));
+    return rp;
+}
+
+path canonical_cache::canonical(const path& p, error_code& ec) {
+#if !_WIN32
+    ec.clear();
+    if (p.empty() || PS_TEXT('~') == p.native()[0]) {
+        return filesystem::canonical(p, ec);
+    }
+    if (p.is_absolute()) {
+        return resolve(p, ec);
+    }
+    const auto cwd = current_path(ec);
+    return !ec.value() ? resolve(absolute(p, cwd), ec) : path{p};
+#else
+    return filesystem::canonical(p, ec);
+#endif
+}
+
+void canonical_cache::clear() {
+    std::lock_guard<std::mutex> lg{m_lock};
+    m_dirs.clear();
+}
+
+size_t canonical_cache::size() const {
+    std::lock_guard<std::mutex> lg{m_lock};
+    return m_dirs.size();
+}
+
+#if !_WIN32
+namespace {
+
+#if PS_FS_HAVE_BSD_STATFS
+#define PS_ST_CTIM st_ctimespec
+#else
+#define PS_ST_CTIM st_ctim
+#endif
+
+std::int64_t to_ns(const struct ::timespec& ts) noexcept {
+    return std::int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+} // anon
+
+path canonical_cache::resolve(const path& p, error_code& ec) {
+    struct ::stat sb;
+    if (0 == ::lstat(p.c_str(), &sb)) {
+        if (S_ISLNK(sb.st_mode)) {
+            if (0 == ::stat(p.c_str(), &sb) && S_ISDIR(sb.st_mode)) {
+                return resolve_dir(p, stamp{std::uint64_t(sb.st_dev), std::uint64_t(sb.st_ino), to_ns(sb.PS_ST_CTIM)}, ec);
+            }
+            return filesystem::canonical(p, ec);
+        } else if (S_ISDIR(sb.st_mode)) {
+            return resolve_dir(p, stamp{std::uint64_t(sb.st_dev), std::uint64_t(sb.st_ino), to_ns(sb.PS_ST_CTIM)}, ec);
+        }
+    } else if (ENOENT != errno) {
+        ifilesystem::system_error(ec);
+        return path{p};
+    }
+    
+    // A non-dir or a missing path (resolved weakly as canonical() does).
+    static const path dot{PS_TEXT(".")};
+    static const path dotdot{PS_TEXT("..")};
+    const auto leaf = p.filename();
+    const auto parent = p.parent_path();
+    if (leaf.empty() || leaf == dot || leaf == dotdot || parent.empty() || parent == p) {
+        return filesystem::canonical(p, ec);
+    }
+    auto rp = resolve(parent, ec);
+    return !ec.value() ? rp / leaf : path{p};
+}
+
+path canonical_cache::resolve_dir(const path& p, const stamp& st, error_code& ec) {
+    {
+        std::lock_guard<std::mutex> lg{m_lock};
+        const auto i = m_dirs.find(p.native());
+        if (i != m_dirs.end()) {
+            const auto& cst = i->second.m_stamp;
+            if (cst.dev == st.dev && cst.ino == st.ino && cst.ctime == st.ctime) {
+                ++m_hits;
+                return i->second.m_path;
+            }
+        }
+    }
+    
+    ++m_misses;
+    auto rp = filesystem::canonical(p, ec);
+    if (!ec.value()) {
+        std::lock_guard<std::mutex> lg{m_lock};
+        m_dirs[p.native()] = value_type{st, rp};
+    }
+    return rp;
+}
+
+#undef PS_ST_CTIM
+#endif // !_WIN32
+
+} // v1
+} // filesystem
+} // prosoft
+
+#if PSTEST_HARNESS && !_WIN32
+// Internal tests.
+#include <catch2/catch_test_macros.hpp>
+#include "fstestutils.hpp"
+
+TEST_CASE("canonical_cache_internal") {
+    using namespace prosoft::filesystem;
+    
+    const auto root = canonical(temp_directory_path()) / process_name("fs17ccache");
+    const auto a = root / PS_TEXT("a");
+    const auto b = root / PS_TEXT("b");
+    const auto link = root / PS_TEXT("l");
+    const auto file = a / PS_TEXT("f");
+    REQUIRE(create_directories(a));
+    PS_RAII_REMOVE(root);
+    PS_RAII_REMOVE(a);
+    REQUIRE(create_directory(b));
+    PS_RAII_REMOVE(b);
+    create_file(file);
+    PS_RAII_REMOVE(file);
+    create_symlink(a, link);
+    PS_RAII_REMOVE(link);
+    
+    canonical_cache c;
+    
+    WHEN("resolving a path") {
+        for (const auto& p : {a, link, file, link / PS_TEXT("f"), link / PS_TEXT("missing") / PS_TEXT("x"), root / PS_TEXT("a") / PS_TEXT("..") / PS_TEXT("b")}) {
+            CHECK(c.canonical(p) == canonical(p));
+            CHECK(weakly_canonical(p, c) == canonical(p)); // cached
+        }
+        CHECK(c.hits() > 0);
+    }
+    
+    WHEN("a path is resolved again") {
+        CHECK(c.canonical(link / PS_TEXT("f")) == file);
+        CHECK(c.misses() == 1);
+        CHECK(c.canonical(link / PS_TEXT("f")) == file);
+        CHECK(c.hits() == 1);
+        CHECK(c.misses() == 1);
+        CHECK(c.size() == 1);
+    }
+    
+    WHEN("a symlink is retargeted") {
+        CHECK(c.canonical(link) == a);
+        REQUIRE(remove(link));
+        create_symlink(b, link);
+        CHECK(c.canonical(link) == b);
+        CHECK(c.misses() == 2);
+        c.clear();
+        CHECK(c.size() == 0);
+    }
+    
+    WHEN("iterating with followed symlinks") {
+        const auto cache = std::make_shared<canonical_cache>();
+        ifilesystem::iterator_config cfg;
+        cfg.canonical_cache = cache;
+        error_code ec;
+        size_t n = 0;
+        for (const auto& e : recursive_directory_iterator{root, directory_options::follow_directory_symlink, std::move(cfg), ec}) {
+            (void)e;
+            ++n;
+        }
+        CHECK_FALSE(ec);
+        CHECK(n == 5); // a, a/f, b, l and l's f
+        CHECK(cache->size() == 1);
+    }
+}
+#endif // PSTEST_HARNESS
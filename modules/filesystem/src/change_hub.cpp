@@ -0,0 +1,792 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include <prosoft/core/config/config_platform.h>
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_change_hub.hpp>
+
+#if PS_HAVE_FILESYSTEM_CHANGE_MONITOR
+
+#include <pthread.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "filesystem_private.hpp"
+#include "fsmonitor_private.hpp"
+
+// Each system monitor (source) has a prefix tree of the paths registered with it, relative to its root.
+// An event visits the recursive registrations along its path and the non-recursive registrations of its path and parent.
+// Matching events are copied to each registration's pending events, which the hub thread delivers once its latency expires.
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+constexpr auto always = fs::change_event::rescan_required|fs::change_event::outside_tree;
+
+// The root is stored without a trailing separator so "/" is the empty string.
+std::string root_key(const fs::path& p) {
+    std::string key{p.c_str()};
+    return key != "/" ? key : std::string{};
+}
+
+// true if p is dir or is contained by dir
+bool is_within(const std::string& p, const std::string& dir) {
+    return p.compare(0, dir.size(), dir) == 0 && (p.size() == dir.size() || p[dir.size()] == '/');
+}
+
+class hub_registration : public fs::change_state {
+public:
+    using latency_type = fs::change_config::latency_type;
+    
+    std::weak_ptr<fs::change_hub_state> m_hub;
+    fs::change_callback m_callback;
+    fs::path m_root;
+    std::string m_key;
+    // Guarded by the hub lock.
+    fs::change_notifications m_pending;
+    clock_type::time_point m_deadline;
+    std::uint64_t m_source;
+    std::uint64_t m_mark; // last event that matched
+    latency_type m_latency;
+    fs::change_event m_events;
+    std::atomic<std::uint64_t> m_collapsed;
+    std::atomic<std::uint64_t> m_dropped;
+    size_t m_maxpending;
+    bool m_recursive;
+    bool m_canceled;
+    bool m_coalesce; // source monitors are shared so they can't fold events
+    
+    hub_registration(const fs::path& p, const fs::change_config& cfg, bool recursive)
+        : m_hub()
+        , m_callback()
+        , m_root(p)
+        , m_key(root_key(p))
+        , m_deadline()
+        , m_source(0)
+        , m_mark(0)
+        , m_latency(cfg.notification_latency)
+        , m_events(cfg.events)
+        , m_collapsed(0)
+        , m_dropped(0)
+        , m_maxpending(cfg.max_pending_events)
+        , m_recursive(recursive)
+        , m_canceled(false)
+        , m_coalesce(cfg.coalesce_events) {}
+    virtual ~hub_registration() = default;
+    
+    virtual fs::change_counters counters() const override {
+        return fs::change_counters{m_collapsed.load(), m_dropped.load()};
+    }
+    
+    bool add(const fs::change_notification&, const fs::path& p, clock_type::time_point);
+    bool add(const fs::change_notification& n, clock_type::time_point now) {
+        return add(n, n.path(), now);
+    }
+    bool root_changed(const fs::change_notification&, const std::string& from, clock_type::time_point);
+    
+    fs::change_notifications flush() {
+        auto notes = std::move(m_pending);
+        m_pending.clear();
+        if (m_coalesce) {
+            fs::change_manager::coalesce(notes);
+        }
+        const auto cc = fs::change_manager::collapse(notes, m_root, m_maxpending);
+        m_collapsed += cc.collapsed;
+        m_dropped += cc.dropped;
+        return notes;
+    }
+    
+private:
+    void arm(clock_type::time_point now) {
+        if (m_pending.empty()) {
+            m_deadline = now + m_latency;
+        }
+    }
+};
+
+using shared_registration = std::shared_ptr<hub_registration>;
+
+bool hub_registration::add(const fs::change_notification& n, const fs::path& p, clock_type::time_point now) {
+    if (m_canceled) {
+        return false;
+    }
+    
+    const auto ev = n.event() & (m_events|always);
+    if (!is_set(ev & (m_events|fs::change_event::rescan_required))) {
+        return false;
+    }
+    
+    arm(now);
+    fs::change_manager::emplace_back(m_pending, fs::path{p}, fs::path{n.renamed_to_path()}, this, n.event_id(), ev, n.type());
+    if (canceled(n)) {
+        m_canceled = true;
+    }
+    return true;
+}
+
+// The registered path (or a parent) was removed or renamed, which cancels the registration just as it would a system monitor.
+bool hub_registration::root_changed(const fs::change_notification& n, const std::string& from, clock_type::time_point now) {
+    if (m_canceled) {
+        return false;
+    }
+    
+    auto ev = fs::change_event::canceled | (n.event() & (fs::change_event::removed|fs::change_event::renamed|fs::change_event::rescan));
+    fs::path np;
+    if (!n.renamed_to_path().empty()) {
+        np = n.renamed_to_path();
+        np += fs::path{m_key.substr(from.size())};
+    } else {
+        ev |= fs::change_event::rescan;
+    }
+    
+    arm(now);
+    fs::change_manager::emplace_back(m_pending, fs::path{m_root}, std::move(np), this, n.event_id(), ev, fs::file_type::none);
+    m_canceled = true;
+    return true;
+}
+
+struct hub_node {
+    std::unordered_map<std::string, std::unique_ptr<hub_node>> m_children;
+    std::vector<hub_registration*> m_recursive;
+    std::vector<hub_registration*> m_direct;
+    
+    bool empty() const noexcept {
+        return m_children.empty() && m_recursive.empty() && m_direct.empty();
+    }
+    
+    template <class Fn>
+    void visit(Fn&& fn) const {
+        for (auto r : m_recursive) {
+            fn(r);
+        }
+        for (auto r : m_direct) {
+            fn(r);
+        }
+        for (const auto& c : m_children) {
+            c.second->visit(fn);
+        }
+    }
+};
+
+// Calls fn(component) for each component of p below the root.
+template <class Fn>
+bool each_component(const std::string& p, const std::string& root, Fn&& fn) {
+    size_t pos = root.size();
+    while (pos < p.size()) {
+        ++pos; // separator
+        auto next = p.find('/', pos);
+        if (next == std::string::npos) {
+            next = p.size();
+        }
+        if (!fn(p.substr(pos, next - pos), next == p.size())) {
+            return false;
+        }
+        pos = next;
+    }
+    return true;
+}
+
+class hub_source {
+    hub_node m_trie;
+public:
+    fs::change_registration m_reg;
+    std::string m_key;
+    std::uint64_t m_id;
+    size_t m_count;
+    fs::change_config::latency_type m_latency;
+    fs::change_event m_events;
+    fs::change_monitor_backend m_backend;
+    bool m_recursive;
+    bool m_canceled;
+    
+    hub_source(const std::string& key, const fs::change_config& cfg, bool recursive, std::uint64_t id)
+        : m_trie()
+        , m_reg()
+        , m_key(key)
+        , m_id(id)
+        , m_count(0)
+        , m_latency(cfg.notification_latency)
+        , m_events(cfg.events)
+        , m_backend(cfg.backend)
+        , m_recursive(recursive)
+        , m_canceled(false) {}
+    
+    bool serves(const hub_registration& r, const fs::change_config& cfg) const {
+        return !m_canceled
+            && m_backend == cfg.backend
+            && m_latency <= cfg.notification_latency
+            && (m_events & cfg.events) == cfg.events
+            && (m_recursive ? is_within(r.m_key, m_key) : !r.m_recursive && r.m_key == m_key);
+    }
+    
+    void insert(hub_registration*);
+    void erase(hub_registration*);
+    
+    // Calls fn for the registrations interested in p.
+    template <class Fn>
+    void match(const std::string& p, Fn&& fn) const;
+    
+    // Calls fn for the registrations of p and its descendants.
+    template <class Fn>
+    void below(const std::string& p, Fn&& fn) const;
+};
+
+void hub_source::insert(hub_registration* r) {
+    auto node = &m_trie;
+    each_component(r->m_key, m_key, [&node](std::string&& c, bool) {
+        auto& child = node->m_children[c];
+        if (!child) {
+            child.reset(new hub_node);
+        }
+        node = child.get();
+        return true;
+    });
+    (r->m_recursive ? node->m_recursive : node->m_direct).push_back(r);
+}
+
+void hub_source::erase(hub_registration* r) {
+    std::vector<std::pair<hub_node*, std::string>> path; // parent, component
+    auto node = &m_trie;
+    const bool found = each_component(r->m_key, m_key, [&node, &path](std::string&& c, bool) {
+        auto i = node->m_children.find(c);
+        if (i == node->m_children.end()) {
+            return false;
+        }
+        path.emplace_back(node, std::move(c));
+        node = i->second.get();
+        return true;
+    });
+    if (!found) {
+        return;
+    }
+    
+    auto& regs = r->m_recursive ? node->m_recursive : node->m_direct;
+    regs.erase(std::remove(regs.begin(), regs.end(), r), regs.end());
+    // prune empty nodes
+    for (auto i = path.rbegin(); i != path.rend() && node->empty(); ++i) {
+        node = i->first;
+        node->m_children.erase(i->second);
+    }
+}
+
+template <class Fn>
+void hub_source::match(const std::string& p, Fn&& fn) const {
+    if (!is_within(p, m_key)) {
+        return;
+    }
+    
+    const hub_node* node = &m_trie;
+    const hub_node* parent = nullptr;
+    for (auto r : node->m_recursive) {
+        fn(r);
+    }
+    const bool found = each_component(p, m_key, [&](std::string&& c, bool last) {
+        auto i = node->m_children.find(c);
+        if (i == node->m_children.end()) {
+            if (last) {
+                for (auto r : node->m_direct) {
+                    fn(r);
+                }
+            }
+            return false;
+        }
+        parent = node;
+        node = i->second.get();
+        for (auto r : node->m_recursive) {
+            fn(r);
+        }
+        return true;
+    });
+    if (found) {
+        for (auto r : node->m_direct) {
+            fn(r);
+        }
+        if (parent) {
+            for (auto r : parent->m_direct) {
+                fn(r);
+            }
+        }
+    }
+}
+
+template <class Fn>
+void hub_source::below(const std::string& p, Fn&& fn) const {
+    if (!is_within(p, m_key)) {
+        return;
+    }
+    
+    const hub_node* node = &m_trie;
+    const bool found = each_component(p, m_key, [&node](std::string&& c, bool) {
+        auto i = node->m_children.find(c);
+        if (i == node->m_children.end()) {
+            return false;
+        }
+        node = i->second.get();
+        return true;
+    });
+    if (found) {
+        node->visit(fn);
+    }
+}
+
+} // anon
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+class change_hub_state : public std::enable_shared_from_this<change_hub_state> {
+    std::mutex m_setup; // serializes registration changes, acquired before m_lock
+    mutable std::mutex m_lock;
+    std::condition_variable m_cv;
+    std::vector<std::unique_ptr<hub_source>> m_sources;
+    std::vector<shared_registration> m_registrations;
+    std::thread m_thread;
+    std::uint64_t m_nextid;
+    std::uint64_t m_mark;
+    bool m_stop;
+    
+    using guard = std::unique_lock<std::mutex>;
+    
+    hub_source* find(std::uint64_t id) const;
+    hub_source* find(const hub_registration&, const change_config&) const;
+    bool registered(const hub_registration*) const;
+    void run();
+    
+public:
+    change_hub_state()
+        : m_nextid(0)
+        , m_mark(0)
+        , m_stop(false) {}
+    ~change_hub_state() = default;
+    PS_DISABLE_COPY(change_hub_state);
+    PS_DISABLE_MOVE(change_hub_state);
+    
+    void start();
+    void stop();
+    
+    change_registration add(const path&, const change_config&, change_callback&&, bool recursive, error_code&);
+    void remove(hub_registration*, error_code&);
+    void dispatch(std::uint64_t source, change_notifications&&);
+    
+    size_t monitors() const {
+        guard lg{m_lock};
+        return m_sources.size();
+    }
+};
+
+hub_source* change_hub_state::find(std::uint64_t id) const {
+    auto i = std::find_if(m_sources.begin(), m_sources.end(), [id](const std::unique_ptr<hub_source>& s) {
+        return s->m_id == id;
+    });
+    return i != m_sources.end() ? i->get() : nullptr;
+}
+
+hub_source* change_hub_state::find(const hub_registration& r, const change_config& cfg) const {
+    auto i = std::find_if(m_sources.begin(), m_sources.end(), [&r, &cfg](const std::unique_ptr<hub_source>& s) {
+        return s->serves(r, cfg);
+    });
+    return i != m_sources.end() ? i->get() : nullptr;
+}
+
+bool change_hub_state::registered(const hub_registration* r) const {
+    return m_registrations.end() != std::find_if(m_registrations.begin(), m_registrations.end(), [r](const shared_registration& sr) {
+        return sr.get() == r;
+    });
+}
+
+void change_hub_state::start() {
+    m_thread = std::thread{[self = shared_from_this()]() {
+#if __APPLE__
+        pthread_setname_np("change_hub");
+#else
+        pthread_setname_np(pthread_self(), "change_hub");
+#endif
+        self->run();
+    }};
+}
+
+void change_hub_state::stop() {
+    {
+        guard lg{m_lock};
+        m_stop = true;
+    }
+    m_cv.notify_one();
+    if (m_thread.joinable()) {
+        if (m_thread.get_id() != std::this_thread::get_id()) {
+            m_thread.join();
+        } else {
+            m_thread.detach(); // the hub was destroyed by a callback
+        }
+    }
+    
+    std::vector<change_registration> regs;
+    std::vector<shared_registration> hubregs; // released outside of the lock
+    {
+        guard sl{m_setup};
+        guard lg{m_lock};
+        for (auto& s : m_sources) {
+            regs.push_back(std::move(s->m_reg));
+        }
+        m_sources.clear();
+        hubregs.swap(m_registrations);
+    }
+    for (auto& reg : regs) {
+        error_code ignored;
+        fs::stop(reg, ignored);
+    }
+}
+
+change_registration change_hub_state::add(const path& p, const change_config& cfg, change_callback&& cb, bool recursive, error_code& ec) {
+    if (p.empty() || !valid(cfg) || !cb || cfg.state || cfg.journal) {
+        ec = einval();
+        return change_registration{};
+    }
+    
+    const auto cp = canonical(p, ec);
+    if (ec) {
+        return change_registration{};
+    }
+    
+    auto r = std::make_shared<hub_registration>(cp, cfg, recursive);
+    r->m_hub = shared_from_this();
+    r->m_callback = std::move(cb);
+    
+    guard sl{m_setup};
+    auto source = find(*r, cfg);
+    if (!source) {
+        std::unique_ptr<hub_source> ns{new hub_source{r->m_key, cfg, recursive, ++m_nextid}};
+        source = ns.get();
+        {
+            guard lg{m_lock};
+            m_sources.push_back(std::move(ns));
+        }
+        
+        change_config scfg{cfg.events};
+        scfg.notification_latency = cfg.notification_latency;
+        scfg.backend = cfg.backend;
+        std::weak_ptr<change_hub_state> wp = shared_from_this();
+        auto scb = [wp, id = source->m_id](change_notifications&& notes) {
+            if (auto hs = wp.lock()) {
+                hs->dispatch(id, std::move(notes));
+            }
+        };
+#if PS_HAVE_RECURISIVE_FILESYSTEM_CHANGE_MONITOR
+        auto sreg = recursive ? fs::recursive_monitor(cp, scfg, std::move(scb), ec) : fs::monitor(cp, scfg, std::move(scb), ec);
+#else
+        auto sreg = fs::monitor(cp, scfg, std::move(scb), ec);
+#endif
+        if (ec) {
+            guard lg{m_lock};
+            m_sources.erase(std::find_if(m_sources.begin(), m_sources.end(), [source](const std::unique_ptr<hub_source>& s) {
+                return s.get() == source;
+            }));
+            return change_registration{};
+        }
+        source->m_reg = std::move(sreg);
+    }
+    
+    {
+        guard lg{m_lock};
+        source->insert(r.get());
+        ++source->m_count;
+        r->m_source = source->m_id;
+        m_registrations.push_back(r);
+    }
+    ec.clear();
+    return change_manager::make_registration(r);
+}
+
+void change_hub_state::remove(hub_registration* r, error_code& ec) {
+    shared_registration sr; // released outside of the lock
+    change_registration reg; // stopped outside of the lock
+    guard sl{m_setup};
+    {
+        guard lg{m_lock};
+        auto i = std::find_if(m_registrations.begin(), m_registrations.end(), [r](const shared_registration& x) {
+            return x.get() == r;
+        });
+        if (i == m_registrations.end()) {
+            ec = error_code{ENOENT, std::system_category()};
+            return;
+        }
+        sr = std::move(*i);
+        m_registrations.erase(i);
+        
+        if (auto source = find(r->m_source)) {
+            source->erase(r);
+            if (--source->m_count == 0) {
+                reg = std::move(source->m_reg);
+                m_sources.erase(std::find_if(m_sources.begin(), m_sources.end(), [source](const std::unique_ptr<hub_source>& s) {
+                    return s.get() == source;
+                }));
+            }
+        }
+    }
+    
+    if (reg) {
+        fs::stop(reg, ec);
+    } else {
+        ec.clear();
+    }
+}
+
+void change_hub_state::dispatch(std::uint64_t id, change_notifications&& notes) {
+    bool wake = false;
+    {
+        guard lg{m_lock};
+        auto source = find(id);
+        if (!source) {
+            return; // stopped
+        }
+        
+        const auto now = clock_type::now();
+        for (const auto& n : notes) {
+            const std::string p{n.path().c_str()};
+            if (canceled(n)) {
+                source->m_canceled = true; // not shared with new registrations
+                source->below(source->m_key, [&](hub_registration* r) {
+                    wake |= is_within(r->m_key, p) ? r->root_changed(n, p, now) : r->add(n, r->m_root, now);
+                });
+                continue;
+            }
+            
+            const auto mark = ++m_mark;
+            if (is_set(n.event() & (change_event::removed|change_event::renamed))) {
+                source->below(p, [&](hub_registration* r) {
+                    r->m_mark = mark;
+                    wake |= r->root_changed(n, p, now);
+                });
+            } else if (rescan(n)) {
+                source->below(p, [&](hub_registration* r) {
+                    r->m_mark = mark;
+                    wake |= r->add(n, r->m_root, now);
+                });
+            }
+            
+            auto visit = [&](hub_registration* r) {
+                if (r->m_mark != mark) {
+                    r->m_mark = mark;
+                    wake |= r->add(n, now);
+                }
+            };
+            source->match(p, visit);
+            if (!n.renamed_to_path().empty()) {
+                source->match(n.renamed_to_path().c_str(), visit);
+            }
+        }
+    }
+    
+    if (wake) {
+        m_cv.notify_one();
+    }
+}
+
+void change_hub_state::run() {
+    std::vector<std::pair<shared_registration, change_notifications>> ready;
+    guard lg{m_lock};
+    while (!m_stop) {
+        auto next = clock_type::time_point::max();
+        for (const auto& r : m_registrations) {
+            if (!r->m_pending.empty()) {
+                next = std::min(next, r->m_deadline);
+            }
+        }
+        const auto now = clock_type::now();
+        if (next > now) {
+            if (next == clock_type::time_point::max()) {
+                m_cv.wait(lg);
+            } else {
+                m_cv.wait_until(lg, next);
+            }
+            continue;
+        }
+        
+        for (const auto& r : m_registrations) {
+            if (!r->m_pending.empty() && r->m_deadline <= now) {
+                ready.emplace_back(r, r->flush());
+            }
+        }
+        
+        lg.unlock();
+        for (auto& r : ready) {
+            {
+                guard rl{m_lock};
+                if (!registered(r.first.get())) { // may have been stopped
+                    continue;
+                }
+            }
+            PSIgnoreCppException(r.first->m_callback(std::move(r.second)));
+        }
+        ready.clear();
+        lg.lock();
+    }
+}
+
+// public
+
+change_hub::change_hub()
+    : m_state(std::make_shared<change_hub_state>()) {
+    m_state->start();
+}
+
+change_hub::~change_hub() {
+    m_state->stop();
+}
+
+change_registration change_hub::monitor(const path& p, const change_config& cfg, change_callback cb, error_code& ec) {
+    return m_state->add(p, cfg, std::move(cb), false, ec);
+}
+
+change_registration change_hub::monitor(const path& p, const change_config& cfg, change_callback cb) {
+    error_code ec;
+    auto reg = monitor(p, cfg, std::move(cb), ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Failed to create change monitor", p, ec));
+    return reg;
+}
+
+#if PS_HAVE_RECURISIVE_FILESYSTEM_CHANGE_MONITOR
+change_registration change_hub::recursive_monitor(const path& p, const change_config& cfg, change_callback cb, error_code& ec) {
+    return m_state->add(p, cfg, std::move(cb), true, ec);
+}
+
+change_registration change_hub::recursive_monitor(const path& p, const change_config& cfg, change_callback cb) {
+    error_code ec;
+    auto reg = recursive_monitor(p, cfg, std::move(cb), ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Failed to create change monitor", p, ec));
+    return reg;
+}
+#endif
+
+size_t change_hub::monitors() const {
+    return m_state->monitors();
+}
+
+// private
+
+bool stop_hub_registration(change_state* state, error_code& ec) {
+    PSASSERT_NOTNULL(state);
+    auto r = dynamic_cast<hub_registration*>(state);
+    if (!r) {
+        return false;
+    }
+    
+    if (auto hs = r->m_hub.lock()) {
+        hs->remove(r, ec);
+    } else {
+        ec = error_code{ENOENT, std::system_category()};
+    }
+    return true;
+}
+
+} // v1
+} // filesystem
+} // prosoft
+
+#if PSTEST_HARNESS
+// Internal tests.
+#include <catch2/catch_test_macros.hpp>
+#include "fstestutils.hpp"
+
+using namespace prosoft::filesystem;
+
+TEST_CASE("change_hub_internal") {
+    change_config cfg;
+    hub_registration root{path{"/a"}, cfg, true};
+    hub_registration sub{path{"/a/b/c"}, cfg, true};
+    hub_registration direct{path{"/a/b"}, cfg, false};
+    hub_source source{root_key(path{"/a"}), cfg, true, 1};
+    source.insert(&root);
+    source.insert(&sub);
+    source.insert(&direct);
+    
+    auto matches = [&source](const char* p) {
+        std::vector<hub_registration*> v;
+        source.match(p, [&v](hub_registration* r) {
+            v.push_back(r);
+        });
+        return v;
+    };
+    
+    auto below = [&source](const char* p) {
+        std::vector<hub_registration*> v;
+        source.below(p, [&v](hub_registration* r) {
+            v.push_back(r);
+        });
+        return v;
+    };
+    
+    WHEN("matching paths") {
+        CHECK(matches("/a") == std::vector<hub_registration*>{&root});
+        CHECK(matches("/a/x") == std::vector<hub_registration*>{&root});
+        CHECK(matches("/a/b") == std::vector<hub_registration*>({&root, &direct}));
+        CHECK(matches("/a/b/x") == std::vector<hub_registration*>({&root, &direct}));
+        CHECK(matches("/a/b/x/y") == std::vector<hub_registration*>{&root});
+        CHECK(matches("/a/b/c") == std::vector<hub_registration*>({&root, &sub, &direct}));
+        CHECK(matches("/a/b/c/d/e") == std::vector<hub_registration*>({&root, &sub}));
+        CHECK(matches("/ab").empty());
+        CHECK(matches("/x").empty());
+    }
+    
+    WHEN("matching descendants") {
+        CHECK(below("/a/b").size() == 2);
+        CHECK(below("/a/b/c") == std::vector<hub_registration*>{&sub});
+        CHECK(below("/a/b/x").empty());
+    }
+    
+    WHEN("removing registrations") {
+        source.erase(&sub);
+        CHECK(matches("/a/b/c/d") == std::vector<hub_registration*>{&root});
+        source.erase(&direct);
+        CHECK(below("/a/b").empty());
+        CHECK(matches("/a/b") == std::vector<hub_registration*>{&root});
+    }
+    
+    WHEN("the root is /") {
+        hub_source top{root_key(path{"/"}), cfg, true, 2};
+        hub_registration all{path{"/"}, cfg, true};
+        top.insert(&sub);
+        top.insert(&all);
+        std::vector<hub_registration*> v;
+        top.match("/a/b/c/d", [&v](hub_registration* r) {
+            v.push_back(r);
+        });
+        CHECK(v == std::vector<hub_registration*>({&all, &sub}));
+    }
+}
+
+#endif // PSTEST_HARNESS
+
+#endif // PS_HAVE_FILESYSTEM_CHANGE_MONITOR
@@ -25,7 +25,10 @@
 
 #include <prosoft/core/config/config_platform.h>
 
+#include <algorithm>
 #include <atomic>
+#include <memory>
+#include <mutex>
 #include <thread>
 #include <unordered_set>
 
@@ -67,6 +70,13 @@ notification_ptr call(fs::change_iterator_config::filter_type f, notification_pt
     return p && f && !f(*p) ? nullptr : p;
 }
 
+notification_ptr match(const fs::path_filter* f, notification_ptr p) {
+    if (p && f && !required(p->event()) && !(*f)(p->path()) && (p->renamed_to_path().empty() || !(*f)(p->renamed_to_path()))) {
+        return nullptr;
+    }
+    return p;
+}
+
 notification_ptr call(const fs::change_iterator_config::filters_type& fl, notification_ptr p) {
     if (p && !required(p->event())) {
         for (auto f : fl) {
@@ -78,22 +88,120 @@ notification_ptr call(const fs::change_iterator_config::filters_type& fl, notifi
     return p;
 }
 
+// Multiple producers (monitor callbacks), single consumer (the iterator).
+// A producer pushes a whole batch with a single CAS and the consumer takes everything at once, so neither side ever waits on the other.
+class path_queue {
+    struct node {
+        fs::path m_path;
+        node* m_next;
+    };
+    
+    std::atomic<node*> m_head{nullptr}; // newest first
+    
+    static void release(node* n) noexcept {
+        while (n) {
+            auto next = n->m_next;
+            delete n;
+            n = next;
+        }
+    }
+    
+public:
+    class batch {
+        node* m_first = nullptr; // newest
+        node* m_last = nullptr;
+        friend path_queue;
+    public:
+        batch() = default;
+        ~batch() {
+            release(m_first);
+        }
+        PS_DISABLE_COPY(batch);
+        PS_DISABLE_MOVE(batch);
+        
+        void push(fs::path&& p) {
+            m_first = new node{std::move(p), m_first};
+            if (!m_last) {
+                m_last = m_first;
+            }
+        }
+        
+        bool empty() const noexcept {
+            return !m_first;
+        }
+        
+        void clear() noexcept {
+            release(m_first);
+            m_first = m_last = nullptr;
+        }
+    };
+    
+    path_queue() = default;
+    ~path_queue() {
+        release(m_head.exchange(nullptr));
+    }
+    PS_DISABLE_COPY(path_queue);
+    PS_DISABLE_MOVE(path_queue);
+    
+    void push(batch& b) noexcept {
+        if (b.empty()) {
+            return;
+        }
+        auto head = m_head.load(std::memory_order_relaxed);
+        do {
+            b.m_last->m_next = head;
+        } while (!m_head.compare_exchange_weak(head, b.m_first, std::memory_order_release, std::memory_order_relaxed));
+        b.m_first = b.m_last = nullptr;
+    }
+    
+    // Consumer only. Paths are passed in the order they were pushed.
+    template <class Fn>
+    void consume(Fn&& f) {
+        auto n = m_head.exchange(nullptr, std::memory_order_acquire);
+        node* fifo = nullptr;
+        while (n) {
+            auto next = n->m_next;
+            n->m_next = fifo;
+            fifo = n;
+            n = next;
+        }
+        while (fifo) {
+            std::unique_ptr<node> cur{fifo};
+            fifo = fifo->m_next;
+            f(std::move(cur->m_path));
+        }
+    }
+    
+    bool empty() const noexcept {
+        return !m_head.load(std::memory_order_acquire);
+    }
+};
+
 using fsiterator_state = fs::ifilesystem::iterator_state;
 using fsiterator_cache = fs::ifilesystem::cache_info;
 
 struct test_state; // for testing
 
 class state : public fsiterator_state {
-    using lock_type = std::mutex;
-    using lock_guard = std::lock_guard<lock_type>;
     using callback_type = decltype(fs::change_iterator_config::callback);
     
+    // Never reassigned after construction as the consumer may read it while the monitor thread aborts.
     fs::change_registration m_reg;
-    lock_type mutable m_lock;
+    path_queue m_queue;
+    // Consumer only, duplicate changes are merged here.
     std::unordered_set<prosoft::stable_hash_wrapper<fs::path>> m_entries;
+    std::atomic<size_t> m_count{0}; // queued + entries
+    std::atomic<std::uint64_t> m_dropped{0};
+    size_t m_maxpending = 0;
     std::atomic_bool m_done{false}; // no more events will be received
+    // The monitor's counters are gone once it's stopped, so they are saved here first.
+    std::atomic<std::uint64_t> m_stopped_collapsed{0};
+    std::atomic<std::uint64_t> m_stopped_dropped{0};
+    std::atomic_bool m_stopped{false};
+    std::mutex m_stoplock;
     callback_type m_callback;
     fs::change_iterator_config::filters_type m_filters;
+    fs::path_filter_ptr m_filter;
     
     static notification_ptr filter(fs::change_notification& n, fs::change_event ev) {
         return is_set(n.event() & ev) ? &n : nullptr;
@@ -101,10 +209,12 @@ class state : public fsiterator_state {
     static void filter(fs::change_notification&&, fs::change_event) = delete;
     
     notification_ptr PS_ALWAYS_INLINE filter(notification_ptr p) {
-        return call(m_filters, p);
+        return call(m_filters, match(m_filter.get(), p));
     }
     
-    void add(notification_ptr);
+    void add(fs::change_notifications&, fs::change_event);
+    
+    void drain();
     
     void abort() noexcept;
     
@@ -128,6 +238,7 @@ public:
     }
     
     extraction_type extract();
+    extraction_type next_n(size_t);
     
     virtual fs::path next(fsiterator_cache&, prosoft::system::error_code&) override;
     virtual bool at_end() const override;
@@ -135,6 +246,15 @@ public:
     std::string serialize() const {
         return m_reg.serialize();
     }
+    
+    fs::change_counters counters() const {
+        auto cc = m_reg.counters();
+        if (m_stopped) { // the monitor may have been stopped while reading its counters
+            cc = fs::change_counters{m_stopped_collapsed.load(), m_stopped_dropped.load()};
+        }
+        cc.dropped += m_dropped;
+        return cc;
+    }
 };
 
 state::state(const fs::path& p, fs::directory_options opts, fs::change_iterator_config&& c, fs::error_code& ec)
@@ -143,6 +263,8 @@ state::state(const fs::path& p, fs::directory_options opts, fs::change_iterator_
     if (!ec) {
         m_callback = std::move(c.callback);
         m_filters = std::move(c.filters);
+        m_filter = std::move(c.filter);
+        m_maxpending = c.max_pending;
         
         using namespace fs;
         const auto events = to_events(opts);
@@ -150,10 +272,10 @@ state::state(const fs::path& p, fs::directory_options opts, fs::change_iterator_
         auto state = change_state::serialize(c.serialize_data);
         cfg.state = state.get();
         cfg.notification_latency = std::chrono::duration_cast<change_config::latency_type>(c.latency);
+        cfg.max_pending_events = c.max_pending;
+        cfg.backend = c.backend;
         m_reg = recursive_monitor(p, cfg, [this, events](change_notifications&& notes) {
-            for (auto& n : notes) {
-                add(filter(filter(n, events)));
-            }
+            add(notes, events);
         }, ec);
     }
 }
@@ -162,27 +284,61 @@ state::~state() {
     abort();
 }
 
-void state::add(notification_ptr np) {
+void state::add(fs::change_notifications& notes, fs::change_event events) {
     using namespace fs;
-    if (np) {
-        auto& n = *np;
-        if (rescan(n) || canceled(n)) {
-            m_done = true;
-            abort();
-            notify();
-            return;
-        }
-        
-        {
-            lock_guard lg{m_lock};
-            m_entries.emplace(n.extract_path());
+    path_queue::batch b;
+    size_t count = 0;
+    bool end = false;
+    for (auto& n : notes) {
+        if (auto np = filter(filter(n, events))) {
+            if (rescan(*np) || canceled(*np)) {
+                end = true;
+                break;
+            }
+            b.push(np->extract_path());
+            ++count;
         }
+    }
+    
+    if (m_maxpending > 0 && m_count + count > m_maxpending) {
+        // The consumer can't keep up, it will have to rescan.
+        m_dropped += count;
+        count = 0;
+        end = true;
+        b.clear();
+    }
+    
+    const bool added = count > 0;
+    m_count += count;
+    m_queue.push(b);
+    if (end) {
+        m_done = true;
+        abort();
+    }
+    if (added || end) {
         notify();
     }
 }
 
+void state::drain() {
+    m_queue.consume([this](fs::path&& p) {
+        if (!m_entries.emplace(std::move(p)).second) {
+            --m_count;
+        }
+    });
+}
+
 void state::abort() noexcept {
-    fs::unique_change_registration u{std::move(m_reg)};
+    std::lock_guard<std::mutex> lg{m_stoplock};
+    if (m_stopped || !m_reg) {
+        return;
+    }
+    const auto cc = m_reg.counters();
+    m_stopped_collapsed = cc.collapsed;
+    m_stopped_dropped = cc.dropped;
+    m_stopped = true;
+    fs::error_code ec;
+    PSIgnoreCppException(fs::stop(m_reg, ec));
 }
 
 void state::notify() noexcept {
@@ -192,36 +348,46 @@ void state::notify() noexcept {
 }
 
 extraction_type state::extract() {
+    drain();
     extraction_type paths;
-    lock_guard lg{m_lock};
+    paths.reserve(m_entries.size());
     for (auto& e : m_entries) {
         paths.emplace_back(e.extract());
     }
     m_entries.clear();
+    m_count -= paths.size();
+    return paths;
+}
+
+extraction_type state::next_n(size_t n) {
+    drain();
+    extraction_type paths;
+    paths.reserve(std::min(n, m_entries.size()));
+    for (auto i = m_entries.begin(); i != m_entries.end() && paths.size() < n;) {
+        paths.emplace_back(i->extract());
+        i = m_entries.erase(i);
+    }
+    m_count -= paths.size();
     return paths;
 }
 
 fs::path state::next(fsiterator_cache&, prosoft::system::error_code&) {
-    {
-        lock_guard lg{m_lock};
-        if (!m_entries.empty()) {
-            auto i = m_entries.begin();
-            fs::path p{i->extract()};
-            m_entries.erase(i);
-            return p;
-        }
+    if (m_entries.empty()) {
+        drain();
+    }
+    if (!m_entries.empty()) {
+        auto i = m_entries.begin();
+        fs::path p{i->extract()};
+        m_entries.erase(i);
+        --m_count;
+        return p;
     }
     return fs::path{};
 }
 
 bool state::at_end() const {
-    const bool empty = is_current_empty();
-    if (empty && m_done) {
-        lock_guard lg{m_lock};
-        return m_entries.empty();
-    } else {
-        return false;
-    }
+    // m_done is set after the last push.
+    return is_current_empty() && m_done && m_queue.empty() && m_entries.empty();
 }
 
 constexpr auto make_opts_required = fs::directory_options::include_created_events|fs::directory_options::include_modified_events;
@@ -270,6 +436,11 @@ extraction_type ifilesystem::change_iterator_traits::extract_paths(basic_iterato
     return p ? p->extract() : extraction_type{};
 }
 
+extraction_type ifilesystem::change_iterator_traits::extract_paths(basic_iterator<change_iterator_traits>& i, size_t max) {
+    auto p = reinterpret_cast<state*>(i.m_i.get());
+    return p ? p->next_n(max) : extraction_type{};
+}
+
 ifilesystem::change_iterator_traits::serialize_type
 ifilesystem::change_iterator_traits::serialize(const basic_iterator<change_iterator_traits>& i) {
     if (auto p = reinterpret_cast<const state*>(i.m_i.get())) {
@@ -278,6 +449,17 @@ ifilesystem::change_iterator_traits::serialize(const basic_iterator<change_itera
     return "";
 }
 
+change_counters ifilesystem::change_iterator_traits::counters(const basic_iterator<change_iterator_traits>& i) {
+    if (auto p = reinterpret_cast<const state*>(i.m_i.get())) {
+        return p->counters();
+    }
+    return change_counters{};
+}
+
+change_counters counters(const ifilesystem::change_iterator_t& i) {
+    return ifilesystem::change_iterator_traits::counters(i);
+}
+
 } // v1
 } // filesystem
 } // prosoft
@@ -292,8 +474,13 @@ struct test_state {
     state s;
     
     void add(fs::path p) {
-        fs::change_notification n{std::move(p), fs::path{}, 0, fs::change_event::none, fs::file_type::regular};
-        s.add(&n);
+        fs::change_notifications notes;
+        notes.emplace_back(std::move(p), fs::path{}, 0, fs::change_event::created, fs::file_type::regular);
+        s.add(notes, fs::change_event::created);
+    }
+    
+    void max_pending(size_t n) {
+        s.m_maxpending = n;
     }
 };
 
@@ -378,6 +565,53 @@ TEST_CASE("change_iterator_internal") {
         paths = ts.s.extract();
         CHECK(paths.empty());
     }
+    
+    WHEN("extracting some paths") {
+        test_state ts;
+        ts.add(fs::path{PS_TEXT("test")});
+        ts.add(fs::path{PS_TEXT("test2")});
+        ts.add(fs::path{PS_TEXT("test")}); // merged
+        ts.add(fs::path{PS_TEXT("test3")});
+        
+        auto paths = ts.s.next_n(2);
+        CHECK(paths.size() == 2);
+        ts.add(fs::path{PS_TEXT("test4")});
+        paths = ts.s.next_n(10);
+        CHECK(paths.size() == 2);
+        CHECK(ts.s.next_n(10).empty());
+    }
+    
+    WHEN("the consumer falls behind") {
+        test_state ts;
+        ts.max_pending(2);
+        ts.add(fs::path{PS_TEXT("test")});
+        ts.add(fs::path{PS_TEXT("test")}); // merged once consumed
+        CHECK_FALSE(ts.s.done());
+        ts.add(fs::path{PS_TEXT("test2")});
+        CHECK(ts.s.done());
+        CHECK(ts.s.counters().dropped == 1);
+        CHECK(ts.s.extract().size() == 1);
+    }
+    
+    WHEN("paths are added concurrently") {
+        test_state ts;
+        constexpr int count = 1000;
+        auto producer = [&ts](int id) {
+            for (int i = 0; i < count; ++i) {
+                ts.add(fs::path{std::to_string(id * count + i)});
+            }
+        };
+        std::thread t1{producer, 0};
+        std::thread t2{producer, 1};
+        size_t total = 0;
+        while (total < 2 * count) {
+            total += ts.s.next_n(64).size();
+        }
+        t1.join();
+        t2.join();
+        CHECK(total == 2 * count);
+        CHECK(ts.s.extract().empty());
+    }
 }
 
 #endif // PSTEST_HARNESS
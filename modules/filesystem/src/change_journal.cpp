@@ -0,0 +1,683 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include <prosoft/core/config/config_platform.h>
+
+#include <sys/file.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <string>
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_change_journal.hpp>
+#include "filesystem_private.hpp"
+#include "fsstore_private.hpp"
+
+#if PS_HAVE_FILESYSTEM_CHANGE_JOURNAL
+
+namespace {
+using namespace prosoft::filesystem;
+
+// Journal layout (native byte order, unaligned records):
+//  header: magic[8], u32 version, u32 reserved, u64 id, u64 end offset, u64 checkpoint offset, u64 last event id,
+//          u64 base position, u64 last discarded event id
+//  record: u32 record size, u32 event, u64 event id, i8 file_type, u32 path size, path bytes, u32 new path size, new path bytes
+// Records between the checkpoint and the end offset are validated when the journal is opened.
+// Positions count the bytes ever recorded, the base position is the size of the records discarded by compaction.
+constexpr char journal_magic[8] = {'P', 'S', 'C', 'H', 'G', 'J', 'N', 'L'};
+constexpr std::uint32_t journal_version = 1;
+
+struct journal_header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t reserved;
+    std::uint64_t id;
+    std::uint64_t end;
+    std::uint64_t checkpoint;
+    std::uint64_t lastid;
+    std::uint64_t base;
+    std::uint64_t firstid;
+};
+static_assert(sizeof(journal_header) == 64, "Broken assumption");
+
+constexpr size_t record_header_size = sizeof(std::uint32_t) * 2 + sizeof(std::uint64_t) + sizeof(std::int8_t);
+constexpr size_t min_map_size = 1024 * 1024;
+constexpr std::chrono::seconds checkpoint_interval{1};
+
+inline journal_header* header(char* map) noexcept {
+    return reinterpret_cast<journal_header*>(map);
+}
+
+inline const journal_header* header(const char* map) noexcept {
+    return reinterpret_cast<const journal_header*>(map);
+}
+
+std::uint64_t make_id() {
+    std::random_device rd;
+    std::uint64_t id;
+    do {
+        id = (static_cast<std::uint64_t>(rd()) << 32) | rd();
+    } while (id == 0);
+    return id;
+}
+
+std::int64_t now() {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+bool valid_type(std::int8_t t) {
+    return t >= static_cast<std::int8_t>(file_type::not_found) && t <= static_cast<std::int8_t>(file_type::unknown);
+}
+
+struct record {
+    path m_path;
+    path m_newpath;
+    change_event_id m_evid;
+    change_event m_event;
+    file_type m_type;
+};
+
+// Reads the record at off, returning its size or 0 if the record is not valid.
+size_t read_record(const char* map, size_t off, size_t end, record& r) {
+    if (end - off < record_header_size) {
+        return 0;
+    }
+    
+    std::uint32_t sz;
+    std::memcpy(&sz, map + off, sizeof(sz));
+    if (sz < record_header_size || sz > end - off) {
+        return 0;
+    }
+    
+    ifilesystem::store_reader rd{map + off + sizeof(sz), sz - sizeof(sz)};
+    std::uint32_t ev;
+    std::int8_t type;
+    std::string p, np;
+    if (!rd.get(ev) || !rd.get(r.m_evid) || !rd.get(type) || !valid_type(type) || !rd.get(p) || !rd.get(np) || !rd.at_end()) {
+        return 0;
+    }
+    r.m_path = path{std::move(p)};
+    r.m_newpath = path{std::move(np)};
+    r.m_event = static_cast<change_event>(ev);
+    r.m_type = static_cast<file_type>(type);
+    return sz;
+}
+
+} // anon
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+using j_guard = std::lock_guard<std::mutex>;
+
+constexpr std::uint64_t change_journal::default_max_size;
+
+change_journal::change_journal(const path& p, std::uint64_t max_size)
+    : m_path(p)
+    , m_maxsize(max_size) {
+    error_code ec;
+    open(ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not open change journal", p, ec));
+}
+
+change_journal::change_journal(const path& p, error_code& ec)
+    : change_journal(p, default_max_size, ec) {
+}
+
+change_journal::change_journal(const path& p, std::uint64_t max_size, error_code& ec)
+    : m_path(p)
+    , m_maxsize(max_size) {
+    open(ec);
+}
+
+change_journal::~change_journal() {
+    if (m_map) {
+        error_code ignored;
+        sync(ignored);
+    }
+    close();
+}
+
+void change_journal::open(error_code& ec) {
+    m_fd = ::open(m_path.c_str(), O_RDWR|O_CREAT|O_CLOEXEC, 0600);
+    if (m_fd < 0) {
+        ifilesystem::system_error(ec);
+        return;
+    }
+    
+    struct ::stat sb;
+    if (0 != ::flock(m_fd, LOCK_EX|LOCK_NB) || 0 != ::fstat(m_fd, &sb)) {
+        ifilesystem::system_error(ec);
+        close();
+        return;
+    }
+    
+    const auto sz = static_cast<size_t>(sb.st_size);
+    const bool created = 0 == sz;
+    if (!reserve(std::max(sz, sizeof(journal_header)), ec)) {
+        close();
+        return;
+    }
+    
+    auto h = header(m_map);
+    if (created) {
+        std::memcpy(h->magic, journal_magic, sizeof(journal_magic));
+        h->version = journal_version;
+        h->id = make_id();
+        h->end = h->checkpoint = sizeof(journal_header);
+        h->lastid = h->base = h->firstid = 0;
+        sync(ec);
+    } else if (0 != std::memcmp(h->magic, journal_magic, sizeof(journal_magic)) || journal_version != h->version) {
+        ec = einval();
+        close();
+    } else {
+        recover();
+        ec.clear();
+    }
+}
+
+void change_journal::close() noexcept {
+    if (m_map) {
+        (void)::munmap(m_map, m_size);
+        m_map = nullptr;
+        m_size = 0;
+    }
+    if (-1 != m_fd) {
+        (void)::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+// Grows the file and mapping to at least sz bytes.
+bool change_journal::reserve(size_t sz, error_code& ec) {
+    if (sz <= m_size) {
+        return true;
+    }
+    
+    const auto nsz = std::max({sz, m_size * 2, min_map_size});
+    if (0 != ::ftruncate(m_fd, static_cast<off_t>(nsz))) {
+        ifilesystem::system_error(ec);
+        return false;
+    }
+    
+    auto p = ::mmap(nullptr, nsz, PROT_READ|PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (MAP_FAILED == p) {
+        ifilesystem::system_error(ec);
+        return false;
+    }
+    
+    if (m_map) {
+        (void)::munmap(m_map, m_size);
+    }
+    m_map = static_cast<char*>(p);
+    m_size = nsz;
+    return true;
+}
+
+// Events after the checkpoint may be partially written if the system crashed. The journal is truncated at the first invalid record.
+void change_journal::recover() {
+    auto h = header(m_map);
+    size_t off = std::min(static_cast<size_t>(h->checkpoint), m_size);
+    if (off < sizeof(journal_header)) {
+        off = sizeof(journal_header);
+        h->lastid = 0;
+    }
+    
+    auto lastid = h->lastid;
+    record r;
+    while (const auto sz = read_record(m_map, off, m_size, r)) {
+        if (r.m_evid <= lastid) {
+            break;
+        }
+        lastid = r.m_evid;
+        off += sz;
+    }
+    
+    h->end = h->checkpoint = off;
+    h->lastid = lastid;
+}
+
+void change_journal::sync(error_code& ec) {
+    auto h = header(m_map);
+    if (0 != ::msync(m_map, static_cast<size_t>(h->end), MS_SYNC)) {
+        ifilesystem::system_error(ec);
+        return;
+    }
+    h->checkpoint = h->end;
+    if (0 != ::msync(m_map, sizeof(journal_header), MS_SYNC)) {
+        ifilesystem::system_error(ec);
+        return;
+    }
+    m_lastsync = now();
+    ec.clear();
+    compact(ec);
+}
+
+// The newest records are copied to a new journal that replaces the old one, so a crash leaves one or the other.
+// Failing to write the new journal is not an error, it's tried again at the next checkpoint.
+void change_journal::compact(error_code& ec) {
+    constexpr auto first = sizeof(journal_header);
+    const auto h = header(m_map);
+    const auto end = static_cast<size_t>(h->end);
+    if (0 == m_maxsize || end - first <= m_maxsize) {
+        return;
+    }
+    
+    // Only checkpointed records are discarded, which is all of them as this follows a sync.
+    const auto cp = static_cast<size_t>(h->checkpoint);
+    size_t off = first;
+    auto firstid = h->firstid;
+    record r;
+    while (end - off > m_maxsize / 2) {
+        const auto sz = read_record(m_map, off, cp, r);
+        if (!sz) {
+            break;
+        }
+        firstid = r.m_evid;
+        off += sz;
+    }
+    if (off == first) {
+        return;
+    }
+    
+    journal_header nh = *h;
+    nh.base += off - first;
+    nh.end = nh.checkpoint = end - (off - first);
+    nh.firstid = firstid;
+    
+    auto tmp = m_path;
+    tmp += PS_TEXT(".tmp");
+    // The new journal is locked before it's visible.
+    ifilesystem::fd_close fd{::open(tmp.c_str(), O_RDWR|O_CREAT|O_TRUNC|O_CLOEXEC, 0600)};
+    if (fd.fd < 0 || 0 != ::flock(fd.fd, LOCK_EX|LOCK_NB)
+        || !ifilesystem::write_all(fd.fd, reinterpret_cast<const char*>(&nh), sizeof(nh))
+        || !ifilesystem::write_all(fd.fd, m_map + off, end - off)
+        || 0 != ::fsync(fd.fd) || 0 != ::rename(tmp.c_str(), m_path.c_str())) {
+        (void)::unlink(tmp.c_str());
+        return;
+    }
+    
+    close();
+    m_fd = fd.fd;
+    fd.fd = -1;
+    if (!reserve(static_cast<size_t>(nh.end), ec)) {
+        close();
+    }
+}
+
+change_journal::id_type change_journal::id() const noexcept {
+    j_guard lg{m_lock};
+    return m_map ? header(m_map)->id : 0;
+}
+
+change_event_id change_journal::last_event_id() const noexcept {
+    j_guard lg{m_lock};
+    return m_map ? header(m_map)->lastid : 0;
+}
+
+change_journal::position_type change_journal::position() const noexcept {
+    j_guard lg{m_lock};
+    if (m_map) {
+        const auto h = header(m_map);
+        return h->base + h->end - sizeof(journal_header);
+    }
+    return 0;
+}
+
+void change_journal::append(const change_notifications& notes, error_code& ec) {
+    j_guard lg{m_lock};
+    if (!m_map) {
+        ec = einval();
+        return;
+    }
+    
+    ifilesystem::store_writer wr;
+    auto lastid = header(m_map)->lastid;
+    for (const auto& n : notes) {
+        if (n.event_id() <= lastid) {
+            continue; // e.g. a replayed event
+        }
+        lastid = n.event_id();
+        
+        const std::string p{n.path().c_str()};
+        const std::string np{n.renamed_to_path().c_str()};
+        wr.put(static_cast<std::uint32_t>(record_header_size + sizeof(std::uint32_t) * 2 + p.size() + np.size()));
+        wr.put(static_cast<std::uint32_t>(n.event()));
+        wr.put(static_cast<std::uint64_t>(n.event_id()));
+        wr.put(static_cast<std::int8_t>(n.type()));
+        wr.put(p);
+        wr.put(np);
+    }
+    
+    const auto& data = wr.data();
+    if (!data.empty()) {
+        const auto end = static_cast<size_t>(header(m_map)->end);
+        if (!reserve(end + data.size(), ec)) {
+            return;
+        }
+        std::memcpy(m_map + end, data.data(), data.size());
+        auto h = header(m_map);
+        h->end = end + data.size();
+        h->lastid = lastid;
+    }
+    
+    if (now() - m_lastsync >= std::chrono::duration_cast<std::chrono::nanoseconds>(checkpoint_interval).count()) {
+        sync(ec);
+    } else {
+        ec.clear();
+    }
+}
+
+void change_journal::checkpoint() {
+    error_code ec;
+    checkpoint(ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not checkpoint change journal", m_path, ec));
+}
+
+void change_journal::checkpoint(error_code& ec) {
+    j_guard lg{m_lock};
+    if (m_map) {
+        sync(ec);
+    } else {
+        ec = einval();
+    }
+}
+
+void change_journal::replay(change_event_id evid, change_notifications& notes, error_code& ec) const {
+    replay(evid, 0, notes, ec);
+}
+
+void change_journal::replay(change_event_id evid, position_type pos, change_notifications& notes, error_code& ec) const {
+    j_guard lg{m_lock};
+    if (!m_map || evid < header(m_map)->firstid) {
+        ec = einval();
+        return;
+    }
+    
+    constexpr auto first = sizeof(journal_header);
+    const auto h = header(m_map);
+    const auto end = static_cast<size_t>(h->end);
+    size_t off = first;
+    record r;
+    // The records before a discarded position can be skipped too, as their ids are <= firstid.
+    if (pos > h->base && pos - h->base <= end - first) {
+        off += static_cast<size_t>(pos - h->base);
+        if (off != end && !read_record(m_map, off, end, r)) {
+            off = first; // not a record boundary, e.g. the position is from before a reset
+        }
+    }
+    while (const auto sz = read_record(m_map, off, end, r)) {
+        off += sz;
+        if (r.m_evid > evid) {
+            notes.emplace_back(std::move(r.m_path), std::move(r.m_newpath), r.m_evid, r.m_event, r.m_type);
+        }
+    }
+    ec.clear();
+}
+
+void change_journal::reset() {
+    error_code ec;
+    reset(ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not reset change journal", m_path, ec));
+}
+
+void change_journal::reset(error_code& ec) {
+    j_guard lg{m_lock};
+    if (!m_map) {
+        ec = einval();
+        return;
+    }
+    
+    // Discard the old records so they can't be mistaken for new ones during recovery.
+    if (0 != ::ftruncate(m_fd, sizeof(journal_header)) || 0 != ::ftruncate(m_fd, static_cast<off_t>(m_size))) {
+        ifilesystem::system_error(ec);
+        return;
+    }
+    
+    auto h = header(m_map);
+    h->id = make_id();
+    h->end = sizeof(journal_header);
+    h->lastid = h->base = h->firstid = 0;
+    sync(ec);
+}
+
+bool change_journal::attach() noexcept {
+    j_guard lg{m_lock};
+    if (m_attached) {
+        return false;
+    }
+    m_attached = true;
+    return true;
+}
+
+void change_journal::detach() noexcept {
+    j_guard lg{m_lock};
+    m_attached = false;
+}
+
+} // v1
+} // filesystem
+} // prosoft
+
+#if PSTEST_HARNESS
+// Internal tests.
+#include <catch2/catch_test_macros.hpp>
+#include <fstream>
+#include "fstestutils.hpp"
+
+TEST_CASE("change_journal_internal") {
+    const auto jp = temp_directory_path() / process_name("fs17journal");
+    PS_RAII_REMOVE(jp);
+    
+    auto make_notes = [](change_event_id first, size_t n) {
+        change_notifications notes;
+        for (size_t i = 0; i < n; ++i) {
+            notes.emplace_back(path{"/a/" + std::to_string(i)}, path{}, first + i, change_event::created, file_type::regular);
+        }
+        notes.emplace_back(path{"/a/0"}, path{"/b/0"}, first + n, change_event::renamed, file_type::none);
+        return notes;
+    };
+    
+    SECTION("recording events") {
+        std::unique_ptr<change_journal> jptr{new change_journal{jp}};
+        auto& j = *jptr;
+        REQUIRE(j);
+        const auto id = j.id();
+        CHECK(id != 0);
+        CHECK(j.last_event_id() == 0);
+        
+        error_code ec;
+        j.append(make_notes(1, 3), ec);
+        REQUIRE_FALSE(ec);
+        CHECK(j.last_event_id() == 4);
+        
+        change_notifications notes;
+        j.replay(2, notes, ec);
+        REQUIRE_FALSE(ec);
+        REQUIRE(notes.size() == 2);
+        CHECK(notes[0].path() == path{"/a/2"});
+        CHECK(notes[0].event_id() == 3);
+        CHECK(notes[0].event() == change_event::created);
+        CHECK(notes[0].type() == file_type::regular);
+        CHECK(notes[1].renamed_to_path() == path{"/b/0"});
+        CHECK(notes[1].type() == file_type::none);
+        
+        WHEN("appending already recorded events") {
+            j.append(make_notes(2, 3), ec);
+            REQUIRE_FALSE(ec);
+            CHECK(j.last_event_id() == 5);
+            notes.clear();
+            j.replay(0, notes, ec);
+            CHECK(notes.size() == 5);
+        }
+        
+        WHEN("replaying from a position") {
+            const auto pos = j.position();
+            CHECK(pos > 0);
+            j.append(make_notes(5, 1), ec);
+            REQUIRE_FALSE(ec);
+            CHECK(j.position() > pos);
+            notes.clear();
+            j.replay(4, pos, notes, ec);
+            REQUIRE_FALSE(ec);
+            REQUIRE(notes.size() == 2);
+            CHECK(notes[0].event_id() == 5);
+            
+            notes.clear();
+            j.replay(4, pos + 1, notes, ec); // not a record, all records are read
+            REQUIRE_FALSE(ec);
+            CHECK(notes.size() == 2);
+        }
+        
+        WHEN("the journal is attached") {
+            CHECK(j.attach());
+            CHECK_FALSE(j.attach());
+            j.detach();
+            CHECK(j.attach());
+        }
+        
+        WHEN("the journal is already open") {
+            change_journal other{jp, ec};
+            CHECK(ec);
+            CHECK_FALSE(other);
+        }
+        
+        WHEN("the journal is reopened") {
+            jptr.reset();
+            change_journal reopened{jp};
+            CHECK(reopened.id() == id);
+            CHECK(reopened.last_event_id() == 4);
+            notes.clear();
+            reopened.replay(0, notes, ec);
+            CHECK(notes.size() == 4);
+        }
+        
+        WHEN("the journal is reset") {
+            j.reset();
+            CHECK(j.id() != id);
+            CHECK(j.last_event_id() == 0);
+            notes.clear();
+            j.replay(0, notes, ec);
+            CHECK(notes.empty());
+        }
+    }
+    
+    SECTION("recovering from a partial write") {
+        {
+            change_journal j{jp};
+            error_code ec;
+            j.append(make_notes(1, 3), ec);
+            REQUIRE_FALSE(ec);
+        }
+        
+        // Simulate a crash before the first checkpoint with a partially written last record.
+        {
+            ifilesystem::fd_close fd{::open(jp.c_str(), O_RDWR)};
+            REQUIRE(fd.fd >= 0);
+            journal_header h;
+            REQUIRE(sizeof(h) == ::pread(fd.fd, &h, sizeof(h), 0));
+            const auto last = h.end - (record_header_size + sizeof(std::uint32_t) * 2 + 8); // "/a/0" -> "/b/0"
+            h.checkpoint = sizeof(h);
+            h.lastid = 0;
+            REQUIRE(sizeof(h) == ::pwrite(fd.fd, &h, sizeof(h), 0));
+            const std::uint32_t sz = 0xffffffff;
+            REQUIRE(sizeof(sz) == ::pwrite(fd.fd, &sz, sizeof(sz), static_cast<off_t>(last)));
+        }
+        
+        change_journal j{jp};
+        CHECK(j.last_event_id() == 3);
+        change_notifications notes;
+        error_code ec;
+        j.replay(0, notes, ec);
+        CHECK(notes.size() == 3);
+        
+        j.append(make_notes(4, 0), ec);
+        CHECK(j.last_event_id() == 4);
+    }
+    
+    SECTION("compacting the journal") {
+        constexpr std::uint64_t max_size = 512;
+        std::unique_ptr<change_journal> jptr{new change_journal{jp, max_size}};
+        auto& j = *jptr;
+        error_code ec;
+        change_event_id evid = 1;
+        change_journal::position_type pos = 0;
+        for (int i = 0; i < 10; ++i) {
+            pos = j.position();
+            j.append(make_notes(evid, 3), ec);
+            REQUIRE_FALSE(ec);
+            j.checkpoint();
+            evid += 4;
+        }
+        CHECK(j.last_event_id() == evid - 1);
+        
+        change_notifications notes;
+        j.replay(0, notes, ec);
+        CHECK(ec); // discarded
+        
+        ec.clear();
+        j.replay(evid - 5, pos, notes, ec);
+        REQUIRE_FALSE(ec);
+        REQUIRE(notes.size() == 4);
+        CHECK(notes[0].event_id() == evid - 4);
+        
+        WHEN("the journal is reopened") {
+            const auto id = j.id();
+            {
+                change_journal other{jp, ec};
+                CHECK(ec); // the compacted journal is still locked
+            }
+            jptr.reset();
+            change_journal reopened{jp, max_size};
+            CHECK(reopened.id() == id);
+            CHECK(reopened.position() > pos);
+            notes.clear();
+            reopened.replay(evid - 5, pos, notes, ec);
+            REQUIRE_FALSE(ec);
+            CHECK(notes.size() == 4);
+            reopened.replay(0, notes, ec);
+            CHECK(ec);
+        }
+    }
+    
+    WHEN("the file is not a journal") {
+        {
+            std::ofstream f{jp.c_str()};
+            f << "hello world";
+        }
+        error_code ec;
+        change_journal j{jp, ec};
+        CHECK(ec);
+        CHECK_FALSE(j);
+    }
+}
+
+#endif // PSTEST_HARNESS
+
+#endif // PS_HAVE_FILESYSTEM_CHANGE_JOURNAL
@@ -0,0 +1,780 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include <prosoft/core/config/config.h>
+#include "fsconfig.h"
+
+#if !_WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <sys/acl.h>
+#if __linux__
+#include <acl/libacl.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+#endif
+#else
+#include <windows.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_extents.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_xattr.hpp>
+#include "filesystem_private.hpp"
+#include "fsstore_private.hpp"
+
+namespace {
+using namespace prosoft;
+using namespace prosoft::filesystem;
+
+constexpr size_t default_buffer_size = 1024 * 1024;
+
+constexpr auto std_options = static_cast<copy_options>(0xfff);
+
+inline error_code not_supported() {
+    return error_code{
+#if !_WIN32
+        ENOTSUP,
+#else
+        ERROR_NOT_SUPPORTED,
+#endif
+        filesystem_category()};
+}
+
+inline error_code exists_error() {
+    return error_code{
+#if !_WIN32
+        EEXIST,
+#else
+        ERROR_ALREADY_EXISTS,
+#endif
+        filesystem_category()};
+}
+
+inline error_code directory_error() {
+    return error_code{
+#if !_WIN32
+        EISDIR,
+#else
+        ERROR_DIRECTORY_NOT_SUPPORTED,
+#endif
+        filesystem_category()};
+}
+
+class copy_progress {
+    const path& m_from;
+    const copy_config::progress_type& m_progress;
+    file_size_type m_size;
+    file_size_type m_copied;
+public:
+    copy_progress(const path& from, const copy_config& cfg, file_size_type sz)
+        : m_from(from)
+        , m_progress(cfg.progress)
+        , m_size(sz)
+        , m_copied(0) {}
+    
+    file_size_type size() const noexcept {
+        return m_size;
+    }
+    
+    file_size_type copied() const noexcept {
+        return m_copied;
+    }
+    
+    // false if canceled
+    bool set(file_size_type copied) {
+        m_copied = copied;
+        return !m_progress || m_progress(m_from, m_copied, m_size);
+    }
+    
+    bool add(file_size_type n) {
+        return set(m_copied + n);
+    }
+};
+
+#if !_WIN32
+using ifilesystem::fd_close;
+
+enum class copy_result {
+    done,
+    failed,
+    unsupported, // try the next method
+};
+
+inline copy_result canceled(error_code& ec) {
+    ifilesystem::error(ECANCELED, ec);
+    return copy_result::failed;
+}
+
+#if __linux__
+constexpr size_t kernel_chunk_size = 16 * 1024 * 1024; // progress granularity of in-kernel copies
+
+// The method is not supported by the FS or for this pair of files.
+inline bool unsupported(int err) {
+    return ENOSYS == err || EOPNOTSUPP == err || ENOTSUP == err || EXDEV == err || EINVAL == err || ENOTTY == err;
+}
+
+copy_result clone(int in, int out, copy_progress& progress, error_code& ec) {
+    if (0 == ::ioctl(out, FICLONE, in)) {
+        return progress.set(progress.size()) ? copy_result::done : canceled(ec);
+    }
+    return copy_result::unsupported;
+}
+
+// For copy_file_range and sendfile, both update the file offsets and return 0 at EOF.
+template <class Op>
+copy_result kernel_copy(Op op, copy_progress& progress, error_code& ec) {
+    for (;;) {
+        const auto n = op();
+        if (n > 0) {
+            if (!progress.add(static_cast<file_size_type>(n))) {
+                return canceled(ec);
+            }
+        } else if (0 == n) {
+            return copy_result::done;
+        } else if (EINTR != errno) {
+            if (0 == progress.copied() && unsupported(errno)) {
+                return copy_result::unsupported;
+            }
+            ifilesystem::system_error(ec);
+            return copy_result::failed;
+        }
+    }
+}
+
+copy_result copy_range(int in, int out, copy_progress& progress, error_code& ec) {
+#if defined(__NR_copy_file_range)
+    return kernel_copy([in, out]() {
+        return ::syscall(__NR_copy_file_range, in, nullptr, out, nullptr, kernel_chunk_size, 0U);
+    }, progress, ec);
+#else
+    (void)in; (void)out; (void)progress; (void)ec;
+    return copy_result::unsupported;
+#endif
+}
+
+copy_result send_file(int in, int out, copy_progress& progress, error_code& ec) {
+    return kernel_copy([in, out]() {
+        return ::sendfile(out, in, nullptr, kernel_chunk_size);
+    }, progress, ec);
+}
+#endif // __linux__
+
+copy_result read_write(int in, int out, size_t bufsize, copy_progress& progress, error_code& ec) {
+    std::unique_ptr<char[]> buf{new char[bufsize]};
+    for (;;) {
+        const auto n = ::read(in, buf.get(), bufsize);
+        if (n > 0) {
+            if (!ifilesystem::write_all(out, buf.get(), static_cast<size_t>(n))) {
+                ifilesystem::system_error(ec);
+                return copy_result::failed;
+            }
+            if (!progress.add(static_cast<file_size_type>(n))) {
+                return canceled(ec);
+            }
+        } else if (0 == n) {
+            return copy_result::done;
+        } else if (EINTR != errno) {
+            ifilesystem::system_error(ec);
+            return copy_result::failed;
+        }
+    }
+}
+
+// Copies a range to the same offset in the target.
+bool copy_at(int in, int out, file_size_type off, file_size_type len, size_t bufsize, copy_progress& progress, error_code& ec) {
+#if __linux__ && defined(__NR_copy_file_range)
+    ::loff_t ioff = static_cast<::loff_t>(off);
+    ::loff_t ooff = ioff;
+    while (len > 0) {
+        const auto n = ::syscall(__NR_copy_file_range, in, &ioff, out, &ooff, std::min<file_size_type>(len, kernel_chunk_size), 0U);
+        if (n > 0) {
+            len -= static_cast<file_size_type>(n);
+            if (!progress.add(static_cast<file_size_type>(n))) {
+                canceled(ec);
+                return false;
+            }
+        } else if (0 == n) { // truncated since listing the extents
+            return true;
+        } else if (EINTR != errno) {
+            if (unsupported(errno)) {
+                break;
+            }
+            ifilesystem::system_error(ec);
+            return false;
+        }
+    }
+    off = static_cast<file_size_type>(ioff);
+#endif
+    std::unique_ptr<char[]> buf{len > 0 ? new char[bufsize] : nullptr};
+    while (len > 0) {
+        const auto n = ::pread(in, buf.get(), static_cast<size_t>(std::min<file_size_type>(len, bufsize)), static_cast<::off_t>(off));
+        if (n > 0) {
+            for (ssize_t w = 0; w < n;) {
+                const auto wn = ::pwrite(out, buf.get() + w, static_cast<size_t>(n - w), static_cast<::off_t>(off) + w);
+                if (wn >= 0) {
+                    w += wn;
+                } else if (EINTR != errno) {
+                    ifilesystem::system_error(ec);
+                    return false;
+                }
+            }
+            off += static_cast<file_size_type>(n);
+            len -= static_cast<file_size_type>(n);
+            if (!progress.add(static_cast<file_size_type>(n))) {
+                canceled(ec);
+                return false;
+            }
+        } else if (0 == n) {
+            return true;
+        } else if (EINTR != errno) {
+            ifilesystem::system_error(ec);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Only the data extents of a sparse file are copied, the target is then extended over the trailing hole (if any).
+copy_result copy_sparse(int in, int out, const struct ::stat& sb, size_t bufsize, copy_progress& progress, error_code& ec) {
+    const auto size = static_cast<file_size_type>(sb.st_size);
+    if (static_cast<file_size_type>(sb.st_blocks) * 512 >= size) { // st_blocks is in 512 byte units
+        return copy_result::unsupported;
+    }
+    error_code xec;
+    const auto extents = file_extents(in, xec);
+    if (xec.value() || (1 == extents.size() && extents[0].length == size)) {
+        return copy_result::unsupported;
+    }
+    
+    for (const auto& e : extents) {
+        if (!copy_at(in, out, e.offset, e.length, bufsize, progress, ec)) {
+            return copy_result::failed;
+        }
+    }
+    if (0 != ::ftruncate(out, sb.st_size)) {
+        ifilesystem::system_error(ec);
+        return copy_result::failed;
+    }
+    return progress.set(size) ? copy_result::done : canceled(ec);
+}
+
+bool copy_content(int in, int out, const struct ::stat& sb, const copy_config& cfg, copy_progress& progress, error_code& ec) {
+    const size_t bufsize = cfg.buffer_size > 0 ? cfg.buffer_size : default_buffer_size;
+    // Files such as those in /proc report a 0 size but have content, only a read will find it.
+    if (sb.st_size > 0) {
+#if __linux__
+        (void)::posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+        // A clone shares the source extents, holes included.
+        const auto cr = clone(in, out, progress, ec);
+        if (copy_result::unsupported != cr) {
+            return copy_result::done == cr;
+        }
+#endif
+        const auto sr = copy_sparse(in, out, sb, bufsize, progress, ec);
+        if (copy_result::unsupported != sr) {
+            return copy_result::done == sr;
+        }
+#if __linux__
+        for (auto method : {copy_range, send_file}) {
+            const auto r = method(in, out, progress, ec);
+            if (copy_result::unsupported != r) {
+                return copy_result::done == r;
+            }
+        }
+#endif
+    }
+    return copy_result::done == read_write(in, out, bufsize, progress, ec);
+}
+
+#if __linux__ || __APPLE__
+// ACLs and security labels are managed by the system and may not be settable by the process.
+inline bool is_system_xattr(const char* name) {
+    return 0 == std::strncmp(name, "system.", 7) || 0 == std::strncmp(name, "security.", 9);
+}
+
+void copy_xattrs(const path& from, const path& to, error_code& ec) {
+    const auto xs = get_xattrs(from, ec);
+    if (ec.value()) {
+        if (ENOTSUP == ec.value()) {
+            ec.clear();
+        }
+        return;
+    }
+    
+    for (const auto& x : xs) {
+        set_xattr(to, x.name, x.value, x.size, ec);
+        if (ec.value()) {
+            if (is_system_xattr(x.name) && (EPERM == ec.value() || ENOTSUP == ec.value())) {
+                ec.clear();
+                continue;
+            }
+            return;
+        }
+    }
+}
+#endif // __linux__ || __APPLE__
+
+// acl() can't set an ACL, so this uses the native API.
+void copy_acl(const path& from, const path& to, bool dir, error_code& ec) {
+#if __APPLE__
+    (void)dir;
+    const ::acl_type_t kinds[] = {ACL_TYPE_EXTENDED};
+#else
+    const ::acl_type_t kinds[] = {ACL_TYPE_ACCESS, ACL_TYPE_DEFAULT};
+#endif
+    for (auto kind : kinds) {
+#if !__APPLE__
+        if (ACL_TYPE_DEFAULT == kind && !dir) {
+            continue;
+        }
+#endif
+        ifilesystem::unique_acl a{::acl_get_file(from.c_str(), kind)};
+        if (!a) {
+            // macOS returns ENOENT if there is no ACL
+            if (ENOTSUP != errno && ENOENT != errno) {
+                ifilesystem::system_error(ec);
+            }
+            return;
+        }
+#if __linux__
+        ::acl_entry_t e;
+        if (ACL_TYPE_ACCESS == kind ? 0 == ::acl_equiv_mode(a.get(), nullptr) : 1 != ::acl_get_entry(a.get(), ACL_FIRST_ENTRY, &e)) {
+            continue; // nothing beyond the perms
+        }
+#endif
+        if (0 != ::acl_set_file(to.c_str(), kind, a.get())) {
+            ifilesystem::system_error(ec);
+            return;
+        }
+    }
+}
+
+// Times are last as setting the other metadata may change them (e.g. the ctime).
+void copy_metadata(const path& from, const path& to, const struct ::stat& sb, copy_options opts, error_code& ec) {
+    if (is_set(opts & copy_options::copy_perms) && 0 != ::chmod(to.c_str(), sb.st_mode & 07777)) {
+        ifilesystem::system_error(ec);
+        return;
+    }
+#if __linux__ || __APPLE__
+    if (is_set(opts & copy_options::copy_xattrs)) {
+        copy_xattrs(from, to, ec);
+        if (ec) {
+            return;
+        }
+    }
+#endif
+    if (is_set(opts & copy_options::copy_acl)) { // after the perms as they may change the ACL mask
+        copy_acl(from, to, S_ISDIR(sb.st_mode), ec);
+        if (ec) {
+            return;
+        }
+    }
+    if (is_set(opts & copy_options::copy_times)) {
+#if __APPLE__
+        const struct ::timespec times[2] = {sb.st_atimespec, sb.st_mtimespec};
+#else
+        const struct ::timespec times[2] = {sb.st_atim, sb.st_mtim};
+#endif
+        if (0 != ::utimensat(AT_FDCWD, to.c_str(), times, 0)) {
+            ifilesystem::system_error(ec);
+        }
+    }
+}
+
+bool copy_file_content(const path& from, const path& to, bool exists, copy_options opts, const copy_config& cfg, error_code& ec) {
+    fd_close in{::open(from.c_str(), O_RDONLY|O_CLOEXEC)};
+    struct ::stat sb;
+    if (in.fd < 0 || 0 != ::fstat(in.fd, &sb)) {
+        ifilesystem::system_error(ec);
+        return false;
+    }
+    
+    fd_close out{::open(to.c_str(), O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC|(exists ? 0 : O_EXCL), sb.st_mode & 07777)};
+    if (out.fd < 0) {
+        ifilesystem::system_error(ec);
+        return false;
+    }
+    
+    copy_progress progress{from, cfg, static_cast<file_size_type>(sb.st_size)};
+    if (copy_content(in.fd, out.fd, sb, cfg, progress, ec)) {
+        const int fd = out.fd;
+        out.fd = -1;
+        if (0 != ::close(fd)) { // NFS may not report write errors until now
+            ifilesystem::system_error(ec);
+        } else if (is_set(opts & copy_options::copy_metadata)) {
+            copy_metadata(from, to, sb, opts, ec);
+        }
+    }
+    
+    if (ec && !exists) {
+        (void)::unlink(to.c_str());
+    }
+    return !ec;
+}
+
+void copy_symlink(const path& from, const path& to, error_code& ec) {
+    std::vector<char> buf(256);
+    for (;;) {
+        const auto n = ::readlink(from.c_str(), buf.data(), buf.size());
+        if (n < 0) {
+            ifilesystem::system_error(ec);
+            return;
+        } else if (static_cast<size_t>(n) < buf.size()) {
+            buf[static_cast<size_t>(n)] = 0;
+            break;
+        }
+        buf.resize(buf.size() * 2);
+    }
+    if (0 != ::symlink(buf.data(), to.c_str())) {
+        ifilesystem::system_error(ec);
+    }
+}
+
+void create_hard_link(const path& from, const path& to, error_code& ec) {
+    if (0 != ::link(from.c_str(), to.c_str())) {
+        ifilesystem::system_error(ec);
+    }
+}
+
+void copy_directory_metadata(const path& from, const path& to, copy_options opts, error_code& ec) {
+    struct ::stat sb;
+    if (0 != ::stat(from.c_str(), &sb)) {
+        ifilesystem::system_error(ec);
+        return;
+    }
+    copy_metadata(from, to, sb, opts, ec);
+}
+
+#else // _WIN32
+
+DWORD CALLBACK copy_progress_routine(LARGE_INTEGER, LARGE_INTEGER copied, LARGE_INTEGER, LARGE_INTEGER, DWORD, DWORD, HANDLE, HANDLE, LPVOID data) {
+    auto progress = static_cast<copy_progress*>(data);
+    return progress->set(static_cast<file_size_type>(copied.QuadPart)) ? PROGRESS_CONTINUE : PROGRESS_CANCEL;
+}
+
+// CopyFileEx always copies the times and attributes.
+bool copy_file_content(const path& from, const path& to, bool exists, copy_options, const copy_config& cfg, error_code& ec) {
+    copy_progress progress{from, cfg, file_size(from, ec)};
+    if (ec) {
+        return false;
+    }
+    BOOL cancel = FALSE;
+    if (::CopyFileExW(from.c_str(), to.c_str(), copy_progress_routine, &progress, &cancel, exists ? 0 : COPY_FILE_FAIL_IF_EXISTS)) {
+        return true;
+    }
+    ifilesystem::system_error(ec);
+    return false;
+}
+
+void copy_symlink(const path&, const path&, error_code& ec) {
+    ec = not_supported();
+}
+
+void create_hard_link(const path& from, const path& to, error_code& ec) {
+    if (!::CreateHardLinkW(to.c_str(), from.c_str(), nullptr)) {
+        ifilesystem::system_error(ec);
+    }
+}
+
+void copy_directory_metadata(const path&, const path&, copy_options, error_code&) {}
+
+#endif // _WIN32
+
+class copier {
+    const copy_config& m_cfg;
+    copy_options m_opts;
+    
+public:
+    copier(copy_options opts, const copy_config& cfg)
+        : m_cfg(cfg)
+        , m_opts(opts) {}
+    
+    void operator()(const path& from, const path& to, bool top, error_code&);
+    
+private:
+    bool is(copy_options o) const noexcept {
+        return is_set(m_opts & o);
+    }
+    
+    void copy_directory(const path& from, const path& to, bool exists, error_code&);
+};
+
+void copier::operator()(const path& from, const path& to, bool top, error_code& ec) {
+    file_status f, t;
+    if (is(copy_options::create_symlinks|copy_options::skip_symlinks)) {
+        f = symlink_status(from, status_info::basic, ec);
+        if (!ec) {
+            t = symlink_status(to, status_info::basic, ec);
+        }
+    } else {
+        f = is(copy_options::copy_symlinks) ? symlink_status(from, status_info::basic, ec) : status(from, status_info::basic, ec);
+        if (!ec) {
+            t = status(to, status_info::basic, ec);
+        }
+    }
+    if (ec) {
+        if (!exists(f) || t.type() != file_type::not_found) {
+            return;
+        }
+        ec.clear();
+    }
+    
+    if (exists(t) && equivalent(from, to, ec)) {
+        ec = exists_error();
+        return;
+    }
+    if (ec) {
+        return;
+    }
+    if (is_other(f) || is_other(t)) {
+        ec = not_supported();
+        return;
+    }
+    if (is_directory(f) && is_regular_file(t)) {
+        ec = exists_error();
+        return;
+    }
+    
+    if (is_symlink(f)) {
+        if (is(copy_options::skip_symlinks)) {
+            return;
+        }
+        if (!exists(t) && is(copy_options::copy_symlinks)) {
+            copy_symlink(from, to, ec);
+        } else {
+            ec = exists(t) ? exists_error() : einval();
+        }
+    } else if (is_regular_file(f)) {
+        if (is(copy_options::directories_only)) {
+            return;
+        }
+        if (is(copy_options::create_symlinks)) {
+            create_symlink(from, to, ec);
+        } else if (is(copy_options::create_hard_links)) {
+            create_hard_link(from, to, ec);
+        } else if (is_directory(t)) {
+            copy_file(from, to / from.filename(), m_opts, m_cfg, ec);
+        } else {
+            copy_file(from, to, m_opts, m_cfg, ec);
+        }
+    } else if (is_directory(f)) {
+        if (is(copy_options::create_symlinks)) {
+            ec = directory_error();
+        } else if (is(copy_options::recursive) || (top && (m_opts & std_options) == copy_options::none)) {
+            copy_directory(from, to, exists(t), ec);
+        }
+    }
+}
+
+void copier::copy_directory(const path& from, const path& to, bool exists, error_code& ec) {
+    if (!exists && !create_directory(to, from, ec)) {
+        return;
+    }
+    
+    for (directory_iterator i{from, ec}, end; !ec && i != end; i.increment(ec)) {
+        const auto& p = i->path();
+        operator()(p, to / p.filename(), false, ec);
+    }
+    
+    if (!ec && is(copy_options::copy_metadata)) {
+        copy_directory_metadata(from, to, m_opts, ec);
+    }
+}
+
+} // anon
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+bool copy_file(const path& from, const path& to, copy_options opts, const copy_config& cfg) {
+    error_code ec;
+    const auto copied = copy_file(from, to, opts, cfg, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not copy file", from, to, ec));
+    return copied;
+}
+
+bool copy_file(const path& from, const path& to, copy_options opts, const copy_config& cfg, error_code& ec) {
+    const auto f = status(from, status_info::times, ec);
+    if (ec) {
+        return false;
+    }
+    if (!is_regular_file(f)) {
+        ec = is_directory(f) ? directory_error() : einval();
+        return false;
+    }
+    
+    const auto t = status(to, status_info::times, ec);
+    if (ec) {
+        if (t.type() != file_type::not_found) {
+            return false;
+        }
+        ec.clear();
+    }
+    
+    const bool exists = filesystem::exists(t);
+    if (exists) {
+        if (!is_regular_file(t) || equivalent(from, to, ec) || ec) {
+            if (!ec) {
+                ec = exists_error();
+            }
+            return false;
+        }
+        if (is_set(opts & copy_options::skip_existing)) {
+            return false;
+        } else if (is_set(opts & copy_options::update_existing)) {
+            if (last_write_time(f) <= last_write_time(t)) {
+                return false;
+            }
+        } else if (!is_set(opts & copy_options::overwrite_existing)) {
+            ec = exists_error();
+            return false;
+        }
+    }
+    
+    return copy_file_content(from, to, exists, opts, cfg, ec);
+}
+
+void copy(const path& from, const path& to, copy_options opts, const copy_config& cfg) {
+    error_code ec;
+    copy(from, to, opts, cfg, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not copy path", from, to, ec));
+}
+
+void copy(const path& from, const path& to, copy_options opts, const copy_config& cfg, error_code& ec) {
+    ec.clear();
+    copier{opts, cfg}(from, to, true, ec);
+}
+
+} // v1
+} // filesystem
+} // prosoft
+
+#if PSTEST_HARNESS && !_WIN32
+// Internal tests.
+#include <catch2/catch_test_macros.hpp>
+#include "fstestutils.hpp"
+
+TEST_CASE("copy_internal") {
+    using namespace prosoft::filesystem;
+    
+    const auto from = temp_directory_path() / process_name("fs17copy_from");
+    const auto to = temp_directory_path() / process_name("fs17copy_to");
+    const std::string content(100000, 'x');
+    {
+        std::ofstream stream(from.c_str(), std::ios::binary);
+        REQUIRE(stream);
+        stream << content;
+    }
+    PS_RAII_REMOVE(from);
+    
+    copy_config cfg;
+    error_code ec;
+    auto copy_with = [&](std::function<copy_result (int, int, copy_progress&)> method) {
+        fd_close in{::open(from.c_str(), O_RDONLY)};
+        fd_close out{::open(to.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0600)};
+        REQUIRE(in.fd >= 0);
+        REQUIRE(out.fd >= 0);
+        copy_progress progress{from, cfg, content.size()};
+        const auto r = method(in.fd, out.fd, progress);
+        if (copy_result::done == r) {
+            CHECK(progress.copied() == content.size());
+            CHECK(file_size(to) == content.size());
+        }
+        return r;
+    };
+    
+    WHEN("using a read/write loop") {
+        CHECK(copy_with([&ec](int in, int out, copy_progress& p) { return read_write(in, out, 4096, p, ec); }) == copy_result::done);
+    }
+    
+#if __linux__
+    WHEN("using the kernel") {
+        CHECK(copy_with([&ec](int in, int out, copy_progress& p) { return send_file(in, out, p, ec); }) == copy_result::done);
+        CHECK(copy_with([&ec](int in, int out, copy_progress& p) { return copy_range(in, out, p, ec); }) != copy_result::failed);
+        CHECK(copy_with([&ec](int in, int out, copy_progress& p) { return clone(in, out, p, ec); }) != copy_result::failed);
+    }
+#endif
+    
+    WHEN("copying a sparse file") {
+        constexpr ::off_t mb = 1024 * 1024;
+        const auto sparse = temp_directory_path() / process_name("fs17copy_sparse");
+        {
+            fd_close f{::open(sparse.c_str(), O_WRONLY|O_CREAT|O_TRUNC, 0600)};
+            REQUIRE(f.fd >= 0);
+            REQUIRE(::pwrite(f.fd, content.data(), 4096, mb) == 4096);
+            REQUIRE(0 == ::ftruncate(f.fd, 4 * mb));
+        }
+        PS_RAII_REMOVE(sparse);
+        
+        fd_close in{::open(sparse.c_str(), O_RDONLY)};
+        fd_close out{::open(to.c_str(), O_RDWR|O_CREAT|O_TRUNC, 0600)};
+        REQUIRE(in.fd >= 0);
+        REQUIRE(out.fd >= 0);
+        struct ::stat sb;
+        REQUIRE(0 == ::fstat(in.fd, &sb));
+        copy_progress progress{sparse, cfg, static_cast<file_size_type>(sb.st_size)};
+        const auto r = copy_sparse(in.fd, out.fd, sb, 1024, progress, ec);
+        CHECK(r != copy_result::failed);
+        if (copy_result::done == r) {
+            CHECK(progress.copied() == static_cast<file_size_type>(4 * mb));
+            struct ::stat tsb;
+            REQUIRE(0 == ::fstat(out.fd, &tsb));
+            CHECK(tsb.st_size == 4 * mb);
+            CHECK(tsb.st_blocks * 512 < tsb.st_size);
+            std::string data(4096, '\0');
+            REQUIRE(::pread(out.fd, &data[0], data.size(), mb) == 4096);
+            CHECK(data == content.substr(0, 4096));
+            REQUIRE(::pread(out.fd, &data[0], data.size(), 0) == 4096);
+            CHECK(data == std::string(4096, '\0'));
+        }
+    }
+    
+    WHEN("canceling") {
+        cfg.progress = [](const path&, file_size_type, file_size_type) {
+            return false;
+        };
+        CHECK(copy_with([&ec](int in, int out, copy_progress& p) { return read_write(in, out, 4096, p, ec); }) == copy_result::failed);
+        CHECK(ec.value() == ECANCELED);
+    }
+    
+    CHECK_FALSE(ec.value() != 0 && ec.value() != ECANCELED);
+    REQUIRE(remove(to));
+}
+
+#endif // PSTEST_HARNESS
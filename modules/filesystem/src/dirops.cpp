@@ -266,6 +266,45 @@ bool remove(const path& p, error_code& ec) noexcept {
     }
 }
 
+std::uintmax_t remove_all(const path& p) {
+    error_code ec;
+    const auto n = remove_all(p, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not remove path", p, ec));
+    return n;
+}
+
+std::uintmax_t remove_all(const path& p, error_code& ec) {
+    constexpr auto error_result = static_cast<std::uintmax_t>(-1);
+    const auto st = symlink_status(p, status_info::basic, ec);
+    if (ec) {
+        if (st.type() == file_type::not_found) {
+            ec.clear();
+            return 0;
+        }
+        return error_result;
+    }
+    
+    std::uintmax_t n = 0;
+    if (is_directory(st)) {
+        // Directories are removed when they are returned again after their content.
+        // Mount points are not descended and fail to be removed.
+        constexpr auto opts = directory_options::include_postorder_directories|directory_options::include_apple_double_files;
+        for (recursive_directory_iterator i{p, opts, ec}, end; !ec && i != end; i.increment(ec)) {
+            if ((i.is_postorder() || !i.recursion_pending()) && remove(i->path(), ec)) {
+                ++n;
+            }
+        }
+        if (ec) {
+            return error_result;
+        }
+    }
+    
+    if (!remove(p, ec)) {
+        return error_result;
+    }
+    return n + 1;
+}
+
 void rename(const path& op, const path& np) {
     error_code ec;
     rename(op, np, ec);
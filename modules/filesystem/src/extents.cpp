@@ -0,0 +1,343 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <prosoft/core/config/config.h>
+
+#include "fsconfig.h"
+
+#if !_WIN32
+#include <fcntl.h>
+#include <sys/errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if __linux__
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+#else
+#include <windows.h>
+#endif
+
+#include <algorithm>
+#include <cstdint>
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_extents.hpp>
+#include "filesystem_private.hpp"
+#include "fsstore_private.hpp"
+
+namespace {
+
+using namespace prosoft::filesystem;
+
+#if !_WIN32
+file_extents_type whole_file(file_size_type size) {
+    file_extents_type l;
+    if (size > 0) {
+        l.push_back({0, size});
+    }
+    return l;
+}
+
+void append(file_extents_type& l, file_size_type offset, file_size_type length) {
+    if (!l.empty() && l.back().offset + l.back().length == offset) {
+        l.back().length += length;
+    } else {
+        l.push_back({offset, length});
+    }
+}
+
+// The FS (or platform) can't report holes.
+inline bool unsupported(int err) {
+    return EINVAL == err || ENOTSUP == err || EOPNOTSUPP == err || ENOTTY == err || ENOSYS == err;
+}
+
+// false if not supported
+bool seek_extents(int fd, file_extents_type& l, error_code& ec) {
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+    ::off_t off = 0;
+    for (;;) {
+        const auto data = ::lseek(fd, off, SEEK_DATA);
+        if (data < 0) {
+            if (ENXIO != errno) { // ENXIO: no data past off
+                if (l.empty() && unsupported(errno)) {
+                    return false;
+                }
+                ifilesystem::system_error(ec);
+            }
+            return true;
+        }
+        const auto hole = ::lseek(fd, data, SEEK_HOLE);
+        if (hole < 0) {
+            if (ENXIO != errno) { // truncated since seeking for data
+                ifilesystem::system_error(ec);
+            }
+            return true;
+        }
+        append(l, static_cast<file_size_type>(data), static_cast<file_size_type>(hole - data));
+        off = hole;
+    }
+#else
+    (void)fd;
+    (void)l;
+    (void)ec;
+    return false;
+#endif
+}
+
+#if __linux__
+// Preallocated (unwritten) extents read as zeros and are treated as holes, as SEEK_DATA does.
+bool map_extents(int fd, file_size_type size, file_extents_type& l, error_code& ec) {
+    constexpr size_t count = 128;
+    std::vector<std::uint64_t> buf((sizeof(::fiemap) + count * sizeof(::fiemap_extent)) / sizeof(std::uint64_t) + 1);
+    auto fm = reinterpret_cast<::fiemap*>(buf.data());
+    file_size_type off = 0;
+    while (off < size) {
+        std::fill(buf.begin(), buf.end(), 0);
+        fm->fm_start = off;
+        fm->fm_length = size - off;
+        fm->fm_flags = FIEMAP_FLAG_SYNC;
+        fm->fm_extent_count = count;
+        if (0 != ::ioctl(fd, FS_IOC_FIEMAP, fm)) {
+            if (l.empty() && unsupported(errno)) {
+                return false;
+            }
+            ifilesystem::system_error(ec);
+            return true;
+        }
+        if (0 == fm->fm_mapped_extents) {
+            break;
+        }
+        for (unsigned i = 0; i < fm->fm_mapped_extents; ++i) {
+            const auto& e = fm->fm_extents[i];
+            const auto start = std::max<file_size_type>(e.fe_logical, off);
+            const auto end = std::min<file_size_type>(e.fe_logical + e.fe_length, size);
+            if (start < end && !(e.fe_flags & FIEMAP_EXTENT_UNWRITTEN)) {
+                append(l, start, end - start);
+            }
+            off = (e.fe_flags & FIEMAP_EXTENT_LAST) ? size : std::max(off, end);
+        }
+    }
+    return true;
+}
+#endif // __linux__
+#endif // !_WIN32
+
+} // anon
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+file_extents_type file_extents(const path& p) {
+    error_code ec;
+    auto l = file_extents(p, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not get file extents", p, ec));
+    return l;
+}
+
+file_extents_type file_extents(const path& p, error_code& ec) {
+#if !_WIN32
+    ifilesystem::fd_close fd{::open(p.c_str(), O_RDONLY|O_CLOEXEC)};
+    if (fd.fd < 0) {
+        ifilesystem::system_error(ec);
+        return {};
+    }
+    return file_extents(fd.fd, ec);
+#else
+    const auto sz = file_size(p, ec);
+    file_extents_type l;
+    if (!ec.value() && sz > 0) {
+        l.push_back({0, sz});
+    }
+    return l;
+#endif
+}
+
+void allocate(const path& p, file_size_type size) {
+    error_code ec;
+    allocate(p, size, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not allocate file", p, ec));
+}
+
+void allocate(const path& p, file_size_type size, error_code& ec) {
+    ec.clear();
+#if !_WIN32
+    ifilesystem::fd_close fd{::open(p.c_str(), O_WRONLY|O_CREAT|O_CLOEXEC, 0666)};
+    if (fd.fd < 0) {
+        ifilesystem::system_error(ec);
+        return;
+    }
+    allocate(fd.fd, size, ec);
+#else
+    windows::Handle h{::CreateFileW(p.c_str(), GENERIC_READ|GENERIC_WRITE, FILE_SHARE_READ|FILE_SHARE_WRITE, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr)};
+    ::FILE_STANDARD_INFO si;
+    if (!h || !::GetFileInformationByHandleEx(h.get(), FileStandardInfo, &si, sizeof(si))) {
+        ifilesystem::system_error(ec);
+        return;
+    }
+    ::FILE_ALLOCATION_INFO ai;
+    ai.AllocationSize.QuadPart = static_cast<LONGLONG>(size);
+    if (!::SetFileInformationByHandle(h.get(), FileAllocationInfo, &ai, sizeof(ai))) {
+        ifilesystem::system_error(ec);
+        return;
+    }
+    if (static_cast<file_size_type>(si.EndOfFile.QuadPart) < size) {
+        ::FILE_END_OF_FILE_INFO ei;
+        ei.EndOfFile.QuadPart = static_cast<LONGLONG>(size);
+        if (!::SetFileInformationByHandle(h.get(), FileEndOfFileInfo, &ei, sizeof(ei))) {
+            ifilesystem::system_error(ec);
+        }
+    }
+#endif
+}
+
+#if !_WIN32
+file_extents_type file_extents(int fd, error_code& ec) {
+    ec.clear();
+    struct ::stat sb;
+    if (0 != ::fstat(fd, &sb)) {
+        ifilesystem::system_error(ec);
+        return {};
+    }
+    if (!S_ISREG(sb.st_mode)) {
+        ec = einval();
+        return {};
+    }
+    
+    const auto size = static_cast<file_size_type>(sb.st_size);
+    const auto cur = ::lseek(fd, 0, SEEK_CUR);
+    file_extents_type l;
+    bool found = seek_extents(fd, l, ec);
+#if __linux__
+    if (!found) {
+        found = map_extents(fd, size, l, ec);
+    }
+#endif
+    if (cur >= 0) {
+        (void)::lseek(fd, cur, SEEK_SET);
+    }
+    if (ec.value()) {
+        return {};
+    }
+    return found ? l : whole_file(size);
+}
+
+void allocate(int fd, file_size_type size, error_code& ec) {
+    ec.clear();
+    if (0 == size) {
+        return;
+    }
+    const auto len = static_cast<::off_t>(size);
+    if (len < 0) {
+        ifilesystem::error(EFBIG, ec);
+        return;
+    }
+#if __linux__
+    if (0 == ::fallocate(fd, 0, 0, len)) {
+        return;
+    }
+    if (EOPNOTSUPP != errno && ENOSYS != errno) {
+        ifilesystem::system_error(ec);
+        return;
+    }
+#endif
+#if __APPLE__
+    struct ::stat sb;
+    if (0 != ::fstat(fd, &sb)) {
+        ifilesystem::system_error(ec);
+        return;
+    }
+    if (sb.st_size < len) {
+        // Allocates past the physical EOF, contiguous if possible.
+        ::fstore_t fst{F_ALLOCATECONTIG, F_PEOFPOSMODE, 0, len - sb.st_size, 0};
+        if (-1 == ::fcntl(fd, F_PREALLOCATE, &fst)) {
+            fst.fst_flags = F_ALLOCATEALL;
+            if (-1 == ::fcntl(fd, F_PREALLOCATE, &fst)) {
+                ifilesystem::system_error(ec);
+                return;
+            }
+        }
+        if (0 != ::ftruncate(fd, len)) {
+            ifilesystem::system_error(ec);
+        }
+    }
+#else
+    // posix_fallocate returns the error, errno is not set.
+    if (const int err = ::posix_fallocate(fd, 0, len)) {
+        ifilesystem::error(err, ec);
+    }
+#endif
+}
+#endif // !_WIN32
+
+} // v1
+} // filesystem
+} // prosoft
+
+#if PSTEST_HARNESS && __linux__
+// Internal tests.
+#include <catch2/catch_test_macros.hpp>
+#include "fstestutils.hpp"
+
+TEST_CASE("extents_internal") {
+    using namespace prosoft::filesystem;
+    
+    constexpr ::off_t mb = 1024 * 1024;
+    const auto p = temp_directory_path() / process_name("fs17extents_internal");
+    ifilesystem::fd_close fd{::open(p.c_str(), O_RDWR|O_CREAT|O_TRUNC, 0600)};
+    REQUIRE(fd.fd >= 0);
+    PS_RAII_REMOVE(p);
+    const std::string data(8192, 'x');
+    REQUIRE(::pwrite(fd.fd, data.data(), data.size(), mb) == 8192);
+    REQUIRE(::pwrite(fd.fd, data.data(), data.size(), 3 * mb) == 8192);
+    REQUIRE(0 == ::ftruncate(fd.fd, 5 * mb));
+    
+    error_code ec;
+    file_extents_type seeked;
+    REQUIRE(seek_extents(fd.fd, seeked, ec));
+    CHECK_FALSE(ec.value());
+    file_extents_type mapped;
+    if (map_extents(fd.fd, 5 * mb, mapped, ec)) {
+        CHECK_FALSE(ec.value());
+        REQUIRE(mapped.size() == seeked.size());
+        for (size_t i = 0; i < mapped.size(); ++i) {
+            CHECK(mapped[i].offset == seeked[i].offset);
+            CHECK(mapped[i].length == seeked[i].length);
+        }
+    }
+    
+    WHEN("merging extents") {
+        file_extents_type l;
+        append(l, 0, 10);
+        append(l, 10, 10);
+        append(l, 30, 10);
+        REQUIRE(l.size() == 2);
+        CHECK(l[0].length == 20);
+        CHECK(l[1].offset == 30);
+    }
+}
+#endif // PSTEST_HARNESS
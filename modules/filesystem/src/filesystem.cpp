@@ -28,15 +28,20 @@
 #include "fsconfig.h"
 
 #if !_WIN32
+#include <fcntl.h>
 #include <sys/errno.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 #include <unistd.h>
+#if PS_FS_HAVE_STATX
+#include <sys/sysmacros.h>
+#endif
 #else
 #include <windows.h>
 #include <array>
 #endif
 
+#include <atomic>
 #include <cstring>
 
 #include <prosoft/core/include/unique_resource.hpp>
@@ -113,11 +118,6 @@ struct to_times {
 #if defined(st_birthtime)
     #define PS_ST_BTIME st_birthtimespec
 #endif
-    file_time_type from(const struct timespec& ts) const {
-        using namespace std::chrono;
-        using fduration = typename file_time_type::duration;
-        return file_time_type{ duration_cast<fduration>(seconds{ts.tv_sec}) + duration_cast<fduration>(nanoseconds{ts.tv_nsec}) };
-    }
 #else
     #define PS_ST_MTIME st_mtime
     #define PS_ST_CTIME st_ctime
@@ -126,6 +126,11 @@ struct to_times {
         return file_time_type::clock::from_time_t(t);
     }
 #endif
+    file_time_type from(const struct timespec& ts) const {
+        using namespace std::chrono;
+        using fduration = typename file_time_type::duration;
+        return file_time_type{ duration_cast<fduration>(seconds{ts.tv_sec}) + duration_cast<fduration>(nanoseconds{ts.tv_nsec}) };
+    }
     
     times operator()(const stat_buf& sb) const {
         times t;
@@ -146,29 +151,39 @@ struct to_times {
 #endif
 };
 
-file_status file_stat(decltype(::stat) statcall, const path& p, status_info what, error_code& ec) {
+file_status file_stat(decltype(::stat) statcall, int flags, const path& p, status_info what, error_code& ec) {
+#if PS_FS_HAVE_STATX
+    static std::atomic<bool> have_statx{true};
+    if (have_statx) {
+        struct ::statx sx;
+        if (0 == ::statx(AT_FDCWD, p.c_str(), flags, ifilesystem::statx_mask(what), &sx)) {
+            ec.clear();
+            return ifilesystem::make_status(sx, what);
+        } else if (ENOSYS != errno && EPERM != errno) {
+            ifilesystem::system_error(ec);
+            return ifilesystem::make_status(ec);
+        }
+        have_statx = false; // pre 4.11 kernel, or a seccomp profile that predates statx and denies it with EPERM
+    }
+#else
+    (void)flags;
+#endif
     stat_buf sb;
     if (0 == statcall(p.c_str(), &sb)) {
         ec.clear();
-        // Not a big type conversion cost, so just do minimal/complete
-        if (status_info::basic == what) {
-            return file_status{to_file_type{}(sb)};
-        } else {
-            static_assert(sizeof(file_size_type) >= sizeof(sb.st_size), "Broken assumption");
-            return file_status{to_file_type{}(sb), to_perms{}(sb), file_size_type(sb.st_size), to_owner{}(sb), to_times{}(sb)};
-        }
+        return ifilesystem::make_status(sb, what);
     } else {
         ifilesystem::system_error(ec);
-        return file_status{to_file_type{}(ec)};
+        return ifilesystem::make_status(ec);
     }
 }
 
 inline file_status file_stat(const path& p, status_info what, error_code& ec) {
-    return file_stat(::stat, p, what, ec);
+    return file_stat(::stat, 0, p, what, ec);
 }
 
 inline file_status link_stat(const path& p, status_info what, error_code& ec) {
-    return file_stat(::lstat, p, what, ec);
+    return file_stat(::lstat, AT_SYMLINK_NOFOLLOW, p, what, ec);
 }
 
 #else
@@ -395,21 +410,39 @@ file_status file_stat(const path& p, status_info what, error_code& ec, bool link
         auto o = owner::invalid_owner();
         perms ap = perms::unknown;
         if (is_set(what & status_info::perms)) {
-            ap = to_perms{}(p, o, lec);
+            ap = to_perms{}(p, o, lec); // the owner is a side effect
+        }
+        if (is_set(what & status_info::owner)) {
+            if (o == owner::invalid_owner()) {
+                o = ifilesystem::make_owner(p, lec);
+            }
+        } else {
+            o = owner::invalid_owner();
         }
         auto&& np = ifilesystem::to_native_path{}(p.native());
         times t;
         file_size_type sz{};
-        if (is_set(what & (status_info::times|status_info::size))) {
+        std::uint64_t dev{};
+        std::uint64_t ino{};
+        if (is_set(what & (status_info::times|status_info::size|status_info::inode))) {
             ::BY_HANDLE_FILE_INFORMATION info;
             if (ifilesystem::finfo(np, &info, lec)) {
-                t = to_times{}(info);
-                if (get_type(attrs) == file_type::regular) {
+                if (is_set(what & status_info::times)) {
+                    t = to_times{}(info);
+                }
+                if (is_set(what & status_info::size) && get_type(attrs) == file_type::regular) {
                     sz = to_size(info);
                 }
+                if (is_set(what & status_info::inode)) {
+                    dev = info.dwVolumeSerialNumber;
+                    ino = std::uint64_t(info.nFileIndexLow) | (std::uint64_t(info.nFileIndexHigh) << 32ULL);
+                }
             }
         }
-        return file_status{get_type(np, attrs, link), ap, sz, std::move(o), t};
+        file_status st{get_type(np, attrs, link), ap, sz, std::move(o), t};
+        st.device(dev);
+        st.inode(ino);
+        return st;
     } else {
         if (is_device_path(p)) {
             return file_status{to_file_type{}(FILE_ATTRIBUTE_DEVICE)}; // We know the type from the path, so return it.
@@ -574,6 +607,88 @@ void last_write_time(const path& p, file_time_type t, error_code& ec) noexcept {
 #endif
 }
 
+#if !_WIN32
+namespace ifilesystem { // private API
+
+file_status make_status(const struct ::stat& sb, status_info what) {
+    file_status st{to_file_type{}(sb)};
+    if (is_set(what & status_info::perms)) {
+        st.permissions(to_perms{}(sb));
+    }
+    if (is_set(what & status_info::size)) {
+        static_assert(sizeof(file_size_type) >= sizeof(sb.st_size), "Broken assumption");
+        st.size(file_size_type(sb.st_size));
+    }
+    if (is_set(what & status_info::owner)) {
+        st.owner(to_owner{}(sb));
+    }
+    if (is_set(what & status_info::times)) {
+        st.times(to_times{}(sb));
+    }
+    if (is_set(what & status_info::inode)) {
+        st.device(static_cast<std::uint64_t>(sb.st_dev));
+        st.inode(static_cast<std::uint64_t>(sb.st_ino));
+    }
+    return st;
+}
+
+#if PS_FS_HAVE_STATX
+unsigned statx_mask(status_info what) noexcept {
+    unsigned mask = STATX_TYPE;
+    if (is_set(what & status_info::perms)) {
+        mask |= STATX_MODE;
+    }
+    if (is_set(what & status_info::size)) {
+        mask |= STATX_SIZE;
+    }
+    if (is_set(what & status_info::owner)) {
+        mask |= STATX_UID|STATX_GID;
+    }
+    if (is_set(what & status_info::times)) {
+        mask |= STATX_ATIME|STATX_MTIME|STATX_CTIME|STATX_BTIME;
+    }
+    if (is_set(what & status_info::inode)) {
+        mask |= STATX_INO;
+    }
+    return mask;
+}
+
+file_status make_status(const struct ::statx& sx, status_info what) {
+    stat_buf sb;
+    std::memset(&sb, 0, sizeof(sb));
+    sb.st_dev = makedev(sx.stx_dev_major, sx.stx_dev_minor);
+    sb.st_ino = sx.stx_ino;
+    sb.st_mode = sx.stx_mode;
+    sb.st_nlink = sx.stx_nlink;
+    sb.st_uid = sx.stx_uid;
+    sb.st_gid = sx.stx_gid;
+    sb.st_size = static_cast<off_t>(sx.stx_size);
+    sb.st_atim.tv_sec = sx.stx_atime.tv_sec;
+    sb.st_atim.tv_nsec = sx.stx_atime.tv_nsec;
+    sb.st_mtim.tv_sec = sx.stx_mtime.tv_sec;
+    sb.st_mtim.tv_nsec = sx.stx_mtime.tv_nsec;
+    sb.st_ctim.tv_sec = sx.stx_ctime.tv_sec;
+    sb.st_ctim.tv_nsec = sx.stx_ctime.tv_nsec;
+    auto st = make_status(sb, what);
+    if (is_set(what & status_info::times) && 0 != (sx.stx_mask & STATX_BTIME)) { // not all filesystems have it
+        auto t = st.times();
+        struct timespec ts;
+        ts.tv_sec = static_cast<decltype(ts.tv_sec)>(sx.stx_btime.tv_sec);
+        ts.tv_nsec = static_cast<decltype(ts.tv_nsec)>(sx.stx_btime.tv_nsec);
+        t.created(to_times{}.from(ts));
+        st.times(t);
+    }
+    return st;
+}
+#endif
+
+file_status make_status(const error_code& ec) {
+    return file_status{to_file_type{}(ec)};
+}
+
+} // ifilesystem
+#endif // !_WIN32
+
 #if _WIN32
 namespace ifilesystem { // private API
 
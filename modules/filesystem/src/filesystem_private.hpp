@@ -26,7 +26,13 @@
 #ifndef PS_CORE_FILESYSTEM_PRIVATE_HPP
 #define PS_CORE_FILESYSTEM_PRIVATE_HPP
 
-#if _WIN32
+#include <memory>
+#include <type_traits>
+
+#if !_WIN32
+#include <sys/acl.h>
+#include <sys/stat.h>
+#else
 #include <prosoft/core/include/unique_resource.hpp>
 #endif
 
@@ -77,6 +83,22 @@ inline filesystem_error system_error(const char* msg) {
 
 #if !_WIN32
 constexpr const char* TMPDIR = "TMPDIR";
+
+// The conversions used by status() (in filesystem.cpp)
+file_status make_status(const struct ::stat&, status_info);
+file_status make_status(const error_code&);
+#if PS_FS_HAVE_STATX
+// Only what's needed for the info is requested.
+unsigned statx_mask(status_info) noexcept;
+file_status make_status(const struct ::statx&, status_info);
+#endif
+
+struct acl_delete {
+    void operator()(void* p) noexcept {
+        (void)::acl_free(p);
+    }
+};
+using unique_acl = std::unique_ptr<std::remove_pointer<::acl_t>::type, acl_delete>;
 #endif
 
 #if _WIN32
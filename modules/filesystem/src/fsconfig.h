@@ -29,5 +29,7 @@
 
 #define PS_FS_HAVE_BSD_STATFS __APPLE__ || __FreeBSD__ || __OpenBSD__ || __NetBSD__
 #define PS_FS_HAVE_MNTENT_H __linux__
+#define PS_FS_HAVE_IO_URING __linux__ // requires 5.6+ kernel headers, availability is checked at runtime
+#define PS_FS_HAVE_STATX __linux__ // requires glibc 2.28+, availability is checked at runtime
 
 #endif // PS_CORE_FILESYSTEM_CONFIG_H
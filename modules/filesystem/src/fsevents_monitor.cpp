@@ -98,6 +98,10 @@ struct platform_state : public fs::change_state {
     prosoft::unique_cftype<CFUUIDRef> m_uuid; // set when constructed and then read-only
     std::string m_uuid_str; // cached for persistence
     std::atomic<FSEventStreamEventId> m_lastid;
+    std::atomic<std::uint64_t> m_collapsed;
+    std::atomic<std::uint64_t> m_dropped;
+    size_t m_maxpending;
+    bool m_coalesce;
     
     platform_state()
         : m_callback()
@@ -106,13 +110,21 @@ struct platform_state : public fs::change_state {
         , m_rootfd(-1)
         , m_stopid(0)
         , m_uuid()
-        , m_lastid(kFSEventStreamEventIdSinceNow) {}
+        , m_lastid(kFSEventStreamEventIdSinceNow)
+        , m_collapsed(0)
+        , m_dropped(0)
+        , m_maxpending(0)
+        , m_coalesce(false) {}
     platform_state(const fs::path&, const fs::change_config&, fs::error_code&);
     platform_state(const std::string&, fs::change_thaw_options); // from serialzed data
     virtual ~platform_state();
     
     virtual fs::change_event_id last_event_id() const override;
     
+    virtual fs::change_counters counters() const override {
+        return fs::change_counters{m_collapsed.load(), m_dropped.load()};
+    }
+    
     virtual std::string serialize() const override;
     virtual std::string serialize(fs::change_event_id) const override;
     
@@ -123,6 +135,22 @@ struct platform_state : public fs::change_state {
 
 using shared_state = std::shared_ptr<platform_state>;
 shared_state get_shared_state(platform_state*);
+fs::path canonical_root_path(const platform_state*);
+
+void collapse(platform_state* state, fs::change_notifications& notes) {
+    if (state->m_maxpending > 0 && notes.size() > state->m_maxpending) {
+        const auto cc = fs::change_manager::collapse(notes, canonical_root_path(state), state->m_maxpending);
+        state->m_collapsed += cc.collapsed;
+        state->m_dropped += cc.dropped;
+    }
+}
+
+// FSEvents already merges the flags of events for the same path, this folds the separate events it reports.
+void coalesce(platform_state* state, fs::change_notifications& notes) {
+    if (state->m_coalesce) {
+        fs::change_manager::coalesce(notes);
+    }
+}
 
 fs::change_event to_event(FSEventStreamEventFlags flags) {
     fs::change_event evts{};
@@ -198,7 +226,7 @@ void dispatch_events::callout_to_client(platform_state* state, fs::change_notifi
             // Before the callback so the client can archive the state with the correct id.
             ss->m_lastid = lastNoteID;
         }
-        PSIgnoreCppException(fs::change_manager::process_renames(*n); ss->m_callback(std::move(*n)));
+        PSIgnoreCppException(fs::change_manager::process_renames(*n); coalesce(ss.get(), *n); collapse(ss.get(), *n); ss->m_callback(std::move(*n)));
     }
 }
 
@@ -398,6 +426,8 @@ dispatch_queue_t make_monitor_queue(dev_t dev) {
 platform_state::platform_state(const fs::path& p, const fs::change_config& cfg, fs::error_code& ec)
     : platform_state() {
     using namespace fs;
+    m_maxpending = cfg.max_pending_events;
+    m_coalesce = cfg.coalesce_events;
     auto cfp = prosoft::to_CFString<fs::path::string_type>{}(p);
     if (!cfp) {
         ec = error_code(platform_error::convert_path, platform_category());
@@ -748,11 +778,11 @@ std::unique_ptr<change_state> change_state::serialize(const std::string& s, chan
 #endif
 }
 
-bool operator==(const change_state& lhs, const change_state& rhs) {
-    return &lhs == &rhs; // All copies of change_registration point to a shared platform state
-}
-
 change_registration monitor(const path& p, const change_config& cfg, change_callback cb, error_code& ec) {
+    if (cfg.backend == change_monitor_backend::polling) {
+        return polling_monitor(p, cfg, std::move(cb), false, ec);
+    }
+    
     if (p.empty() || !valid(cfg) || !cb) {
         ec = einval();
         return change_registration{};
@@ -764,6 +794,10 @@ change_registration monitor(const path& p, const change_config& cfg, change_call
 }
 
 change_registration recursive_monitor(const path& p, const change_config& cfg, change_callback cb, error_code& ec) {
+    if (cfg.backend == change_monitor_backend::polling) {
+        return polling_monitor(p, cfg, std::move(cb), true, ec);
+    }
+    
     if (p.empty() || !valid(cfg) || !cb) {
         ec = einval();
         return change_registration{};
@@ -780,6 +814,9 @@ change_registration recursive_monitor(const path& p, const change_config& cfg, c
 
 void stop(change_state* state, error_code& ec) {
     PSASSERT_NOTNULL(state);
+    if (stop_polling_monitor(state, ec)) {
+        return;
+    }
     if (auto fsep = dynamic_cast<platform_state*>(state)) {
         unregister_events_monitor(fsep, ec);
         // fsep is probably bad now
@@ -788,32 +825,6 @@ void stop(change_state* state, error_code& ec) {
     }
 }
 
-void change_manager::process_renames(fs::change_notifications& notes) {
-    size_t count = notes.size();
-    for (size_t i = 0; i < count; ++i) {
-        auto& n = notes[i];
-        // XXX: this fails if FS events are merged (e.g. create and rename) as the merged event will not have the same id as the pure rename event
-        if (is_set(n.event() & fs::change_event::renamed) && n.m_eventid > 0) {
-            for (size_t j = i+1; j < count; ++j) {
-                auto& nn = notes[j];
-                if (is_set(nn.event() & fs::change_event::renamed) && n.m_eventid == nn.m_eventid) {
-                    if (!is_set(nn.event() & fs::change_event::removed)) {
-                        // rename within the tree and within the same latency period.
-                        n.m_newpath = std::move(nn.path());
-                        notes.erase(notes.begin()+j); // need to maintain order, swap() trick with last() will not work
-                        --count;
-                    } else {
-                        nn.m_event &= ~fs::change_event::renamed;
-                    }
-                    break;
-                }
-            }
-        }
-        
-        // Other methods of detecting a rename (such as using stat on the paths of renamed events) are prone to race conditions.
-    }
-}
-
 } // v1
 } // filesystem
 } // prosoft
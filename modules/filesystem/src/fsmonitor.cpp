@@ -25,6 +25,13 @@
 
 #include <prosoft/core/config/config_platform.h>
 
+#include <algorithm>
+#include <iterator>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
 #include <prosoft/core/modules/filesystem/filesystem.hpp>
 #include <prosoft/core/modules/filesystem/filesystem_change_monitor.hpp>
 #if PS_HAVE_FILESYSTEM_CHANGE_MONITOR
@@ -55,7 +62,9 @@ void stop(const change_registration& reg, error_code& ec) {
     if (reg) {
         if (auto p = change_manager::state(reg)) {
             ec.clear();
-            stop(p.get(), ec);
+            if (!stop_hub_registration(p.get(), ec)) {
+                stop(p.get(), ec);
+            }
             return;
         }
     }
@@ -71,6 +80,168 @@ void stop(const change_registration& reg) {
 
 // private
 
+bool operator==(const change_state& lhs, const change_state& rhs) {
+    return &lhs == &rhs; // All copies of change_registration point to a shared platform state
+}
+
+// Pairs rename events that share an event id. Each rename is paired with the next rename using the same id (if any) and
+// if that event is not a remove it's folded into the first event as the new path, otherwise it's just a remove.
+// XXX: this fails if FS events are merged (e.g. create and rename) as the merged event will not have the same id as the pure rename event
+void change_manager::process_renames(fs::change_notifications& notes) {
+    std::unordered_map<evid_type, size_t> unpaired; // event id -> first rename without a match
+    std::vector<bool> folded;
+    for (size_t i = 0; i < notes.size(); ++i) {
+        auto& n = notes[i];
+        if (!is_set(n.event() & fs::change_event::renamed) || n.m_eventid == 0) {
+            continue;
+        }
+        auto u = unpaired.find(n.m_eventid);
+        if (u == unpaired.end()) {
+            unpaired.emplace(n.m_eventid, i);
+            continue;
+        }
+        
+        if (!is_set(n.event() & fs::change_event::removed)) {
+            // rename within the tree and within the same latency period.
+            notes[u->second].m_newpath = std::move(n.m_path);
+            if (folded.empty()) {
+                folded.resize(notes.size());
+            }
+            folded[i] = true;
+        } else {
+            n.m_event &= ~fs::change_event::renamed;
+        }
+        unpaired.erase(u);
+    }
+    
+    // Other methods of detecting a rename (such as using stat on the paths of renamed events) are prone to race conditions.
+    
+    if (!folded.empty()) { // stable compaction, order must be maintained
+        size_t out = 0;
+        for (size_t i = 0; i < notes.size(); ++i) {
+            if (!folded[i]) {
+                if (out != i) {
+                    notes[out] = std::move(notes[i]);
+                }
+                ++out;
+            }
+        }
+        notes.erase(notes.begin() + out, notes.end());
+    }
+}
+
+change_counters change_manager::collapse(fs::change_notifications& notes, const path& root, size_t max) {
+    change_counters cc{};
+    if (max == 0 || notes.size() <= max) {
+        return cc;
+    }
+    
+    fs::change_notifications rescans;
+    std::unordered_set<std::string> dirs;
+    bool toroot = false;
+    auto add = [&](const path& p, std::uintptr_t regid) {
+        auto dir = p == root ? p : p.parent_path();
+        if (!dirs.emplace(dir.c_str()).second) {
+            return;
+        }
+        if (rescans.size() >= max) {
+            // too many dirs, everything but cancellations is replaced by a rescan of the root
+            auto i = std::remove_if(rescans.begin(), rescans.end(), [](const change_notification& n) {
+                return !canceled(n);
+            });
+            cc.dropped += std::distance(i, rescans.end());
+            rescans.erase(i, rescans.end());
+            dir = root;
+            toroot = true;
+        }
+        rescans.emplace_back(std::move(dir), path{}, 0, change_event::rescan, file_type::directory);
+        rescans.back().m_regid = regid;
+    };
+    
+    for (auto& n : notes) {
+        if (canceled(n)) {
+            rescans.push_back(std::move(n));
+        } else if (toroot) {
+            ++cc.dropped;
+        } else {
+            ++cc.collapsed;
+            add(n.path(), n.m_regid);
+            if (!toroot && !n.renamed_to_path().empty()) {
+                add(n.renamed_to_path(), n.m_regid);
+            }
+        }
+    }
+    
+    notes.swap(rescans);
+    return cc;
+}
+
+change_event change_manager::coalesce(change_event pending, change_event ev) noexcept {
+    constexpr auto unfolded = change_event::renamed|change_event::rescan|change_event::canceled;
+    if (pending == change_event::none) {
+        return ev;
+    }
+    if (is_set((pending|ev) & unfolded)) {
+        return pending|ev;
+    }
+    
+    if (is_set(ev & change_event::removed)) {
+        if (is_set(pending & change_event::created) && !is_set(pending & change_event::removed)) {
+            return change_event::none; // never existed outside of the latency period
+        }
+        return change_event::removed|(ev & ~change_event::all); // modifications are moot
+    }
+    if (is_set(ev & change_event::created) && is_set(pending & change_event::removed)) {
+        return change_event::removed|ev; // replaced, may be a different type
+    }
+    return pending|ev;
+}
+
+void change_manager::coalesce(fs::change_notifications& notes) {
+    std::unordered_map<std::string, size_t> pending; // path -> first event
+    std::vector<bool> folded;
+    for (size_t i = 0; i < notes.size(); ++i) {
+        auto& n = notes[i];
+        if (is_set(n.event() & (change_event::renamed|change_event::rescan|change_event::canceled))) {
+            // Later events for these paths happened after the rename, so they can't be folded into earlier events.
+            pending.erase(n.path().c_str());
+            if (!n.renamed_to_path().empty()) {
+                pending.erase(n.renamed_to_path().c_str());
+            }
+            continue;
+        }
+        
+        auto p = pending.find(n.path().c_str());
+        if (p == pending.end()) {
+            pending.emplace(n.path().c_str(), i);
+            continue;
+        }
+        
+        auto& first = notes[p->second];
+        first.m_event = coalesce(first.m_event, n.m_event);
+        if (n.type() != file_type::none) {
+            first.m_type = n.type();
+        }
+        if (folded.empty()) {
+            folded.resize(notes.size());
+        }
+        folded[i] = true;
+    }
+    
+    if (!folded.empty()) { // stable compaction, order must be maintained
+        size_t out = 0;
+        for (size_t i = 0; i < notes.size(); ++i) {
+            if (!folded[i] && notes[i].event() != change_event::none) {
+                if (out != i) {
+                    notes[out] = std::move(notes[i]);
+                }
+                ++out;
+            }
+        }
+        notes.erase(notes.begin() + out, notes.end());
+    }
+}
+
 bool valid(const fs::change_config& cfg) {
     return cfg.events != fs::change_event::none
         && cfg.notification_latency >= decltype(cfg.notification_latency){}
@@ -106,4 +277,121 @@ const std::error_category& platform_category() noexcept(std::is_nothrow_default_
 } // v1
 } // filesystem
 } // prosoft
+
+#if PSTEST_HARNESS
+// Internal tests.
+#include <catch2/catch_test_macros.hpp>
+
+using namespace prosoft::filesystem;
+
+TEST_CASE("fsmonitor_internal") {
+    change_notifications notes;
+    auto add = [&notes](const char* p, change_event ev, change_event_id evid) {
+        notes.emplace_back(path{p}, path{}, evid, ev, file_type::regular);
+    };
+    
+    WHEN("renames are paired") {
+        add("a", change_event::renamed, 1);
+        add("x", change_event::created, 2);
+        add("b", change_event::renamed, 3);
+        add("a2", change_event::renamed, 1);
+        add("c", change_event::renamed, 0); // no id
+        add("b2", change_event::renamed, 3);
+        add("c2", change_event::renamed, 0);
+        change_manager::process_renames(notes);
+        REQUIRE(notes.size() == 5);
+        CHECK(notes[0].path() == path{"a"});
+        CHECK(notes[0].renamed_to_path() == path{"a2"});
+        CHECK(notes[1].path() == path{"x"});
+        CHECK(notes[2].path() == path{"b"});
+        CHECK(notes[2].renamed_to_path() == path{"b2"});
+        CHECK(notes[3].path() == path{"c"});
+        CHECK(notes[3].renamed_to_path().empty());
+        CHECK(notes[4].path() == path{"c2"});
+    }
+    
+    WHEN("a rename is paired with a remove") {
+        add("a", change_event::renamed, 1);
+        add("a2", change_event::renamed|change_event::removed, 1);
+        add("a3", change_event::renamed, 1);
+        change_manager::process_renames(notes);
+        REQUIRE(notes.size() == 3);
+        CHECK(notes[0].renamed_to_path().empty());
+        CHECK(notes[1].event() == change_event::removed);
+        CHECK(notes[2].event() == change_event::renamed);
+        CHECK(notes[2].renamed_to_path().empty());
+    }
+    
+    WHEN("more than 2 renames share an id") {
+        add("a", change_event::renamed, 1);
+        add("a2", change_event::renamed, 1);
+        add("a3", change_event::renamed, 1);
+        add("a4", change_event::renamed, 1);
+        change_manager::process_renames(notes);
+        REQUIRE(notes.size() == 2);
+        CHECK(notes[0].renamed_to_path() == path{"a2"});
+        CHECK(notes[1].path() == path{"a3"});
+        CHECK(notes[1].renamed_to_path() == path{"a4"});
+    }
+    
+    WHEN("collapsing events") {
+        const path root{"/r"};
+        add("/r/a/1", change_event::created, 1);
+        add("/r/a/2", change_event::created, 2);
+        add("/r/b/1", change_event::created, 3);
+        auto notes2 = notes;
+        auto cc = change_manager::collapse(notes, root, 3);
+        CHECK(notes.size() == 3); // under the limit
+        CHECK(cc.collapsed == 0);
+        
+        cc = change_manager::collapse(notes, root, 2);
+        REQUIRE(notes.size() == 2);
+        CHECK(notes[0].path() == path{"/r/a"});
+        CHECK(notes[0].event() == change_event::rescan);
+        CHECK(notes[1].path() == path{"/r/b"});
+        CHECK(cc.collapsed == 3);
+        CHECK(cc.dropped == 0);
+        
+        cc = change_manager::collapse(notes2, root, 1);
+        REQUIRE(notes2.size() == 1);
+        CHECK(notes2[0].path() == root);
+        CHECK(cc.collapsed == 3);
+        CHECK(cc.dropped == 1); // the rescan of /r/a
+    }
+    
+    WHEN("coalescing an event") {
+        using cm = change_manager;
+        CHECK(cm::coalesce(change_event::none, change_event::created) == change_event::created);
+        CHECK(cm::coalesce(change_event::created, change_event::content_modified) == (change_event::created|change_event::content_modified));
+        CHECK(cm::coalesce(change_event::content_modified, change_event::metadata_modified) == change_event::modified);
+        CHECK(cm::coalesce(change_event::created|change_event::modified, change_event::removed) == change_event::none);
+        CHECK(cm::coalesce(change_event::modified, change_event::removed|change_event::outside_tree) == (change_event::removed|change_event::outside_tree));
+        CHECK(cm::coalesce(change_event::removed, change_event::created) == (change_event::removed|change_event::created));
+        CHECK(cm::coalesce(change_event::removed|change_event::created, change_event::removed) == change_event::removed);
+        CHECK(cm::coalesce(change_event::created, change_event::renamed) == (change_event::created|change_event::renamed));
+    }
+    
+    WHEN("coalescing events") {
+        add("a", change_event::created, 1);
+        add("b", change_event::content_modified, 2);
+        add("a", change_event::content_modified, 3);
+        add("b", change_event::content_modified, 4);
+        add("a", change_event::removed, 5);
+        add("c", change_event::renamed, 6);
+        add("c", change_event::created, 7);
+        add("c", change_event::removed, 8);
+        add("a", change_event::created, 9);
+        change_manager::coalesce(notes);
+        REQUIRE(notes.size() == 3);
+        CHECK(notes[0].path() == path{"a"}); // dropped and recreated
+        CHECK(notes[0].event() == change_event::created);
+        CHECK(notes[1].path() == path{"b"});
+        CHECK(notes[1].event() == change_event::content_modified);
+        CHECK(notes[2].path() == path{"c"}); // events before the rename are not folded into later events
+        CHECK(notes[2].event() == change_event::renamed);
+    }
+}
+
+#endif // PSTEST_HARNESS
+
 #endif // PS_HAVE_FILESYSTEM_CHANGE_MONITOR
@@ -33,6 +33,13 @@ inline namespace v1 {
 bool valid(const fs::change_config&);
 void stop(change_state*, error_code&);
 
+// Portable polling backend, see change_monitor_backend::polling.
+change_registration polling_monitor(const path&, const change_config&, change_callback&&, bool recursive, error_code&);
+// Returns false if the state is not a polling monitor.
+bool stop_polling_monitor(change_state*, error_code&);
+// Returns false if the state is not a change_hub registration.
+bool stop_hub_registration(change_state*, error_code&);
+
 class change_manager {
     using evid_type = change_notification::platform_event_id_type;
 public:
@@ -58,6 +65,15 @@ public:
     }
     
     static void process_renames(fs::change_notifications&);
+    
+    // Applies change_config::max_pending_events to a batch of events, for backends that do not track pending events themselves.
+    static change_counters collapse(fs::change_notifications&, const path& root, size_t max);
+    
+    // Folds a new event for a path into its pending event, see change_config::coalesce_events.
+    // Returns none if nothing should be reported for the path.
+    static change_event coalesce(change_event pending, change_event) noexcept;
+    // Ditto for a batch of events, for backends that do not fold events as they occur.
+    static void coalesce(fs::change_notifications&);
 };
 
 enum platform_error {
@@ -0,0 +1,225 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef PS_CORE_FSSTORE_PRIVATE_HPP
+#define PS_CORE_FSSTORE_PRIVATE_HPP
+
+// Helpers for the flat binary stores used by the listing cache and tree manifests.
+// Stores are written in native byte order and are not meant to be portable between systems.
+
+#if !_WIN32
+#include <fcntl.h>
+#include <sys/errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+namespace ifilesystem {
+
+class store_writer {
+    std::string m_buf;
+public:
+    template <typename T>
+    void put(T val) {
+        static_assert(std::is_trivially_copyable<T>::value, "Broken assumption");
+        m_buf.append(reinterpret_cast<const char*>(&val), sizeof(val));
+    }
+
+    void put(const char* p, size_t sz) {
+        m_buf.append(p, sz);
+    }
+
+    void put(const std::string& s) {
+        put(static_cast<std::uint32_t>(s.size()));
+        m_buf.append(s);
+    }
+
+    template <typename T>
+    void put(const std::vector<T>& v) {
+        static_assert(std::is_trivially_copyable<T>::value, "Broken assumption");
+        m_buf.append(reinterpret_cast<const char*>(v.data()), v.size() * sizeof(T));
+    }
+
+    const std::string& data() const noexcept {
+        return m_buf;
+    }
+};
+
+class store_reader {
+    const char* m_cur;
+    const char* m_end;
+public:
+    store_reader(const char* p, size_t sz) noexcept
+        : m_cur(p)
+        , m_end(p + sz) {}
+
+    template <typename T>
+    bool get(T& val) noexcept {
+        if (static_cast<size_t>(m_end - m_cur) < sizeof(val)) {
+            return false;
+        }
+        std::memcpy(&val, m_cur, sizeof(val));
+        m_cur += sizeof(val);
+        return true;
+    }
+
+    bool get(std::string& s) {
+        std::uint32_t sz;
+        if (!get(sz) || static_cast<size_t>(m_end - m_cur) < sz) {
+            return false;
+        }
+        s.assign(m_cur, sz);
+        m_cur += sz;
+        return true;
+    }
+
+    // Reads a column of n values.
+    template <typename T>
+    bool get(std::vector<T>& v, size_t n) {
+        static_assert(std::is_trivially_copyable<T>::value, "Broken assumption");
+        if (static_cast<size_t>(m_end - m_cur) / sizeof(T) < n) {
+            return false;
+        }
+        v.resize(n);
+        std::memcpy(v.data(), m_cur, n * sizeof(T));
+        m_cur += n * sizeof(T);
+        return true;
+    }
+
+    bool get(std::string& s, size_t n) {
+        if (static_cast<size_t>(m_end - m_cur) < n) {
+            return false;
+        }
+        s.assign(m_cur, n);
+        m_cur += n;
+        return true;
+    }
+
+    bool at_end() const noexcept {
+        return m_cur == m_end;
+    }
+};
+
+struct fd_close {
+    int fd;
+    ~fd_close() {
+        if (fd >= 0) {
+            (void)::close(fd);
+        }
+    }
+};
+
+struct map_close {
+    void* mem;
+    size_t size;
+    ~map_close() {
+        if (MAP_FAILED != mem) {
+            (void)::munmap(mem, size);
+        }
+    }
+};
+
+inline bool write_all(int fd, const char* p, size_t sz) {
+    while (sz > 0) {
+        const auto n = ::write(fd, p, sz);
+        if (n > 0) {
+            p += n;
+            sz -= static_cast<size_t>(n);
+        } else if (0 == n) { // no progress, e.g. a full device that doesn't report ENOSPC
+            errno = EIO;
+            return false;
+        } else if (errno != EINTR) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Maps the store read only. The mapping is empty on error.
+inline void map_store(const path& p, map_close& m, error_code& ec) {
+    fd_close fd{::open(p.c_str(), O_RDONLY|O_CLOEXEC)};
+    struct stat sb;
+    if (fd.fd < 0 || 0 != ::fstat(fd.fd, &sb)) {
+        system_error(ec);
+        return;
+    }
+
+    const auto sz = static_cast<size_t>(sb.st_size);
+    if (0 == sz) {
+        ec = einval();
+        return;
+    }
+
+    m.mem = ::mmap(nullptr, sz, PROT_READ, MAP_PRIVATE, fd.fd, 0);
+    if (MAP_FAILED != m.mem) {
+        m.size = sz;
+        ec.clear();
+    } else {
+        system_error(ec);
+    }
+}
+
+// The store is written to a temporary file and then renamed over the destination.
+inline void write_store(const path& p, const std::string& data, error_code& ec) {
+    auto tmp = p;
+    tmp += PS_TEXT(".tmp");
+    {
+        // The data must be durable before the rename, otherwise a crash can leave an empty or partial store in place of the old one.
+        fd_close fd{::open(tmp.c_str(), O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC, 0600)};
+        if (fd.fd < 0 || !write_all(fd.fd, data.data(), data.size()) || 0 != ::fsync(fd.fd)) {
+            system_error(ec);
+            (void)::unlink(tmp.c_str());
+            return;
+        }
+        const int err = ::close(fd.fd);
+        fd.fd = -1;
+        if (0 != err) {
+            system_error(ec);
+            (void)::unlink(tmp.c_str());
+            return;
+        }
+    }
+
+    rename(tmp, p, ec);
+    if (ec) {
+        (void)::unlink(tmp.c_str());
+    }
+}
+
+} // ifilesystem
+} // v1
+} // filesystem
+} // prosoft
+
+#endif // !_WIN32
+
+#endif // PS_CORE_FSSTORE_PRIVATE_HPP
@@ -0,0 +1,1597 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <prosoft/core/config/config_platform.h>
+
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/fanotify.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_change_journal.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_change_monitor.hpp>
+#include "filesystem_private.hpp"
+#include "fsmonitor_private.hpp"
+#include <prosoft/core/config/config_analyzer.h>
+
+// Each registration owns an inotify instance as watch descriptors are per instance and overlapping registrations would otherwise share (and remove) each other's watches.
+// All instances are read by a single epoll thread, which also delivers the notifications.
+// Neither inotify nor fanotify have an event history, a change_journal is used to serialize and thaw monitor state.
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+constexpr std::uint32_t watch_flags_defaults = IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO|IN_DELETE_SELF|IN_MOVE_SELF|IN_EXCL_UNLINK;
+constexpr std::uint32_t subdir_watch_flags = IN_ONLYDIR|IN_DONT_FOLLOW;
+constexpr std::uint32_t parent_watch_flags = IN_MOVED_FROM|IN_MOVED_TO|IN_ONLYDIR;
+
+std::uint32_t watch_flags(const fs::change_config& cfg) {
+    auto flags = watch_flags_defaults;
+    if (is_set(cfg.events & fs::change_event::content_modified)) {
+        flags |= IN_MODIFY;
+    }
+    if (is_set(cfg.events & fs::change_event::metadata_modified)) {
+        flags |= IN_ATTRIB;
+    }
+    return flags;
+}
+
+fs::change_event to_event(std::uint32_t mask) {
+    fs::change_event evts{};
+    if ((mask & (IN_MOVED_FROM|IN_MOVED_TO))) {
+        evts |= fs::change_event::renamed;
+    }
+    if ((mask & IN_CREATE)) {
+        evts |= fs::change_event::created;
+    }
+    if ((mask & IN_DELETE)) {
+        evts |= fs::change_event::removed;
+    }
+    if ((mask & IN_MODIFY)) {
+        evts |= fs::change_event::content_modified;
+    }
+    if ((mask & IN_ATTRIB)) {
+        evts |= fs::change_event::metadata_modified;
+    }
+    return evts;
+}
+
+std::uint64_t fanotify_flags(const fs::change_config& cfg) {
+    std::uint64_t flags = FAN_CREATE|FAN_DELETE|FAN_RENAME|FAN_ONDIR;
+    if (is_set(cfg.events & fs::change_event::content_modified)) {
+        flags |= FAN_MODIFY;
+    }
+    if (is_set(cfg.events & fs::change_event::metadata_modified)) {
+        flags |= FAN_ATTRIB;
+    }
+    return flags;
+}
+
+fs::change_event to_fanotify_event(std::uint64_t mask) {
+    fs::change_event evts{};
+    if ((mask & FAN_CREATE)) {
+        evts |= fs::change_event::created;
+    }
+    if ((mask & FAN_DELETE)) {
+        evts |= fs::change_event::removed;
+    }
+    if ((mask & FAN_MODIFY)) {
+        evts |= fs::change_event::content_modified;
+    }
+    if ((mask & FAN_ATTRIB)) {
+        evts |= fs::change_event::metadata_modified;
+    }
+    return evts;
+}
+
+inline fs::file_type to_type(std::uint32_t mask) {
+    return (mask & IN_ISDIR) ? fs::file_type::directory : fs::file_type::none;
+}
+
+fs::file_type lstat_type(const fs::path& p) {
+    struct ::stat sb;
+    if (0 == ::lstat(p.c_str(), &sb)) {
+        return fs::ifilesystem::make_status(sb, fs::status_info::basic).type();
+    }
+    return fs::file_type::none;
+}
+
+// true if p is dir or is contained by dir
+bool is_within(const std::string& p, const std::string& dir) {
+    return p.compare(0, dir.size(), dir) == 0 && (p.size() == dir.size() || p[dir.size()] == '/');
+}
+
+// Serialized state: "journal:<journal id>:<last event id>:<journal position>"
+// The position lets a replay skip the earlier records, it's optional as it's only a hint.
+constexpr const char journal_state_prefix[] = "journal:";
+
+struct pending_event {
+    fs::path m_path;
+    fs::path m_newpath;
+    fs::change_event m_event;
+    fs::file_type m_type;
+};
+
+// Taken from a state under the global lock and turned into notifications once it's released.
+struct pending_batch {
+    std::vector<pending_event> m_pending;
+    fs::change_notifications m_replay;
+};
+
+struct platform_state : public fs::change_state {
+    using latency_type = fs::change_config::latency_type;
+    
+    fs::change_callback m_callback;
+    fs::path m_root;
+    fs::change_journal* m_journal;
+    std::mutex m_journallock; // held while appending, so the journal is not written to after it's detached
+    // Only accessed by the monitor thread once registered.
+    fs::change_notifications m_replay; // journaled events, delivered before any new events
+    std::vector<pending_event> m_pending;
+    std::unordered_map<std::string, size_t> m_index; // path -> pending event, for coalescing
+    clock_type::time_point m_deadline;
+    latency_type m_latency;
+    fs::change_event m_events;
+    std::atomic<fs::change_event_id> m_lastid;
+    std::atomic<fs::change_journal::position_type> m_journalpos; // updated after m_lastid
+    std::atomic<std::uint64_t> m_collapsed;
+    std::atomic<std::uint64_t> m_dropped;
+    fs::change_journal::id_type m_journalid; // thawed state
+    size_t m_maxpending;
+    int m_fd;
+    fs::file_type m_roottype;
+    bool m_recursive;
+    bool m_canceled;
+    bool m_coalesce;
+    bool m_collapsing; // pending events are per directory rescans
+    bool m_collapsing_root; // pending events are a single rescan of the root
+    bool m_replay_to_current; // thawed state
+    bool m_recording; // attached to m_journal
+    
+    platform_state()
+        : m_callback()
+        , m_root()
+        , m_journal()
+        , m_deadline()
+        , m_latency()
+        , m_events(fs::change_event::all)
+        , m_lastid(0)
+        , m_journalpos(0)
+        , m_collapsed(0)
+        , m_dropped(0)
+        , m_journalid(0)
+        , m_maxpending(0)
+        , m_fd(-1)
+        , m_roottype(fs::file_type::none)
+        , m_recursive(false)
+        , m_canceled(false)
+        , m_coalesce(false)
+        , m_collapsing(false)
+        , m_collapsing_root(false)
+        , m_replay_to_current(false)
+        , m_recording(false) {}
+    platform_state(const fs::path&, const fs::change_config&, bool recursive, fs::error_code&);
+    platform_state(const std::string&, fs::change_thaw_options); // from serialzed data
+    virtual ~platform_state();
+    
+    virtual fs::change_event_id last_event_id() const override {
+        return m_lastid.load();
+    }
+    
+    virtual fs::change_counters counters() const override {
+        return fs::change_counters{m_collapsed.load(), m_dropped.load()};
+    }
+    
+    virtual std::string serialize() const override {
+        return this->serialize(m_lastid.load());
+    }
+    
+    virtual std::string serialize(fs::change_event_id) const override;
+    
+    virtual bool pending() const noexcept {
+        return !m_pending.empty() || !m_replay.empty();
+    }
+    
+    // Reads all available events from m_fd.
+    virtual void read() {}
+    pending_batch take();
+    fs::change_notifications deliver(pending_batch&&);
+    
+    fs::change_notifications flush() { // for testing
+        return deliver(take());
+    }
+    
+    void replay(const platform_state& from, fs::error_code&);
+    
+    // Lets another monitor record to the journal, called when the monitor is stopped.
+    void detach_journal();
+    
+protected:
+    virtual void will_flush() {}
+    
+    // Starts the latency period for the first pending event.
+    void arm() {
+        if (!pending()) {
+            m_deadline = clock_type::now() + m_latency;
+        }
+    }
+    
+    void add(fs::path&&, fs::change_event, fs::file_type, fs::path&& newpath = fs::path{});
+    void collapse_pending();
+    void collapse(fs::path&&);
+    void cancel(fs::change_event);
+    void root_removed();
+    void root_renamed(fs::path&&);
+};
+
+using shared_state = std::shared_ptr<platform_state>;
+
+platform_state::platform_state(const fs::path& p, const fs::change_config& cfg, bool recursive, fs::error_code& ec)
+    : platform_state() {
+    m_root = p;
+    m_latency = cfg.notification_latency;
+    m_events = cfg.events;
+    m_maxpending = cfg.max_pending_events;
+    m_recursive = recursive;
+    m_coalesce = cfg.coalesce_events;
+    if (cfg.journal) {
+        if (!cfg.journal->attach()) {
+            ec = einval();
+            return;
+        }
+        m_journal = cfg.journal;
+        m_recording = true;
+        m_lastid = m_journal->last_event_id();
+        m_journalpos = m_journal->position();
+    }
+    
+    const auto st = fs::status(p, fs::status_info::basic, ec);
+    if (ec) {
+        return;
+    }
+    m_roottype = st.type();
+    if (recursive && m_roottype != fs::file_type::directory) {
+        ec = fs::error_code{ENOTDIR, std::system_category()};
+    }
+}
+
+platform_state::platform_state(const std::string& s, fs::change_thaw_options opts)
+    : platform_state() {
+    if (s.empty()) {
+        return;
+    }
+    
+    constexpr auto prefix_size = sizeof(journal_state_prefix) - 1;
+    const auto sep = s.find(':', prefix_size);
+    if (s.compare(0, prefix_size, journal_state_prefix) != 0 || sep == std::string::npos) {
+        throw std::invalid_argument("Invalid filesystem monitor state");
+    }
+    // throws for invalid numbers
+    m_journalid = std::stoull(s.substr(prefix_size, sep - prefix_size), nullptr, 16);
+    const auto possep = s.find(':', sep + 1);
+    m_lastid = std::stoull(s.substr(sep + 1, possep - sep - 1));
+    if (possep != std::string::npos) {
+        m_journalpos = std::stoull(s.substr(possep + 1));
+    }
+    if (m_journalid == 0) {
+        throw std::invalid_argument("Invalid filesystem monitor state");
+    }
+    m_replay_to_current = is_set(opts & fs::change_thaw_options::replay_to_current_event);
+}
+
+platform_state::~platform_state() {
+    detach_journal();
+    if (-1 != m_fd) {
+        ::close(m_fd);
+    }
+}
+
+void platform_state::detach_journal() {
+    std::lock_guard<std::mutex> lg{m_journallock};
+    if (m_recording) {
+        m_journal->detach();
+        m_recording = false;
+    }
+}
+
+std::string platform_state::serialize(fs::change_event_id evid) const {
+    const auto jid = m_journal ? m_journal->id() : m_journalid;
+    if (jid == 0) {
+        return "";
+    }
+    // The records before the position have ids <= the last id read after it.
+    const auto pos = m_journalpos.load();
+    const auto lastid = m_lastid.load();
+    char buf[96];
+    (void)std::snprintf(buf, sizeof(buf), "%s%llx:%llu:%llu", journal_state_prefix, static_cast<unsigned long long>(jid), static_cast<unsigned long long>(evid),
+        static_cast<unsigned long long>(evid >= lastid ? pos : 0));
+    return buf;
+}
+
+// Queues the events journaled since the thawed state for delivery.
+void platform_state::replay(const platform_state& from, fs::error_code& ec) {
+    if (!m_journal || m_journal->id() != from.m_journalid) {
+        ec = fs::error_code(fs::platform_error::monitor_thaw, fs::platform_category());
+        return;
+    }
+    if (from.m_lastid > m_journal->last_event_id()) {
+        ec = fs::error_code(fs::platform_error::monitor_replay_past, fs::platform_category());
+        return;
+    }
+    
+    fs::change_notifications notes;
+    m_journal->replay(from.m_lastid.load(), from.m_journalpos.load(), notes, ec);
+    if (ec) { // some of the events were discarded
+        ec = fs::error_code(fs::platform_error::monitor_thaw, fs::platform_category());
+        return;
+    }
+    
+    for (auto& n : notes) {
+        // The replayed monitor was not necessarily canceled by a journaled cancel event.
+        const auto ev = n.event() & ~(fs::change_event::canceled|fs::change_event::replay_done);
+        fs::change_manager::emplace_back(m_replay, fs::path{n.path()}, fs::path{n.renamed_to_path()}, this, n.event_id(), ev, n.type());
+    }
+    if (from.m_replay_to_current) {
+        fs::change_manager::emplace_back(m_replay, fs::path{}, fs::path{}, this, 0, fs::change_event::replay_end, fs::file_type::none);
+        m_canceled = true;
+    }
+    m_deadline = clock_type::now(); // no need to wait for more events
+}
+
+void platform_state::add(fs::path&& p, fs::change_event ev, fs::file_type type, fs::path&& np) {
+    arm();
+    
+    if (m_collapsing && !is_set(ev & fs::change_event::canceled)) {
+        ++m_collapsed;
+        collapse(std::move(p));
+        if (!np.empty()) {
+            collapse(std::move(np));
+        }
+        return;
+    }
+    
+    if (!is_set(ev & (fs::change_event::renamed|fs::change_event::rescan))) {
+        std::string key{p.c_str()};
+        auto i = m_index.find(key);
+        if (i != m_index.end()) {
+            auto& pe = m_pending[i->second];
+            pe.m_event = m_coalesce ? fs::change_manager::coalesce(pe.m_event, ev) : pe.m_event|ev;
+            if (type != fs::file_type::none) {
+                pe.m_type = type;
+            }
+            return;
+        }
+        m_index.emplace(std::move(key), m_pending.size());
+    } else if (m_coalesce) {
+        // Later events for these paths can't be folded into events before the rename.
+        m_index.erase(p.c_str());
+        if (!np.empty()) {
+            m_index.erase(np.c_str());
+        }
+    }
+    
+    m_pending.push_back(pending_event{std::move(p), std::move(np), ev, type});
+    if (m_maxpending > 0 && m_pending.size() > m_maxpending) {
+        collapse_pending();
+    }
+}
+
+void platform_state::collapse_pending() {
+    auto pending = std::move(m_pending);
+    m_pending.clear();
+    m_index.clear();
+    m_collapsing = true;
+    for (auto& pe : pending) {
+        if (is_set(pe.m_event & fs::change_event::canceled)) {
+            m_pending.push_back(std::move(pe));
+            continue;
+        }
+        if (pe.m_event == fs::change_event::none) { // folded away
+            continue;
+        }
+        ++m_collapsed;
+        collapse(std::move(pe.m_path));
+        if (!pe.m_newpath.empty()) {
+            collapse(std::move(pe.m_newpath));
+        }
+    }
+}
+
+// Adds a rescan of the parent dir, or of the root if there are too many dirs.
+void platform_state::collapse(fs::path&& p) {
+    if (m_collapsing_root) {
+        ++m_dropped;
+        return;
+    }
+    
+    auto dir = p == m_root ? std::move(p) : p.parent_path();
+    std::string key{dir.c_str()};
+    if (m_index.find(key) != m_index.end()) {
+        return;
+    }
+    
+    if (m_pending.size() >= m_maxpending) {
+        // everything but cancellations is replaced by a rescan of the root
+        auto i = std::remove_if(m_pending.begin(), m_pending.end(), [](const pending_event& pe) {
+            return !is_set(pe.m_event & fs::change_event::canceled);
+        });
+        m_dropped += std::distance(i, m_pending.end());
+        m_pending.erase(i, m_pending.end());
+        m_index.clear();
+        m_collapsing_root = true;
+        dir = m_root;
+        key = dir.c_str();
+    }
+    m_index.emplace(std::move(key), m_pending.size());
+    m_pending.push_back(pending_event{std::move(dir), fs::path{}, fs::change_event::rescan, fs::file_type::directory});
+}
+
+void platform_state::cancel(fs::change_event ev) {
+    PSASSERT(is_set(ev & fs::change_event::canceled), "Broken assumption");
+    add(fs::path{m_root}, ev, m_roottype);
+    m_canceled = true;
+}
+
+void platform_state::root_removed() {
+    cancel(fs::change_event::rescan_required|fs::change_event::removed);
+}
+
+void platform_state::root_renamed(fs::path&& np) {
+    auto ev = fs::change_event::rescan_required|fs::change_event::renamed;
+    fs::error_code ec;
+    if (!np.empty() && fs::exists(np, ec)) {
+        ev &= ~fs::change_event::rescan;
+    } else {
+        np.clear(); // moved to an unknown location
+    }
+    add(fs::path{m_root}, ev, m_roottype, std::move(np));
+    m_canceled = true;
+}
+
+pending_batch platform_state::take() {
+    will_flush();
+    
+    pending_batch b{std::move(m_pending), std::move(m_replay)};
+    m_pending.clear();
+    m_replay.clear();
+    m_index.clear();
+    m_collapsing = m_collapsing_root = false;
+    return b;
+}
+
+// Type lookups and the journal append may block, so this is called without the global lock.
+fs::change_notifications platform_state::deliver(pending_batch&& b) {
+    constexpr auto always = fs::change_event::rescan_required|fs::change_event::outside_tree;
+    fs::change_notifications notes;
+    for (auto& pe : b.m_pending) {
+        const auto ev = pe.m_event & (m_events|always);
+        if (!is_set(ev & (m_events|fs::change_event::rescan_required))) {
+            continue;
+        }
+        auto type = pe.m_type;
+        if (type == fs::file_type::none && !is_set(ev & fs::change_event::removed)) {
+            type = lstat_type(pe.m_newpath.empty() ? pe.m_path : pe.m_newpath);
+        }
+        fs::change_manager::emplace_back(notes, std::move(pe.m_path), std::move(pe.m_newpath), this, ++m_lastid, ev, type);
+    }
+    
+    if (m_journal && !notes.empty()) {
+        std::lock_guard<std::mutex> lg{m_journallock};
+        if (m_recording) {
+            fs::error_code ec;
+            m_journal->append(notes, ec);
+            if (ec) {
+                // A journal with missing events can't be replayed, so states serialized from it are invalidated.
+                m_journal->reset(ec);
+            }
+            m_journalpos = m_journal->position();
+        }
+    }
+    
+    if (!b.m_replay.empty()) {
+        for (auto& n : notes) {
+            b.m_replay.push_back(std::move(n));
+        }
+        notes = std::move(b.m_replay);
+    }
+    return notes;
+}
+
+class inotify_state : public platform_state {
+    std::unordered_map<int, fs::path> m_watches; // watch descriptor -> watched path
+    struct pending_move {
+        fs::path m_path;
+        fs::file_type m_type;
+    };
+    std::unordered_map<std::uint32_t, pending_move> m_moves; // cookie -> IN_MOVED_FROM waiting for its IN_MOVED_TO
+    std::uint32_t m_flags;
+    int m_rootwd;
+    // The root's parent is watched for renames so the new root path can be reported.
+    // (Holding a descriptor to the root to look up the path would delay IN_DELETE_SELF until it was closed.)
+    int m_parentwd;
+    std::uint32_t m_rootcookie;
+    fs::path m_newroot;
+    
+public:
+    inotify_state(const fs::path&, const fs::change_config&, bool recursive, fs::error_code&);
+    virtual ~inotify_state() = default;
+    
+    virtual bool pending() const noexcept override {
+        return platform_state::pending() || !m_moves.empty();
+    }
+    
+    virtual void read() override;
+    
+private:
+    virtual void will_flush() override;
+    
+    void process(const struct ::inotify_event*);
+    void moved_from(fs::path&&, fs::file_type, std::uint32_t cookie);
+    void moved_to(fs::path&&, fs::file_type, std::uint32_t cookie);
+    void root_changed(std::uint32_t mask);
+    void parent_changed(const struct ::inotify_event*);
+    
+    int add_watch(const fs::path&, std::uint32_t flags, fs::error_code&);
+    void watch_descendants(const fs::path&, bool notify, fs::error_code&);
+    void watch_tree(const fs::path&, bool notify);
+    void unwatch_tree(const fs::path&);
+    void rebase_watches(const fs::path& from, const fs::path& to);
+};
+
+inotify_state::inotify_state(const fs::path& p, const fs::change_config& cfg, bool recursive, fs::error_code& ec)
+    : platform_state(p, cfg, recursive, ec)
+    , m_flags(watch_flags(cfg))
+    , m_rootwd(-1)
+    , m_parentwd(-1)
+    , m_rootcookie(0) {
+    if (ec) {
+        return;
+    }
+    
+    m_fd = ::inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+    if (m_fd < 0) {
+        ec = fs::error_code(fs::platform_error::monitor_create, fs::platform_category());
+        return;
+    }
+    
+    m_rootwd = add_watch(p, m_flags, ec);
+    if (m_rootwd >= 0 && recursive) {
+        watch_descendants(p, false, ec);
+    }
+    
+    const auto parent = p.parent_path();
+    if (!ec && !parent.empty() && parent != p) {
+        m_parentwd = ::inotify_add_watch(m_fd, parent.c_str(), parent_watch_flags);
+    }
+}
+
+void inotify_state::read() {
+    alignas(struct ::inotify_event) char buf[64 * 1024];
+    for (;;) {
+        const auto n = ::read(m_fd, buf, sizeof(buf));
+        if (n <= 0) {
+            if (n < 0 && EINTR == errno) {
+                continue;
+            }
+            break;
+        }
+        for (ssize_t i = 0; i < n;) {
+            auto e = reinterpret_cast<const struct ::inotify_event*>(buf + i);
+            process(e);
+            i += sizeof(struct ::inotify_event) + e->len;
+        }
+    }
+}
+
+void inotify_state::process(const struct ::inotify_event* e) {
+    if (m_canceled) {
+        return;
+    }
+    
+    if ((e->mask & IN_Q_OVERFLOW)) {
+        cancel(fs::change_event::rescan_required);
+        return;
+    }
+    
+    if (e->wd == m_parentwd) {
+        parent_changed(e);
+        return;
+    }
+    
+    auto wi = m_watches.find(e->wd);
+    if (wi == m_watches.end()) {
+        return;
+    }
+    
+    const bool isroot = e->wd == m_rootwd;
+    if ((e->mask & (IN_DELETE_SELF|IN_MOVE_SELF|IN_UNMOUNT|IN_IGNORED))) {
+        if (isroot) {
+            root_changed(e->mask);
+        } else if ((e->mask & IN_UNMOUNT)) {
+            add(fs::path{wi->second}, fs::change_event::rescan, fs::file_type::directory);
+        } else if ((e->mask & IN_IGNORED)) {
+            m_watches.erase(wi);
+        }
+        // The parent dir reports the remove or rename of a subdir.
+        return;
+    }
+    
+    fs::path p{wi->second};
+    if (e->len > 0 && e->name[0]) {
+        fs::path leaf;
+        PSSilenceCppException(leaf = fs::path(fs::path::string_type(e->name, ::strlen(e->name))));
+        if (leaf.empty()) {
+            // should only happen when the name is not encoded as UTF8
+            add(std::move(p), fs::change_event::rescan, fs::file_type::directory);
+            return;
+        }
+        p /= leaf;
+    }
+    
+    const auto type = to_type(e->mask);
+    if ((e->mask & IN_MOVED_FROM)) {
+        moved_from(std::move(p), type, e->cookie);
+    } else if ((e->mask & IN_MOVED_TO)) {
+        moved_to(std::move(p), type, e->cookie);
+    } else if (m_recursive && (e->mask & IN_CREATE) && type == fs::file_type::directory) {
+        add(fs::path{p}, fs::change_event::created, type);
+        // Anything created before the watch was added will not generate an event.
+        watch_tree(p, true);
+    } else {
+        add(std::move(p), to_event(e->mask), type);
+    }
+}
+
+void inotify_state::moved_from(fs::path&& p, fs::file_type type, std::uint32_t cookie) {
+    arm();
+    m_moves[cookie] = pending_move{std::move(p), type};
+}
+
+void inotify_state::moved_to(fs::path&& p, fs::file_type type, std::uint32_t cookie) {
+    auto i = m_moves.find(cookie);
+    if (i != m_moves.end()) {
+        auto from = std::move(i->second.m_path);
+        m_moves.erase(i);
+        if (m_recursive && type == fs::file_type::directory) {
+            rebase_watches(from, p);
+        }
+        add(std::move(from), fs::change_event::renamed, type, std::move(p));
+        return;
+    }
+    
+    // Moved in from outside the tree.
+    if (m_recursive && type == fs::file_type::directory) {
+        watch_tree(p, false);
+    }
+    add(std::move(p), fs::change_event::renamed|fs::change_event::created|fs::change_event::outside_tree, type);
+}
+
+void inotify_state::root_changed(std::uint32_t mask) {
+    if ((mask & IN_MOVE_SELF)) {
+        root_renamed(std::move(m_newroot));
+    } else if ((mask & (IN_DELETE_SELF|IN_IGNORED))) {
+        root_removed();
+    } else {
+        cancel(fs::change_event::rescan_required); // unmounted
+    }
+}
+
+// The parent receives the rename events before the root receives IN_MOVE_SELF.
+void inotify_state::parent_changed(const struct ::inotify_event* e) {
+    if (e->len == 0 || !e->name[0]) {
+        return;
+    }
+    
+    if ((e->mask & IN_MOVED_FROM)) {
+        if (0 == std::strcmp(e->name, m_root.filename().c_str())) {
+            m_rootcookie = e->cookie;
+        }
+    } else if ((e->mask & IN_MOVED_TO) && m_rootcookie != 0 && e->cookie == m_rootcookie) {
+        PSSilenceCppException(m_newroot = m_root.parent_path() / fs::path(fs::path::string_type(e->name, ::strlen(e->name))));
+        m_rootcookie = 0;
+    }
+}
+
+// A watch for an inode that is already watched returns the existing descriptor, in which case the newest path wins.
+int inotify_state::add_watch(const fs::path& p, std::uint32_t flags, fs::error_code& ec) {
+    const int wd = ::inotify_add_watch(m_fd, p.c_str(), flags);
+    if (wd >= 0) {
+        m_watches[wd] = p;
+        ec.clear();
+    } else {
+        fs::ifilesystem::system_error(ec);
+    }
+    return wd;
+}
+
+void inotify_state::watch_descendants(const fs::path& dir, bool notify, fs::error_code& ec) {
+    const auto flags = m_flags|subdir_watch_flags;
+    fs::recursive_directory_iterator i{dir, fs::directory_options::skip_permission_denied, ec};
+    for (; !ec && i != end(i); i.increment(ec)) {
+        const auto& e = *i;
+        fs::error_code tec;
+        const bool isdir = e.is_directory(tec);
+        if (isdir && add_watch(e.path(), flags, tec) < 0 && ENOSPC == tec.value()) {
+            ec = tec;
+            return;
+        }
+        if (notify) {
+            add(fs::path{e.path()}, fs::change_event::created, isdir ? fs::file_type::directory : fs::file_type::none);
+        }
+    }
+    ec.clear(); // most likely removed while scanning, which will have its own events
+}
+
+void inotify_state::watch_tree(const fs::path& dir, bool notify) {
+    fs::error_code ec;
+    if (add_watch(dir, m_flags|subdir_watch_flags, ec) >= 0) {
+        watch_descendants(dir, notify, ec);
+    }
+    if (ENOSPC == ec.value()) {
+        // out of watches, changes to the tree can no longer be tracked
+        cancel(fs::change_event::rescan_required);
+    }
+}
+
+void inotify_state::unwatch_tree(const fs::path& dir) {
+    const std::string ds{dir.c_str()};
+    for (auto i = m_watches.begin(); i != m_watches.end();) {
+        if (is_within(i->second.c_str(), ds)) {
+            (void)::inotify_rm_watch(m_fd, i->first);
+            i = m_watches.erase(i);
+        } else {
+            ++i;
+        }
+    }
+}
+
+void inotify_state::rebase_watches(const fs::path& from, const fs::path& to) {
+    const std::string fs{from.c_str()};
+    const std::string ts{to.c_str()};
+    for (auto& w : m_watches) {
+        const std::string ws{w.second.c_str()};
+        if (is_within(ws, fs)) {
+            w.second = fs::path{ts + ws.substr(fs.size())};
+        }
+    }
+}
+
+void inotify_state::will_flush() {
+    // Renames without a destination moved the item out of the tree.
+    auto moves = std::move(m_moves);
+    m_moves.clear();
+    for (auto& m : moves) {
+        auto& pm = m.second;
+        if (m_recursive && pm.m_type == fs::file_type::directory) {
+            unwatch_tree(pm.m_path);
+        }
+        add(std::move(pm.m_path), fs::change_event::renamed|fs::change_event::removed|fs::change_event::outside_tree, pm.m_type);
+    }
+}
+
+// Reports events for the whole filesystem containing the root, each with the handle of the parent directory and the entry name.
+// Directory handles are resolved to paths (and cached) to filter events outside of the tree.
+class fanotify_state : public platform_state {
+    std::unordered_map<std::string, std::string> m_dirs; // directory file handle -> real path, empty if unresolvable
+    std::string m_realroot;
+    int m_mountfd;
+    
+public:
+    fanotify_state(const fs::path&, const fs::change_config&, fs::error_code&);
+    virtual ~fanotify_state();
+    
+    virtual void read() override;
+    
+private:
+    static constexpr size_t max_cached_dirs = 64 * 1024;
+    
+    void process(const struct ::fanotify_event_metadata*);
+    void renamed(std::string&& from, std::string&& to, fs::file_type);
+    std::string resolve(const struct ::fanotify_event_info_fid*);
+    bool to_tree_path(const std::string&, fs::path&) const;
+    void forget_dirs(const std::string&);
+    void rebase_dirs(const std::string& from, const std::string& to);
+};
+
+std::string handle_path(int mountfd, const struct ::file_handle* fh) {
+    // The handle in the event buffer may not be aligned and open_by_handle_at() takes a non-const handle.
+    std::vector<char> buf(sizeof(struct ::file_handle) + fh->handle_bytes);
+    std::memcpy(buf.data(), fh, buf.size());
+    const int fd = ::open_by_handle_at(mountfd, reinterpret_cast<struct ::file_handle*>(buf.data()), O_PATH|O_CLOEXEC);
+    if (fd < 0) {
+        return {};
+    }
+    
+    char lbuf[PATH_MAX];
+    const auto fdp = std::string{"/proc/self/fd/"} + std::to_string(fd);
+    const auto n = ::readlink(fdp.c_str(), lbuf, sizeof(lbuf));
+    ::close(fd);
+    if (n <= 0 || static_cast<size_t>(n) >= sizeof(lbuf) || lbuf[0] != '/') {
+        return {};
+    }
+    
+    std::string p{lbuf, static_cast<size_t>(n)};
+    constexpr char deleted[] = " (deleted)";
+    constexpr size_t dlen = sizeof(deleted) - 1;
+    if (p.size() > dlen && 0 == p.compare(p.size() - dlen, dlen, deleted)) {
+        return {};
+    }
+    return p;
+}
+
+fanotify_state::fanotify_state(const fs::path& p, const fs::change_config& cfg, fs::error_code& ec)
+    : platform_state(p, cfg, true, ec)
+    , m_mountfd(-1) {
+    if (ec) {
+        return;
+    }
+    
+    const auto real = fs::canonical(p, ec);
+    if (ec) {
+        return;
+    }
+    m_realroot = real.c_str();
+    
+    m_fd = ::fanotify_init(FAN_CLASS_NOTIF|FAN_REPORT_DFID_NAME|FAN_NONBLOCK|FAN_CLOEXEC, O_RDONLY|O_CLOEXEC);
+    if (m_fd < 0 || 0 != ::fanotify_mark(m_fd, FAN_MARK_ADD|FAN_MARK_FILESYSTEM, fanotify_flags(cfg), AT_FDCWD, real.c_str())) {
+        fs::ifilesystem::system_error(ec);
+        return;
+    }
+    
+    // Handles are resolved relative to the mount containing the root.
+    const auto mp = fs::mount_path(real, ec);
+    if (!ec) {
+        m_mountfd = ::open(mp.c_str(), O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+        if (m_mountfd < 0) {
+            fs::ifilesystem::system_error(ec);
+        }
+    }
+}
+
+fanotify_state::~fanotify_state() {
+    if (-1 != m_mountfd) {
+        ::close(m_mountfd);
+    }
+}
+
+void fanotify_state::read() {
+    alignas(struct ::fanotify_event_metadata) char buf[64 * 1024];
+    for (;;) {
+        auto n = ::read(m_fd, buf, sizeof(buf));
+        if (n <= 0) {
+            if (n < 0 && EINTR == errno) {
+                continue;
+            }
+            break;
+        }
+        for (auto m = reinterpret_cast<const struct ::fanotify_event_metadata*>(buf); FAN_EVENT_OK(m, n); m = FAN_EVENT_NEXT(m, n)) {
+            process(m);
+        }
+    }
+}
+
+void fanotify_state::process(const struct ::fanotify_event_metadata* m) {
+    if (m_canceled) {
+        return;
+    }
+    
+    if (m->vers != FANOTIFY_METADATA_VERSION || (m->mask & FAN_Q_OVERFLOW)) {
+        cancel(fs::change_event::rescan_required);
+        return;
+    }
+    
+    std::string from, to;
+    auto info = reinterpret_cast<const char*>(m + 1);
+    const auto last = reinterpret_cast<const char*>(m) + m->event_len;
+    while (info + sizeof(struct ::fanotify_event_info_header) <= last) {
+        auto fid = reinterpret_cast<const struct ::fanotify_event_info_fid*>(info);
+        if (fid->hdr.len == 0) {
+            break;
+        }
+        switch (fid->hdr.info_type) {
+            case FAN_EVENT_INFO_TYPE_DFID_NAME:
+            case FAN_EVENT_INFO_TYPE_OLD_DFID_NAME:
+                from = resolve(fid);
+                break;
+            case FAN_EVENT_INFO_TYPE_NEW_DFID_NAME:
+                to = resolve(fid);
+                break;
+            default:
+                break;
+        }
+        info += fid->hdr.len;
+    }
+    
+    const auto type = (m->mask & FAN_ONDIR) ? fs::file_type::directory : fs::file_type::none;
+    if ((m->mask & FAN_RENAME)) {
+        renamed(std::move(from), std::move(to), type);
+        return;
+    }
+    
+    if ((m->mask & FAN_DELETE) && type == fs::file_type::directory) {
+        forget_dirs(from);
+    }
+    
+    fs::path p;
+    if (!to_tree_path(from, p)) {
+        return;
+    }
+    
+    if ((m->mask & FAN_DELETE) && p == m_root) {
+        root_removed();
+    } else {
+        add(std::move(p), to_fanotify_event(m->mask), type);
+    }
+}
+
+void fanotify_state::renamed(std::string&& from, std::string&& to, fs::file_type type) {
+    if (type == fs::file_type::directory) {
+        if (!to.empty()) {
+            rebase_dirs(from, to);
+        } else {
+            forget_dirs(from);
+        }
+    }
+    
+    fs::path fp, tp;
+    const bool fin = to_tree_path(from, fp);
+    const bool tin = to_tree_path(to, tp);
+    if (fin && fp == m_root) {
+        root_renamed(fs::path{std::move(to)});
+    } else if (fin && tin) {
+        add(std::move(fp), fs::change_event::renamed, type, std::move(tp));
+    } else if (fin) {
+        add(std::move(fp), fs::change_event::renamed|fs::change_event::removed|fs::change_event::outside_tree, type);
+    } else if (tin) {
+        add(std::move(tp), fs::change_event::renamed|fs::change_event::created|fs::change_event::outside_tree, type);
+    }
+}
+
+// Returns the real path of the event's directory + name.
+std::string fanotify_state::resolve(const struct ::fanotify_event_info_fid* fid) {
+    auto fh = reinterpret_cast<const struct ::file_handle*>(fid->handle);
+    std::string key{reinterpret_cast<const char*>(&fh->handle_type), sizeof(fh->handle_type)};
+    key.append(reinterpret_cast<const char*>(fh->f_handle), fh->handle_bytes);
+    
+    auto i = m_dirs.find(key);
+    if (i == m_dirs.end()) {
+        if (m_dirs.size() >= max_cached_dirs) {
+            m_dirs.clear();
+        }
+        i = m_dirs.emplace(std::move(key), handle_path(m_mountfd, fh)).first;
+    }
+    if (i->second.empty()) {
+        return {};
+    }
+    
+    const char* name = reinterpret_cast<const char*>(fh->f_handle + fh->handle_bytes);
+    if (!name[0] || 0 == std::strcmp(name, ".")) { // an event for the dir itself
+        return i->second;
+    }
+    std::string p{i->second};
+    if (p.back() != '/') {
+        p += '/';
+    }
+    return p.append(name);
+}
+
+bool fanotify_state::to_tree_path(const std::string& rp, fs::path& p) const {
+    if (rp.empty() || !is_within(rp, m_realroot)) {
+        return false;
+    }
+    PSSilenceCppException(p = m_root / fs::path{rp.substr(m_realroot.size())});
+    if (p.empty()) {
+        return false; // should only happen when the name is not encoded as UTF8
+    }
+    return true;
+}
+
+void fanotify_state::forget_dirs(const std::string& dir) {
+    if (dir.empty()) {
+        return;
+    }
+    for (auto i = m_dirs.begin(); i != m_dirs.end();) {
+        if (is_within(i->second, dir)) {
+            i = m_dirs.erase(i);
+        } else {
+            ++i;
+        }
+    }
+}
+
+void fanotify_state::rebase_dirs(const std::string& from, const std::string& to) {
+    if (from.empty()) {
+        return;
+    }
+    for (auto& d : m_dirs) {
+        if (is_within(d.second, from)) {
+            d.second = to + d.second.substr(from.size());
+        }
+    }
+}
+
+shared_state make_state(const fs::path& p, const fs::change_config& cfg, bool recursive, fs::error_code& ec) {
+    if (recursive && cfg.backend == fs::change_monitor_backend::filesystem) {
+        auto s = std::make_shared<fanotify_state>(p, cfg, ec);
+        if (!ec) {
+            return s;
+        }
+        // Most likely EPERM (no CAP_SYS_ADMIN), an older kernel or a filesystem without file handle support.
+        s.reset(); // detaches the journal
+        ec.clear();
+    }
+    return std::make_shared<inotify_state>(p, cfg, recursive, ec);
+}
+
+class gstate {
+public:
+    std::unordered_map<int, shared_state> registrations; // by inotify fd
+    std::mutex lck;
+    int epfd;
+    int wakefd; // wakes the monitor thread for a registration with events to replay
+    
+    gstate()
+        : epfd(::epoll_create1(EPOLL_CLOEXEC))
+        , wakefd(::eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK)) {
+        struct ::epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = wakefd;
+        (void)::epoll_ctl(epfd, EPOLL_CTL_ADD, wakefd, &ev);
+    }
+    PS_DISABLE_COPY(gstate);
+    PS_DISABLE_MOVE(gstate);
+    
+    shared_state find(int fd);
+    int timeout();
+    void flush();
+};
+
+PS_NOINLINE
+gstate& gs() {
+    prosoft::intentional_leak_guard lg;
+    static auto gp = new gstate;
+    return *gp;
+}
+
+using g_guard = std::lock_guard<decltype(gstate::lck)>;
+
+shared_state gstate::find(int fd) {
+    g_guard lg{lck};
+    auto i = registrations.find(fd);
+    return i != registrations.end() ? i->second : shared_state{};
+}
+
+int gstate::timeout() {
+    using namespace std::chrono;
+    const auto now = clock_type::now();
+    auto t = clock_type::time_point::max();
+    {
+        g_guard lg{lck};
+        for (const auto& r : registrations) {
+            if (r.second->pending()) {
+                t = std::min(t, r.second->m_deadline);
+            }
+        }
+    }
+    if (t == clock_type::time_point::max()) {
+        return -1;
+    }
+    return t > now ? static_cast<int>(duration_cast<milliseconds>(t - now).count()) + 1 : 0;
+}
+
+void gstate::flush() {
+    std::vector<std::pair<shared_state, pending_batch>> ready;
+    {
+        const auto now = clock_type::now();
+        g_guard lg{lck};
+        for (auto& r : registrations) {
+            auto& ss = r.second;
+            if (ss->pending() && ss->m_deadline <= now) {
+                ready.emplace_back(ss, ss->take());
+                if (ss->m_canceled) {
+                    (void)::epoll_ctl(epfd, EPOLL_CTL_DEL, ss->m_fd, nullptr);
+                }
+            }
+        }
+    }
+    
+    for (auto& r : ready) {
+        auto notes = r.first->deliver(std::move(r.second));
+        if (!notes.empty() && find(r.first->m_fd) == r.first) { // may have been stopped
+            PSIgnoreCppException(r.first->m_callback(std::move(notes)));
+        }
+    }
+}
+
+void monitor_thread() {
+    pthread_setname_np(pthread_self(), "inotify_monitor");
+    auto& g = gs();
+    for (;;) {
+        struct ::epoll_event evs[32];
+        const int n = ::epoll_wait(g.epfd, evs, sizeof(evs)/sizeof(evs[0]), g.timeout());
+        for (int i = 0; i < n; ++i) {
+            if (evs[i].data.fd == g.wakefd) {
+                std::uint64_t val;
+                (void)::read(g.wakefd, &val, sizeof(val));
+            } else if (auto ss = g.find(evs[i].data.fd)) {
+                ss->read();
+            }
+        }
+        g.flush();
+    }
+}
+
+void start_monitor_thread() {
+    struct start_thread {
+        start_thread() {
+            std::thread t{monitor_thread};
+            t.detach();
+        }
+    };
+    
+    static start_thread s{};
+}
+
+fs::change_registration register_events_monitor(shared_state&& state, fs::change_callback&& cb, fs::error_code& ec) {
+    auto& g = gs();
+    if (g.epfd < 0) {
+        ec = fs::error_code(fs::platform_error::monitor_start, fs::platform_category());
+        return fs::change_registration{};
+    }
+    
+    state->m_callback = std::move(cb);
+    auto reg = fs::change_manager::make_registration(state);
+    const int fd = state->m_fd;
+    const bool wake = state->pending();
+    {
+        g_guard lg{g.lck};
+        struct ::epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.fd = fd;
+        // A monitor replaying to the current event is already canceled and does not need new events.
+        if (!state->m_canceled && 0 != ::epoll_ctl(g.epfd, EPOLL_CTL_ADD, fd, &ev)) {
+            ec = fs::error_code(fs::platform_error::monitor_start, fs::platform_category());
+            return fs::change_registration{};
+        }
+        g.registrations.emplace(fd, std::move(state));
+    }
+    
+    start_monitor_thread();
+    if (wake) {
+        const std::uint64_t val = 1;
+        (void)::write(g.wakefd, &val, sizeof(val));
+    }
+    ec.clear();
+    return reg;
+}
+
+void unregister_events_monitor(platform_state* state, fs::error_code& ec) {
+    PSASSERT_NOTNULL(state);
+    shared_state ss; // released outside of the lock
+    auto& g = gs();
+    {
+        g_guard lg{g.lck};
+        auto i = g.registrations.find(state->m_fd);
+        if (i != g.registrations.end() && i->second.get() == state) {
+            (void)::epoll_ctl(g.epfd, EPOLL_CTL_DEL, state->m_fd, nullptr);
+            ss = std::move(i->second);
+            g.registrations.erase(i);
+        } else {
+            ec = fs::error_code{ENOENT, std::system_category()};
+            return;
+        }
+    }
+    // The monitor thread may still hold the state, but it won't record any more events.
+    ss->detach_journal();
+}
+
+fs::change_registration make_monitor(const fs::path& p, const fs::change_config& cfg, fs::change_callback&& cb, bool recursive, fs::error_code& ec) {
+    if (cfg.backend == fs::change_monitor_backend::polling) {
+        return fs::polling_monitor(p, cfg, std::move(cb), recursive, ec);
+    }
+    
+    if (p.empty() || !valid(cfg) || !cb) {
+        ec = einval();
+        return fs::change_registration{};
+    }
+    
+    auto state = make_state(p, cfg, recursive, ec);
+    if (!ec) {
+        auto thawed = dynamic_cast<const platform_state*>(cfg.state);
+        if (thawed && thawed->m_journalid != 0) {
+            state->replay(*thawed, ec);
+            if (ec) {
+                return fs::change_registration{};
+            }
+        }
+        return register_events_monitor(std::move(state), std::move(cb), ec);
+    }
+    
+    return fs::change_registration{};
+}
+
+} // anon
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+struct change_token {
+    dev_t m_device;
+    
+    change_token(const path&, error_code&);
+};
+
+change_token::change_token(const path& p, error_code& ec)
+    : m_device() {
+    struct ::stat sb;
+    if (0 == ::lstat(p.c_str(), &sb)) {
+        m_device = sb.st_dev;
+        ec.clear();
+    } else {
+        ifilesystem::system_error(ec);
+    }
+}
+
+change_state::token_type change_state::serialize_token(const path& p, error_code& ec) {
+    auto ct = std::make_shared<change_token>(p, ec);
+    if (ec.value() == 0) {
+        return ct;
+    } else {
+        return {};
+    }
+}
+
+change_state::token_type change_state::serialize_token(const path& p) {
+    fs::error_code ec;
+    auto s = serialize_token(p, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not serialize filesystem monitor state", p, ec));
+    return s;
+}
+
+std::string change_state::serialize(const token_type&, error_code& ec) {
+    ec.clear();
+    return ""; // no event history
+}
+
+std::string change_state::serialize(const token_type& token) {
+    fs::error_code ec;
+    auto s = serialize(token, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not serialize filesystem monitor state", ec));
+    return s;
+}
+
+std::string change_state::serialize(const path& p, error_code& ec) {
+    if (auto token = serialize_token(p, ec)) {
+        return serialize(token, ec);
+    }
+    return "";
+}
+
+std::string change_state::serialize(const path& p) {
+    fs::error_code ec;
+    auto s = serialize(p, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not serialize filesystem monitor state", p, ec));
+    return s;
+}
+
+std::unique_ptr<change_state> change_state::serialize(const std::string& s, change_thaw_options opts) {
+    return std::unique_ptr<platform_state>{new platform_state{s, opts}};
+}
+
+change_registration monitor(const path& p, const change_config& cfg, change_callback cb, error_code& ec) {
+    return make_monitor(p, cfg, std::move(cb), false, ec);
+}
+
+change_registration recursive_monitor(const path& p, const change_config& cfg, change_callback cb, error_code& ec) {
+    return make_monitor(p, cfg, std::move(cb), true, ec);
+}
+
+void stop(change_state* state, error_code& ec) {
+    PSASSERT_NOTNULL(state);
+    if (stop_polling_monitor(state, ec)) {
+        return;
+    }
+    if (auto ip = dynamic_cast<platform_state*>(state)) {
+        unregister_events_monitor(ip, ec);
+    } else {
+        throw std::bad_cast{}; // should never happen or something's gone south
+    }
+}
+
+} // v1
+} // filesystem
+} // prosoft
+
+#if PSTEST_HARNESS
+// Internal tests.
+#include <catch2/catch_test_macros.hpp>
+#include "fstestutils.hpp"
+
+using namespace prosoft::filesystem;
+
+namespace {
+struct test_state : platform_state {
+    using platform_state::platform_state;
+    using platform_state::add;
+    using platform_state::cancel;
+};
+} // anon
+
+TEST_CASE("inotify_monitor_internal") {
+    WHEN("converting inotify events") {
+        CHECK(to_event(IN_CREATE) == change_event::created);
+        CHECK(to_event(IN_DELETE) == change_event::removed);
+        CHECK(to_event(IN_MODIFY|IN_ATTRIB) == change_event::modified);
+        CHECK(to_event(IN_MOVED_FROM) == change_event::renamed);
+        CHECK(to_event(IN_MOVED_TO) == change_event::renamed);
+        CHECK(to_type(IN_CREATE|IN_ISDIR) == file_type::directory);
+        CHECK(to_type(IN_CREATE) == file_type::none);
+        
+        change_config cfg{change_event::created};
+        CHECK(0 == (watch_flags(cfg) & (IN_MODIFY|IN_ATTRIB)));
+        cfg.events = change_event::all;
+        CHECK((IN_MODIFY|IN_ATTRIB) == (watch_flags(cfg) & (IN_MODIFY|IN_ATTRIB)));
+    }
+    
+    WHEN("checking for a contained path") {
+        CHECK(is_within("/a/b", "/a/b"));
+        CHECK(is_within("/a/b/c", "/a/b"));
+        CHECK_FALSE(is_within("/a/bc", "/a/b"));
+        CHECK_FALSE(is_within("/a", "/a/b"));
+    }
+    
+    SECTION("processing events") {
+        const auto root = canonical(temp_directory_path()) / process_name("fs17inotify");
+        create_directory(root);
+        PS_RAII_REMOVE(root);
+        
+        change_config cfg;
+        cfg.notification_latency = change_config::latency_type{0};
+        error_code ec;
+        inotify_state ps{root, cfg, true, ec};
+        REQUIRE_FALSE(ec);
+        
+        const auto sub = root / PS_TEXT("a");
+        create_directory(sub);
+        PS_RAII_REMOVE(sub);
+        const auto f = create_file(sub / PS_TEXT("1"));
+        const auto nf = sub / PS_TEXT("2");
+        rename(f, nf);
+        PS_RAII_REMOVE(nf);
+        
+        ps.read();
+        auto notes = ps.flush();
+        REQUIRE_FALSE(notes.empty());
+        CHECK(notes.front().path() == sub);
+        CHECK(created(notes.front()));
+        CHECK(notes.front().type() == file_type::directory);
+        
+        // The file may have been created before the subdir watch was added. Either way the rename target must be known.
+        const auto i = std::find_if(notes.begin(), notes.end(), [&nf](const change_notification& n) {
+            return n.path() == nf || n.renamed_to_path() == nf;
+        });
+        REQUIRE(i != notes.end());
+        CHECK(i->type() == file_type::regular);
+        
+        WHEN("a subdir is renamed") {
+            const auto nsub = root / PS_TEXT("b");
+            rename(sub, nsub);
+            const auto f3 = create_file(nsub / PS_TEXT("3"));
+            
+            ps.read();
+            notes = ps.flush();
+            REQUIRE(notes.size() == 2);
+            CHECK(renamed(notes[0]));
+            CHECK(notes[0].path() == sub);
+            CHECK(notes[0].renamed_to_path() == nsub);
+            CHECK(created(notes[1]));
+            CHECK(notes[1].path() == f3); // watch path updated
+            
+            rename(nsub, sub);
+            CHECK(remove(sub / PS_TEXT("3")));
+        }
+        
+        WHEN("events are coalesced") {
+            {
+                std::ofstream s{nf.c_str()};
+                s << "hello" << std::flush;
+                s << "world" << std::flush;
+            }
+            ps.read();
+            notes = ps.flush();
+            REQUIRE(notes.size() == 1);
+            CHECK(content_modified(notes[0]));
+        }
+    }
+    
+    SECTION("collapsing events") {
+        const auto root = canonical(temp_directory_path()) / process_name("fs17inotify");
+        create_directory(root);
+        PS_RAII_REMOVE(root);
+        const auto a = root / PS_TEXT("a");
+        create_directory(a);
+        PS_RAII_REMOVE(a);
+        const auto c = root / PS_TEXT("c");
+        create_directory(c);
+        PS_RAII_REMOVE(c);
+        
+        change_config cfg;
+        cfg.notification_latency = change_config::latency_type{0};
+        cfg.max_pending_events = 2;
+        error_code ec;
+        inotify_state ps{root, cfg, true, ec};
+        REQUIRE_FALSE(ec);
+        
+        const auto f1 = create_file(root / PS_TEXT("1"));
+        PS_RAII_REMOVE(f1);
+        const auto f2 = create_file(root / PS_TEXT("2"));
+        PS_RAII_REMOVE(f2);
+        const auto f3 = create_file(root / PS_TEXT("3"));
+        PS_RAII_REMOVE(f3);
+        const auto f4 = create_file(a / PS_TEXT("4"));
+        PS_RAII_REMOVE(f4);
+        
+        ps.read();
+        auto notes = ps.flush();
+        REQUIRE(notes.size() == 2);
+        CHECK(notes[0].path() == root);
+        CHECK(notes[0].event() == change_event::rescan);
+        CHECK(notes[1].path() == a);
+        CHECK(notes[1].event() == change_event::rescan);
+        CHECK(ps.counters().collapsed > 2);
+        CHECK(ps.counters().dropped == 0);
+        
+        WHEN("there are too many directories") {
+            const auto f5 = create_file(root / PS_TEXT("5"));
+            PS_RAII_REMOVE(f5);
+            const auto f6 = create_file(a / PS_TEXT("6"));
+            PS_RAII_REMOVE(f6);
+            const auto f7 = create_file(c / PS_TEXT("7"));
+            PS_RAII_REMOVE(f7);
+            
+            ps.read();
+            notes = ps.flush();
+            REQUIRE(notes.size() == 1);
+            CHECK(notes[0].path() == root);
+            CHECK(notes[0].event() == change_event::rescan);
+            CHECK(ps.counters().dropped == 2);
+        }
+        
+        WHEN("a cancellation is followed by an overflow") {
+            test_state ts{root, cfg, true, ec};
+            REQUIRE_FALSE(ec);
+            ts.add(path{f1}, change_event::created, file_type::regular);
+            ts.cancel(change_event::rescan_required);
+            ts.add(path{f4}, change_event::created, file_type::regular);
+            ts.add(c / PS_TEXT("7"), change_event::created, file_type::regular);
+            notes = ts.flush();
+            REQUIRE(notes.size() == 2);
+            CHECK(notes[0].path() == root);
+            CHECK(canceled(notes[0]));
+            CHECK(notes[1].path() == root);
+            CHECK(notes[1].event() == change_event::rescan);
+            CHECK(ts.counters().dropped == 2);
+        }
+    }
+    
+    SECTION("processing fanotify events") {
+        CHECK(to_fanotify_event(FAN_CREATE|FAN_DELETE) == (change_event::created|change_event::removed));
+        CHECK(to_fanotify_event(FAN_MODIFY|FAN_ATTRIB) == change_event::modified);
+        CHECK(0 == (fanotify_flags(change_config{change_event::created}) & (FAN_MODIFY|FAN_ATTRIB)));
+        
+        const auto root = canonical(temp_directory_path()) / process_name("fs17fanotify");
+        create_directory(root);
+        PS_RAII_REMOVE(root);
+        
+        change_config cfg;
+        cfg.notification_latency = change_config::latency_type{0};
+        error_code ec;
+        fanotify_state ps{root, cfg, ec};
+        if (ec) {
+            WARN("fanotify is not available: " << ec.message());
+            return;
+        }
+        
+        const auto sub = root / PS_TEXT("a");
+        create_directory(sub);
+        PS_RAII_REMOVE(sub);
+        const auto f = create_file(sub / PS_TEXT("1"));
+        const auto nf = sub / PS_TEXT("2");
+        rename(f, nf);
+        PS_RAII_REMOVE(nf);
+        // outside of the tree
+        const auto other = create_file(root.parent_path() / process_name("fs17fanotify_other"));
+        PS_RAII_REMOVE(other);
+        
+        ps.read();
+        auto notes = ps.flush();
+        REQUIRE(notes.size() == 3);
+        CHECK(notes[0].path() == sub);
+        CHECK(created(notes[0]));
+        CHECK(notes[0].type() == file_type::directory);
+        CHECK(notes[1].path() == f);
+        CHECK(created(notes[1]));
+        CHECK(renamed(notes[2]));
+        CHECK(notes[2].path() == f);
+        CHECK(notes[2].renamed_to_path() == nf);
+        CHECK(notes[2].type() == file_type::regular);
+        
+        WHEN("a subdir is renamed") {
+            const auto nsub = root / PS_TEXT("b");
+            rename(sub, nsub);
+            const auto f3 = create_file(nsub / PS_TEXT("3"));
+            
+            ps.read();
+            notes = ps.flush();
+            REQUIRE(notes.size() == 2);
+            CHECK(renamed(notes[0]));
+            CHECK(notes[0].path() == sub);
+            CHECK(notes[0].renamed_to_path() == nsub);
+            CHECK(created(notes[1]));
+            CHECK(notes[1].path() == f3); // cached dir path updated
+            
+            rename(nsub, sub);
+            CHECK(remove(sub / PS_TEXT("3")));
+        }
+        
+        WHEN("the root is removed") {
+            CHECK(remove(nf));
+            CHECK(remove(sub));
+            CHECK(remove(root));
+            ps.read();
+            notes = ps.flush();
+            REQUIRE(notes.size() == 3);
+            CHECK(notes[2].path() == root);
+            CHECK(removed(notes[2]));
+            CHECK(canceled(notes[2]));
+            
+            // restore for cleanup
+            create_directory(root);
+            create_directory(sub);
+            create_file(nf);
+        }
+    }
+}
+
+#endif // PSTEST_HARNESS
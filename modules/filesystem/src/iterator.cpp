@@ -28,11 +28,14 @@
 #if !_WIN32
 #include <dirent.h>
 #include <sys/errno.h>
+#include <sys/stat.h>
+#include <time.h>
 #else
 #include <windows.h>
 #endif
 
 #include <cstring>
+#include <unordered_map>
 #include <vector>
 
 #include <prosoft/core/include/system_error.hpp>
@@ -121,6 +124,19 @@ void cache_info(fs::ifilesystem::cache_info& ci, const native_dirent* e) {
         break;
     }
 }
+
+unsigned char to_dirent_type(fs::file_type t) {
+    switch(t) {
+        case fs::file_type::regular: return DT_REG;
+        case fs::file_type::directory: return DT_DIR;
+        case fs::file_type::symlink: return DT_LNK;
+        case fs::file_type::block: return DT_BLK;
+        case fs::file_type::character: return DT_CHR;
+        case fs::file_type::fifo: return DT_FIFO;
+        case fs::file_type::socket: return DT_SOCK;
+        default: return DT_UNKNOWN;
+    }
+}
 #else
 using native_dirent = ::WIN32_FIND_DATAW;
 struct native_dir {
@@ -253,6 +269,12 @@ inline PS_CONSTEXPR_IF_CPP14 bool is_apple_double(const fs::path&, const fs::pat
 
 native_dir* const INVALID_DIR = (native_dir*)((uintptr_t)0xbaadf00dUL);
 
+#if !_WIN32 && !__APPLE__
+// Mount crossings are detected by a device change instead of is_mountpoint(), which has to consult the mount table.
+// Apple uses is_mountpoint() for its mount trigger support.
+#define PS_FS_ITERATOR_DEVICE_MOUNTPOINTS 1
+#endif
+
 struct dir_ops {
     PS_ALWAYS_INLINE static native_dir* open(const fs::path& p) {
         return open_dir(p);
@@ -265,16 +287,29 @@ struct dir_ops {
     PS_ALWAYS_INLINE static int close(native_dir* d) {
         return close_dir(d);
     }
+    
+#if PS_FS_ITERATOR_DEVICE_MOUNTPOINTS
+    PS_ALWAYS_INLINE static int stat_dir(native_dir* d, const fs::path&, struct ::stat* sb) {
+        return ::fstat(::dirfd(d), sb);
+    }
+#endif
 };
 
+using device_type = std::uint64_t;
+constexpr device_type unknown_device = ~device_type{0};
+
 template <class Ops>
 struct stack_entry {
     native_dir* m_dir;
     fs::path m_path;
+    device_type m_dev;
+    bool m_unlisted; // only descended into for the filter, the dir itself is not returned
     
     stack_entry(native_dir* d, fs::path&& p) noexcept(std::is_nothrow_move_constructible<fs::path>::value)
         : m_dir(d)
-        , m_path(std::move(p)) {}
+        , m_path(std::move(p))
+        , m_dev(unknown_device)
+        , m_unlisted(false) {}
     stack_entry(native_dir* d, const fs::path& p)
         : stack_entry(d, fs::path{p}) {}
     ~stack_entry() {
@@ -284,7 +319,9 @@ struct stack_entry {
     }
     stack_entry(stack_entry&& other) noexcept(std::is_nothrow_move_constructible<fs::path>::value)
         : m_dir(other.m_dir)
-        , m_path(std::move(other.m_path)) {
+        , m_path(std::move(other.m_path))
+        , m_dev(other.m_dev)
+        , m_unlisted(other.m_unlisted) {
         other.m_dir = INVALID_DIR;
     }
     
@@ -302,6 +339,8 @@ class state : public fsiterator_state {
 // save subdirs as they are found, process all files, close parent and then recurse saved subdirs.
     using entry = stack_entry<Ops>;
     std::vector<entry> m_stack;
+    fs::path_filter_ptr m_filter;
+    fs::canonical_cache_ptr m_canonical;
     
 #if PSTEST_HARNESS
 public:
@@ -341,14 +380,38 @@ public:
     void push_placeholder(fs::path&& dir) {
         m_stack.emplace_back(INVALID_DIR, std::move(dir));
     }
+    
+    bool is_mountpoint(const entry&, const native_dirent*, const fs::path&, fs::error_code&) const;
+    
+    fs::path link_path(const fs::path& p, const native_dirent* e) const {
+        if (is_symlink(e)) {
+            fs::error_code ec;
+            auto np = m_canonical ? m_canonical->canonical(p, ec) : fs::canonical(p, ec);
+            if (!np.empty()) {
+                return np;
+            }
+        }
+        return p;
+    }
 
 public:
     using fsiterator_state::fsiterator_state;
     
-    state(const fs::path&, fs::directory_options, fs::error_code&);
+    state(const fs::path&, fs::directory_options, Ops&&, fs::error_code&);
+    
+    state(const fs::path& p, fs::directory_options opts, fs::error_code& ec)
+        : state(p, opts, Ops{}, ec) {}
     
     virtual ~state() {};
     
+    void filter(fs::path_filter_ptr f) noexcept {
+        m_filter = std::move(f);
+    }
+    
+    void canonical_cache(fs::canonical_cache_ptr c) noexcept {
+        m_canonical = std::move(c);
+    }
+    
     virtual fs::path next(fsiterator_cache&, prosoft::system::error_code&) override;
 #if PSTEST_HARNESS
     fs::path next(prosoft::system::error_code& ec) {
@@ -414,6 +477,12 @@ bool state<Ops>::push(fs::path&& p, fs::error_code& ec) {
     if (auto d = m_ops.open(p)) {
         set(fs::directory_options::reserved_state_will_recurse);
         m_stack.emplace_back(d, std::move(p));
+#if PS_FS_ITERATOR_DEVICE_MOUNTPOINTS
+        struct ::stat sb;
+        if (recurse() && !is_set(options() & fs::directory_options::follow_mountpoints) && 0 == m_ops.stat_dir(d, m_stack.back().m_path, &sb)) {
+            m_stack.back().m_dev = static_cast<device_type>(sb.st_dev);
+        }
+#endif
         ec.clear();
         return true;
     } else {
@@ -438,8 +507,9 @@ inline bool leaf_is_dot_or_dot_dot(const fs::path& leaf) {
 #endif
 
 template <class Ops>
-state<Ops>::state(const fs::path& p, fs::directory_options opts, fs::error_code& ec)
-    : fsiterator_state(p, opts, ec) {
+state<Ops>::state(const fs::path& p, fs::directory_options opts, Ops&& ops, fs::error_code& ec)
+    : fsiterator_state(p, opts, ec)
+    , m_ops(std::move(ops)) {
 #if _WIN32
     // Empty path is valid in Win32 (implicit "."), but not POSIX. Use POSIX behavior for Windows.
     if (p.empty()) {
@@ -459,7 +529,7 @@ fs::path state<Ops>::next(fsiterator_cache& cinfo, prosoft::system::error_code&
     base::clear(fs::directory_options::reserved_state_mask);
     ec.clear();
     
-    if (postorder && is_child() && !is_valid()) {
+    if (postorder && is_child() && !is_valid() && !peek_unsafe().m_unlisted) {
         // Handle post order event for the current directory that we failed to open.
         set(fs::directory_options::reserved_state_postorder);
         auto p = peek_unsafe().m_path;
@@ -510,41 +580,52 @@ fs::path state<Ops>::next(fsiterator_cache& cinfo, prosoft::system::error_code&
                     continue;
                 }
                 
+                if (m_filter) {
+                    const auto m = m_filter->match(cpath);
+                    if (m != fs::filter_match::included) {
+                        if (m == fs::filter_match::ancestor && recurse() && is_directory(ent)
+                            && (is_set(options() & fs::directory_options::follow_mountpoints) || !is_mountpoint(*e, ent, cpath, derr))) {
+                            // Errors are ignored as the dir is not returned.
+                            fs::error_code ignored;
+                            (void)push(std::move(cpath), ignored);
+                            m_stack.back().m_unlisted = true;
+                            base::clear(fs::directory_options::reserved_state_will_recurse);
+                            break; // continue with the new dir
+                        }
+                        continue;
+                    }
+                }
+                
                 if (recurse()
                     && (is_directory(ent)
                         || (is_set(options() & fs::directory_options::follow_directory_symlink) && is_symlink(ent) && is_directory(cpath, derr)))
                     ) {
-                    if ((!is_set(options() & fs::directory_options::follow_mountpoints) && is_mountpoint(cpath, derr))
+                    if ((!is_set(options() & fs::directory_options::follow_mountpoints) && is_mountpoint(*e, ent, cpath, derr))
                         || (is_set(options() & fs::directory_options::skip_package_content_descendants) && is_package(cpath, derr))
                     ) {
                         // push a placeholder so clients can call skipDescendants() w/o unexpected results.
                         push_placeholder(fs::path{cpath});
                     } else {
-                        static auto copy_link_path = [](const fs::path& p, native_dirent* e) -> fs::path {
-                            if (is_symlink(e)) {
-                                fs::error_code ec;
-                                auto np = fs::canonical(p, ec);
-                                if (!np.empty()) {
-                                    return np;
-                                }
-                            }
-                            return p;
-                        };
-                        
-                        if (!push(copy_link_path(cpath, ent), ec)) {
-                            PSASSERT(peek_unsafe().m_path == copy_link_path(cpath, ent), "Broken assumption"); // assuming placeholder is pushed
+                        if (!push(link_path(cpath, ent), ec)) {
+                            PSASSERT(peek_unsafe().m_path == link_path(cpath, ent), "Broken assumption"); // assuming placeholder is pushed
                             // Fallthrough to return entry, even though there was an open error
                         }
                     }
                 }
                 
                 cache_info(cinfo, ent);
+                if (is_set(options() & fs::directory_options::include_xattrs)) {
+                    auto xs = fs::get_xattrs(cpath, derr);
+                    if (!derr) {
+                        cinfo.xattrs = std::make_shared<const fs::xattr_set>(std::move(xs));
+                    }
+                }
                 return cpath;
             } else {
                 // we've read all entries in the current dir
                 prosoft::system::system_error(ec);
                 clear_if(ec, is_no_entries(ec));
-                if (!ec && postorder && is_child()) { // don't include root
+                if (!ec && postorder && is_child() && !e->m_unlisted) { // don't include root
                     set(fs::directory_options::reserved_state_postorder);
                     auto p = e->m_path;
                     #if DEBUG
@@ -568,6 +649,30 @@ fs::path state<Ops>::next(fsiterator_cache& cinfo, prosoft::system::error_code&
     return fs::path{};
 }
 
+template <class Ops>
+bool state<Ops>::is_mountpoint(const entry& parent, const native_dirent* ent, const fs::path& p, fs::error_code& ec) const {
+#if PS_FS_ITERATOR_DEVICE_MOUNTPOINTS
+    if (unknown_device != parent.m_dev) {
+        if (is_symlink(ent)) { // followed link, is_mountpoint() is always false for a link
+            return false;
+        }
+        struct ::stat sb;
+        if (0 != ::lstat(p.c_str(), &sb) || !S_ISDIR(sb.st_mode) || static_cast<device_type>(sb.st_dev) == parent.m_dev) {
+            return false;
+        }
+        // Not every device change is a mount (e.g. an unmounted btrfs subvolume), the cached mount table confirms it.
+        fs::error_code mec;
+        const auto mp = fs::mount_path(p, mec);
+        struct ::stat msb;
+        return !mec && 0 == ::stat(mp.c_str(), &msb) && msb.st_dev == sb.st_dev && msb.st_ino == sb.st_ino;
+    }
+#else
+    (void)parent;
+    (void)ent;
+#endif
+    return fs::is_mountpoint(p, ec);
+}
+
 template <class Ops>
 void state<Ops>::pop() {
     if (size() > 0) {
@@ -606,6 +711,142 @@ bool state<Ops>::at_end() const {
     return size() == 0;
 }
 
+#if !_WIN32
+#if PS_FS_HAVE_BSD_STATFS
+    #define PS_ST_MTIM st_mtimespec
+    #define PS_ST_CTIM st_ctimespec
+#else
+    #define PS_ST_MTIM st_mtim
+    #define PS_ST_CTIM st_ctim
+#endif
+
+// Replays listings from a directory_listing_cache for directories that have not changed since they were recorded.
+// The dir is still opened as the stamp is taken from the open handle (no path races), but the reads are avoided.
+class listing_cache_ops {
+    using cache_type = fs::directory_listing_cache;
+    
+    struct cursor {
+        cache_type::stamp m_stamp;
+        cache_type::listing_ptr m_replay;
+        cache_type::listing m_record;
+        size_t m_pos;
+        bool m_recording;
+    };
+    
+    fs::directory_listing_cache_ptr m_cache;
+    // Keyed by the open handle. A stale cursor (e.g. the dir was popped before EOF) is replaced if the handle value is reused.
+    std::unordered_map<native_dir*, cursor> m_cursors;
+    native_dirent m_cur;
+    
+    static std::int64_t to_ns(const ::timespec& ts) {
+        return std::int64_t{ts.tv_sec} * 1000000000 + ts.tv_nsec;
+    }
+    
+    // Timestamp granularity may be as coarse as 1 second (or 2 for FAT), so a dir changed in the same tick as the read
+    // could be modified again without a stamp change. Such dirs are read normally but not recorded.
+    static bool is_settled(const cache_type::stamp& st) {
+        constexpr std::int64_t window = std::int64_t{2} * 1000000000;
+        ::timespec now;
+        return 0 == ::clock_gettime(CLOCK_REALTIME, &now) && (to_ns(now) - std::max(st.ctime, st.mtime)) > window;
+    }
+    
+    static bool is_dot_or_dot_dot(const char* name) {
+        return name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0));
+    }
+    
+    native_dirent* replay(cursor& c) {
+        if (c.m_pos < c.m_replay->size()) {
+            const auto& e = (*c.m_replay)[c.m_pos++];
+            const auto n = std::min(e.name.size(), sizeof(m_cur.d_name) - 1);
+            std::memcpy(m_cur.d_name, e.name.data(), n);
+            m_cur.d_name[n] = 0;
+#if PS_FS_HAVE_BSD_STATFS
+            m_cur.d_namlen = static_cast<decltype(m_cur.d_namlen)>(n);
+#endif
+            m_cur.d_type = to_dirent_type(e.type);
+            return &m_cur;
+        }
+        return nullptr;
+    }
+    
+public:
+    listing_cache_ops() = default; // close() only
+    
+    explicit listing_cache_ops(fs::directory_listing_cache_ptr c)
+        : m_cache(std::move(c)) {}
+    
+    static cache_type::stamp make_stamp(const struct ::stat& sb) {
+        return cache_type::stamp{std::uint64_t(sb.st_dev), std::uint64_t(sb.st_ino), to_ns(sb.PS_ST_CTIM), to_ns(sb.PS_ST_MTIM)};
+    }
+    
+    native_dir* open(const fs::path& p) {
+        auto d = open_dir(p);
+        if (d && m_cache) {
+            struct ::stat sb;
+            if (0 == ::fstat(::dirfd(d), &sb)) {
+                auto& c = m_cursors[d];
+                c.m_stamp = make_stamp(sb);
+                c.m_replay = m_cache->find(c.m_stamp);
+                c.m_record.clear();
+                c.m_pos = 0;
+                c.m_recording = !c.m_replay && is_settled(c.m_stamp);
+            } else {
+                m_cursors.erase(d);
+            }
+            errno = 0; // open succeeded, don't leak any cache errors
+        }
+        return d;
+    }
+    
+    native_dirent* read(native_dir* d) {
+        auto i = m_cursors.find(d);
+        if (i == m_cursors.end()) {
+            return read_dir(d);
+        }
+        
+        auto& c = i->second;
+        if (c.m_replay) {
+            auto ent = replay(c);
+            if (!ent) {
+                m_cursors.erase(i);
+            }
+            errno = 0;
+            return ent;
+        }
+        
+        auto ent = read_dir(d);
+        if (ent) {
+            if (c.m_recording && !is_dot_or_dot_dot(ent->d_name)) {
+                fsiterator_cache ci;
+                cache_info(ci, ent);
+                c.m_record.push_back(cache_type::entry{prosoft::native_string_type{ent->d_name}, ci.ftype});
+            }
+        } else {
+            const auto err = errno;
+            if (0 == err && c.m_recording) {
+                m_cache->insert(c.m_stamp, std::move(c.m_record));
+            }
+            m_cursors.erase(i);
+            errno = err;
+        }
+        return ent;
+    }
+    
+    static int close(native_dir* d) {
+        return close_dir(d);
+    }
+    
+#if PS_FS_ITERATOR_DEVICE_MOUNTPOINTS
+    static int stat_dir(native_dir* d, const fs::path&, struct ::stat* sb) {
+        return ::fstat(::dirfd(d), sb);
+    }
+#endif
+};
+
+#undef PS_ST_MTIM
+#undef PS_ST_CTIM
+#endif // !_WIN32
+
 } // anon
 
 namespace prosoft {
@@ -613,8 +854,22 @@ namespace filesystem {
 inline namespace v1 {
 
 ifilesystem::iterator_state_ptr
-ifilesystem::make_iterator_state(const path& p, directory_options opts, iterator_traits::configuration_type, error_code& ec) {
-    auto s = std::make_shared<state<dir_ops>>(p, opts, ec);
+ifilesystem::make_iterator_state(const path& p, directory_options opts, iterator_traits::configuration_type cfg, error_code& ec) {
+    iterator_state_ptr s;
+#if !_WIN32
+    if (cfg.listing_cache) {
+        auto cs = std::make_shared<state<listing_cache_ops>>(p, opts, listing_cache_ops{std::move(cfg.listing_cache)}, ec);
+        cs->filter(std::move(cfg.filter));
+        cs->canonical_cache(std::move(cfg.canonical_cache));
+        s = std::move(cs);
+    } else
+#endif
+    {
+        auto ds = std::make_shared<state<dir_ops>>(p, opts, ec);
+        ds->filter(std::move(cfg.filter));
+        ds->canonical_cache(std::move(cfg.canonical_cache));
+        s = std::move(ds);
+    }
     if (ec) {
         s.reset(); // null is the end iterator
     }
@@ -657,6 +912,7 @@ void directory_entry::refresh(error_code& ec) {
 
 #if PSTEST_HARNESS
 // Internal tests.
+#include <fstream>
 #include <catch2/catch_test_macros.hpp>
 
 using namespace prosoft::filesystem;
@@ -723,6 +979,12 @@ struct test_ops {
     virtual int close(native_dir* d) {
         return close_dir(d);
     }
+    
+#if PS_FS_ITERATOR_DEVICE_MOUNTPOINTS
+    int stat_dir(native_dir*, const fs::path& p, struct ::stat* sb) {
+        return ::stat(p.c_str(), sb);
+    }
+#endif
 };
 
 struct test_nopen : test_ops {
@@ -941,6 +1203,44 @@ TEST_CASE("filesystem_iterator_internal") {
         CHECK(0 == ec.value());
         CHECK(p.empty());
     }
+    
+    WHEN("a directory listing is cached") {
+        using cops = state<listing_cache_ops>;
+        
+        auto root = temp_directory_path() / PS_TEXT("fs17lcache");
+        root += std::to_string(::getpid());
+        REQUIRE(create_directory(root));
+        
+        struct ::stat sb;
+        REQUIRE(0 == ::stat(root.c_str(), &sb));
+        auto cache = std::make_shared<fs::directory_listing_cache>();
+        cache->insert(listing_cache_ops::make_stamp(sb), fs::directory_listing_cache::listing{{"replayed", fs::file_type::regular}});
+        
+        error_code ec;
+        auto s = make_ptr<cops>(root, recursive_directory_iterator::default_options(), listing_cache_ops{cache}, ec);
+        CHECK(0 == ec.value());
+        auto p = s->next(ec);
+        CHECK(0 == ec.value());
+        CHECK(p.filename().native() == "replayed"); // the dir is empty, so this can only come from the cache
+        CHECK(cache->hits() == 1);
+        p = s->next(ec);
+        CHECK(0 == ec.value());
+        CHECK(p.empty());
+        
+        // Changing the dir invalidates the listing
+        const auto f = root / PS_TEXT("1");
+        { std::ofstream os{f.c_str()}; }
+        s = make_ptr<cops>(root, recursive_directory_iterator::default_options(), listing_cache_ops{cache}, ec);
+        p = s->next(ec);
+        CHECK(0 == ec.value());
+        CHECK(p == f);
+        CHECK(cache->misses() == 1);
+        p = s->next(ec);
+        CHECK(p.empty());
+        
+        CHECK(remove(f));
+        CHECK(remove(root));
+    }
 #endif
 }
 
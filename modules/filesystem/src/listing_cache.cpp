@@ -0,0 +1,301 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <prosoft/core/config/config.h>
+
+#include <cstring>
+#include <limits>
+#include <string>
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_listing_cache.hpp>
+#include "filesystem_private.hpp"
+#include "fsstore_private.hpp"
+
+namespace {
+using namespace prosoft::filesystem;
+
+using cache_type = directory_listing_cache;
+
+// Store layout (native byte order, unaligned):
+//  header: magic[8], u32 version, u32 reserved, u64 record count
+//  record: u64 dev, u64 ino, i64 ctime, i64 mtime, u32 entry count, entries...
+//  entry: i8 file_type, u32 name size, name bytes
+constexpr char store_magic[8] = {'P', 'S', 'D', 'L', 'C', 'A', 'C', 'H'};
+constexpr std::uint32_t store_version = 1;
+
+#if !_WIN32
+
+bool valid_type(std::int8_t t) {
+    return t >= static_cast<std::int8_t>(file_type::not_found) && t <= static_cast<std::int8_t>(file_type::unknown);
+}
+
+#endif // !_WIN32
+
+} // anon
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+directory_listing_cache::directory_listing_cache(const path& p) {
+    error_code ignored;
+    load(p, ignored);
+}
+
+void directory_listing_cache::load(const path& p) {
+    error_code ec;
+    load(p, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not load directory listing cache", p, ec));
+}
+
+void directory_listing_cache::save(const path& p) const {
+    error_code ec;
+    save(p, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not save directory listing cache", p, ec));
+}
+
+#if !_WIN32
+
+void directory_listing_cache::load(const path& p, error_code& ec) {
+    ifilesystem::map_close m{MAP_FAILED, 0};
+    ifilesystem::map_store(p, m, ec);
+    if (ec) {
+        return;
+    }
+
+    ifilesystem::store_reader r{static_cast<const char*>(m.mem), m.size};
+    char magic[sizeof(store_magic)];
+    std::uint32_t version, reserved;
+    std::uint64_t count;
+    if (!r.get(magic) || 0 != std::memcmp(magic, store_magic, sizeof(magic))
+        || !r.get(version) || version != store_version
+        || !r.get(reserved) || !r.get(count)) {
+        ec = einval();
+        return;
+    }
+
+    // The counts are untrusted, so nothing is reserved from them.
+    map_type listings;
+    for (std::uint64_t i = 0; i < count; ++i) {
+        stamp st;
+        std::uint32_t nents;
+        if (!r.get(st.dev) || !r.get(st.ino) || !r.get(st.ctime) || !r.get(st.mtime) || !r.get(nents)) {
+            ec = einval();
+            return;
+        }
+        auto l = std::make_shared<listing>();
+        for (std::uint32_t j = 0; j < nents; ++j) {
+            std::int8_t ft;
+            entry e;
+            if (!r.get(ft) || !valid_type(ft) || !r.get(e.name)) {
+                ec = einval();
+                return;
+            }
+            e.type = static_cast<file_type>(ft);
+            l->emplace_back(std::move(e));
+        }
+        listings[st] = value_type{st, std::move(l)};
+    }
+
+    if (!r.at_end()) {
+        ec = einval();
+        return;
+    }
+
+    std::lock_guard<std::mutex> lg{m_lock};
+    m_listings.swap(listings);
+    ec.clear();
+}
+
+void directory_listing_cache::save(const path& p, error_code& ec) const {
+    ifilesystem::store_writer w;
+    w.put(store_magic, sizeof(store_magic));
+    w.put(store_version);
+    w.put(std::uint32_t{});
+    {
+        std::lock_guard<std::mutex> lg{m_lock};
+        w.put(static_cast<std::uint64_t>(m_listings.size()));
+        for (const auto& v : m_listings) {
+            const auto& st = v.second.m_stamp;
+            w.put(st.dev);
+            w.put(st.ino);
+            w.put(st.ctime);
+            w.put(st.mtime);
+            w.put(static_cast<std::uint32_t>(v.second.m_listing->size()));
+            for (const auto& e : *v.second.m_listing) {
+                w.put(static_cast<std::int8_t>(e.type));
+                w.put(e.name);
+            }
+        }
+    }
+
+    ifilesystem::write_store(p, w.data(), ec);
+}
+
+#else
+
+void directory_listing_cache::load(const path&, error_code& ec) {
+    ifilesystem::error(ENOTSUP, ec);
+}
+
+void directory_listing_cache::save(const path&, error_code& ec) const {
+    ifilesystem::error(ENOTSUP, ec);
+}
+
+#endif // !_WIN32
+
+directory_listing_cache::listing_ptr directory_listing_cache::find(const stamp& st) const {
+    {
+        std::lock_guard<std::mutex> lg{m_lock};
+        auto i = m_listings.find(st);
+        if (i != m_listings.end() && i->second.m_stamp == st) {
+            ++m_hits;
+            return i->second.m_listing;
+        }
+    }
+    ++m_misses;
+    return listing_ptr{};
+}
+
+void directory_listing_cache::insert(const stamp& st, listing&& l) {
+    auto lp = std::make_shared<const listing>(std::move(l));
+    std::lock_guard<std::mutex> lg{m_lock};
+    m_listings[st] = value_type{st, std::move(lp)};
+}
+
+void directory_listing_cache::erase(const stamp& st) {
+    std::lock_guard<std::mutex> lg{m_lock};
+    m_listings.erase(st);
+}
+
+void directory_listing_cache::clear() {
+    std::lock_guard<std::mutex> lg{m_lock};
+    m_listings.clear();
+}
+
+size_t directory_listing_cache::size() const {
+    std::lock_guard<std::mutex> lg{m_lock};
+    return m_listings.size();
+}
+
+} // v1
+} // filesystem
+} // prosoft
+
+#if PSTEST_HARNESS
+// Internal tests.
+#include <catch2/catch_test_macros.hpp>
+#include "fstestutils.hpp"
+
+TEST_CASE("listing_cache_internal") {
+    using namespace prosoft::filesystem;
+
+    const cache_type::stamp st{1, 2, 3, 4};
+
+    WHEN("a stamp changes") {
+        cache_type c;
+        c.insert(st, cache_type::listing{{PS_TEXT("a"), file_type::regular}});
+        CHECK(c.find(st));
+        auto st2 = st;
+        st2.mtime += 1;
+        CHECK_FALSE(c.find(st2));
+        st2 = st;
+        st2.ctime += 1;
+        CHECK_FALSE(c.find(st2));
+        CHECK(c.hits() == 1);
+        CHECK(c.misses() == 2);
+        CHECK(c.size() == 1);
+        c.insert(st2, cache_type::listing{});
+        CHECK(c.size() == 1); // same dir
+        CHECK(c.find(st2)->empty());
+    }
+
+#if !_WIN32
+    WHEN("a cache is saved and loaded") {
+        const auto p = temp_directory_path() / process_name("fs17lcache");
+        PS_RAII_REMOVE(p);
+
+        cache_type c;
+        c.insert(st, cache_type::listing{{PS_TEXT("a"), file_type::regular}, {PS_TEXT("b"), file_type::directory}});
+        REQUIRE_NOTHROW(c.save(p));
+
+        cache_type c2{p};
+        REQUIRE(c2.size() == 1);
+        auto l = c2.find(st);
+        REQUIRE(l);
+        REQUIRE(l->size() == 2);
+        CHECK((*l)[0].name == PS_TEXT("a"));
+        CHECK((*l)[0].type == file_type::regular);
+        CHECK((*l)[1].name == PS_TEXT("b"));
+        CHECK((*l)[1].type == file_type::directory);
+    }
+
+    WHEN("a store is invalid") {
+        const auto p = create_file(temp_directory_path() / process_name("fs17lcache"));
+        PS_RAII_REMOVE(p);
+
+        cache_type c;
+        c.insert(st, cache_type::listing{});
+        error_code ec;
+        c.load(p, ec);
+        CHECK(ec);
+        CHECK(c.size() == 1); // unchanged
+    }
+
+    WHEN("a store has a huge count") {
+        const auto p = temp_directory_path() / process_name("fs17lcache");
+        PS_RAII_REMOVE(p);
+
+        auto write = [&p](std::uint64_t count, std::uint32_t nents) {
+            ifilesystem::store_writer w;
+            w.put(store_magic, sizeof(store_magic));
+            w.put(store_version);
+            w.put(std::uint32_t{});
+            w.put(count);
+            w.put(std::uint64_t{1});
+            w.put(std::uint64_t{2});
+            w.put(std::int64_t{3});
+            w.put(std::int64_t{4});
+            w.put(nents);
+            error_code ec;
+            ifilesystem::write_store(p, w.data(), ec);
+            REQUIRE_FALSE(ec);
+        };
+
+        for (const auto count : {std::numeric_limits<std::uint64_t>::max(), std::uint64_t{1}}) {
+            write(count, std::numeric_limits<std::uint32_t>::max());
+            cache_type c{p};
+            CHECK(c.size() == 0);
+            error_code ec;
+            REQUIRE_NOTHROW(c.load(p, ec));
+            CHECK(ec == einval());
+            CHECK(c.size() == 0);
+        }
+    }
+#endif
+}
+
+#endif // PSTEST_HARNESS
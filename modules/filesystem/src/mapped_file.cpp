@@ -0,0 +1,286 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <prosoft/core/config/config.h>
+
+#include "fsconfig.h"
+
+#if !_WIN32
+#include <fcntl.h>
+#include <sys/errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <windows.h>
+#endif
+
+#include <limits>
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_mapped_file.hpp>
+#include "filesystem_private.hpp"
+
+namespace {
+
+using namespace prosoft::filesystem;
+
+inline error_code not_open() {
+    return error_code{
+#if !_WIN32
+        EBADF,
+#else
+        ERROR_INVALID_HANDLE,
+#endif
+        filesystem_category()};
+}
+
+inline error_code too_large() {
+    return error_code{
+#if !_WIN32
+        ENOMEM,
+#else
+        ERROR_NOT_ENOUGH_MEMORY,
+#endif
+        filesystem_category()};
+}
+
+} // anon
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+void mapped_region::advise(map_advice advice) {
+    error_code ec;
+    advise(advice, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not advise mapping", ec));
+}
+
+void mapped_region::advise(map_advice advice, error_code& ec) {
+    ec.clear();
+#if !_WIN32
+    if (!m_base) {
+        return;
+    }
+    auto apply = [this, &ec](int a) {
+        if (!ec.value() && 0 != ::madvise(m_base, m_map_size, a)) {
+            ifilesystem::system_error(ec);
+        }
+    };
+    if (is_set(advice & map_advice::sequential)) {
+        apply(MADV_SEQUENTIAL);
+    }
+    if (is_set(advice & map_advice::random)) {
+        apply(MADV_RANDOM);
+    }
+    if (is_set(advice & map_advice::will_need)) {
+        apply(MADV_WILLNEED);
+    }
+#if defined(MADV_HUGEPAGE)
+    if (is_set(advice & map_advice::large_pages)) {
+        apply(MADV_HUGEPAGE);
+    }
+#endif
+#else
+    (void)advice;
+#endif
+}
+
+void mapped_region::unmap() noexcept {
+    if (m_base) {
+#if !_WIN32
+        (void)::munmap(m_base, m_map_size);
+#else
+        (void)::UnmapViewOfFile(m_base);
+#endif
+    }
+    m_base = nullptr;
+    m_map_size = 0;
+    m_data = nullptr;
+    m_size = 0;
+    m_offset = 0;
+}
+
+mapped_file::mapped_file(const path& p, map_mode mode)
+    : mapped_file() {
+    open(p, mode);
+}
+
+mapped_file::mapped_file(const path& p, map_mode mode, error_code& ec)
+    : mapped_file() {
+    open(p, mode, ec);
+}
+
+void mapped_file::open(const path& p, map_mode mode) {
+    error_code ec;
+    open(p, mode, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not open file for mapping", p, ec));
+}
+
+void mapped_file::open(const path& p, map_mode mode, error_code& ec) {
+    ec.clear();
+    close();
+#if !_WIN32
+    // Copy on write mappings are writable, but a private mapping never writes the file so read access is enough.
+    const int fd = ::open(p.c_str(), O_RDONLY|O_CLOEXEC);
+    struct ::stat sb;
+    if (fd < 0 || 0 != ::fstat(fd, &sb)) {
+        ifilesystem::system_error(ec);
+        if (fd >= 0) {
+            (void)::close(fd);
+        }
+        return;
+    }
+    if (!S_ISREG(sb.st_mode)) {
+        (void)::close(fd);
+        ec = einval();
+        return;
+    }
+    m_file = fd;
+    m_size = static_cast<file_size_type>(sb.st_size);
+#else
+    auto h = ::CreateFileW(p.c_str(), GENERIC_READ, FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    ::LARGE_INTEGER sz;
+    if (INVALID_HANDLE_VALUE == h || !::GetFileSizeEx(h, &sz)) {
+        ifilesystem::system_error(ec);
+        if (INVALID_HANDLE_VALUE != h) {
+            (void)::CloseHandle(h);
+        }
+        return;
+    }
+    m_file = h;
+    m_size = static_cast<file_size_type>(sz.QuadPart);
+#endif
+    m_mode = mode;
+}
+
+void mapped_file::close() noexcept {
+    if (is_open()) {
+#if !_WIN32
+        (void)::close(m_file);
+#else
+        (void)::CloseHandle(m_file);
+#endif
+    }
+    m_file = invalid_file;
+    m_size = 0;
+}
+
+mapped_region mapped_file::map(file_size_type offset, size_t size, map_advice advice) const {
+    error_code ec;
+    auto r = map(offset, size, advice, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not map file", ec));
+    return r;
+}
+
+mapped_region mapped_file::map(file_size_type offset, size_t size, map_advice advice, error_code& ec) const {
+    mapped_region r;
+    remap(r, offset, size, advice, ec);
+    return r;
+}
+
+void mapped_file::remap(mapped_region& r, file_size_type offset, size_t size, map_advice advice) const {
+    error_code ec;
+    remap(r, offset, size, advice, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not map file", ec));
+}
+
+void mapped_file::remap(mapped_region& r, file_size_type offset, size_t size, map_advice advice, error_code& ec) const {
+    ec.clear();
+    r.unmap();
+    if (!is_open()) {
+        ec = not_open();
+        return;
+    }
+    if (offset > m_size) {
+        ec = einval();
+        return;
+    }
+    const auto avail = m_size - offset;
+    if (0 == size || size > avail) {
+        if (avail > std::numeric_limits<size_t>::max()) {
+            ec = too_large();
+            return;
+        }
+        size = static_cast<size_t>(avail);
+    }
+    if (0 == size) { // empty files can't be mapped
+        r.m_offset = offset;
+        return;
+    }
+    
+    const auto delta = static_cast<size_t>(offset % granularity());
+    const auto start = offset - delta;
+    if (size > std::numeric_limits<size_t>::max() - delta) {
+        ec = too_large();
+        return;
+    }
+    const auto msize = size + delta;
+#if !_WIN32
+    const bool cow = map_mode::copy_on_write == m_mode;
+    auto base = ::mmap(nullptr, msize, cow ? PROT_READ|PROT_WRITE : PROT_READ, cow ? MAP_PRIVATE : MAP_SHARED, m_file, static_cast<::off_t>(start));
+    if (MAP_FAILED == base) {
+        ifilesystem::system_error(ec);
+        return;
+    }
+#else
+    const bool cow = map_mode::copy_on_write == m_mode;
+    // The view holds a reference to the mapping object.
+    windows::Handle mapping{::CreateFileMappingW(m_file, nullptr, cow ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, nullptr)};
+    void* base = mapping ? ::MapViewOfFile(mapping.get(), cow ? FILE_MAP_COPY : FILE_MAP_READ, static_cast<DWORD>(start >> 32), static_cast<DWORD>(start), msize) : nullptr;
+    if (!base) {
+        ifilesystem::system_error(ec);
+        return;
+    }
+#endif
+    r.m_base = base;
+    r.m_map_size = msize;
+    r.m_data = static_cast<char*>(base) + delta;
+    r.m_size = size;
+    r.m_offset = offset;
+    if (advice != map_advice::none) {
+        error_code ignored;
+        r.advise(advice, ignored);
+    }
+}
+
+size_t mapped_file::granularity() noexcept {
+#if !_WIN32
+    static const auto pgsz = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    return pgsz;
+#else
+    static const auto gran = []() {
+        ::SYSTEM_INFO si;
+        ::GetSystemInfo(&si);
+        return static_cast<size_t>(si.dwAllocationGranularity);
+    }();
+    return gran;
+#endif
+}
+
+} // v1
+} // filesystem
+} // prosoft
@@ -0,0 +1,330 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include <prosoft/core/config/config_platform.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_path_filter.hpp>
+#include "filesystem_private.hpp"
+
+namespace {
+using namespace prosoft::filesystem;
+
+using char_type = path_filter::char_type;
+using string_type = path_filter::string_type;
+
+constexpr char_type star = '*';
+constexpr char_type question = '?';
+
+inline bool is_separator(char_type c) noexcept {
+#if _WIN32
+    return c == '/' || c == '\\';
+#else
+    return c == '/';
+#endif
+}
+
+// Calls fn(begin, end) for each non-empty component.
+template <class Fn>
+void each_component(const char_type* p, Fn&& fn) {
+    for (;;) {
+        while (*p && is_separator(*p)) {
+            ++p;
+        }
+        if (!*p) {
+            return;
+        }
+        auto e = p;
+        while (*e && !is_separator(*e)) {
+            ++e;
+        }
+        fn(p, e);
+        p = e;
+    }
+}
+
+bool is_glob(const string_type& s) noexcept {
+    return s.find_first_of(string_type{star, question}) != string_type::npos;
+}
+
+// '*' matches any run of characters (including none) and '?' any single character.
+bool glob_match(const string_type& pattern, const string_type& s) noexcept {
+    size_t p = 0, i = 0;
+    size_t star_p = string_type::npos, star_i = 0;
+    while (i < s.size()) {
+        if (p < pattern.size() && (pattern[p] == question || pattern[p] == s[i])) {
+            ++p;
+            ++i;
+        } else if (p < pattern.size() && pattern[p] == star) {
+            star_p = p++;
+            star_i = i;
+        } else if (star_p != string_type::npos) {
+            p = star_p + 1;
+            i = ++star_i;
+        } else {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == star) {
+        ++p;
+    }
+    return p == pattern.size();
+}
+
+// ".ext" for a "*.ext" glob, otherwise empty.
+string_type extension_glob(const string_type& s) {
+    if (s.size() > 2 && s[0] == star && s[1] == '.') {
+        auto ext = s.substr(1);
+        if (!is_glob(ext) && ext.find('.', 1) == string_type::npos) {
+            return ext;
+        }
+    }
+    return {};
+}
+
+string_type extension(const string_type& name) {
+    const auto dot = name.rfind('.');
+    return dot != string_type::npos ? name.substr(dot) : string_type{};
+}
+
+} // anon
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+path_filter::path_filter()
+    : m_nodes(1)
+    , m_rules(0)
+    , m_includes(0) {}
+
+void path_filter::include(const path& p) {
+    add(p, rule::include);
+}
+
+void path_filter::exclude(const path& p) {
+    add(p, rule::exclude);
+}
+
+// The exclusion wins if the same rule is both included and excluded.
+void path_filter::add(const path& p, rule r) {
+    const auto merge = [](rule& to, rule r) {
+        if (to != rule::exclude) {
+            to = r;
+        }
+    };
+    
+    const char_type* s = p.c_str();
+    bool anchored = false;
+    for (auto c = s; *c; ++c) {
+        anchored |= is_separator(*c);
+    }
+    
+    std::vector<string_type> components;
+    each_component(s, [&components](const char_type* b, const char_type* e) {
+        components.emplace_back(b, e);
+    });
+    if (!anchored && components.empty()) {
+        throw std::invalid_argument("Empty path filter rule");
+    }
+    
+    string_type glob;
+    if (!components.empty() && is_glob(components.back())) {
+        glob = std::move(components.back());
+        components.pop_back();
+    }
+    for (const auto& c : components) {
+        if (is_glob(c)) {
+            throw std::invalid_argument("Path filter rules may only have a glob as the last component");
+        }
+    }
+    
+    std::vector<size_t> nodes{0}; // the rule's node and its parents
+    if (anchored) {
+        for (auto& c : components) {
+            auto& children = m_nodes[nodes.back()].m_children;
+            auto i = children.find(c);
+            if (i != children.end()) {
+                nodes.push_back(i->second);
+            } else {
+                children.emplace(std::move(c), m_nodes.size());
+                nodes.push_back(m_nodes.size());
+                m_nodes.emplace_back();
+            }
+        }
+    } else if (glob.empty()) {
+        glob = std::move(components.back()); // a name
+    }
+    
+    auto& n = m_nodes[nodes.back()];
+    if (glob.empty()) {
+        merge(n.m_prefix, r);
+    } else if (!is_glob(glob)) {
+        merge(n.m_names[glob], r);
+    } else {
+        auto ext = extension_glob(glob);
+        if (!ext.empty()) {
+            merge(n.m_extensions[ext], r);
+        } else {
+            auto i = std::find_if(n.m_globs.begin(), n.m_globs.end(), [&glob](const std::pair<string_type, rule>& g) {
+                return g.first == glob;
+            });
+            if (i != n.m_globs.end()) {
+                merge(i->second, r);
+            } else {
+                n.m_globs.emplace_back(std::move(glob), r);
+            }
+        }
+    }
+    
+    if (r == rule::include) {
+        if (!glob.empty()) {
+            n.m_include_names = true;
+        }
+        for (auto i : nodes) {
+            m_nodes[i].m_includes_below = true;
+        }
+        ++m_includes;
+    }
+    ++m_rules;
+}
+
+path_filter::rule path_filter::node::match_name(const string_type& name) const {
+    rule r = rule::none;
+    const auto merge = [&r](rule m) {
+        if (m != rule::none && r != rule::exclude) {
+            r = m;
+        }
+    };
+    
+    auto i = m_names.find(name);
+    if (i != m_names.end()) {
+        merge(i->second);
+    }
+    if (!m_extensions.empty()) {
+        auto e = m_extensions.find(extension(name));
+        if (e != m_extensions.end()) {
+            merge(e->second);
+        }
+    }
+    for (const auto& g : m_globs) {
+        if (r == rule::exclude) {
+            break;
+        }
+        if (glob_match(g.first, name)) {
+            merge(g.second);
+        }
+    }
+    return r;
+}
+
+filter_match path_filter::match(const path& p) const {
+    rule decision = m_nodes[0].m_prefix; // "/"
+    const node* cur = &m_nodes[0]; // null once the path leaves the tree
+    std::vector<const node*> active; // nodes with name rules that apply to the next component
+    bool include_names = false;
+    string_type name;
+    
+    each_component(p.c_str(), [&](const char_type* b, const char_type* e) {
+        if (cur && cur->has_names()) {
+            active.push_back(cur);
+            include_names |= cur->m_include_names;
+        }
+        
+        name.assign(b, e);
+        rule r = rule::none;
+        for (auto n : active) {
+            const auto m = n->match_name(name);
+            if (m != rule::none && r != rule::exclude) {
+                r = m;
+            }
+        }
+        
+        if (cur) {
+            auto i = cur->m_children.find(name);
+            if (i != cur->m_children.end()) {
+                cur = &m_nodes[i->second];
+                if (cur->m_prefix != rule::none && r != rule::exclude) {
+                    r = cur->m_prefix;
+                }
+            } else {
+                cur = nullptr;
+            }
+        }
+        
+        if (r != rule::none) {
+            decision = r;
+        }
+    });
+    
+    if (decision == rule::include || (decision == rule::none && m_includes == 0)) {
+        return filter_match::included;
+    }
+    if ((cur && cur->m_includes_below) || include_names) {
+        return filter_match::ancestor;
+    }
+    return filter_match::excluded;
+}
+
+} // v1
+} // filesystem
+} // prosoft
+
+#if PSTEST_HARNESS
+// Internal tests.
+#include <catch2/catch_test_macros.hpp>
+#include "fstestutils.hpp"
+
+TEST_CASE("path_filter_internal") {
+    auto s = [](const char* p) {
+        return string_type{p, p + std::strlen(p)};
+    };
+    
+    WHEN("matching globs") {
+        CHECK(glob_match(s("*"), s("")));
+        CHECK(glob_match(s("*"), s("abc")));
+        CHECK(glob_match(s("a?c"), s("abc")));
+        CHECK_FALSE(glob_match(s("a?c"), s("ac")));
+        CHECK(glob_match(s("*.tmp"), s("x.tmp")));
+        CHECK_FALSE(glob_match(s("*.tmp"), s("x.tmp1")));
+        CHECK(glob_match(s("a*b*c"), s("aXbYbZc")));
+        CHECK_FALSE(glob_match(s("a*b*c"), s("aXbYbZ")));
+        CHECK(glob_match(s("**x"), s("x")));
+    }
+    
+    WHEN("compiling extension globs") {
+        CHECK(extension_glob(s("*.tmp")) == s(".tmp"));
+        CHECK(extension_glob(s("*.tar.gz")).empty());
+        CHECK(extension_glob(s("*.t?p")).empty());
+        CHECK(extension_glob(s("x*.tmp")).empty());
+        CHECK(extension(s("a.b.c")) == s(".c"));
+        CHECK(extension(s("abc")).empty());
+    }
+}
+
+#endif // PSTEST_HARNESS
@@ -27,11 +27,14 @@
 
 #if !_WIN32
 #include <sys/errno.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #else
 #include <windows.h>
 #endif
 
+#include <unordered_map>
+
 #include <prosoft/core/modules/filesystem/filesystem.hpp>
 #include "filesystem_private.hpp"
 
@@ -119,20 +122,8 @@ path shell_expansion(const path& p, error_code& ec) { // returns empty if no exp
     return {};
 }
 
-} // anon
-
-namespace prosoft {
-namespace filesystem {
-inline namespace v1 {
-
-path canonical(const path& p, const path& base) {
-    error_code ec;
-    path rp = canonical(p, base, ec);
-    PS_THROW_IF(ec.value(), filesystem_error("Could not create a canonical path", p, ec));
-    return rp;
-}
-
-path canonical(const path& rp, const path& base, error_code& ec) {
+// The current path is used if base is null.
+path canonical(const path& rp, const path* base, error_code& ec) {
     ec.clear();
     
     auto ep = shell_expansion(rp, ec);
@@ -141,7 +132,15 @@ path canonical(const path& rp, const path& base, error_code& ec) {
     }
     
     if (ep.empty() && !rp.is_absolute()) {
-        ep = absolute(rp, base);
+        if (base) {
+            ep = absolute(rp, *base);
+        } else {
+            const auto cwd = filesystem::current_path(ec);
+            if (ec.value()) {
+                return {rp};
+            }
+            ep = absolute(rp, cwd);
+        }
     }
 
     const path& p = !ep.empty() ? ep : rp;
@@ -155,7 +154,7 @@ path canonical(const path& rp, const path& base, error_code& ec) {
     } else if (ENOENT == errno && p != rootp) {
         const auto parent = p.parent_path(); // attempt to resolve parents
         if (!parent.empty()) {
-            return canonical(parent, ec) / p.filename();
+            return canonical(parent, nullptr, ec) / p.filename();
         } else {
             ifilesystem::error(ENOENT, ec);
         }
@@ -176,6 +175,134 @@ path canonical(const path& rp, const path& base, error_code& ec) {
 #endif
 }
 
+#if !_WIN32
+using dir_cache = std::unordered_map<path::string_type, path>; // absolute -> canonical
+
+bool is_lexical(const path& leaf) {
+    static const path dot{PS_TEXT(".")};
+    static const path dotdot{PS_TEXT("..")};
+    return leaf.empty() || leaf == dot || leaf == dotdot;
+}
+
+// A dir is resolved through its parent, so each uncached ancestor costs one lstat instead of a realpath over the shared prefix.
+// Symlinks, missing dirs and dot components fall back to canonical().
+dir_cache::const_iterator resolve_dir(dir_cache& dirs, const path& dir, error_code& ec) {
+    auto i = dirs.find(dir.native());
+    if (i != dirs.end()) {
+        return i;
+    }
+    
+    const auto parent = dir.parent_path();
+    const auto leaf = dir.filename();
+    path rp;
+    if (is_lexical(leaf) || parent.empty() || parent == dir) {
+        rp = canonical(dir, ec);
+    } else {
+        const auto pi = resolve_dir(dirs, parent, ec);
+        if (ec.value()) {
+            return dirs.end();
+        }
+        rp = pi->second / leaf;
+        struct ::stat sb;
+        if (0 != ::lstat(rp.c_str(), &sb) || S_ISLNK(sb.st_mode)) {
+            rp = canonical(rp, ec);
+        }
+    }
+    if (ec.value()) {
+        return dirs.end();
+    }
+    return dirs.emplace(dir.native(), std::move(rp)).first;
+}
+#endif // !_WIN32
+
+} // anon
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+path canonical(const path& p) {
+    error_code ec;
+    path rp = canonical(p, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not create a canonical path", p, ec));
+    return rp;
+}
+
+path canonical(const path& p, error_code& ec) {
+    return ::canonical(p, nullptr, ec);
+}
+
+path canonical(const path& p, const path& base) {
+    error_code ec;
+    path rp = canonical(p, base, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not create a canonical path", p, ec));
+    return rp;
+}
+
+path canonical(const path& p, const path& base, error_code& ec) {
+    return ::canonical(p, &base, ec);
+}
+
+void canonicalize(path* paths, std::size_t count, error_code* ecs) {
+#if !_WIN32
+    dir_cache parents;
+    path cwd;
+    for (size_t i = 0; i < count; ++i) {
+        auto& p = paths[i];
+        auto& ec = ecs[i];
+        ec.clear();
+        
+        path ap;
+        if (!p.is_absolute() && !p.empty() && PS_TEXT('~') != p.native()[0]) {
+            if (cwd.empty()) {
+                cwd = current_path(ec);
+                if (ec.value()) {
+                    continue;
+                }
+            }
+            ap = cwd / p;
+        }
+        const auto& abs = ap.empty() ? p : ap;
+        const auto leaf = abs.filename();
+        const auto parent = abs.parent_path();
+        if (!abs.is_absolute() || is_lexical(leaf) || parent.empty() || parent == abs) {
+            auto rp = canonical(abs, ec);
+            if (!ec.value()) {
+                p = std::move(rp);
+            }
+            continue;
+        }
+        
+        const auto pi = resolve_dir(parents, parent, ec);
+        if (ec.value()) {
+            continue;
+        }
+        
+        auto rp = pi->second / leaf;
+        struct ::stat sb;
+        if (0 == ::lstat(rp.c_str(), &sb)) {
+            if (S_ISLNK(sb.st_mode)) {
+                rp = canonical(rp, ec);
+                if (ec.value()) {
+                    continue;
+                }
+            }
+        } else if (ENOENT != errno) {
+            ifilesystem::system_error(ec);
+            continue;
+        }
+        p = std::move(rp);
+    }
+#else
+    for (size_t i = 0; i < count; ++i) {
+        auto rp = canonical(paths[i], ecs[i]);
+        if (!ecs[i].value()) {
+            paths[i] = std::move(rp);
+        }
+    }
+#endif
+}
+
 path current_path() {
     error_code ec;
     path p = current_path(ec);
@@ -207,6 +334,10 @@ void current_path(const path& p, error_code& ec) {
     }
 }
 
+path absolute(const path& p) {
+    return p.is_absolute() ? p : absolute(p, current_path());
+}
+
 path absolute(const path& p, const path& base) {
     if (p.is_absolute()) {
         return p;
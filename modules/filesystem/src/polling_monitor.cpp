@@ -0,0 +1,888 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include <prosoft/core/config/config_platform.h>
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_change_monitor.hpp>
+
+#if PS_HAVE_FILESYSTEM_CHANGE_MONITOR
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "fsconfig.h"
+#include "filesystem_private.hpp"
+#include "fsmonitor_private.hpp"
+#include <prosoft/core/config/config_analyzer.h>
+
+// Polls a stat index of the tree for filesystems without kernel notifications (NFS, SMB, FUSE, etc).
+// A directory is only re-read when its identity or timestamps change, otherwise only its (non-dir) entries are stat'd.
+// Each directory has its own poll interval, which is reset when a change is found and doubled (up to a limit) when not,
+// so active subtrees are polled at the configured latency while idle ones back off.
+// All polling monitors share a single thread, which also delivers the notifications.
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+#if PS_FS_HAVE_BSD_STATFS
+    #define PS_ST_MTIM st_mtimespec
+    #define PS_ST_CTIM st_ctimespec
+#else
+    #define PS_ST_MTIM st_mtim
+    #define PS_ST_CTIM st_ctim
+#endif
+
+constexpr fs::change_config::latency_type min_poll_interval{100};
+constexpr unsigned max_backoff = 32;
+
+std::int64_t to_ns(const ::timespec& ts) {
+    return std::int64_t{ts.tv_sec} * 1000000000 + ts.tv_nsec;
+}
+
+struct poll_entry {
+    std::uint64_t m_dev;
+    std::uint64_t m_ino;
+    std::uint64_t m_size;
+    std::int64_t m_mtime;
+    std::int64_t m_ctime;
+    fs::file_type m_type;
+    // directories only
+    std::vector<std::string> m_children; // sorted leaf names
+    clock_type::time_point m_due;
+    unsigned m_backoff;
+    
+    poll_entry()
+        : m_dev()
+        , m_ino()
+        , m_size()
+        , m_mtime()
+        , m_ctime()
+        , m_type(fs::file_type::none)
+        , m_children()
+        , m_due()
+        , m_backoff(1) {}
+    explicit poll_entry(const struct ::stat& sb)
+        : poll_entry() {
+        m_dev = sb.st_dev;
+        m_ino = sb.st_ino;
+        m_size = sb.st_size;
+        m_mtime = to_ns(sb.PS_ST_MTIM);
+        m_ctime = to_ns(sb.PS_ST_CTIM);
+        m_type = fs::ifilesystem::make_status(sb, fs::status_info::basic).type();
+    }
+    
+    bool same_node(const poll_entry& other) const noexcept {
+        return m_dev == other.m_dev && m_ino == other.m_ino && m_type == other.m_type;
+    }
+    
+    // Returns the changes from other to this entry.
+    fs::change_event compare(const poll_entry& other) const noexcept {
+        if (!same_node(other)) {
+            return fs::change_event::removed|fs::change_event::created; // replaced
+        }
+        fs::change_event ev{};
+        if (m_size != other.m_size || m_mtime != other.m_mtime) {
+            ev |= fs::change_event::content_modified;
+        } else if (m_ctime != other.m_ctime) {
+            ev |= fs::change_event::metadata_modified;
+        }
+        return ev;
+    }
+};
+
+struct poll_event {
+    std::string m_path;
+    std::string m_newpath;
+    std::uint64_t m_dev;
+    std::uint64_t m_ino;
+    fs::change_event m_event;
+    fs::file_type m_type;
+};
+
+struct scheduled {
+    clock_type::time_point m_due;
+    std::string m_path;
+    
+    bool operator>(const scheduled& other) const noexcept {
+        return m_due > other.m_due;
+    }
+};
+
+// true if p is dir or is contained by dir
+bool is_within(const std::string& p, const std::string& dir) {
+    return p.compare(0, dir.size(), dir) == 0 && (p.size() == dir.size() || p[dir.size()] == '/');
+}
+
+std::string join(const std::string& dir, const std::string& name) {
+    std::string p{dir};
+    if (p.empty() || p.back() != '/') {
+        p += '/';
+    }
+    return p.append(name);
+}
+
+bool list(const std::string& dir, std::vector<std::string>& names) {
+    auto d = ::opendir(dir.c_str());
+    if (!d) {
+        return false;
+    }
+    names.clear();
+    while (auto e = ::readdir(d)) {
+        if (0 != std::strcmp(e->d_name, ".") && 0 != std::strcmp(e->d_name, "..")) {
+            names.emplace_back(e->d_name);
+        }
+    }
+    ::closedir(d);
+    std::sort(names.begin(), names.end());
+    return true;
+}
+
+class polling_state : public fs::change_state {
+    using index_type = std::map<std::string, poll_entry>; // ordered so that a subtree is a contiguous range
+    using queue_type = std::priority_queue<scheduled, std::vector<scheduled>, std::greater<scheduled>>;
+    
+    index_type m_index;
+    queue_type m_queue; // directory poll schedule, stale items are skipped
+    std::vector<poll_event> m_pending;
+    std::unordered_set<std::string> m_rescans; // collapsed dirs
+    std::string m_root;
+    fs::path m_rootpath;
+    clock_type::duration m_interval;
+    fs::change_event m_events;
+    std::atomic<fs::change_event_id> m_lastid;
+    std::atomic<std::uint64_t> m_collapsed;
+    std::atomic<std::uint64_t> m_dropped;
+    size_t m_maxpending;
+    bool m_recursive;
+    bool m_canceled;
+    bool m_collapsing_root;
+    
+public:
+    fs::change_callback m_callback;
+    
+    polling_state(const fs::path&, const fs::change_config&, bool recursive, fs::error_code&);
+    virtual ~polling_state() = default;
+    
+    virtual fs::change_event_id last_event_id() const override {
+        return m_lastid.load();
+    }
+    
+    virtual fs::change_counters counters() const override {
+        return fs::change_counters{m_collapsed.load(), m_dropped.load()};
+    }
+    
+    clock_type::time_point next_poll() const {
+        return m_canceled || m_queue.empty() ? clock_type::time_point::max() : m_queue.top().m_due;
+    }
+    
+    fs::change_notifications poll();
+    
+    size_t size() const noexcept { // for testing
+        return m_index.size();
+    }
+    
+private:
+    void add(const std::string& p, fs::change_event, const poll_entry&, std::string&& newpath = std::string{});
+    void cancel(fs::change_event);
+    void collapse_pending();
+    void collapse(const std::string&);
+    
+    void index(const std::string&, poll_entry&&, bool notify);
+    void schedule(const std::string& dir, poll_entry&, clock_type::time_point now, bool changed);
+    bool poll_root();
+    void poll_dir(const std::string& dir, poll_entry&, clock_type::time_point now);
+    void poll_file(const std::string&, poll_entry&, clock_type::time_point now);
+    bool relist(const std::string& dir, poll_entry&);
+    void erase(const std::string& p);
+    void erase_descendants(const std::string& p);
+    void pair_renames();
+    fs::change_notifications flush();
+};
+
+using shared_state = std::shared_ptr<polling_state>;
+
+polling_state::polling_state(const fs::path& p, const fs::change_config& cfg, bool recursive, fs::error_code& ec)
+    : m_root(p.c_str())
+    , m_rootpath(p)
+    , m_interval(std::max(cfg.notification_latency, min_poll_interval))
+    , m_events(cfg.events)
+    , m_lastid(0)
+    , m_collapsed(0)
+    , m_dropped(0)
+    , m_maxpending(cfg.max_pending_events)
+    , m_recursive(recursive)
+    , m_canceled(false)
+    , m_collapsing_root(false) {
+    struct ::stat sb;
+    if (0 != ::lstat(m_root.c_str(), &sb)) {
+        fs::ifilesystem::system_error(ec);
+        return;
+    }
+    
+    poll_entry e{sb};
+    if (recursive && e.m_type != fs::file_type::directory) {
+        ec = fs::error_code{ENOTDIR, std::system_category()};
+        return;
+    }
+    
+    index(m_root, std::move(e), false);
+    ec.clear();
+}
+
+void polling_state::add(const std::string& p, fs::change_event ev, const poll_entry& e, std::string&& np) {
+    if (!m_rescans.empty() && !is_set(ev & fs::change_event::canceled)) {
+        ++m_collapsed;
+        collapse(p);
+        if (!np.empty()) {
+            collapse(np);
+        }
+        return;
+    }
+    
+    m_pending.push_back(poll_event{p, std::move(np), e.m_dev, e.m_ino, ev, e.m_type});
+    if (m_maxpending > 0 && m_pending.size() > m_maxpending) {
+        collapse_pending();
+    }
+}
+
+void polling_state::collapse_pending() {
+    auto pending = std::move(m_pending);
+    m_pending.clear();
+    for (auto& pe : pending) {
+        if (is_set(pe.m_event & fs::change_event::canceled)) {
+            m_pending.push_back(std::move(pe));
+            continue;
+        }
+        ++m_collapsed;
+        collapse(pe.m_path);
+        if (!pe.m_newpath.empty()) {
+            collapse(pe.m_newpath);
+        }
+    }
+}
+
+// Adds a rescan of the parent dir, or of the root if there are too many dirs.
+void polling_state::collapse(const std::string& p) {
+    if (m_collapsing_root) {
+        ++m_dropped;
+        return;
+    }
+    
+    auto dir = p == m_root ? p : p.substr(0, std::max<size_t>(p.rfind('/'), 1));
+    if (m_rescans.find(dir) != m_rescans.end()) {
+        return;
+    }
+    
+    if (m_pending.size() >= m_maxpending) {
+        // everything but cancellations is replaced by a rescan of the root
+        auto i = std::remove_if(m_pending.begin(), m_pending.end(), [](const poll_event& pe) {
+            return !is_set(pe.m_event & fs::change_event::canceled);
+        });
+        m_dropped += std::distance(i, m_pending.end());
+        m_pending.erase(i, m_pending.end());
+        m_collapsing_root = true;
+        dir = m_root;
+    }
+    m_pending.push_back(poll_event{dir, std::string{}, 0, 0, fs::change_event::rescan, fs::file_type::directory});
+    m_rescans.emplace(std::move(dir));
+}
+
+void polling_state::cancel(fs::change_event ev) {
+    PSASSERT(is_set(ev & fs::change_event::canceled), "Broken assumption");
+    auto i = m_index.find(m_root);
+    add(m_root, ev, i != m_index.end() ? i->second : poll_entry{});
+    m_canceled = true;
+}
+
+// Adds the entry (and its descendants if recursive) to the index.
+void polling_state::index(const std::string& p, poll_entry&& pe, bool notify) {
+    const auto now = clock_type::now();
+    std::vector<std::pair<std::string, poll_entry>> todo;
+    todo.emplace_back(p, std::move(pe));
+    while (!todo.empty()) {
+        auto cur = std::move(todo.back());
+        todo.pop_back();
+        
+        auto& e = m_index[cur.first] = std::move(cur.second);
+        if (notify && cur.first != p) {
+            add(cur.first, fs::change_event::created, e);
+        }
+        if (e.m_type != fs::file_type::directory || (!m_recursive && cur.first != m_root)) {
+            if (cur.first == m_root) {
+                schedule(cur.first, e, now, true);
+            }
+            continue;
+        }
+        
+        (void)list(cur.first, e.m_children); // permission errors, etc. are treated as an empty dir
+        schedule(cur.first, e, now, true);
+        
+        const auto& dir = cur.first;
+        auto& children = e.m_children; // e is not invalidated by later map inserts
+        for (auto i = children.begin(); i != children.end();) {
+            const auto cp = join(dir, *i);
+            struct ::stat sb;
+            if (0 == ::lstat(cp.c_str(), &sb)) {
+                todo.emplace_back(cp, poll_entry{sb});
+                ++i;
+            } else {
+                i = children.erase(i); // removed while scanning
+            }
+        }
+    }
+}
+
+void polling_state::schedule(const std::string& dir, poll_entry& e, clock_type::time_point now, bool changed) {
+    e.m_backoff = changed ? 1 : std::min(e.m_backoff * 2, max_backoff);
+    e.m_due = now + m_interval * e.m_backoff;
+    m_queue.push(scheduled{e.m_due, dir});
+}
+
+// Returns false if the root is gone or replaced.
+bool polling_state::poll_root() {
+    auto i = m_index.find(m_root);
+    PSASSERT(i != m_index.end(), "Broken assumption");
+    struct ::stat sb;
+    if (0 != ::lstat(m_root.c_str(), &sb)) {
+        // A rename is not distinguishable from a remove.
+        cancel(errno == ENOENT ? fs::change_event::rescan_required|fs::change_event::removed : fs::change_event::rescan_required);
+        return false;
+    }
+    
+    if (!poll_entry{sb}.same_node(i->second)) {
+        cancel(fs::change_event::rescan_required);
+        return false;
+    }
+    return true;
+}
+
+// Only used for a root that is not a directory, otherwise entries are polled by their directory.
+void polling_state::poll_file(const std::string& p, poll_entry& e, clock_type::time_point now) {
+    struct ::stat sb;
+    bool changed = false;
+    if (0 == ::lstat(p.c_str(), &sb)) {
+        const poll_entry st{sb};
+        const auto ev = st.compare(e);
+        if (ev != fs::change_event::none) {
+            e = st;
+            add(p, ev, e);
+            changed = true;
+        }
+    }
+    schedule(p, e, now, changed);
+}
+
+void polling_state::poll_dir(const std::string& dir, poll_entry& e, clock_type::time_point now) {
+    struct ::stat sb;
+    if (0 != ::lstat(dir.c_str(), &sb) || !S_ISDIR(sb.st_mode)) {
+        return; // the parent will find the change
+    }
+    
+    const poll_entry st{sb};
+    if (!st.same_node(e)) { // replaced
+        add(dir, fs::change_event::removed, e);
+        add(dir, fs::change_event::created, st);
+        erase_descendants(dir);
+        index(dir, poll_entry{sb}, true);
+        return;
+    }
+    
+    bool changed = false;
+    if (st.m_mtime != e.m_mtime || st.m_ctime != e.m_ctime) {
+        changed = true;
+        const bool relisted = relist(dir, e);
+        if (!relisted && st.m_mtime == e.m_mtime) {
+            add(dir, fs::change_event::metadata_modified, st);
+        }
+        e.m_size = st.m_size;
+        e.m_mtime = st.m_mtime;
+        e.m_ctime = st.m_ctime;
+    }
+    
+    // Content changes do not update the dir.
+    for (const auto& name : e.m_children) {
+        const auto cp = join(dir, name);
+        auto i = m_index.find(cp);
+        if (i == m_index.end() || (m_recursive && i->second.m_type == fs::file_type::directory)) {
+            continue; // subdirs have their own schedule
+        }
+        if (0 != ::lstat(cp.c_str(), &sb)) {
+            continue; // the next relist will find the remove
+        }
+        const poll_entry ce{sb};
+        const auto ev = ce.compare(i->second);
+        if (ev == fs::change_event::none) {
+            continue;
+        }
+        if (is_set(ev & fs::change_event::removed)) {
+            add(cp, fs::change_event::removed, i->second);
+            add(cp, fs::change_event::created, ce);
+        } else {
+            add(cp, ev, ce);
+        }
+        i->second = ce;
+        changed = true;
+    }
+    
+    schedule(dir, e, now, changed);
+}
+
+// Returns true if the listing changed.
+bool polling_state::relist(const std::string& dir, poll_entry& e) {
+    std::vector<std::string> names;
+    if (!list(dir, names)) {
+        return false;
+    }
+    
+    std::vector<std::string> children;
+    children.reserve(names.size());
+    bool changed = false;
+    auto oi = e.m_children.cbegin();
+    const auto oend = e.m_children.cend();
+    for (auto& name : names) {
+        for (; oi != oend && *oi < name; ++oi) {
+            const auto cp = join(dir, *oi);
+            auto i = m_index.find(cp);
+            if (i != m_index.end()) {
+                add(cp, fs::change_event::removed, i->second);
+            }
+            erase(cp);
+            changed = true;
+        }
+        if (oi != oend && *oi == name) {
+            ++oi;
+            children.push_back(std::move(name));
+            continue;
+        }
+        
+        const auto cp = join(dir, name);
+        struct ::stat sb;
+        if (0 != ::lstat(cp.c_str(), &sb)) {
+            continue; // removed since listing
+        }
+        poll_entry ce{sb};
+        add(cp, fs::change_event::created, ce);
+        index(cp, std::move(ce), true);
+        children.push_back(std::move(name));
+        changed = true;
+    }
+    for (; oi != oend; ++oi) {
+        const auto cp = join(dir, *oi);
+        auto i = m_index.find(cp);
+        if (i != m_index.end()) {
+            add(cp, fs::change_event::removed, i->second);
+        }
+        erase(cp);
+        changed = true;
+    }
+    
+    e.m_children.swap(children);
+    return changed;
+}
+
+// Removes the entry and all its descendants. A removed directory is reported once, not per descendant.
+void polling_state::erase(const std::string& p) {
+    m_index.erase(p);
+    erase_descendants(p);
+}
+
+void polling_state::erase_descendants(const std::string& p) {
+    auto first = m_index.lower_bound(p + '/');
+    auto last = m_index.lower_bound(p + static_cast<char>('/' + 1));
+    m_index.erase(first, last);
+}
+
+// A remove and create of the same node in the same poll is a rename.
+void polling_state::pair_renames() {
+    using key_type = std::pair<std::uint64_t, std::uint64_t>;
+    struct key_hash {
+        size_t operator()(const key_type& k) const noexcept {
+            return std::hash<std::uint64_t>{}(k.second ^ (k.first << 1));
+        }
+    };
+    
+    std::unordered_map<key_type, size_t, key_hash> removes;
+    for (size_t i = 0; i < m_pending.size(); ++i) {
+        const auto& pe = m_pending[i];
+        if (pe.m_event == fs::change_event::removed) {
+            removes.emplace(key_type{pe.m_dev, pe.m_ino}, i);
+        }
+    }
+    if (removes.empty()) {
+        return;
+    }
+    
+    std::vector<std::string> moved; // renamed dirs, the descendants are not reported
+    for (auto& pe : m_pending) {
+        if (pe.m_event != fs::change_event::created) {
+            continue;
+        }
+        auto ri = removes.find(key_type{pe.m_dev, pe.m_ino});
+        if (ri == removes.end() || m_pending[ri->second].m_type != pe.m_type) {
+            continue;
+        }
+        auto& rpe = m_pending[ri->second];
+        rpe.m_event = fs::change_event::renamed;
+        rpe.m_newpath = pe.m_path;
+        pe.m_event = fs::change_event::none;
+        if (pe.m_type == fs::file_type::directory) {
+            moved.push_back(pe.m_path);
+        }
+        removes.erase(ri);
+    }
+    
+    if (!moved.empty()) {
+        for (auto& pe : m_pending) {
+            if (pe.m_event == fs::change_event::created) {
+                for (const auto& d : moved) {
+                    if (is_within(pe.m_path, d)) {
+                        pe.m_event = fs::change_event::none;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+}
+
+fs::change_notifications polling_state::flush() {
+    pair_renames();
+    
+    constexpr auto always = fs::change_event::rescan_required|fs::change_event::outside_tree;
+    fs::change_notifications notes;
+    for (auto& pe : m_pending) {
+        const auto ev = pe.m_event & (m_events|always);
+        if (!is_set(ev & (m_events|fs::change_event::rescan_required))) {
+            continue;
+        }
+        fs::path p, np;
+        PSSilenceCppException(p = fs::path{pe.m_path});
+        if (!pe.m_newpath.empty()) {
+            PSSilenceCppException(np = fs::path{pe.m_newpath});
+        }
+        if (p.empty()) {
+            // should only happen when the name is not encoded as UTF8
+            fs::change_manager::emplace_back(notes, fs::path{m_rootpath}, fs::path{}, this, ++m_lastid, fs::change_event::rescan, fs::file_type::directory);
+            continue;
+        }
+        fs::change_manager::emplace_back(notes, std::move(p), std::move(np), this, ++m_lastid, ev, pe.m_type);
+    }
+    
+    m_pending.clear();
+    m_rescans.clear();
+    m_collapsing_root = false;
+    return notes;
+}
+
+fs::change_notifications polling_state::poll() {
+    const auto now = clock_type::now();
+    if (m_canceled) {
+        return {};
+    }
+    
+    if (poll_root()) {
+        while (!m_queue.empty() && m_queue.top().m_due <= now) {
+            const auto s = m_queue.top();
+            m_queue.pop();
+            auto i = m_index.find(s.m_path);
+            if (i == m_index.end() || i->second.m_due != s.m_due) {
+                continue;
+            }
+            if (i->second.m_type == fs::file_type::directory) {
+                poll_dir(i->first, i->second, now);
+            } else {
+                poll_file(i->first, i->second, now);
+            }
+        }
+    }
+    
+    return flush();
+}
+
+class gstate {
+public:
+    std::vector<shared_state> registrations;
+    std::mutex lck;
+    std::condition_variable cv;
+    
+    gstate() = default;
+    ~gstate() = default;
+    PS_DISABLE_COPY(gstate);
+    PS_DISABLE_MOVE(gstate);
+    
+    bool registered(const polling_state* s) const {
+        return registrations.end() != std::find_if(registrations.begin(), registrations.end(), [s](const shared_state& r) {
+            return r.get() == s;
+        });
+    }
+};
+
+using g_guard = std::unique_lock<std::mutex>;
+
+PS_NOINLINE
+gstate& gs() {
+    prosoft::intentional_leak_guard lg;
+    static auto gp = new gstate;
+    return *gp;
+}
+
+void poll_thread() {
+#if __APPLE__
+    pthread_setname_np("polling_monitor");
+#else
+    pthread_setname_np(pthread_self(), "polling_monitor");
+#endif
+    auto& g = gs();
+    std::vector<shared_state> due;
+    for (;;) {
+        {
+            g_guard lg{g.lck};
+            auto next = clock_type::time_point::max();
+            for (const auto& s : g.registrations) {
+                next = std::min(next, s->next_poll());
+            }
+            const auto now = clock_type::now();
+            if (next > now) {
+                if (next == clock_type::time_point::max()) {
+                    g.cv.wait(lg);
+                } else {
+                    g.cv.wait_until(lg, next);
+                }
+                continue;
+            }
+            for (const auto& s : g.registrations) {
+                if (s->next_poll() <= now) {
+                    due.push_back(s);
+                }
+            }
+        }
+        
+        // States are only polled by this thread.
+        for (auto& s : due) {
+            auto notes = s->poll();
+            if (notes.empty()) {
+                continue;
+            }
+            {
+                g_guard lg{g.lck};
+                if (!g.registered(s.get())) {
+                    continue;
+                }
+            }
+            PSIgnoreCppException(s->m_callback(std::move(notes)));
+        }
+        due.clear();
+    }
+}
+
+void start_poll_thread() {
+    struct start_thread {
+        start_thread() {
+            std::thread t{poll_thread};
+            t.detach();
+        }
+    };
+    
+    static start_thread s{};
+}
+
+} // anon
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+change_registration polling_monitor(const path& p, const change_config& cfg, change_callback&& cb, bool recursive, error_code& ec) {
+    if (p.empty() || !valid(cfg) || !cb) {
+        ec = einval();
+        return change_registration{};
+    }
+    
+    auto state = std::make_shared<polling_state>(p, cfg, recursive, ec);
+    if (ec) {
+        return change_registration{};
+    }
+    
+    state->m_callback = std::move(cb);
+    auto reg = change_manager::make_registration(state);
+    auto& g = gs();
+    {
+        g_guard lg{g.lck};
+        g.registrations.push_back(std::move(state));
+    }
+    g.cv.notify_one();
+    
+    start_poll_thread();
+    return reg;
+}
+
+bool stop_polling_monitor(change_state* state, error_code& ec) {
+    PSASSERT_NOTNULL(state);
+    auto ps = dynamic_cast<polling_state*>(state);
+    if (!ps) {
+        return false;
+    }
+    
+    shared_state ss; // released outside of the lock
+    auto& g = gs();
+    g_guard lg{g.lck};
+    auto i = std::find_if(g.registrations.begin(), g.registrations.end(), [ps](const shared_state& r) {
+        return r.get() == ps;
+    });
+    if (i != g.registrations.end()) {
+        ss = std::move(*i);
+        g.registrations.erase(i);
+    } else {
+        ec = error_code{ENOENT, std::system_category()};
+    }
+    return true;
+}
+
+} // v1
+} // filesystem
+} // prosoft
+
+#if PSTEST_HARNESS
+// Internal tests.
+#include <catch2/catch_test_macros.hpp>
+#include "fstestutils.hpp"
+
+using namespace prosoft::filesystem;
+
+TEST_CASE("polling_monitor_internal") {
+    WHEN("comparing entries") {
+        struct ::stat sb{};
+        sb.st_mode = S_IFREG;
+        sb.st_ino = 2;
+        const poll_entry e{sb};
+        CHECK(e.compare(e) == change_event::none);
+        
+        auto sb2 = sb;
+        sb2.st_size = 1;
+        CHECK(poll_entry{sb2}.compare(e) == change_event::content_modified);
+        sb2 = sb;
+        sb2.PS_ST_CTIM.tv_sec = 1;
+        CHECK(poll_entry{sb2}.compare(e) == change_event::metadata_modified);
+        sb2 = sb;
+        sb2.st_ino = 3;
+        CHECK(poll_entry{sb2}.compare(e) == (change_event::removed|change_event::created));
+    }
+    
+    SECTION("polling") {
+        const auto root = canonical(temp_directory_path()) / process_name("fs17polling");
+        create_directory(root);
+        PS_RAII_REMOVE(root);
+        const auto sub = root / PS_TEXT("a");
+        create_directory(sub);
+        PS_RAII_REMOVE(sub);
+        const auto f = create_file(sub / PS_TEXT("1"));
+        PS_RAII_REMOVE(f);
+        
+        change_config cfg;
+        cfg.notification_latency = change_config::latency_type{0};
+        error_code ec;
+        polling_state ps{root, cfg, true, ec};
+        REQUIRE_FALSE(ec);
+        CHECK(ps.size() == 3);
+        CHECK(ps.poll().empty());
+        
+        const auto wait = [&ps]() {
+            std::this_thread::sleep_until(ps.next_poll());
+        };
+        
+        WHEN("a file is created and modified") {
+            const auto f2 = create_file(sub / PS_TEXT("2"));
+            PS_RAII_REMOVE(f2);
+            wait();
+            auto notes = ps.poll();
+            REQUIRE(notes.size() == 1);
+            CHECK(created(notes[0]));
+            CHECK(notes[0].path() == f2);
+            CHECK(notes[0].type() == file_type::regular);
+            
+            {
+                std::ofstream s{f2.c_str()};
+                s << "hello" << std::flush;
+            }
+            wait();
+            notes = ps.poll();
+            REQUIRE(notes.size() == 1);
+            CHECK(content_modified(notes[0]));
+            CHECK(notes[0].path() == f2);
+        }
+        
+        WHEN("a subdir is renamed") {
+            const auto nsub = root / PS_TEXT("b");
+            rename(sub, nsub);
+            wait();
+            auto notes = ps.poll();
+            REQUIRE(notes.size() == 1);
+            CHECK(renamed(notes[0]));
+            CHECK(notes[0].path() == sub);
+            CHECK(notes[0].renamed_to_path() == nsub);
+            CHECK(notes[0].type() == file_type::directory);
+            CHECK(ps.size() == 3);
+            rename(nsub, sub);
+        }
+        
+        WHEN("the root is removed") {
+            CHECK(remove(f));
+            CHECK(remove(sub));
+            CHECK(remove(root));
+            wait();
+            auto notes = ps.poll();
+            REQUIRE(notes.size() == 1);
+            CHECK(notes[0].path() == root);
+            CHECK(removed(notes[0]));
+            CHECK(canceled(notes[0]));
+            CHECK(ps.next_poll() == clock_type::time_point::max());
+            
+            // restore for cleanup
+            create_directory(root);
+            create_directory(sub);
+            create_file(f);
+        }
+    }
+}
+
+#endif // PSTEST_HARNESS
+
+#endif // PS_HAVE_FILESYSTEM_CHANGE_MONITOR
@@ -0,0 +1,673 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <prosoft/core/config/config.h>
+
+#include "fsconfig.h"
+
+#if !_WIN32
+#include <fcntl.h>
+#include <sys/errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <unordered_map>
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_extents.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_mapped_file.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_tree_hasher.hpp>
+#include "filesystem_private.hpp"
+#include "batch_private.hpp"
+#include "fsstore_private.hpp"
+
+namespace {
+using namespace prosoft::filesystem;
+
+// XXH64 (https://github.com/Cyan4973/xxHash), streamed so a file can be hashed in buffers or mapped windows.
+class xxh64 {
+    static constexpr std::uint64_t p1 = 11400714785074694791ULL;
+    static constexpr std::uint64_t p2 = 14029467366897019727ULL;
+    static constexpr std::uint64_t p3 = 1609587929392839161ULL;
+    static constexpr std::uint64_t p4 = 9650029242287828579ULL;
+    static constexpr std::uint64_t p5 = 2870177450012600261ULL;
+
+    std::uint64_t m_seed;
+    std::uint64_t m_v[4];
+    std::uint64_t m_total;
+    unsigned char m_buf[32];
+    size_t m_bufsz;
+
+    static std::uint64_t rotl(std::uint64_t x, int r) noexcept {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    template <typename T>
+    static T read(const unsigned char* p) noexcept {
+        T v;
+        std::memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        v = sizeof(v) == 8 ? static_cast<T>(__builtin_bswap64(v)) : static_cast<T>(__builtin_bswap32(static_cast<std::uint32_t>(v)));
+#endif
+        return v;
+    }
+
+    static std::uint64_t round(std::uint64_t acc, std::uint64_t input) noexcept {
+        acc += input * p2;
+        return rotl(acc, 31) * p1;
+    }
+
+    static std::uint64_t merge(std::uint64_t acc, std::uint64_t val) noexcept {
+        acc ^= round(0, val);
+        return acc * p1 + p4;
+    }
+
+    void consume(const unsigned char* p) noexcept {
+        for (int i = 0; i < 4; ++i) {
+            m_v[i] = round(m_v[i], read<std::uint64_t>(p + i * 8));
+        }
+    }
+
+public:
+    explicit xxh64(std::uint64_t seed = 0) noexcept
+        : m_seed(seed)
+        , m_v{seed + p1 + p2, seed + p2, seed, seed - p1}
+        , m_total()
+        , m_buf()
+        , m_bufsz() {}
+
+    void update(const void* data, size_t sz) noexcept {
+        auto p = static_cast<const unsigned char*>(data);
+        m_total += sz;
+        if (m_bufsz + sz < sizeof(m_buf)) {
+            std::memcpy(m_buf + m_bufsz, p, sz);
+            m_bufsz += sz;
+            return;
+        }
+        if (m_bufsz > 0) {
+            const auto n = sizeof(m_buf) - m_bufsz;
+            std::memcpy(m_buf + m_bufsz, p, n);
+            consume(m_buf);
+            p += n;
+            sz -= n;
+            m_bufsz = 0;
+        }
+        for (; sz >= sizeof(m_buf); p += sizeof(m_buf), sz -= sizeof(m_buf)) {
+            consume(p);
+        }
+        std::memcpy(m_buf, p, sz);
+        m_bufsz = sz;
+    }
+
+    std::uint64_t digest() const noexcept {
+        std::uint64_t h;
+        if (m_total >= sizeof(m_buf)) {
+            h = rotl(m_v[0], 1) + rotl(m_v[1], 7) + rotl(m_v[2], 12) + rotl(m_v[3], 18);
+            for (auto v : m_v) {
+                h = merge(h, v);
+            }
+        } else {
+            h = m_seed + p5;
+        }
+        h += m_total;
+
+        auto p = m_buf;
+        auto sz = m_bufsz;
+        for (; sz >= 8; p += 8, sz -= 8) {
+            h ^= round(0, read<std::uint64_t>(p));
+            h = rotl(h, 27) * p1 + p4;
+        }
+        if (sz >= 4) {
+            h ^= std::uint64_t{read<std::uint32_t>(p)} * p1;
+            h = rotl(h, 23) * p2 + p3;
+            p += 4;
+            sz -= 4;
+        }
+        for (; sz > 0; ++p, --sz) {
+            h ^= *p * p5;
+            h = rotl(h, 11) * p1;
+        }
+
+        h ^= h >> 33;
+        h *= p2;
+        h ^= h >> 29;
+        h *= p3;
+        h ^= h >> 32;
+        return h;
+    }
+};
+
+#if !_WIN32
+// Store layout (native byte order, unaligned):
+//  header: magic[8], u32 version, u32 reserved, u64 file count, u64 names size, root (u32 size + bytes)
+//  columns: u64 size[count], i64 mtime[count], u64 dev[count], u64 ino[count], u64 edge digest[count], u64 digest[count],
+//           u32 flags[count], u64 name offset[count + 1], name bytes (absolute paths)
+constexpr char store_magic[8] = {'P', 'S', 'T', 'R', 'E', 'E', 'H', 'S'};
+constexpr std::uint32_t store_version = 1;
+
+constexpr std::uint32_t has_edge_flag = 0x1;
+constexpr std::uint32_t has_digest_flag = 0x2;
+
+constexpr size_t default_buffer_size = 1024 * 1024;
+constexpr size_t map_window_size = 64 * 1024 * 1024;
+
+std::int64_t to_ns(const struct ::timespec& ts) noexcept {
+    return static_cast<std::int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+#if __APPLE__
+#define PS_ST_MTIM st_mtimespec
+#else
+#define PS_ST_MTIM st_mtim
+#endif
+
+bool ignore_iteration_error(const error_code& ec) {
+    return ec.value() == EACCES || ec.value() == EPERM || ec.value() == ENOENT;
+}
+
+bool pread_all(int fd, char* p, size_t sz, ::off_t off) {
+    while (sz > 0) {
+        const auto n = ::pread(fd, p, sz, off);
+        if (n > 0) {
+            p += n;
+            sz -= static_cast<size_t>(n);
+            off += n;
+        } else if (0 == n) { // truncated since the scan
+            errno = EIO;
+            return false;
+        } else if (EINTR != errno) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Files smaller than two edges are read in full and both digests are set.
+bool edge_digest(tree_hasher::file_info& fi, error_code& ec) {
+    constexpr auto edge = tree_hasher::edge_size;
+    ifilesystem::fd_close fd{::open(fi.file.c_str(), O_RDONLY|O_CLOEXEC)};
+    if (fd.fd < 0) {
+        ifilesystem::system_error(ec);
+        return false;
+    }
+    char buf[2 * edge];
+    const bool whole = fi.size <= sizeof(buf);
+    const auto head = whole ? static_cast<size_t>(fi.size) : edge;
+    if (!pread_all(fd.fd, buf, head, 0) || (!whole && !pread_all(fd.fd, buf + edge, edge, static_cast<::off_t>(fi.size - edge)))) {
+        ifilesystem::system_error(ec);
+        return false;
+    }
+    fi.edge_digest = tree_hasher::hash(buf, whole ? head : sizeof(buf));
+    fi.has_edge_digest = true;
+    if (whole) {
+        fi.digest = fi.edge_digest;
+        fi.has_digest = true;
+    }
+    return true;
+}
+
+// Holes are hashed from here instead of being read, the digest is the same.
+const char zero_block[64 * 1024] = {};
+
+void update_zeros(xxh64& h, file_size_type n) noexcept {
+    while (n > 0) {
+        const auto sz = static_cast<size_t>(std::min<file_size_type>(n, sizeof(zero_block)));
+        h.update(zero_block, sz);
+        n -= sz;
+    }
+}
+
+// The ranges to read. A dense file (or one whose extents can't be found) is a single range.
+template <class File>
+file_extents_type data_ranges(const File& f, const struct ::stat& sb, file_size_type size) {
+    if (static_cast<file_size_type>(sb.st_blocks) * 512 < size) {
+        error_code ec;
+        auto extents = file_extents(f, ec);
+        if (!ec.value()) {
+            return extents;
+        }
+    }
+    return file_extents_type{file_extent{0, size}};
+}
+
+// Calls read(offset, size) for the data of each range (in pieces of at most max) and hashes the holes between them.
+template <class Read>
+bool hash_ranges(const file_extents_type& ranges, file_size_type size, file_size_type max, xxh64& h, Read read) {
+    file_size_type pos = 0;
+    for (const auto& e : ranges) {
+        const auto start = std::max(e.offset, pos);
+        const auto end = std::min(e.offset + e.length, size);
+        if (start >= end) {
+            continue;
+        }
+        update_zeros(h, start - pos);
+        for (pos = start; pos < end;) {
+            const auto n = read(pos, std::min(end - pos, max));
+            if (0 == n) {
+                return false;
+            }
+            pos += n;
+        }
+    }
+    update_zeros(h, size - pos);
+    return true;
+}
+
+bool read_digest(const path& p, size_t bufsize, tree_hasher::digest_type& d, error_code& ec) {
+    ifilesystem::fd_close fd{::open(p.c_str(), O_RDONLY|O_CLOEXEC)};
+    struct ::stat sb;
+    if (fd.fd < 0 || 0 != ::fstat(fd.fd, &sb)) {
+        ifilesystem::system_error(ec);
+        return false;
+    }
+#if __linux__
+    (void)::posix_fadvise(fd.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    std::unique_ptr<char[]> buf{new char[bufsize]};
+    xxh64 h;
+    const auto size = static_cast<file_size_type>(sb.st_size);
+    const bool ok = hash_ranges(data_ranges(fd.fd, sb, size), size, bufsize, h, [&](file_size_type off, file_size_type n) -> file_size_type {
+        if (!pread_all(fd.fd, buf.get(), static_cast<size_t>(n), static_cast<::off_t>(off))) {
+            return 0;
+        }
+        h.update(buf.get(), static_cast<size_t>(n));
+        return n;
+    });
+    if (!ok) {
+        ifilesystem::system_error(ec);
+        return false;
+    }
+    d = h.digest();
+    return true;
+}
+
+bool map_digest(const path& p, tree_hasher::digest_type& d, error_code& ec) {
+    mapped_file mf{p, map_mode::read_only, ec};
+    struct ::stat sb;
+    if (ec.value()) {
+        return false;
+    } else if (0 != ::stat(p.c_str(), &sb)) {
+        ifilesystem::system_error(ec);
+        return false;
+    }
+    xxh64 h;
+    mapped_region r;
+    const auto size = mf.size();
+    const bool ok = hash_ranges(data_ranges(p, sb, size), size, map_window_size, h, [&](file_size_type off, file_size_type n) -> file_size_type {
+        mf.remap(r, off, static_cast<size_t>(n), map_advice::sequential|map_advice::will_need, ec);
+        if (ec.value()) {
+            return 0;
+        }
+        h.update(r.data(), r.size());
+        return r.size();
+    });
+    if (ok) {
+        d = h.digest();
+    }
+    return ok;
+}
+
+// Groups the candidates by key, returning the members of groups with two or more files.
+template <class Key>
+std::vector<size_t> shared(const std::vector<tree_hasher::file_info>& files, std::vector<size_t> candidates, Key key) {
+    std::sort(candidates.begin(), candidates.end(), [&](size_t lhs, size_t rhs) {
+        return key(files[lhs]) < key(files[rhs]);
+    });
+    std::vector<size_t> l;
+    for (size_t i = 0; i < candidates.size();) {
+        auto j = i + 1;
+        while (j < candidates.size() && key(files[candidates[i]]) == key(files[candidates[j]])) {
+            ++j;
+        }
+        if (j - i > 1) {
+            l.insert(l.end(), candidates.begin() + static_cast<std::ptrdiff_t>(i), candidates.begin() + static_cast<std::ptrdiff_t>(j));
+        }
+        i = j;
+    }
+    return l;
+}
+#endif // !_WIN32
+
+} // anon
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+constexpr std::size_t tree_hasher::edge_size;
+
+tree_hasher::digest_type tree_hasher::hash(const void* p, std::size_t sz, digest_type seed) noexcept {
+    xxh64 h{seed};
+    h.update(p, sz);
+    return h.digest();
+}
+
+tree_hasher::digest_type tree_hasher::hash(const path& p) {
+    error_code ec;
+    const auto d = hash(p, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not hash file", p, ec));
+    return d;
+}
+
+void tree_hasher::scan(const path& root, const tree_hasher_config& cfg) {
+    error_code ec;
+    scan(root, cfg, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not scan tree", root, ec));
+}
+
+tree_hasher tree_hasher::load(const path& p) {
+    error_code ec;
+    auto h = load(p, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not load tree digests", p, ec));
+    return h;
+}
+
+void tree_hasher::save(const path& p) const {
+    error_code ec;
+    save(p, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not save tree digests", p, ec));
+}
+
+void tree_hasher::group() {
+    m_duplicates.clear();
+    std::vector<size_type> hashed;
+    for (size_type i = 0; i < m_files.size(); ++i) {
+        if (m_files[i].has_digest) {
+            hashed.push_back(i);
+        }
+    }
+    // Largest first, then by digest so members are adjacent.
+    const auto key = [this](size_type i) {
+        const auto& fi = m_files[i];
+        return std::make_tuple(~fi.size, fi.digest, i);
+    };
+    std::sort(hashed.begin(), hashed.end(), [&key](size_type lhs, size_type rhs) {
+        return key(lhs) < key(rhs);
+    });
+    for (size_type i = 0; i < hashed.size();) {
+        const auto& fi = m_files[hashed[i]];
+        group_type g;
+        auto j = i;
+        for (; j < hashed.size() && m_files[hashed[j]].size == fi.size && m_files[hashed[j]].digest == fi.digest; ++j) {
+            const auto& cur = m_files[hashed[j]];
+            // A hard link is not a duplicate, only its first path is listed.
+            if (std::none_of(g.begin(), g.end(), [this, &cur](size_type k) { return m_files[k].device == cur.device && m_files[k].inode == cur.inode; })) {
+                g.push_back(hashed[j]);
+            }
+        }
+        if (g.size() > 1) {
+            m_duplicates.push_back(std::move(g));
+        }
+        i = j;
+    }
+}
+
+#if !_WIN32
+
+tree_hasher::digest_type tree_hasher::hash(const path& p, error_code& ec) {
+    ec.clear();
+    digest_type d = 0;
+    return read_digest(p, default_buffer_size, d, ec) ? d : 0;
+}
+
+void tree_hasher::scan(const path& root, const tree_hasher_config& cfg, error_code& ec) {
+    recursive_directory_iterator i{root, recursive_directory_iterator::default_options(), ec};
+    if (ec) {
+        return;
+    }
+
+    std::unordered_map<std::string, size_type> previous;
+    previous.reserve(m_files.size());
+    for (size_type j = 0; j < m_files.size(); ++j) {
+        previous.emplace(m_files[j].file.native().str(), j);
+    }
+
+    std::vector<file_info> files;
+    size_type reused = 0;
+    struct ::stat sb;
+    for (; i != end(i); i.increment(ec)) {
+        if (ec) {
+            if (ignore_iteration_error(ec)) {
+                ec.clear();
+                continue;
+            }
+            return;
+        }
+
+        error_code tec;
+        if (!i->is_regular_file(tec)) { // the type is usually known from the listing, so most non-files are skipped without a stat
+            continue;
+        }
+        const auto& ep = i->path();
+        if (0 != ::lstat(ep.c_str(), &sb)) {
+            continue; // raced with a remove
+        }
+        if (!S_ISREG(sb.st_mode) || static_cast<file_size_type>(sb.st_size) < cfg.min_size) {
+            continue;
+        }
+
+        file_info fi{ep, static_cast<file_size_type>(sb.st_size), to_ns(sb.PS_ST_MTIM), static_cast<std::uint64_t>(sb.st_dev),
+            static_cast<std::uint64_t>(sb.st_ino), 0, 0, false, false};
+        const auto prev = previous.find(ep.native().str());
+        if (prev != previous.end()) {
+            const auto& pfi = m_files[prev->second];
+            if (pfi.size == fi.size && pfi.mtime == fi.mtime && pfi.device == fi.device && pfi.inode == fi.inode) {
+                fi.edge_digest = pfi.edge_digest;
+                fi.has_edge_digest = pfi.has_edge_digest;
+                fi.digest = pfi.digest;
+                fi.has_digest = pfi.has_digest;
+                reused += pfi.has_edge_digest || pfi.has_digest;
+            }
+        }
+        files.push_back(std::move(fi));
+    }
+    ec.clear();
+
+    const auto bufsize = cfg.buffer_size > 0 ? cfg.buffer_size : default_buffer_size;
+    std::vector<size_t> all(files.size());
+    for (size_t j = 0; j < all.size(); ++j) {
+        all[j] = j;
+    }
+
+    // 1. size
+    auto candidates = shared(files, std::move(all), [](const file_info& fi) { return fi.size; });
+    
+    // Hard links are hashed once, through the first path found. A file that only shares its size with its own links is dropped.
+    std::vector<std::pair<size_t, size_t>> links; // link -> hashed path
+    {
+        std::map<std::pair<std::uint64_t, std::uint64_t>, size_t> inodes;
+        std::vector<size_t> unique;
+        for (auto j : candidates) {
+            const auto i = inodes.emplace(std::make_pair(files[j].device, files[j].inode), j);
+            if (i.second) {
+                unique.push_back(j);
+            } else {
+                links.emplace_back(j, i.first->second);
+            }
+        }
+        candidates = shared(files, std::move(unique), [](const file_info& fi) { return fi.size; });
+    }
+
+    // 2. edges
+    std::vector<size_t> todo;
+    std::copy_if(candidates.begin(), candidates.end(), std::back_inserter(todo), [&files](size_t j) { return !files[j].has_edge_digest; });
+    ifilesystem::parallel_for(todo.size(), cfg.threads, 1, [&files, &todo](size_t j) {
+        error_code ignored;
+        (void)edge_digest(files[todo[j]], ignored);
+    });
+    candidates.erase(std::remove_if(candidates.begin(), candidates.end(), [&files](size_t j) { return !files[j].has_edge_digest; }), candidates.end());
+    candidates = shared(files, std::move(candidates), [](const file_info& fi) { return std::make_pair(fi.size, fi.edge_digest); });
+
+    // 3. content
+    todo.clear();
+    std::copy_if(candidates.begin(), candidates.end(), std::back_inserter(todo), [&files](size_t j) { return !files[j].has_digest; });
+    ifilesystem::parallel_for(todo.size(), cfg.threads, 1, [&files, &todo, &cfg, bufsize](size_t j) {
+        auto& fi = files[todo[j]];
+        error_code ignored;
+        fi.has_digest = cfg.map_files ? map_digest(fi.file, fi.digest, ignored) : read_digest(fi.file, bufsize, fi.digest, ignored);
+    });
+    
+    for (const auto& l : links) {
+        auto& fi = files[l.first];
+        const auto& from = files[l.second];
+        if (from.has_edge_digest) {
+            fi.edge_digest = from.edge_digest;
+            fi.has_edge_digest = true;
+        }
+        if (from.has_digest) {
+            fi.digest = from.digest;
+            fi.has_digest = true;
+        }
+    }
+
+    m_root = root;
+    m_files = std::move(files);
+    m_reused = reused;
+    group();
+}
+
+tree_hasher tree_hasher::load(const path& p, error_code& ec) {
+    ifilesystem::map_close mc{MAP_FAILED, 0};
+    ifilesystem::map_store(p, mc, ec);
+    if (ec) {
+        return tree_hasher{};
+    }
+
+    ifilesystem::store_reader r{static_cast<const char*>(mc.mem), mc.size};
+    char magic[sizeof(store_magic)];
+    std::uint32_t version, reserved;
+    std::uint64_t count, names_size;
+    std::string root;
+    if (!r.get(magic) || 0 != std::memcmp(magic, store_magic, sizeof(magic))
+        || !r.get(version) || version != store_version
+        || !r.get(reserved) || !r.get(count) || !r.get(names_size) || !r.get(root)) {
+        ec = einval();
+        return tree_hasher{};
+    }
+
+    const auto n = static_cast<size_t>(count);
+    std::vector<std::uint64_t> sizes, devs, inodes, edges, digests, offsets;
+    std::vector<std::int64_t> mtimes;
+    std::vector<std::uint32_t> flags;
+    std::string names;
+    if (!r.get(sizes, n) || !r.get(mtimes, n) || !r.get(devs, n) || !r.get(inodes, n) || !r.get(edges, n) || !r.get(digests, n)
+        || !r.get(flags, n) || !r.get(offsets, n + 1) || !r.get(names, static_cast<size_t>(names_size)) || !r.at_end()
+        || offsets.front() != 0 || offsets.back() != names_size || !std::is_sorted(offsets.begin(), offsets.end())) {
+        ec = einval();
+        return tree_hasher{};
+    }
+
+    tree_hasher h;
+    h.m_root = path{path::string_type{std::move(root)}};
+    h.m_files.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        const auto name = names.data() + offsets[i];
+        h.m_files.push_back({path{path::string_type{name, static_cast<size_t>(offsets[i + 1] - offsets[i])}}, sizes[i], mtimes[i], devs[i], inodes[i],
+            edges[i], digests[i], 0 != (flags[i] & has_edge_flag), 0 != (flags[i] & has_digest_flag)});
+    }
+    h.group();
+    ec.clear();
+    return h;
+}
+
+void tree_hasher::save(const path& p, error_code& ec) const {
+    const auto n = m_files.size();
+    std::vector<std::uint64_t> sizes, devs, inodes, edges, digests, offsets;
+    std::vector<std::int64_t> mtimes;
+    std::vector<std::uint32_t> flags;
+    std::string names;
+    for (auto v : {&sizes, &devs, &inodes, &edges, &digests}) {
+        v->reserve(n);
+    }
+    mtimes.reserve(n);
+    flags.reserve(n);
+    offsets.reserve(n + 1);
+    offsets.push_back(0);
+    for (const auto& fi : m_files) {
+        sizes.push_back(fi.size);
+        mtimes.push_back(fi.mtime);
+        devs.push_back(fi.device);
+        inodes.push_back(fi.inode);
+        edges.push_back(fi.edge_digest);
+        digests.push_back(fi.digest);
+        flags.push_back((fi.has_edge_digest ? has_edge_flag : 0) | (fi.has_digest ? has_digest_flag : 0));
+        names.append(fi.file.native().str());
+        offsets.push_back(names.size());
+    }
+
+    ifilesystem::store_writer w;
+    w.put(store_magic, sizeof(store_magic));
+    w.put(store_version);
+    w.put(std::uint32_t{});
+    w.put(static_cast<std::uint64_t>(n));
+    w.put(static_cast<std::uint64_t>(names.size()));
+    w.put(m_root.native().str());
+    w.put(sizes);
+    w.put(mtimes);
+    w.put(devs);
+    w.put(inodes);
+    w.put(edges);
+    w.put(digests);
+    w.put(flags);
+    w.put(offsets);
+    w.put(names.data(), names.size());
+
+    ifilesystem::write_store(p, w.data(), ec);
+}
+
+#undef PS_ST_MTIM
+
+#else
+
+tree_hasher::digest_type tree_hasher::hash(const path&, error_code& ec) {
+    ifilesystem::error(ENOTSUP, ec);
+    return 0;
+}
+
+void tree_hasher::scan(const path&, const tree_hasher_config&, error_code& ec) {
+    ifilesystem::error(ENOTSUP, ec);
+}
+
+tree_hasher tree_hasher::load(const path&, error_code& ec) {
+    ifilesystem::error(ENOTSUP, ec);
+    return tree_hasher{};
+}
+
+void tree_hasher::save(const path&, error_code& ec) const {
+    ifilesystem::error(ENOTSUP, ec);
+}
+
+#endif // !_WIN32
+
+} // v1
+} // filesystem
+} // prosoft
@@ -0,0 +1,598 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <prosoft/core/config/config.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <unordered_map>
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_tree_manifest.hpp>
+#include "filesystem_private.hpp"
+#include "fsstore_private.hpp"
+
+namespace {
+using namespace prosoft::filesystem;
+
+// Store layout (native byte order, unaligned):
+//  header: magic[8], u32 version, u32 reserved, u64 entry count, u64 names size, root (u32 size + bytes)
+//  columns: u64 hash[count], u64 dev[count], u64 ino[count], u64 size[count], i64 mtime[count], u32 mode[count],
+//           u64 name offset[count + 1], name bytes
+constexpr char store_magic[8] = {'P', 'S', 'T', 'R', 'E', 'E', 'M', 'F'};
+constexpr std::uint32_t store_version = 1;
+
+constexpr std::uint32_t perms_mask = 07777;
+
+#if !_WIN32
+std::int64_t to_ns(const struct ::timespec& ts) noexcept {
+    return static_cast<std::int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+#if __APPLE__
+#define PS_ST_MTIM st_mtimespec
+#else
+#define PS_ST_MTIM st_mtim
+#endif
+
+bool ignore_iteration_error(const error_code& ec) {
+    return ec.value() == EACCES || ec.value() == EPERM || ec.value() == ENOENT;
+}
+#endif // !_WIN32
+
+} // anon
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+tree_manifest::hash_type tree_manifest::hash(const char* p, size_t sz) noexcept {
+    // FNV-1a, stable across runs (and processes) unlike std::hash.
+    hash_type h = 14695981039346656037ULL;
+    for (size_t i = 0; i < sz; ++i) {
+        h ^= static_cast<unsigned char>(p[i]);
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+file_type tree_manifest::type(size_type i) const {
+#if !_WIN32
+    switch (m_modes[i] & S_IFMT) {
+        case S_IFDIR: return file_type::directory;
+        case S_IFREG: return file_type::regular;
+        case S_IFLNK: return file_type::symlink;
+        case S_IFBLK: return file_type::block;
+        case S_IFCHR: return file_type::character;
+        case S_IFIFO: return file_type::fifo;
+        case S_IFSOCK: return file_type::socket;
+        default: return file_type::unknown;
+    };
+#else
+    (void)i;
+    return file_type::unknown;
+#endif
+}
+
+path tree_manifest::relative_path(size_type i) const {
+#if !_WIN32
+    return path{path::string_type{name(i), name_size(i)}};
+#else
+    (void)i;
+    return path{};
+#endif
+}
+
+tree_manifest::size_type tree_manifest::find(const path& relative) const {
+#if !_WIN32
+    const auto& s = relative.native().str();
+    const auto h = hash(s.data(), s.size());
+    auto r = std::equal_range(m_hashes.begin(), m_hashes.end(), h);
+    for (auto i = r.first; i != r.second; ++i) {
+        const auto idx = static_cast<size_type>(i - m_hashes.begin());
+        if (name_size(idx) == s.size() && 0 == std::memcmp(name(idx), s.data(), s.size())) {
+            return idx;
+        }
+    }
+#else
+    (void)relative;
+#endif
+    return size();
+}
+
+tree_manifest tree_manifest::capture(const path& root) {
+    error_code ec;
+    auto m = capture(root, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not capture tree manifest", root, ec));
+    return m;
+}
+
+tree_manifest tree_manifest::load(const path& p) {
+    error_code ec;
+    auto m = load(p, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not load tree manifest", p, ec));
+    return m;
+}
+
+void tree_manifest::save(const path& p) const {
+    error_code ec;
+    save(p, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not save tree manifest", p, ec));
+}
+
+#if !_WIN32
+
+tree_manifest tree_manifest::capture(const path& root, error_code& ec) {
+    tree_manifest m;
+    recursive_directory_iterator i{root, recursive_directory_iterator::default_options(), ec};
+    if (ec) {
+        return m;
+    }
+    m.m_root = root;
+
+    const auto& rs = root.native().str();
+    const auto prefix = rs.size() + ((!rs.empty() && rs.back() == '/') ? 0 : 1);
+    std::vector<std::uint64_t> offsets{0};
+    struct ::stat sb;
+    for (; i != end(i); i.increment(ec)) {
+        if (ec) {
+            if (ignore_iteration_error(ec)) {
+                ec.clear();
+                continue;
+            }
+            return tree_manifest{};
+        }
+
+        const auto& ep = i->path();
+        if (0 != ::lstat(ep.c_str(), &sb)) {
+            if (ENOENT == errno) { // raced with a remove
+                continue;
+            }
+            ifilesystem::system_error(ec);
+            return tree_manifest{};
+        }
+
+        const auto& es = ep.native().str();
+        PSASSERT(es.size() > prefix, "Broken assumption");
+        m.m_names.append(es, prefix, std::string::npos);
+        offsets.push_back(m.m_names.size());
+        m.m_devs.push_back(static_cast<std::uint64_t>(sb.st_dev));
+        m.m_inodes.push_back(static_cast<std::uint64_t>(sb.st_ino));
+        m.m_sizes.push_back(static_cast<std::uint64_t>(sb.st_size));
+        m.m_mtimes.push_back(to_ns(sb.PS_ST_MTIM));
+        m.m_modes.push_back(static_cast<std::uint32_t>(sb.st_mode));
+    }
+    ec.clear();
+
+    // Sort the columns by (hash, name) so a diff is a simple merge-join that can be partitioned by hash range.
+    const auto n = m.m_modes.size();
+    m.m_name_offsets = std::move(offsets);
+    m.m_hashes.resize(n);
+    for (size_type j = 0; j < n; ++j) {
+        m.m_hashes[j] = hash(m.name(j), m.name_size(j));
+    }
+
+    std::vector<size_type> order(n);
+    std::iota(order.begin(), order.end(), size_type{0});
+    std::sort(order.begin(), order.end(), [&m](size_type lhs, size_type rhs) {
+        if (m.m_hashes[lhs] != m.m_hashes[rhs]) {
+            return m.m_hashes[lhs] < m.m_hashes[rhs];
+        }
+        return std::lexicographical_compare(m.name(lhs), m.name(lhs) + m.name_size(lhs), m.name(rhs), m.name(rhs) + m.name_size(rhs));
+    });
+
+    tree_manifest sorted;
+    sorted.m_root = std::move(m.m_root);
+    sorted.m_hashes.reserve(n);
+    sorted.m_devs.reserve(n);
+    sorted.m_inodes.reserve(n);
+    sorted.m_sizes.reserve(n);
+    sorted.m_mtimes.reserve(n);
+    sorted.m_modes.reserve(n);
+    sorted.m_name_offsets.reserve(n + 1);
+    sorted.m_names.reserve(m.m_names.size());
+    sorted.m_name_offsets.push_back(0);
+    for (auto j : order) {
+        sorted.m_hashes.push_back(m.m_hashes[j]);
+        sorted.m_devs.push_back(m.m_devs[j]);
+        sorted.m_inodes.push_back(m.m_inodes[j]);
+        sorted.m_sizes.push_back(m.m_sizes[j]);
+        sorted.m_mtimes.push_back(m.m_mtimes[j]);
+        sorted.m_modes.push_back(m.m_modes[j]);
+        sorted.m_names.append(m.name(j), m.name_size(j));
+        sorted.m_name_offsets.push_back(sorted.m_names.size());
+    }
+    return sorted;
+}
+
+tree_manifest tree_manifest::load(const path& p, error_code& ec) {
+    ifilesystem::map_close mc{MAP_FAILED, 0};
+    ifilesystem::map_store(p, mc, ec);
+    if (ec) {
+        return tree_manifest{};
+    }
+
+    ifilesystem::store_reader r{static_cast<const char*>(mc.mem), mc.size};
+    char magic[sizeof(store_magic)];
+    std::uint32_t version, reserved;
+    std::uint64_t count, names_size;
+    std::string root;
+    if (!r.get(magic) || 0 != std::memcmp(magic, store_magic, sizeof(magic))
+        || !r.get(version) || version != store_version
+        || !r.get(reserved) || !r.get(count) || !r.get(names_size) || !r.get(root)) {
+        ec = einval();
+        return tree_manifest{};
+    }
+
+    tree_manifest m;
+    const auto n = static_cast<size_t>(count);
+    if (!r.get(m.m_hashes, n) || !r.get(m.m_devs, n) || !r.get(m.m_inodes, n) || !r.get(m.m_sizes, n)
+        || !r.get(m.m_mtimes, n) || !r.get(m.m_modes, n) || !r.get(m.m_name_offsets, n + 1)
+        || !r.get(m.m_names, static_cast<size_t>(names_size)) || !r.at_end()) {
+        ec = einval();
+        return tree_manifest{};
+    }
+
+    // Validate the invariants the accessors and diff rely on.
+    if (m.m_name_offsets.front() != 0 || m.m_name_offsets.back() != names_size
+        || !std::is_sorted(m.m_name_offsets.begin(), m.m_name_offsets.end())
+        || !std::is_sorted(m.m_hashes.begin(), m.m_hashes.end())) {
+        ec = einval();
+        return tree_manifest{};
+    }
+
+    m.m_root = path{path::string_type{std::move(root)}};
+    ec.clear();
+    return m;
+}
+
+void tree_manifest::save(const path& p, error_code& ec) const {
+    ifilesystem::store_writer w;
+    w.put(store_magic, sizeof(store_magic));
+    w.put(store_version);
+    w.put(std::uint32_t{});
+    w.put(static_cast<std::uint64_t>(size()));
+    w.put(static_cast<std::uint64_t>(m_names.size()));
+    w.put(m_root.native().str());
+    w.put(m_hashes);
+    w.put(m_devs);
+    w.put(m_inodes);
+    w.put(m_sizes);
+    w.put(m_mtimes);
+    w.put(m_modes);
+    if (!m_name_offsets.empty()) {
+        w.put(m_name_offsets);
+    } else {
+        w.put(std::uint64_t{});
+    }
+    w.put(m_names.data(), m_names.size());
+
+    ifilesystem::write_store(p, w.data(), ec);
+}
+
+#undef PS_ST_MTIM
+
+#else
+
+tree_manifest tree_manifest::capture(const path&, error_code& ec) {
+    ifilesystem::error(ENOTSUP, ec);
+    return tree_manifest{};
+}
+
+tree_manifest tree_manifest::load(const path&, error_code& ec) {
+    ifilesystem::error(ENOTSUP, ec);
+    return tree_manifest{};
+}
+
+void tree_manifest::save(const path&, error_code& ec) const {
+    ifilesystem::error(ENOTSUP, ec);
+}
+
+#endif // !_WIN32
+
+// Matching paths are found with a merge-join of the (hash sorted) manifests. Each worker joins one hash range at a time.
+// Unmatched entries are kept as indexes only and paired by device/inode once all ranges are done to infer renames.
+class manifest_differ {
+    using size_type = tree_manifest::size_type;
+    using index_list = std::vector<size_type>;
+
+    const tree_manifest& m_from;
+    const tree_manifest& m_to;
+    const change_callback& m_cb;
+    const size_t m_batch_size;
+
+    std::mutex m_lock; // serializes callbacks and guards the state below
+    index_list m_removed;
+    index_list m_created;
+    std::exception_ptr m_error;
+    std::atomic<size_t> m_next_range{0};
+    std::atomic<bool> m_canceled{false};
+
+    struct inode_key {
+        std::uint64_t dev;
+        std::uint64_t ino;
+
+        bool operator==(const inode_key& other) const noexcept {
+            return dev == other.dev && ino == other.ino;
+        }
+    };
+
+    struct inode_hash {
+        size_t operator()(const inode_key& k) const noexcept {
+            return std::hash<std::uint64_t>{}(k.ino ^ (k.dev << 1));
+        }
+    };
+
+    int compare(size_type i, size_type j) const noexcept {
+        if (m_from.m_hashes[i] != m_to.m_hashes[j]) {
+            return m_from.m_hashes[i] < m_to.m_hashes[j] ? -1 : 1;
+        }
+        const auto isz = m_from.name_size(i);
+        const auto jsz = m_to.name_size(j);
+        const auto r = std::memcmp(m_from.name(i), m_to.name(j), std::min(isz, jsz));
+        return r != 0 ? r : (isz < jsz ? -1 : (isz > jsz ? 1 : 0));
+    }
+
+    path from_path(size_type i) const {
+        return m_from.root() / m_from.relative_path(i);
+    }
+
+    path to_path(size_type j) const {
+        return m_to.root() / m_to.relative_path(j);
+    }
+
+    void flush(change_notifications& batch) {
+        if (!batch.empty()) {
+            std::lock_guard<std::mutex> lg{m_lock};
+            if (!m_canceled) {
+                m_cb(std::move(batch));
+            }
+            batch.clear();
+        }
+    }
+
+    void emit(change_notifications& batch, path&& p, path&& np, change_event ev, file_type ft) {
+        batch.emplace_back(std::move(p), std::move(np), 0, ev, ft);
+        if (batch.size() >= m_batch_size) {
+            flush(batch);
+        }
+    }
+
+    bool content_differs(size_type i, size_type j) const noexcept {
+        return m_from.m_sizes[i] != m_to.m_sizes[j] || m_from.m_mtimes[i] != m_to.m_mtimes[j];
+    }
+
+    void compare_entry(size_type i, size_type j, change_notifications& batch) {
+        const auto ft = m_to.type(j);
+        if (m_from.type(i) != ft) {
+            emit(batch, from_path(i), path{}, change_event::removed, m_from.type(i));
+            emit(batch, to_path(j), path{}, change_event::created, ft);
+            return;
+        }
+
+        auto ev = change_event::none;
+        if (m_from.m_inodes[i] != m_to.m_inodes[j] || m_from.m_devs[i] != m_to.m_devs[j]) {
+            ev = change_event::modified; // replaced
+        } else {
+            if (ft != file_type::directory && content_differs(i, j)) {
+                ev |= change_event::content_modified;
+            }
+            if ((m_from.m_modes[i] & perms_mask) != (m_to.m_modes[j] & perms_mask)) {
+                ev |= change_event::metadata_modified;
+            }
+        }
+        if (ev != change_event::none) {
+            emit(batch, to_path(j), path{}, ev, ft);
+        }
+    }
+
+    void join(size_type fbegin, size_type fend, size_type tbegin, size_type tend, change_notifications& batch) {
+        index_list removed, created;
+        auto i = fbegin;
+        auto j = tbegin;
+        while (i < fend && j < tend) {
+            const auto r = compare(i, j);
+            if (r < 0) {
+                removed.push_back(i++);
+            } else if (r > 0) {
+                created.push_back(j++);
+            } else {
+                compare_entry(i++, j++, batch);
+            }
+        }
+        for (; i < fend; ++i) {
+            removed.push_back(i);
+        }
+        for (; j < tend; ++j) {
+            created.push_back(j);
+        }
+
+        std::lock_guard<std::mutex> lg{m_lock};
+        m_removed.insert(m_removed.end(), removed.begin(), removed.end());
+        m_created.insert(m_created.end(), created.begin(), created.end());
+    }
+
+    void work(size_t nranges) {
+        const auto range_size = std::numeric_limits<tree_manifest::hash_type>::max() / nranges;
+        change_notifications batch;
+        try {
+            for (auto r = m_next_range++; r < nranges && !m_canceled; r = m_next_range++) {
+                size_type fbegin = 0, tbegin = 0;
+                size_type fend = m_from.size(), tend = m_to.size();
+                if (r > 0) {
+                    const auto h = range_size * r;
+                    fbegin = static_cast<size_type>(std::lower_bound(m_from.m_hashes.begin(), m_from.m_hashes.end(), h) - m_from.m_hashes.begin());
+                    tbegin = static_cast<size_type>(std::lower_bound(m_to.m_hashes.begin(), m_to.m_hashes.end(), h) - m_to.m_hashes.begin());
+                }
+                if (r + 1 < nranges) {
+                    const auto h = range_size * (r + 1);
+                    fend = static_cast<size_type>(std::lower_bound(m_from.m_hashes.begin(), m_from.m_hashes.end(), h) - m_from.m_hashes.begin());
+                    tend = static_cast<size_type>(std::lower_bound(m_to.m_hashes.begin(), m_to.m_hashes.end(), h) - m_to.m_hashes.begin());
+                }
+                join(fbegin, fend, tbegin, tend, batch);
+            }
+            flush(batch);
+        } catch (...) {
+            std::lock_guard<std::mutex> lg{m_lock};
+            if (!m_error) {
+                m_error = std::current_exception();
+            }
+            m_canceled = true;
+        }
+    }
+
+    // Inodes are reused, so a new file may have the inode of a removed one. A rename doesn't change the mtime of a file.
+    // The mtime of a directory may change when moved to another parent, so the inode alone is used.
+    bool is_rename(size_type i, size_type j) const noexcept {
+        const auto ft = m_to.type(j);
+        return m_from.type(i) == ft && (ft == file_type::directory || m_from.m_mtimes[i] == m_to.m_mtimes[j]);
+    }
+
+    // A renamed directory implies the rename of all its descendants.
+    static bool implied(const std::string& from, const std::string& to, const std::unordered_map<std::string, std::string>& dirs) {
+        for (auto sep = from.rfind('/'); sep != std::string::npos && sep > 0; sep = from.rfind('/', sep - 1)) {
+            auto d = dirs.find(from.substr(0, sep));
+            if (d != dirs.end()) {
+                return to.size() > d->second.size() && 0 == to.compare(0, d->second.size(), d->second)
+                    && 0 == to.compare(d->second.size(), std::string::npos, from, sep, std::string::npos);
+            }
+        }
+        return false;
+    }
+
+    std::string from_name(size_type i) const {
+        return std::string{m_from.name(i), m_from.name_size(i)};
+    }
+
+    std::string to_name(size_type j) const {
+        return std::string{m_to.name(j), m_to.name_size(j)};
+    }
+
+    void match_renames() {
+        change_notifications batch;
+        std::unordered_map<inode_key, size_type, inode_hash> removed;
+        removed.reserve(m_removed.size());
+        for (auto i : m_removed) {
+            removed.emplace(inode_key{m_from.m_devs[i], m_from.m_inodes[i]}, i);
+        }
+
+        std::vector<std::pair<size_type, size_type>> renames;
+        std::unordered_map<std::string, std::string> renamed_dirs;
+        std::vector<bool> matched(m_from.size());
+        for (auto j : m_created) {
+            auto r = removed.find(inode_key{m_to.m_devs[j], m_to.m_inodes[j]});
+            if (r != removed.end() && is_rename(r->second, j)) {
+                const auto i = r->second;
+                matched[i] = true;
+                renames.emplace_back(i, j);
+                if (m_to.type(j) == file_type::directory) {
+                    renamed_dirs.emplace(from_name(i), to_name(j));
+                }
+                removed.erase(r);
+            } else {
+                emit(batch, to_path(j), path{}, change_event::created, m_to.type(j));
+            }
+        }
+
+        for (const auto& r : renames) {
+            if (!renamed_dirs.empty() && implied(from_name(r.first), to_name(r.second), renamed_dirs)) {
+                continue;
+            }
+            emit(batch, from_path(r.first), to_path(r.second), change_event::renamed, m_to.type(r.second));
+        }
+
+        for (auto i : m_removed) {
+            if (!matched[i]) {
+                emit(batch, from_path(i), path{}, change_event::removed, m_from.type(i));
+            }
+        }
+        flush(batch);
+    }
+
+public:
+    manifest_differ(const tree_manifest& from, const tree_manifest& to, const change_callback& cb, size_t batch_size)
+        : m_from(from)
+        , m_to(to)
+        , m_cb(cb)
+        , m_batch_size(std::max(batch_size, size_t{1})) {}
+    PS_DISABLE_COPY(manifest_differ);
+    PS_DISABLE_MOVE(manifest_differ);
+
+    void run(unsigned nthreads) {
+        // Not worth the thread overhead for small trees.
+        constexpr size_t min_entries_per_thread = 4096;
+        const auto entries = std::max(m_from.size(), m_to.size());
+        nthreads = static_cast<unsigned>(std::min<size_t>(nthreads, std::max<size_t>(entries / min_entries_per_thread, 1)));
+        const auto nranges = nthreads > 1 ? size_t{nthreads} * 4 : 1;
+
+        std::vector<std::thread> workers;
+        try {
+            for (unsigned t = 1; t < nthreads; ++t) {
+                workers.emplace_back(&manifest_differ::work, this, nranges);
+            }
+        } catch (...) {
+            // The calling thread will process the remaining ranges.
+        }
+        work(nranges);
+        for (auto& t : workers) {
+            t.join();
+        }
+
+        if (!m_error) {
+            try {
+                match_renames();
+            } catch (...) {
+                m_error = std::current_exception();
+            }
+        }
+        if (m_error) {
+            std::rethrow_exception(m_error);
+        }
+    }
+};
+
+void diff(const tree_manifest& from, const tree_manifest& to, const manifest_diff_config& cfg, const change_callback& cb) {
+    const auto nthreads = cfg.threads ? cfg.threads : std::max(std::thread::hardware_concurrency(), 1U);
+    manifest_differ d{from, to, cb, cfg.batch_size};
+    d.run(nthreads);
+}
+
+change_notifications diff(const tree_manifest& from, const tree_manifest& to) {
+    change_notifications notes;
+    diff(from, to, [&notes](change_notifications&& batch) {
+        std::move(batch.begin(), batch.end(), std::back_inserter(notes));
+    });
+    return notes;
+}
+
+} // v1
+} // filesystem
+} // prosoft
@@ -0,0 +1,506 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <prosoft/core/config/config.h>
+
+#include "fsconfig.h"
+
+#if !_WIN32
+#include <sys/errno.h>
+#if __linux__ || __APPLE__
+#include <sys/xattr.h>
+#endif
+#endif
+
+#include <algorithm>
+#include <cstring>
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_xattr.hpp>
+#include "filesystem_private.hpp"
+
+#ifndef ENOATTR
+#define ENOATTR ENODATA
+#endif
+
+namespace {
+
+using namespace prosoft::filesystem;
+
+inline error_code not_supported() {
+    return error_code{
+#if !_WIN32
+        ENOTSUP,
+#else
+        ERROR_NOT_SUPPORTED,
+#endif
+        filesystem_category()};
+}
+
+#if __linux__ || __APPLE__
+struct path_ops {
+    const char* p;
+    
+    ssize_t list(char* buf, size_t sz) const {
+#if __APPLE__
+        return ::listxattr(p, buf, sz, 0);
+#else
+        return ::listxattr(p, buf, sz);
+#endif
+    }
+    
+    ssize_t get(const char* name, void* buf, size_t sz) const {
+#if __APPLE__
+        return ::getxattr(p, name, buf, sz, 0, 0);
+#else
+        return ::getxattr(p, name, buf, sz);
+#endif
+    }
+    
+    int set(const char* name, const void* buf, size_t sz) const {
+#if __APPLE__
+        return ::setxattr(p, name, buf, sz, 0, 0);
+#else
+        return ::setxattr(p, name, buf, sz, 0);
+#endif
+    }
+    
+    int remove(const char* name) const {
+#if __APPLE__
+        return ::removexattr(p, name, 0);
+#else
+        return ::removexattr(p, name);
+#endif
+    }
+};
+
+struct fd_ops {
+    int fd;
+    
+    ssize_t list(char* buf, size_t sz) const {
+#if __APPLE__
+        return ::flistxattr(fd, buf, sz, 0);
+#else
+        return ::flistxattr(fd, buf, sz);
+#endif
+    }
+    
+    ssize_t get(const char* name, void* buf, size_t sz) const {
+#if __APPLE__
+        return ::fgetxattr(fd, name, buf, sz, 0, 0);
+#else
+        return ::fgetxattr(fd, name, buf, sz);
+#endif
+    }
+    
+    int set(const char* name, const void* buf, size_t sz) const {
+#if __APPLE__
+        return ::fsetxattr(fd, name, buf, sz, 0, 0);
+#else
+        return ::fsetxattr(fd, name, buf, sz, 0);
+#endif
+    }
+    
+    int remove(const char* name) const {
+#if __APPLE__
+        return ::fremovexattr(fd, name, 0);
+#else
+        return ::fremovexattr(fd, name);
+#endif
+    }
+};
+
+// Reads a list or value that may change size between calls.
+template <class Op>
+ssize_t get_sized(std::vector<char>& buf, Op op) {
+    for (;;) {
+        auto n = op(nullptr, 0);
+        if (n <= 0) {
+            buf.clear();
+            return n;
+        }
+        buf.resize(static_cast<size_t>(n));
+        n = op(buf.data(), buf.size());
+        if (n >= 0 || ERANGE != errno) {
+            return n;
+        }
+    }
+}
+
+template <class Ops>
+std::vector<std::string> list_names(const Ops& ops, error_code& ec) {
+    ec.clear();
+    std::vector<char> names;
+    const auto n = get_sized(names, [&ops](char* buf, size_t sz) { return ops.list(buf, sz); });
+    if (n < 0) {
+        ifilesystem::system_error(ec);
+        return {};
+    }
+    
+    std::vector<std::string> l;
+    for (const char* name = names.data(); name < names.data() + n; name += std::strlen(name) + 1) {
+        l.emplace_back(name);
+    }
+    return l;
+}
+
+template <class Ops>
+std::string get_value(const Ops& ops, const std::string& name, error_code& ec) {
+    ec.clear();
+    std::vector<char> value;
+    const auto n = get_sized(value, [&ops, &name](char* buf, size_t sz) { return ops.get(name.c_str(), buf, sz); });
+    if (n < 0) {
+        ifilesystem::system_error(ec);
+        return {};
+    }
+    return std::string(value.data(), static_cast<size_t>(n));
+}
+
+template <class Ops>
+void set_value(const Ops& ops, const std::string& name, const void* value, size_t sz, error_code& ec) {
+    ec.clear();
+    if (0 != ops.set(name.c_str(), value, sz)) {
+        ifilesystem::system_error(ec);
+    }
+}
+
+template <class Ops>
+void remove_value(const Ops& ops, const std::string& name, error_code& ec) {
+    ec.clear();
+    if (0 != ops.remove(name.c_str())) {
+        ifilesystem::system_error(ec);
+    }
+}
+#endif // __linux__ || __APPLE__
+
+} // anon
+
+namespace prosoft {
+namespace filesystem {
+inline namespace v1 {
+
+namespace ifilesystem {
+
+struct xattr_reader {
+#if __linux__ || __APPLE__
+    // The names are listed at the front of the arena and each value is read directly into the space after them.
+    // A value that doesn't fit grows the arena and is read again, so most values take a single call.
+    template <class Ops>
+    static xattr_set read(const Ops& ops, error_code& ec) {
+        ec.clear();
+        constexpr size_t min_value_space = 4096;
+        xattr_set xs;
+        auto& data = xs.m_data;
+        const auto n = get_sized(data, [&ops](char* buf, size_t sz) { return ops.list(buf, sz); });
+        if (n <= 0) {
+            if (n < 0) {
+                system_error(ec);
+            }
+            return xs;
+        }
+        
+        struct offsets {
+            size_t name;
+            size_t value;
+            size_t size;
+        };
+        std::vector<offsets> found;
+        auto next = static_cast<size_t>(n);
+        data.resize(next + std::max(next, min_value_space));
+        for (size_t name = 0; name < static_cast<size_t>(n); name += std::strlen(data.data() + name) + 1) {
+            for (;;) {
+                if (next == data.size()) { // a 0 size read returns the value size
+                    data.resize(data.size() * 2);
+                }
+                const auto vn = ops.get(data.data() + name, data.data() + next, data.size() - next);
+                if (vn >= 0) {
+                    found.push_back({name, next, static_cast<size_t>(vn)});
+                    next += static_cast<size_t>(vn);
+                    break;
+                }
+                if (ENOATTR == errno) { // removed since listed
+                    break;
+                }
+                if (ERANGE != errno) {
+                    system_error(ec);
+                    return xattr_set{};
+                }
+                const auto sz = ops.get(data.data() + name, nullptr, 0);
+                if (sz < 0) {
+                    if (ENOATTR == errno) {
+                        break;
+                    }
+                    system_error(ec);
+                    return xattr_set{};
+                }
+                data.resize(std::max(next + static_cast<size_t>(sz), data.size() * 2));
+            }
+        }
+        data.resize(next);
+        
+        xs.m_entries.reserve(found.size());
+        for (const auto& o : found) {
+            xs.m_entries.push_back({data.data() + o.name, data.data() + o.value, o.size});
+        }
+        return xs;
+    }
+#endif
+};
+
+} // ifilesystem
+
+const xattr_set::entry* xattr_set::find(const char* name) const noexcept {
+    const auto i = std::find_if(m_entries.begin(), m_entries.end(), [name](const entry& e) {
+        return 0 == std::strcmp(e.name, name);
+    });
+    return i != m_entries.end() ? &*i : nullptr;
+}
+
+std::vector<std::string> list_xattrs(const path& p) {
+    error_code ec;
+    auto l = list_xattrs(p, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not list extended attributes", p, ec));
+    return l;
+}
+
+std::vector<std::string> list_xattrs(const path& p, error_code& ec) {
+#if __linux__ || __APPLE__
+    return list_names(path_ops{p.c_str()}, ec);
+#else
+    (void)p;
+    ec = not_supported();
+    return {};
+#endif
+}
+
+std::string get_xattr(const path& p, const std::string& name) {
+    error_code ec;
+    auto v = get_xattr(p, name, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not get extended attribute", p, ec));
+    return v;
+}
+
+std::string get_xattr(const path& p, const std::string& name, error_code& ec) {
+#if __linux__ || __APPLE__
+    return get_value(path_ops{p.c_str()}, name, ec);
+#else
+    (void)p;
+    (void)name;
+    ec = not_supported();
+    return {};
+#endif
+}
+
+void set_xattr(const path& p, const std::string& name, const void* value, size_t size) {
+    error_code ec;
+    set_xattr(p, name, value, size, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not set extended attribute", p, ec));
+}
+
+void set_xattr(const path& p, const std::string& name, const void* value, size_t size, error_code& ec) {
+#if __linux__ || __APPLE__
+    set_value(path_ops{p.c_str()}, name, value, size, ec);
+#else
+    (void)p;
+    (void)name;
+    (void)value;
+    (void)size;
+    ec = not_supported();
+#endif
+}
+
+void remove_xattr(const path& p, const std::string& name) {
+    error_code ec;
+    remove_xattr(p, name, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not remove extended attribute", p, ec));
+}
+
+void remove_xattr(const path& p, const std::string& name, error_code& ec) {
+#if __linux__ || __APPLE__
+    remove_value(path_ops{p.c_str()}, name, ec);
+#else
+    (void)p;
+    (void)name;
+    ec = not_supported();
+#endif
+}
+
+xattr_set get_xattrs(const path& p) {
+    error_code ec;
+    auto xs = get_xattrs(p, ec);
+    PS_THROW_IF(ec.value(), filesystem_error("Could not get extended attributes", p, ec));
+    return xs;
+}
+
+xattr_set get_xattrs(const path& p, error_code& ec) {
+#if __linux__ || __APPLE__
+    return ifilesystem::xattr_reader::read(path_ops{p.c_str()}, ec);
+#else
+    (void)p;
+    ec = not_supported();
+    return {};
+#endif
+}
+
+#if !_WIN32
+std::vector<std::string> list_xattrs(int fd, error_code& ec) {
+#if __linux__ || __APPLE__
+    return list_names(fd_ops{fd}, ec);
+#else
+    (void)fd;
+    ec = not_supported();
+    return {};
+#endif
+}
+
+std::string get_xattr(int fd, const std::string& name, error_code& ec) {
+#if __linux__ || __APPLE__
+    return get_value(fd_ops{fd}, name, ec);
+#else
+    (void)fd;
+    (void)name;
+    ec = not_supported();
+    return {};
+#endif
+}
+
+void set_xattr(int fd, const std::string& name, const void* value, size_t size, error_code& ec) {
+#if __linux__ || __APPLE__
+    set_value(fd_ops{fd}, name, value, size, ec);
+#else
+    (void)fd;
+    (void)name;
+    (void)value;
+    (void)size;
+    ec = not_supported();
+#endif
+}
+
+void remove_xattr(int fd, const std::string& name, error_code& ec) {
+#if __linux__ || __APPLE__
+    remove_value(fd_ops{fd}, name, ec);
+#else
+    (void)fd;
+    (void)name;
+    ec = not_supported();
+#endif
+}
+
+xattr_set get_xattrs(int fd, error_code& ec) {
+#if __linux__ || __APPLE__
+    return ifilesystem::xattr_reader::read(fd_ops{fd}, ec);
+#else
+    (void)fd;
+    ec = not_supported();
+    return {};
+#endif
+}
+#endif // !_WIN32
+
+} // v1
+} // filesystem
+} // prosoft
+
+#if PSTEST_HARNESS && (__linux__ || __APPLE__)
+// Internal tests.
+#include <map>
+#include <catch2/catch_test_macros.hpp>
+
+namespace {
+
+struct test_ops {
+    std::map<std::string, std::string> m_attrs;
+    mutable int m_gets = 0;
+    
+    ssize_t list(char* buf, size_t sz) const {
+        std::string names;
+        for (const auto& a : m_attrs) {
+            names.append(a.first.c_str(), a.first.size() + 1);
+        }
+        if (sz > 0) {
+            if (sz < names.size()) {
+                errno = ERANGE;
+                return -1;
+            }
+            std::memcpy(buf, names.data(), names.size());
+        }
+        return static_cast<ssize_t>(names.size());
+    }
+    
+    ssize_t get(const char* name, void* buf, size_t sz) const {
+        ++m_gets;
+        const auto i = m_attrs.find(name);
+        if (i == m_attrs.end()) {
+            errno = ENOATTR;
+            return -1;
+        }
+        if (sz > 0) {
+            if (sz < i->second.size()) {
+                errno = ERANGE;
+                return -1;
+            }
+            std::memcpy(buf, i->second.data(), i->second.size());
+        }
+        return static_cast<ssize_t>(i->second.size());
+    }
+};
+
+} // anon
+
+TEST_CASE("xattr_internal") {
+    using namespace prosoft::filesystem;
+    
+    test_ops ops;
+    error_code ec;
+    
+    WHEN("there are no attributes") {
+        const auto xs = ifilesystem::xattr_reader::read(ops, ec);
+        CHECK_FALSE(ec.value());
+        CHECK(xs.empty());
+    }
+    
+    WHEN("values fit the arena") {
+        ops.m_attrs = {{"a", "1"}, {"b", ""}, {"c", std::string(100, 'c')}};
+        const auto xs = ifilesystem::xattr_reader::read(ops, ec);
+        CHECK_FALSE(ec.value());
+        REQUIRE(xs.size() == 3);
+        CHECK(ops.m_gets == 3);
+        for (const auto& x : xs) {
+            CHECK(std::string(x.value, x.size) == ops.m_attrs[x.name]);
+        }
+    }
+    
+    WHEN("values are larger than the arena") {
+        ops.m_attrs = {{"a", std::string(5000, 'a')}, {"b", "2"}, {"c", std::string(20000, 'c')}};
+        const auto xs = ifilesystem::xattr_reader::read(ops, ec);
+        CHECK_FALSE(ec.value());
+        REQUIRE(xs.size() == 3);
+        CHECK(ops.m_gets == 7); // a and c are sized and read again
+        for (const auto& x : xs) {
+            CHECK(std::string(x.value, x.size) == ops.m_attrs[x.name]);
+        }
+    }
+}
+#endif // PSTEST_HARNESS
@@ -0,0 +1,160 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <prosoft/core/config/config_platform.h>
+
+#include <algorithm>
+#include <mutex>
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_async_iterator.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+#include <fstestutils.hpp>
+
+using namespace prosoft;
+using namespace prosoft::filesystem;
+
+namespace {
+
+struct collector {
+    std::mutex lock;
+    std::vector<path> paths;
+    size_t batches = 0;
+    error_code result;
+    bool completed = false;
+
+    async_entries_callback entries() {
+        return [this](directory_entries&& ents) {
+            std::lock_guard<std::mutex> lg{lock};
+            ++batches;
+            for (const auto& e : ents) {
+                paths.push_back(e.path());
+            }
+        };
+    }
+
+    async_completion_callback completion() {
+        return [this](const error_code& ec) {
+            std::lock_guard<std::mutex> lg{lock};
+            CHECK_FALSE(completed);
+            completed = true;
+            result = ec;
+        };
+    }
+};
+
+} // anon
+
+TEST_CASE("filesystem_async_iterator") {
+    WHEN("args are invalid") {
+        collector c;
+        CHECK_THROWS(iterate_async(path{}, c.entries(), c.completion()));
+        CHECK_THROWS(iterate_async(temp_directory_path(), async_entries_callback{}, c.completion()));
+        CHECK_THROWS(iterate_async(temp_directory_path(), c.entries(), async_completion_callback{}));
+    }
+
+    WHEN("the root does not exist") {
+        collector c;
+        auto i = iterate_async(temp_directory_path() / process_name("fs17async"), c.entries(), c.completion());
+        REQUIRE(i);
+        i->wait();
+        CHECK(i->done());
+        CHECK(c.completed);
+        CHECK(c.result);
+        CHECK(c.paths.empty());
+    }
+
+    SECTION("iterating a tree") {
+        const auto root = canonical(temp_directory_path()) / process_name("fs17async");
+        REQUIRE(create_directory(root));
+        PS_RAII_REMOVE(root);
+        const auto d1 = root / PS_TEXT("d1");
+        REQUIRE(create_directory(d1));
+        PS_RAII_REMOVE(d1);
+        const auto d2 = d1 / PS_TEXT("d2");
+        REQUIRE(create_directory(d2));
+        PS_RAII_REMOVE(d2);
+        const auto f1 = create_file(root / PS_TEXT("f1"));
+        PS_RAII_REMOVE(f1);
+        const auto f2 = create_file(d1 / PS_TEXT("f2"));
+        PS_RAII_REMOVE(f2);
+        const auto f3 = create_file(d2 / PS_TEXT("f3"));
+        PS_RAII_REMOVE(f3);
+
+        WHEN("recursion is enabled") {
+            std::vector<path> expected;
+            for (auto& e : recursive_directory_iterator{root}) {
+                expected.push_back(e.path());
+            }
+            REQUIRE(expected.size() == 5);
+
+            collector c;
+            async_iterator_config cfg;
+            cfg.batch_size = 2;
+            auto i = iterate_async(root, directory_options::none, cfg, c.entries(), c.completion());
+            REQUIRE(i);
+            i->wait();
+            CHECK(i->done());
+            CHECK(c.completed);
+            CHECK_FALSE(c.result);
+            CHECK(c.batches >= 3);
+            std::sort(expected.begin(), expected.end());
+            std::sort(c.paths.begin(), c.paths.end());
+            CHECK(c.paths == expected);
+        }
+
+        WHEN("recursion is disabled") {
+            collector c;
+            auto i = iterate_async(root, directory_options::skip_subdirectory_descendants, async_iterator_config{}, c.entries(), c.completion());
+            REQUIRE(i);
+            i->wait();
+            CHECK_FALSE(c.result);
+            std::sort(c.paths.begin(), c.paths.end());
+            CHECK(c.paths == (std::vector<path>{d1, f1}));
+        }
+
+        WHEN("a callback cancels") {
+            collector c;
+            async_iterator_config cfg;
+            cfg.batch_size = 1;
+            cfg.threads = 1;
+            async_iteration_ptr i;
+            std::mutex ilock;
+            {
+                std::lock_guard<std::mutex> lg{ilock};
+                i = iterate_async(root, directory_options::none, cfg, [&](directory_entries&&) {
+                    std::lock_guard<std::mutex> lg2{ilock};
+                    ++c.batches;
+                    i->cancel();
+                }, c.completion());
+                REQUIRE(i);
+            }
+            i->wait();
+            CHECK(c.batches == 1);
+            CHECK(c.result.value() == ECANCELED);
+        }
+    }
+}
@@ -0,0 +1,276 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <prosoft/core/config/config_platform.h>
+
+#if !_WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_batch.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+#include <fstestutils.hpp>
+
+using namespace prosoft;
+using namespace prosoft::filesystem;
+
+namespace {
+
+void check_status(const std::vector<path>& paths, bool link, const batch_config& cfg) {
+    std::vector<file_status> results(paths.size());
+    std::vector<error_code> ecs(paths.size());
+    if (link) {
+        batch_symlink_status(paths.data(), paths.size(), status_info::all, results.data(), ecs.data(), cfg);
+    } else {
+        batch_status(paths.data(), paths.size(), status_info::all, results.data(), ecs.data(), cfg);
+    }
+    for (size_t i = 0; i < paths.size(); ++i) {
+        error_code ec;
+        const auto st = link ? symlink_status(paths[i], status_info::all, ec) : status(paths[i], status_info::all, ec);
+        CHECK(ecs[i] == ec);
+        CHECK(results[i].type() == st.type());
+        CHECK(results[i].permissions() == st.permissions());
+        CHECK(results[i].size() == st.size());
+        CHECK(results[i].times().modified() == st.times().modified());
+    }
+}
+
+} // anon
+
+TEST_CASE("filesystem_batch") {
+    WHEN("the batch is empty") {
+        std::vector<error_code> ecs;
+        CHECK(batch_status(std::vector<path>{}, status_info::all, ecs).empty());
+        CHECK(ecs.empty());
+    }
+
+    SECTION("batch status") {
+        const auto root = canonical(temp_directory_path()) / process_name("fs17batch");
+        REQUIRE(create_directory(root));
+        PS_RAII_REMOVE(root);
+
+        std::vector<path> paths;
+        for (int i = 0; i < 40; ++i) {
+            paths.push_back(create_file(root / path{std::to_string(i)}, std::ios::binary|std::ios::out));
+            if (i % 4 == 0) {
+                paths.push_back(root / path{std::to_string(i) + "_missing"});
+            }
+        }
+        paths.push_back(root);
+        const auto link = root / PS_TEXT("link");
+        create_symlink(paths[0], link);
+        paths.push_back(link);
+
+        batch_config threaded;
+        threaded.use_threads = true;
+        threaded.threads = 3;
+
+        WHEN("following links") {
+            check_status(paths, false, batch_config{});
+            check_status(paths, false, threaded);
+        }
+
+        WHEN("not following links") {
+            check_status(paths, true, batch_config{});
+            check_status(paths, true, threaded);
+        }
+
+        WHEN("the batch is small") {
+            std::vector<error_code> ecs;
+            auto results = batch_status(std::vector<path>{paths[0], root / PS_TEXT("missing")}, status_info::basic, ecs);
+            REQUIRE(results.size() == 2);
+            CHECK(is_regular_file(results[0]));
+            CHECK_FALSE(ecs[0]);
+            CHECK(results[1].type() == file_type::not_found);
+            CHECK(ecs[1]);
+        }
+
+#if !_WIN32
+        WHEN("opening files") {
+            for (const auto& cfg : {batch_config{}, threaded}) {
+                std::vector<int> fds(paths.size(), -1);
+                std::vector<error_code> ecs(paths.size());
+                batch_open(paths.data(), paths.size(), O_RDONLY, fds.data(), ecs.data(), cfg);
+                for (size_t i = 0; i < paths.size(); ++i) {
+                    error_code ec;
+                    const bool found = exists(paths[i], ec);
+                    CHECK((fds[i] >= 0) == found);
+                    CHECK(bool(ecs[i]) == !found);
+                    if (fds[i] >= 0) {
+                        CHECK((::fcntl(fds[i], F_GETFD) & FD_CLOEXEC));
+                        ::close(fds[i]);
+                    }
+                }
+            }
+        }
+#endif
+
+        for (const auto& p : paths) {
+            if (p != root) {
+                error_code ec;
+                remove(p, ec);
+            }
+        }
+    }
+}
+
+TEST_CASE("batch_remove_all") {
+    GIVEN("a tree") {
+        const auto root = temp_directory_path() / process_name("fs17test");
+        error_code ec;
+        REQUIRE_FALSE(exists(root, ec));
+
+        // Budgets: descriptors for all dirs, for none (removal by path) and the default.
+        batch_config cfg;
+        cfg.threads = 4;
+        for (unsigned max_open : {1024U, 1U, 0U}) {
+            std::uintmax_t count = 1;
+            for (int i = 0; i < 8; ++i) {
+                auto d = root / path{std::to_string(i)};
+                for (int depth = 0; depth < 4; ++depth, d /= PS_TEXT("d")) {
+                    REQUIRE(create_directories(d));
+                    for (int f = 0; f < 5; ++f) {
+                        create_file(d / path{std::to_string(f)});
+                    }
+                    count += 6;
+                }
+            }
+            create_symlink(root / PS_TEXT("0"), root / PS_TEXT("link"));
+            ++count;
+
+            cfg.max_open = max_open;
+            CHECK(remove_all(root, cfg, ec) == count);
+            CHECK_FALSE(ec);
+            CHECK_FALSE(exists(root, ec));
+        }
+
+        CHECK(remove_all(root, cfg) == 0);
+        create_file(root);
+        CHECK(remove_all(root, cfg) == 1);
+        CHECK_FALSE(exists(root, ec));
+    }
+}
+
+#if !_WIN32
+TEST_CASE("batch_clone_metadata") {
+    GIVEN("two trees") {
+        const auto from = temp_directory_path() / process_name("fs17test");
+        const auto to = temp_directory_path() / process_name("fs17test2");
+        error_code ec;
+        REQUIRE_FALSE(exists(from, ec));
+        REQUIRE_FALSE(exists(to, ec));
+
+        std::vector<path> entries;
+        for (int i = 0; i < 4; ++i) {
+            const auto d = path{std::to_string(i)} / PS_TEXT("d");
+            REQUIRE(create_directories(from / d));
+            REQUIRE(create_directories(to / d));
+            entries.push_back(d.parent_path());
+            entries.push_back(d);
+            for (int f = 0; f < 5; ++f) {
+                const auto fp = d / path{std::to_string(f)};
+                create_file(from / fp);
+                create_file(to / fp);
+                entries.push_back(fp);
+            }
+        }
+        create_file(from / PS_TEXT("missing"));
+
+        const auto t = last_write_time(from) - std::chrono::hours{24};
+        for (const auto& e : entries) {
+            REQUIRE(0 == ::chmod((from / e).c_str(), is_directory(from / e) ? 0750 : 0640));
+            last_write_time(from / e, t);
+        }
+        last_write_time(from, t);
+
+        batch_config cfg;
+        cfg.threads = 3;
+
+        WHEN("cloning the perms") {
+            CHECK(clone_metadata(from, to, metadata_options::perms, cfg) == entries.size());
+            for (const auto& e : entries) {
+                CHECK(status(to / e).permissions() == status(from / e).permissions());
+                CHECK(last_write_time(to / e) != t);
+            }
+            CHECK(clone_metadata(from, to, metadata_options::perms, cfg) == 0);
+        }
+
+        WHEN("cloning everything") {
+            CHECK(clone_metadata(from, to, metadata_options::all, cfg, ec) == entries.size() + 1);
+            CHECK_FALSE(ec);
+            for (const auto& e : entries) {
+                CHECK(status(to / e).permissions() == status(from / e).permissions());
+                CHECK(last_write_time(to / e) == t);
+            }
+            CHECK(last_write_time(to) == t);
+            CHECK_FALSE(exists(to / PS_TEXT("missing"), ec));
+            CHECK(clone_metadata(from, to, metadata_options::all, cfg) == 0);
+        }
+
+        WHEN("a file can't be read") {
+            const auto f = entries.back();
+            REQUIRE(0 == ::chmod((from / f).c_str(), 0200));
+            // Root can open anything, so the trees are handed to another user.
+            const bool root = 0 == ::geteuid();
+            constexpr uid_t nobody = 65534;
+            if (root) {
+                for (const auto& e : entries) {
+                    REQUIRE(0 == ::lchown((from / e).c_str(), nobody, nobody));
+                    REQUIRE(0 == ::lchown((to / e).c_str(), nobody, nobody));
+                }
+                REQUIRE(0 == ::lchown(from.c_str(), nobody, nobody));
+                REQUIRE(0 == ::lchown(to.c_str(), nobody, nobody));
+                REQUIRE(0 == ::seteuid(nobody));
+            }
+            const auto n = clone_metadata(from, to, metadata_options::perms|metadata_options::acl, cfg, ec);
+            if (root) {
+                REQUIRE(0 == ::seteuid(0));
+            }
+            CHECK_FALSE(ec);
+            CHECK(n == entries.size());
+            CHECK(status(to / f).permissions() == perms::owner_write);
+        }
+
+        WHEN("cloning a file") {
+            const auto f = entries.back();
+            CHECK(clone_metadata(from / f, to / PS_TEXT("0") / PS_TEXT("d") / PS_TEXT("0"), metadata_options::times) == 1);
+            CHECK(last_write_time(to / PS_TEXT("0") / PS_TEXT("d") / PS_TEXT("0")) == t);
+        }
+
+        WHEN("the types differ") {
+            CHECK_THROWS(clone_metadata(from / entries[0], to / entries[2], metadata_options::all));
+            CHECK(clone_metadata(to, from / PS_TEXT("nope"), metadata_options::all, cfg, ec) == static_cast<std::uintmax_t>(-1));
+            CHECK(ec);
+        }
+
+        CHECK(remove_all(from) > 0);
+        CHECK(remove_all(to) > 0);
+    }
+}
+#endif
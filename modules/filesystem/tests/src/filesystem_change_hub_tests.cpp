@@ -0,0 +1,172 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include <prosoft/core/config/config_platform.h>
+
+#include <algorithm>
+#include <mutex>
+#include <thread>
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_change_hub.hpp>
+
+#if PS_HAVE_RECURISIVE_FILESYSTEM_CHANGE_MONITOR
+
+#include <catch2/catch_test_macros.hpp>
+#include <fstestutils.hpp>
+
+using namespace prosoft;
+using namespace prosoft::filesystem;
+
+namespace {
+
+class collector {
+    mutable std::mutex m_lock;
+    change_notifications m_notes;
+public:
+    change_callback callback() {
+        return [this](change_notifications&& n) {
+            std::lock_guard<std::mutex> lg{m_lock};
+            m_notes.insert(m_notes.end(), n.begin(), n.end());
+        };
+    }
+    
+    change_notifications notes() const {
+        std::lock_guard<std::mutex> lg{m_lock};
+        return m_notes;
+    }
+    
+    size_t count(const path& p) const {
+        std::lock_guard<std::mutex> lg{m_lock};
+        return static_cast<size_t>(std::count_if(m_notes.begin(), m_notes.end(), [&p](const change_notification& n) {
+            return n.path() == p;
+        }));
+    }
+};
+
+} // anon
+
+TEST_CASE("filesystem_change_hub") {
+    WHEN("args are invalid") {
+        change_hub hub;
+        error_code ec;
+        CHECK_FALSE(hub.monitor(path{}, change_config{}, [](change_notifications&&){}, ec));
+        CHECK(ec);
+        CHECK_FALSE(hub.recursive_monitor(temp_directory_path(), change_config{}, change_callback{}, ec));
+        CHECK(ec);
+        CHECK_THROWS(hub.recursive_monitor(temp_directory_path() / process_name("fs17noexist"), change_config{}, [](change_notifications&&){}));
+        CHECK(hub.monitors() == 0);
+    }
+    
+    SECTION("shared monitor") {
+        const auto root = canonical(temp_directory_path()) / process_name("fs17test");
+        create_directory(root);
+        REQUIRE(exists(root));
+        PS_RAII_REMOVE(root);
+        const auto sub = root / PS_TEXT("a");
+        create_directory(sub);
+        PS_RAII_REMOVE(sub);
+        
+        change_config cfg;
+        cfg.notification_latency = change_config::latency_type{0};
+        constexpr auto sleep_duration = change_config::latency_type{300};
+        
+        change_hub hub;
+        collector rootc, subc, directc;
+        auto rootreg = hub.recursive_monitor(root, cfg, rootc.callback());
+        auto subreg = hub.recursive_monitor(sub, cfg, subc.callback());
+        auto directreg = hub.monitor(root, cfg, directc.callback());
+        CHECK(hub.monitors() == 1);
+        
+        const auto f1 = create_file(root / PS_TEXT("1"));
+        PS_RAII_REMOVE(f1);
+        const auto f2 = create_file(sub / PS_TEXT("2"));
+        PS_RAII_REMOVE(f2);
+        std::this_thread::sleep_for(sleep_duration);
+        
+        CHECK(rootc.count(f1) > 0);
+        CHECK(rootc.count(f2) > 0);
+        CHECK(subc.count(f1) == 0);
+        CHECK(subc.count(f2) > 0);
+        CHECK(directc.count(f1) > 0);
+        CHECK(directc.count(f2) == 0);
+        for (const auto& n : subc.notes()) {
+            CHECK(n == subreg);
+            CHECK_FALSE(n == rootreg);
+        }
+        
+        WHEN("a registration wants more events than the monitor") {
+            cfg.events = change_event::created;
+            auto createdreg = hub.recursive_monitor(sub, cfg, [](change_notifications&&){});
+            CHECK(hub.monitors() == 1);
+            
+            change_hub other;
+            auto narrow = other.recursive_monitor(root, cfg, [](change_notifications&&){});
+            cfg.events = change_event::all;
+            auto wide = other.recursive_monitor(sub, cfg, [](change_notifications&&){});
+            CHECK(other.monitors() == 2);
+            stop(createdreg);
+        }
+        
+        WHEN("a registration's events are masked") {
+            collector createdc;
+            cfg.events = change_event::created;
+            auto createdreg = hub.recursive_monitor(sub, cfg, createdc.callback());
+            REQUIRE(remove(f2));
+            create_file(f2);
+            std::this_thread::sleep_for(sleep_duration);
+            stop(createdreg);
+            
+            const auto notes = createdc.notes();
+            CHECK_FALSE(notes.empty());
+            for (const auto& n : notes) {
+                CHECK(n.event() == change_event::created);
+            }
+        }
+        
+        WHEN("a registered path is removed") {
+            REQUIRE(remove(f2));
+            REQUIRE(remove(sub));
+            std::this_thread::sleep_for(sleep_duration);
+            
+            const auto notes = subc.notes();
+            REQUIRE_FALSE(notes.empty());
+            CHECK(canceled(notes.back()));
+            CHECK(removed(notes.back()));
+            CHECK(notes.back().path() == sub);
+            CHECK_FALSE(canceled(rootc.notes().back()));
+            create_directory(sub);
+            create_file(f2);
+        }
+        
+        stop(subreg);
+        stop(directreg);
+        CHECK(hub.monitors() == 1);
+        stop(rootreg);
+        CHECK(hub.monitors() == 0);
+        CHECK_THROWS(stop(rootreg));
+    }
+}
+
+#endif // PS_HAVE_RECURISIVE_FILESYSTEM_CHANGE_MONITOR
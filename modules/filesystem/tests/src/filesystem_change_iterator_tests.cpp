@@ -108,6 +108,68 @@ TEST_CASE("filesystem_change_iterator") {
         
         rename(newroot, root); // rename back so we can cleanup
     }
+    
+    SECTION("polling") {
+        const auto root = canonical(temp_directory_path()) / process_name("fs17test");
+        create_directory(root);
+        REQUIRE(exists(root));
+        PS_RAII_REMOVE(root);
+        const auto subdir = root / PS_TEXT("2");
+        create_directory(subdir);
+        PS_RAII_REMOVE(subdir);
+        
+        config_type c{config_type::latency_type{0}}; // the minimum poll interval is used
+        CHECK(c.backend == change_monitor_backend::platform);
+        c.backend = change_monitor_backend::polling;
+        changed_directory_iterator i{root, traits_type::defaults, std::move(c)};
+        
+        const auto f1 = create_file(root / PS_TEXT("1"));
+        PS_RAII_REMOVE(f1);
+        const auto f2 = create_file(subdir / PS_TEXT("2"));
+        PS_RAII_REMOVE(f2);
+        
+        std::vector<path> paths;
+        int j{};
+        while (paths.size() < 2 && ++j < 100) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            for (auto& p : extract_paths(i)) {
+                paths.push_back(std::move(p));
+            }
+        }
+        CHECK_FALSE(canceled(i));
+        auto last = paths.end();
+        CHECK(last != std::find(paths.begin(), last, f1));
+        CHECK(last != std::find(paths.begin(), last, f2));
+    }
+    
+    SECTION("the consumer falls behind") {
+        const auto root = canonical(temp_directory_path()) / process_name("fs17test");
+        create_directory(root);
+        REQUIRE(exists(root));
+        PS_RAII_REMOVE(root);
+        
+        // The monitor collapses the events into a rescan, which ends the iterator.
+        config_type c{config_type::latency_type{200}};
+        c.max_pending = 2;
+        changed_directory_iterator i{root, traits_type::defaults, std::move(c)};
+        
+        std::vector<path> files;
+        for (int k = 0; k < 20; ++k) {
+            files.push_back(create_file(root / path{std::to_string(k)}));
+        }
+        
+        int j{};
+        while (!canceled(i) && ++j < 200) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        REQUIRE(canceled(i));
+        // The monitor is stopped, but what it counted is kept.
+        CHECK(counters(i).collapsed > 0);
+        
+        for (const auto& f : files) {
+            remove(f);
+        }
+    }
 }
 
 #endif // PS_HAVE_FILESYSTEM_CHANGE_ITERATOR
@@ -0,0 +1,139 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <prosoft/core/config/config_platform.h>
+
+#include <fstream>
+#include <iterator>
+
+#if !_WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_extents.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+#include <fstestutils.hpp>
+
+using namespace prosoft;
+using namespace prosoft::filesystem;
+
+namespace {
+
+std::string content(const path& p) {
+    std::ifstream f{p.c_str(), std::ios::binary};
+    return std::string{std::istreambuf_iterator<char>{f}, std::istreambuf_iterator<char>{}};
+}
+
+} // anon
+
+TEST_CASE("filesystem_extents") {
+    const auto root = canonical(temp_directory_path()) / process_name("fs17extents");
+    REQUIRE(create_directory(root));
+    PS_RAII_REMOVE(root);
+    const auto f = create_file(root / PS_TEXT("f"));
+    PS_RAII_REMOVE(f);
+    constexpr file_size_type mb = 1024 * 1024;
+    
+    WHEN("the file is empty") {
+        CHECK(file_extents(f).empty());
+    }
+    
+    WHEN("allocating a file") {
+        allocate(f, mb);
+        CHECK(file_size(f) == mb);
+        allocate(f, 10); // not truncated
+        CHECK(file_size(f) == mb);
+        CHECK(content(f) == std::string(mb, '\0'));
+        CHECK(data_size(file_extents(f)) <= mb);
+        
+        const auto g = root / PS_TEXT("g");
+        allocate(g, 10);
+        PS_RAII_REMOVE(g);
+        CHECK(file_size(g) == 10);
+    }
+    
+    WHEN("the path doesn't exist") {
+        error_code ec;
+        CHECK(file_extents(root / PS_TEXT("missing"), ec).empty());
+        CHECK(ec.value());
+        CHECK_THROWS(file_extents(root / PS_TEXT("missing")));
+        CHECK_THROWS(allocate(root / PS_TEXT("missing") / PS_TEXT("x"), 10));
+    }
+    
+#if !_WIN32
+    WHEN("a file has holes") {
+        const std::string data(4096, 'x');
+        const int wfd = ::open(f.c_str(), O_WRONLY);
+        REQUIRE(wfd >= 0);
+        CHECK(::pwrite(wfd, data.data(), data.size(), mb) == 4096);
+        CHECK(0 == ::ftruncate(wfd, 4 * mb));
+        ::close(wfd);
+        
+        const auto extents = file_extents(f);
+        REQUIRE_FALSE(extents.empty());
+        file_size_type end = 0;
+        bool found = false;
+        for (const auto& e : extents) {
+            CHECK(e.offset >= end); // sorted and disjoint
+            CHECK(e.length > 0);
+            end = e.offset + e.length;
+            CHECK(end <= 4 * mb);
+            found = found || (e.offset <= mb && end >= mb + data.size());
+        }
+        CHECK(found);
+        
+        struct ::stat sb;
+        REQUIRE(0 == ::stat(f.c_str(), &sb));
+        const bool sparse = sb.st_blocks * 512 < sb.st_size;
+        if (sparse) {
+            CHECK(data_size(extents) < 4 * mb);
+        }
+        
+        const int fd = ::open(f.c_str(), O_RDONLY);
+        REQUIRE(fd >= 0);
+        CHECK(::lseek(fd, 10, SEEK_SET) == 10);
+        error_code ec;
+        const auto fdextents = file_extents(fd, ec);
+        CHECK_FALSE(ec.value());
+        CHECK(fdextents.size() == extents.size());
+        CHECK(::lseek(fd, 0, SEEK_CUR) == 10);
+        ::close(fd);
+        
+        const auto t = root / PS_TEXT("t");
+        REQUIRE(copy_file(f, t));
+        PS_RAII_REMOVE(t);
+        CHECK(content(t) == content(f));
+        if (sparse) {
+            struct ::stat tsb;
+            REQUIRE(0 == ::stat(t.c_str(), &tsb));
+            CHECK(tsb.st_blocks * 512 < tsb.st_size);
+        }
+    }
+#endif
+}
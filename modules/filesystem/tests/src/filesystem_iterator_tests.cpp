@@ -274,6 +274,27 @@ TEST_CASE("filesystem_iterator") {
             }
 #endif
             
+            WHEN("a listing cache is used") {
+                auto cache = std::make_shared<directory_listing_cache>();
+                recursive_directory_iterator::configuration_type cfg;
+                cfg.listing_cache = cache;
+                recursive_directory_iterator i{root, recursive_directory_iterator::default_options(), std::move(cfg)};
+                
+                auto e = *i;
+                CHECK(e.path().filename().native() == PS_TEXT("1"));
+                CHECK(i.recursion_pending());
+                e = *i++;
+                CHECK(e.path().filename().native() == PS_TEXT("._2"));
+                CHECK(i.depth() == 1);
+                i++;
+                CHECK(i == end(i));
+            #if !_WIN32
+                CHECK(cache->misses() == 2);
+            #else
+                CHECK(cache->misses() == 0);
+            #endif
+            }
+            
             WHEN("skip hidden is enabled") {
                 recursive_directory_iterator i{root, recursive_directory_iterator::default_options()|directory_options::skip_hidden_descendants};
                 CHECK(i.depth() == 0);
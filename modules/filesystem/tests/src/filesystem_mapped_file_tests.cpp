@@ -0,0 +1,141 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <prosoft/core/config/config_platform.h>
+
+#include <fstream>
+#include <string>
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_mapped_file.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+#include <fstestutils.hpp>
+
+using namespace prosoft;
+using namespace prosoft::filesystem;
+
+TEST_CASE("filesystem_mapped_file") {
+    const auto root = canonical(temp_directory_path()) / process_name("fs17mapped");
+    REQUIRE(create_directory(root));
+    PS_RAII_REMOVE(root);
+    const auto f = root / PS_TEXT("f");
+    std::string content;
+    for (int i = 0; content.size() < 3 * mapped_file::granularity() + 100; ++i) {
+        content += std::to_string(i);
+        content += '\n';
+    }
+    {
+        std::ofstream stream(f.c_str(), std::ios::binary);
+        REQUIRE(stream);
+        stream << content;
+    }
+    PS_RAII_REMOVE(f);
+    
+    WHEN("mapping a whole file") {
+        mapped_file mf{f};
+        CHECK(mf.is_open());
+        CHECK(mf.size() == content.size());
+        CHECK(mf.mode() == map_mode::read_only);
+        const auto r = mf.map(0, 0, map_advice::sequential|map_advice::will_need|map_advice::large_pages);
+        REQUIRE(r.size() == content.size());
+        CHECK(r.offset() == 0);
+        CHECK(std::string(r.begin(), r.end()) == content);
+        
+        mf.close();
+        CHECK_FALSE(mf.is_open());
+        CHECK(std::string(r.data(), r.size()) == content); // still valid
+        error_code ec;
+        CHECK(mf.map(0, 0, map_advice::none, ec).empty());
+        CHECK(ec.value());
+    }
+    
+    WHEN("mapping windows") {
+        mapped_file mf{f};
+        const auto window = mapped_file::granularity();
+        mapped_region r;
+        std::string seen;
+        for (file_size_type off = 0; off < mf.size(); off += window) {
+            mf.remap(r, off, window, map_advice::sequential);
+            CHECK(r.offset() == off);
+            seen.append(r.data(), r.size());
+        }
+        CHECK(seen == content);
+        
+        // Unaligned
+        r = mf.map(7, 100);
+        CHECK(std::string(r.data(), r.size()) == content.substr(7, 100));
+        r = mf.map(mf.size() - 10, 100); // clipped
+        CHECK(r.size() == 10);
+        r = mf.map(mf.size());
+        CHECK(r.empty());
+        
+        error_code ec;
+        r = mf.map(mf.size() + 1, 0, map_advice::none, ec);
+        CHECK(ec.value());
+        CHECK(r.empty());
+        CHECK_THROWS(mf.map(mf.size() + 1));
+    }
+    
+    WHEN("mapping copy on write") {
+        mapped_file mf{f, map_mode::copy_on_write};
+        auto r = mf.map();
+        REQUIRE(r.size() == content.size());
+        r.data()[0] = 'x';
+        CHECK(r.data()[0] == 'x');
+        
+        mapped_file ro{f};
+        CHECK(ro.map(0, 1).data()[0] == content[0]);
+    }
+    
+    WHEN("moving") {
+        mapped_file mf{f};
+        auto r = mf.map(0, 10);
+        mapped_file mf2{std::move(mf)};
+        CHECK_FALSE(mf.is_open());
+        CHECK(mf2.is_open());
+        mapped_region r2{std::move(r)};
+        CHECK(r.empty());
+        CHECK(r2.size() == 10);
+        r2.unmap();
+        CHECK(r2.empty());
+    }
+    
+    WHEN("mapping an empty file") {
+        const auto e = create_file(root / PS_TEXT("e"));
+        PS_RAII_REMOVE(e);
+        mapped_file mf{e};
+        CHECK(mf.size() == 0);
+        CHECK(mf.map().empty());
+    }
+    
+    WHEN("opening a missing file") {
+        error_code ec;
+        mapped_file mf{root / PS_TEXT("missing"), map_mode::read_only, ec};
+        CHECK(ec.value());
+        CHECK_FALSE(mf.is_open());
+        CHECK_THROWS(mapped_file{root / PS_TEXT("missing")});
+    }
+}
@@ -32,6 +32,7 @@
 #include <thread>
 
 #include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_change_journal.hpp>
 #include <prosoft/core/modules/filesystem/filesystem_change_monitor.hpp>
 
 #if PS_HAVE_FILESYSTEM_CHANGE_MONITOR
@@ -57,8 +58,11 @@ TEST_CASE("filesystem_monitor") {
         
         change_config cfg;
         CHECK(cfg.state == nullptr);
+        CHECK(cfg.journal == nullptr);
         CHECK(cfg.notification_latency > change_config::latency_type());
         CHECK(cfg.events == change_event::all);
+        CHECK(cfg.backend == change_monitor_backend::platform);
+        CHECK_FALSE(cfg.coalesce_events);
     }
     
     WHEN("registration is invalid") {
@@ -89,6 +93,7 @@ TEST_CASE("filesystem_monitor") {
         CHECK_THROWS(stop(reg));
     }
     
+#if __APPLE__
     WHEN("serializing monitor state") {
         CHECK_THROWS(change_state::serialize(path()));
     
@@ -115,6 +120,19 @@ TEST_CASE("filesystem_monitor") {
             CHECK(state->serialize().empty());
         }
     }
+#else
+    WHEN("serializing monitor state") {
+        CHECK_THROWS(change_state::serialize(path()));
+        
+        // inotify has no event history
+        CHECK(change_state::serialize(path{"/"}).empty());
+        
+        auto state = change_state::serialize(std::string{});
+        CHECK(state->serialize() == "");
+        
+        CHECK_THROWS(change_state::serialize(std::string{"hello"}));
+    }
+#endif
     
     SECTION("recursive monitor") {
         const auto root = canonical(temp_directory_path()) / process_name("fs17test");
@@ -227,6 +245,37 @@ TEST_CASE("filesystem_monitor") {
             CHECK(count > 0);
         }
         
+        WHEN("coalescing events") {
+            const auto p = root / PS_TEXT("1");
+            const auto p2 = create_file(root / PS_TEXT("2"));
+            REQUIRE(exists(p2));
+            
+            cfg.notification_latency = sleep_duration;
+            cfg.coalesce_events = true;
+            unique_change_registration reg{recursive_monitor(root, cfg, [&lock, &notes](const change_notifications& n) {
+                guard lg{lock};
+                notes.insert(notes.end(), n.begin(), n.end());
+            })};
+            CHECK(reg);
+            
+            create_file(p);
+            for (auto f : {p, p2, p, p2}) {
+                std::ofstream stream(f.c_str(), std::ios::app);
+                CHECK(stream);
+                stream << "hello world" << std::flush;
+            }
+            CHECK(remove(p));
+            
+            std::this_thread::sleep_for(sleep_duration * 3);
+            stop(reg);
+            CHECK(remove(p2));
+            
+            REQUIRE(notes.size() == 1);
+            CHECK(notes[0].path() == p2);
+            CHECK(content_modified(notes[0]));
+            CHECK_FALSE(removed(notes[0]));
+        }
+        
         WHEN("renaming a file") {
             const auto p = create_file(root / PS_TEXT("1"));
             REQUIRE(exists(p));
@@ -303,6 +352,139 @@ TEST_CASE("filesystem_monitor") {
         
         REQUIRE(remove(root));
     }
+    
+    SECTION("polling monitor") {
+        const auto root = canonical(temp_directory_path()) / process_name("fs17test");
+        create_directory(root);
+        REQUIRE(exists(root));
+        const auto p = create_file(root / PS_TEXT("1"));
+        
+        std::mutex lock;
+        using guard = std::lock_guard<std::mutex>;
+        change_notifications notes;
+        
+        change_config cfg;
+        cfg.notification_latency = change_config::latency_type{0}; // the minimum poll interval is used
+        cfg.backend = change_monitor_backend::polling;
+        constexpr auto sleep_duration = change_config::latency_type{300};
+        
+        WHEN("renaming a file") {
+            unique_change_registration reg{recursive_monitor(root, cfg, [&lock, &notes](const change_notifications& n) {
+                guard lg{lock};
+                notes.insert(notes.end(), n.begin(), n.end());
+            })};
+            CHECK(reg);
+            
+            const auto np = root / PS_TEXT("2");
+            rename(p, np);
+            
+            std::this_thread::sleep_for(sleep_duration);
+            stop(reg);
+            
+            rename(np, p);
+            
+            REQUIRE(notes.size() == 1);
+            CHECK(renamed(notes[0]));
+            CHECK(notes[0].path() == p);
+            CHECK(notes[0].renamed_to_path() == np);
+        }
+        
+        WHEN("monitoring a file") {
+            unique_change_registration reg{monitor(p, cfg, [&lock, &notes](const change_notifications& n) {
+                guard lg{lock};
+                notes.insert(notes.end(), n.begin(), n.end());
+            })};
+            CHECK(reg);
+            
+            {
+                std::ofstream stream(p.c_str());
+                CHECK(stream);
+                stream << "hello world" << std::flush;
+            }
+            
+            std::this_thread::sleep_for(sleep_duration);
+            stop(reg);
+            
+            REQUIRE(notes.size() == 1);
+            CHECK(content_modified(notes[0]));
+            CHECK(notes[0].path() == p);
+        }
+        
+        REQUIRE(remove(p));
+        REQUIRE(remove(root));
+    }    
+#if PS_HAVE_FILESYSTEM_CHANGE_JOURNAL
+    SECTION("journaled monitor") {
+        const auto root = canonical(temp_directory_path()) / process_name("fs17test");
+        create_directory(root);
+        REQUIRE(exists(root));
+        const auto jp = temp_directory_path() / process_name("fs17journal");
+        PS_RAII_REMOVE(jp);
+        change_journal journal{jp};
+        
+        std::mutex lock;
+        using guard = std::lock_guard<std::mutex>;
+        change_notifications notes;
+        auto cb = [&lock, &notes](const change_notifications& n) {
+            guard lg{lock};
+            notes.insert(notes.end(), n.begin(), n.end());
+        };
+        
+        change_config cfg;
+        cfg.notification_latency = change_config::latency_type{0};
+        cfg.journal = &journal;
+        constexpr auto sleep_duration = change_config::latency_type{300};
+        
+        std::string archive;
+        {
+            unique_change_registration reg{recursive_monitor(root, cfg, cb)};
+            CHECK(reg);
+            archive = static_cast<const change_registration&>(reg).serialize();
+            CHECK_FALSE(archive.empty());
+            
+            create_file(root / PS_TEXT("1"));
+            std::this_thread::sleep_for(sleep_duration);
+        }
+        REQUIRE(notes.size() == 1);
+        CHECK(journal.last_event_id() == notes[0].event_id());
+        notes.clear();
+        
+        WHEN("replaying the journal") {
+            auto state = change_state::serialize(archive, change_thaw_options::replay_to_current_event);
+            CHECK(state->serialize() == archive);
+            cfg.state = state.get();
+            unique_change_registration reg{recursive_monitor(root, cfg, cb)};
+            CHECK(reg);
+            std::this_thread::sleep_for(sleep_duration);
+            
+            REQUIRE(notes.size() == 2);
+            CHECK(created(notes[0]));
+            CHECK(notes[0].path() == root / PS_TEXT("1"));
+            CHECK(notes[0] == static_cast<const change_registration&>(reg));
+            CHECK(notes[1].event() == change_event::replay_end);
+        }
+        
+        WHEN("the journal is recording another monitor") {
+            unique_change_registration reg{recursive_monitor(root, cfg, cb)};
+            CHECK(reg);
+            error_code ec;
+            CHECK_FALSE(recursive_monitor(root, cfg, cb, ec));
+            CHECK(ec);
+        }
+        
+        WHEN("the journal was reset") {
+            journal.reset();
+            auto state = change_state::serialize(archive);
+            cfg.state = state.get();
+            error_code ec;
+            CHECK_FALSE(recursive_monitor(root, cfg, cb, ec));
+            CHECK(ec);
+        }
+        
+        REQUIRE(remove(root / PS_TEXT("1")));
+        REQUIRE(remove(root));
+    }
+#endif
 }
 
 #endif // PS_HAVE_FILESYSTEM_CHANGE_MONITOR
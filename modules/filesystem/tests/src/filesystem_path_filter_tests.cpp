@@ -0,0 +1,164 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+#include <prosoft/core/config/config_platform.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_path_filter.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+#include <fstestutils.hpp>
+
+using namespace prosoft;
+using namespace prosoft::filesystem;
+
+TEST_CASE("path_filter") {
+    WHEN("the filter is empty") {
+        path_filter f;
+        CHECK(f.empty());
+        CHECK(f(path{"/a/b"}));
+        CHECK(f(path{}));
+    }
+    
+    WHEN("rules are invalid") {
+        path_filter f;
+        CHECK_THROWS(f.include(path{}));
+        CHECK_THROWS(f.exclude(path{"/a/*/c"}));
+        CHECK(f.empty());
+    }
+    
+    WHEN("excluding paths") {
+        path_filter f;
+        f.exclude(path{"/a/b"});
+        f.exclude(path{"/a/c/*.o"});
+        f.exclude(path{"*.tmp"});
+        f.exclude(path{".git"});
+        f.exclude(path{"*~"});
+        CHECK_FALSE(f.empty());
+        
+        CHECK(f(path{"/a"}));
+        CHECK_FALSE(f(path{"/a/b"}));
+        CHECK_FALSE(f(path{"/a/b/c"}));
+        CHECK(f(path{"/a/bc"}));
+        CHECK(f(path{"/a/c/x.c"}));
+        CHECK_FALSE(f(path{"/a/c/x.o"}));
+        CHECK_FALSE(f(path{"/a/c/d/x.o"}));
+        CHECK(f(path{"/a/x.o"}));
+        CHECK_FALSE(f(path{"/x/y.tmp"}));
+        CHECK_FALSE(f(path{"/x/y.tmp/z"}));
+        CHECK(f(path{"/x/y.tmp1"}));
+        CHECK_FALSE(f(path{"/x/.git/config"}));
+        CHECK(f(path{"/x/.gitignore"}));
+        CHECK_FALSE(f(path{"/x/y~"}));
+        CHECK(f.match(path{"/a/b"}) == filter_match::excluded);
+    }
+    
+    WHEN("including paths") {
+        path_filter f;
+        f.include(path{"/a/b"});
+        f.include(path{"/c/*.txt"});
+        
+        CHECK(f(path{"/a/b"}));
+        CHECK(f(path{"/a/b/c"}));
+        CHECK(f(path{"/c/d/1.txt"}));
+        CHECK_FALSE(f(path{"/c/d/1.tmp"}));
+        CHECK_FALSE(f(path{"/d"}));
+        CHECK(f.match(path{"/a"}) == filter_match::ancestor);
+        CHECK(f.match(path{"/c/d"}) == filter_match::ancestor);
+        CHECK(f.match(path{"/d"}) == filter_match::excluded);
+    }
+    
+    WHEN("the deepest rule decides") {
+        path_filter f;
+        f.exclude(path{"/a"});
+        f.include(path{"/a/b"});
+        f.exclude(path{"/a/b/c"});
+        f.include(path{"*.keep"});
+        
+        CHECK(f.match(path{"/a"}) == filter_match::ancestor);
+        CHECK(f(path{"/a/b"}));
+        CHECK(f(path{"/a/b/d"}));
+        CHECK_FALSE(f(path{"/a/b/c/d"}));
+        CHECK(f(path{"/a/b/c/d.keep"}));
+        CHECK_FALSE(f(path{"/e"})); // there are include rules
+    }
+    
+    WHEN("a rule is both included and excluded") {
+        path_filter f;
+        f.include(path{"*.tmp"});
+        f.exclude(path{"*.tmp"});
+        f.exclude(path{"/a/b"});
+        f.include(path{"/a/b"});
+        CHECK_FALSE(f(path{"/x.tmp"}));
+        CHECK_FALSE(f(path{"/a/b"}));
+    }
+}
+
+TEST_CASE("path_filter_iteration") {
+    const auto root = canonical(temp_directory_path()) / process_name("fs17test");
+    create_directory(root);
+    PS_RAII_REMOVE(root);
+    const auto a = root / PS_TEXT("a");
+    create_directory(a);
+    PS_RAII_REMOVE(a);
+    const auto f1 = create_file(a / PS_TEXT("1.txt"));
+    PS_RAII_REMOVE(f1);
+    const auto f2 = create_file(a / PS_TEXT("2.tmp"));
+    PS_RAII_REMOVE(f2);
+    const auto f3 = create_file(root / PS_TEXT("3.txt"));
+    PS_RAII_REMOVE(f3);
+    
+    auto iterate = [&root](std::shared_ptr<path_filter> f, directory_options opts = recursive_directory_iterator::default_options()) {
+        recursive_directory_iterator::configuration_type cfg;
+        cfg.filter = std::move(f);
+        std::vector<path> v;
+        for (const auto& e : recursive_directory_iterator{root, opts, std::move(cfg)}) {
+            v.push_back(e.path());
+        }
+        std::sort(v.begin(), v.end());
+        return v;
+    };
+    
+    WHEN("excluding paths") {
+        auto f = std::make_shared<path_filter>();
+        f->exclude(path{"*.tmp"});
+        CHECK(iterate(f) == std::vector<path>({f3, a, f1}));
+    }
+    
+    WHEN("excluding a directory") {
+        auto f = std::make_shared<path_filter>();
+        f->exclude(a);
+        CHECK(iterate(f) == std::vector<path>({f3}));
+    }
+    
+    WHEN("including paths") {
+        auto f = std::make_shared<path_filter>();
+        f->include(a / PS_TEXT("*.txt"));
+        CHECK(iterate(f) == std::vector<path>({f1})); // a is only descended into
+        CHECK(iterate(f, recursive_directory_iterator::default_options()|directory_options::include_postorder_directories) == std::vector<path>({f1}));
+    }
+}
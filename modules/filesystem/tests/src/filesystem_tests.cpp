@@ -27,6 +27,7 @@
 
 #include <fstream>
 #include <iosfwd>
+#include <iterator>
 #include <limits>
 #include <type_traits>
 
@@ -235,6 +236,27 @@ TEST_CASE("filesystem") {
         
         CHECK(st.times().has_modified());
         CHECK_FALSE(status(p, status_info::basic).times().has_modified());
+        if (st.times().has_created()) {
+            // Birth times keep their sub-second part.
+            const auto ct = st.times().created().time_since_epoch();
+            CHECK(ct != std::chrono::duration_cast<std::chrono::seconds>(ct));
+        }
+        
+        // Only the requested info is filled in.
+        CHECK(st.size() == 5);
+        CHECK(st.inode() != 0);
+        CHECK(st.owner() != owner::invalid_owner());
+        const auto sz = status(p, status_info::size);
+        CHECK(sz.size() == 5);
+        CHECK(sz.permissions() == perms::unknown);
+        CHECK(sz.owner() == owner::invalid_owner());
+        CHECK_FALSE(sz.times().has_modified());
+        CHECK(sz.inode() == 0);
+        const auto ino = status(p, status_info::inode|status_info::owner);
+        CHECK(ino.inode() == st.inode());
+        CHECK(ino.device() == st.device());
+        CHECK(ino.owner() == st.owner());
+        CHECK(ino.size() == 0);
         
         CHECK_FALSE(is_directory(st));
         CHECK_FALSE(is_symlink(st));
@@ -701,6 +723,25 @@ TEST_CASE("filesystem") {
             REQUIRE_FALSE(exists(p, ec));
             CHECK_THROWS(remove(p));
         }
+        
+        WHEN("removing a tree") {
+            error_code ec;
+            REQUIRE_FALSE(exists(p, ec));
+            CHECK(remove_all(p) == 0);
+            
+            const auto fp = p / PS_TEXT("1") / PS_TEXT("2");
+            REQUIRE(create_directories(fp));
+            create_file(fp / PS_TEXT("f"));
+            create_file(p / PS_TEXT("._f"));
+            create_symlink(fp, p / PS_TEXT("link"));
+            CHECK(remove_all(p) == 6);
+            CHECK_FALSE(exists(p, ec));
+            
+            create_file(p);
+            CHECK(remove_all(p, ec) == 1);
+            CHECK_FALSE(ec);
+            CHECK_FALSE(exists(p, ec));
+        }
     } // create/remove dirs
 
     SECTION("symlink") {
@@ -861,4 +902,194 @@ TEST_CASE("filesystem") {
         }
 #endif // !_WIN32
     }
+
+    SECTION("copy") {
+        const auto root = canonical(temp_directory_path()) / process_name("fs17test");
+        REQUIRE(create_directory(root));
+        PS_RAII_REMOVE(root);
+        const auto from = root / PS_TEXT("from");
+        const auto to = root / PS_TEXT("to");
+        const std::string content(3 * 1024 * 1024 + 17, 'x');
+        {
+            std::ofstream stream(from.c_str(), std::ios::binary);
+            REQUIRE(stream);
+            stream << content;
+        }
+        PS_RAII_REMOVE(from);
+        error_code ec;
+        
+        auto read = [](const path& p) {
+            std::ifstream stream(p.c_str(), std::ios::binary);
+            return std::string{std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>()};
+        };
+        
+        WHEN("copying a file") {
+            copy_config cfg;
+            file_size_type copied = 0;
+            cfg.progress = [&](const path& p, file_size_type n, file_size_type sz) {
+                CHECK(p == from);
+                CHECK(sz == content.size());
+                CHECK(n > copied);
+                copied = n;
+                return true;
+            };
+            CHECK(copy_file(from, to, copy_options::none, cfg, ec));
+            CHECK_FALSE(ec);
+            CHECK(copied == content.size());
+            CHECK(read(to) == content);
+            
+            CHECK_FALSE(copy_file(from, to, ec)); // exists
+            CHECK(ec);
+            CHECK_FALSE(copy_file(from, to, copy_options::skip_existing, ec));
+            CHECK_FALSE(ec);
+            CHECK_FALSE(copy_file(from, to, copy_options::update_existing, ec)); // not newer
+            CHECK_FALSE(ec);
+            CHECK(copy_file(from, to, copy_options::overwrite_existing, ec));
+            CHECK_FALSE(ec);
+            CHECK_FALSE(copy_file(from, from, copy_options::overwrite_existing, ec));
+            CHECK(ec);
+            REQUIRE(remove(to));
+        }
+        
+        WHEN("copying a file with a small buffer") {
+            copy_config cfg;
+            cfg.buffer_size = 1000;
+            CHECK(copy_file(from, to, copy_options::none, cfg));
+            CHECK(read(to) == content);
+            REQUIRE(remove(to));
+        }
+        
+        WHEN("a copy is canceled") {
+            copy_config cfg;
+            cfg.progress = [](const path&, file_size_type, file_size_type) {
+                return false;
+            };
+            CHECK_FALSE(copy_file(from, to, copy_options::none, cfg, ec));
+            CHECK(ec.value() ==
+#if !_WIN32
+                ECANCELED
+#else
+                ERROR_REQUEST_ABORTED
+#endif
+            );
+            CHECK_FALSE(exists(to, ec));
+        }
+        
+        WHEN("copying a directory") {
+            CHECK_THROWS(copy_file(root, to));
+            
+            const auto sub = root / PS_TEXT("sub");
+            REQUIRE(create_directory(sub));
+            PS_RAII_REMOVE(sub);
+            const auto f = create_file(sub / PS_TEXT("f"));
+            PS_RAII_REMOVE(f);
+            const auto dest = temp_directory_path() / process_name("fs17copy");
+            
+            copy(root, dest); // the direct members
+            CHECK(read(dest / PS_TEXT("from")) == content);
+            CHECK_FALSE(exists(dest / PS_TEXT("sub"), ec));
+            REQUIRE(remove(dest / PS_TEXT("from")));
+            
+            copy(root, dest, copy_options::recursive|copy_options::directories_only);
+            CHECK(is_directory(dest / PS_TEXT("sub")));
+            CHECK_FALSE(exists(dest / PS_TEXT("sub") / PS_TEXT("f"), ec));
+            
+            copy(root, dest, copy_options::recursive|copy_options::skip_existing|copy_options::copy_times);
+            CHECK(exists(dest / PS_TEXT("sub") / PS_TEXT("f")));
+            CHECK(last_write_time(dest / PS_TEXT("from")) == last_write_time(from));
+            CHECK(last_write_time(dest / PS_TEXT("sub")) == last_write_time(sub));
+            
+            CHECK_THROWS(copy(root / PS_TEXT("missing"), dest));
+            
+            REQUIRE(remove(dest / PS_TEXT("sub") / PS_TEXT("f")));
+            REQUIRE(remove(dest / PS_TEXT("sub")));
+            REQUIRE(remove(dest / PS_TEXT("from")));
+            REQUIRE(remove(dest));
+        }
+        
+#if !_WIN32
+        WHEN("copying metadata") {
+            create_file(to);
+            REQUIRE(0 == ::chmod(from.c_str(), 0600));
+            REQUIRE(0 == ::chmod(to.c_str(), 0644));
+            CHECK(copy_file(from, to, copy_options::overwrite_existing|copy_options::copy_perms|copy_options::copy_times));
+            const auto st = status(to);
+            CHECK((st.permissions() & perms::all) == (perms::owner_read|perms::owner_write));
+            CHECK(st.times().modified() == last_write_time(from));
+            REQUIRE(remove(to));
+        }
+        
+        WHEN("copying symlinks") {
+            const auto lnk = root / PS_TEXT("lnk");
+            create_symlink(from, lnk);
+            PS_RAII_REMOVE(lnk);
+            
+            copy(lnk, to, copy_options::copy_symlinks);
+            CHECK(is_symlink(to));
+            CHECK_THROWS(copy(lnk, to, copy_options::copy_symlinks));
+            REQUIRE(remove(to));
+            
+            copy(lnk, to, copy_options::skip_symlinks);
+            CHECK_FALSE(exists(to, ec));
+            
+            copy(lnk, to);
+            CHECK(is_regular_file(to));
+            REQUIRE(remove(to));
+            
+            copy(from, to, copy_options::create_hard_links);
+            CHECK(equivalent(from, to));
+            REQUIRE(remove(to));
+        }
+#endif
+    }
+    
+    SECTION("canonicalize") {
+        const auto root = canonical(temp_directory_path()) / process_name("fs17test");
+        const auto dir = root / PS_TEXT("d");
+        const auto file = dir / PS_TEXT("f");
+        const auto link = root / PS_TEXT("l");
+        REQUIRE(create_directories(dir));
+        PS_RAII_REMOVE(root);
+        PS_RAII_REMOVE(dir);
+        create_file(file);
+        PS_RAII_REMOVE(file);
+        const auto sub = dir / PS_TEXT("s");
+        REQUIRE(create_directory(sub));
+        PS_RAII_REMOVE(sub);
+        create_symlink(dir, link);
+        PS_RAII_REMOVE(link);
+        
+        std::vector<path> paths{
+            root / PS_TEXT("d") / PS_TEXT("f"),
+            root / PS_TEXT("d") / PS_TEXT("missing"),
+            root / PS_TEXT("l"),
+            root / PS_TEXT("l") / PS_TEXT("f"),
+            root / PS_TEXT("d") / PS_TEXT("..") / PS_TEXT("d") / PS_TEXT("f"),
+            root / PS_TEXT("d") / PS_TEXT("."),
+            path{PS_TEXT("relative")},
+            root / PS_TEXT("d") / PS_TEXT("s") / PS_TEXT("f"),
+            root / PS_TEXT("l") / PS_TEXT("s") / PS_TEXT("f"),
+            root / PS_TEXT("missing") / PS_TEXT("s") / PS_TEXT("f"),
+        };
+        std::vector<path> expected;
+        for (const auto& p : paths) {
+            expected.push_back(canonical(p));
+        }
+        CHECK(expected[0] == expected[3]);
+        CHECK(expected[2] == root / PS_TEXT("d"));
+        CHECK(expected[6] == canonical(current_path()) / PS_TEXT("relative"));
+        CHECK(expected[8] == sub / PS_TEXT("f"));
+        CHECK(expected[9] == root / PS_TEXT("missing") / PS_TEXT("s") / PS_TEXT("f"));
+        
+        std::vector<error_code> ecs;
+        canonicalize(paths, ecs);
+        REQUIRE(ecs.size() == paths.size());
+        for (size_t i = 0; i < paths.size(); ++i) {
+            CHECK_FALSE(ecs[i]);
+            CHECK(paths[i] == expected[i]);
+        }
+        
+        CHECK(absolute(root) == root);
+        CHECK(absolute(path{PS_TEXT("relative")}) == current_path() / PS_TEXT("relative"));
+    }
 }
@@ -0,0 +1,235 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <prosoft/core/config/config_platform.h>
+
+#include <algorithm>
+#include <fstream>
+
+#if !_WIN32
+#include <unistd.h>
+#endif
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_tree_hasher.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+#include <fstestutils.hpp>
+
+using namespace prosoft;
+using namespace prosoft::filesystem;
+
+namespace {
+
+path write_file(const path& p, const std::string& content) {
+    std::ofstream f{p.c_str(), std::ios::binary};
+    f << content;
+    return p;
+}
+
+const tree_hasher::file_info* find_file(const tree_hasher& h, const path& p) {
+    auto i = std::find_if(h.files().begin(), h.files().end(), [&p](const tree_hasher::file_info& fi) {
+        return fi.file == p;
+    });
+    return i != h.files().end() ? &*i : nullptr;
+}
+
+std::vector<path> group_paths(const tree_hasher& h, const tree_hasher::group_type& g) {
+    std::vector<path> l;
+    for (auto i : g) {
+        l.push_back(h.files()[i].file);
+    }
+    std::sort(l.begin(), l.end());
+    return l;
+}
+
+} // anon
+
+TEST_CASE("filesystem_tree_hasher") {
+    WHEN("hashing bytes") {
+        // XXH64 reference values
+        CHECK(tree_hasher::hash("", 0) == 0xEF46DB3751D8E999ULL);
+        CHECK(tree_hasher::hash("a", 1) == 0xD24EC4F1A98C6E5BULL);
+        CHECK(tree_hasher::hash("abc", 3) == 0x44BC2CF5AD770999ULL);
+        const std::string s{"Nobody inspects the spammish repetition"};
+        CHECK(tree_hasher::hash(s.data(), s.size()) == 0xFBCEA83C8A378BF1ULL);
+    }
+
+#if !_WIN32
+    WHEN("scanning a tree") {
+        const auto root = canonical(temp_directory_path()) / process_name("fs17hasher");
+        const auto sub = root / PS_TEXT("sub");
+        REQUIRE(create_directories(sub));
+        PS_RAII_REMOVE(root);
+        PS_RAII_REMOVE(sub);
+
+        const std::string big(100000, 'x');
+        auto big2 = big;
+        big2[50000] = 'y'; // same size and edges, different content
+        auto big3 = big;
+        big3[0] = 'y'; // same size, different edges
+        const auto a = write_file(root / PS_TEXT("a"), "small");
+        const auto b = write_file(sub / PS_TEXT("b"), "small");
+        const auto c = write_file(root / PS_TEXT("c"), "other");
+        const auto d = write_file(root / PS_TEXT("d"), "unique size");
+        const auto e = write_file(root / PS_TEXT("e"), big);
+        const auto f = write_file(sub / PS_TEXT("f"), big);
+        const auto g = write_file(root / PS_TEXT("g"), big2);
+        const auto h = write_file(root / PS_TEXT("h"), big3);
+        const auto empty = create_file(root / PS_TEXT("empty"));
+        const auto link = root / PS_TEXT("link");
+        create_symlink(e, link);
+        PS_RAII_REMOVE(a);
+        PS_RAII_REMOVE(b);
+        PS_RAII_REMOVE(c);
+        PS_RAII_REMOVE(d);
+        PS_RAII_REMOVE(e);
+        PS_RAII_REMOVE(f);
+        PS_RAII_REMOVE(g);
+        PS_RAII_REMOVE(h);
+        PS_RAII_REMOVE(empty);
+        PS_RAII_REMOVE(link);
+
+        tree_hasher_config cfg;
+        cfg.threads = 2;
+        tree_hasher th;
+        th.scan(root, cfg);
+        CHECK(th.root() == root);
+        CHECK(th.files().size() == 8); // no empty file or symlink
+        CHECK_FALSE(find_file(th, empty));
+        CHECK_FALSE(find_file(th, link));
+        CHECK(th.reused() == 0);
+
+        REQUIRE(th.duplicates().size() == 2);
+        CHECK(group_paths(th, th.duplicates()[0]) == std::vector<path>({e, f})); // largest first
+        CHECK(group_paths(th, th.duplicates()[1]) == std::vector<path>({a, b}));
+
+        // Only what's needed is read
+        CHECK_FALSE(find_file(th, d)->has_edge_digest);
+        CHECK(find_file(th, h)->has_edge_digest);
+        CHECK_FALSE(find_file(th, h)->has_digest);
+        CHECK(find_file(th, g)->has_digest);
+        CHECK(find_file(th, e)->digest == tree_hasher::hash(big.data(), big.size()));
+        CHECK(find_file(th, e)->digest == tree_hasher::hash(e));
+        CHECK(find_file(th, g)->digest != find_file(th, e)->digest);
+
+        WHEN("mapping files") {
+            cfg.map_files = true;
+            tree_hasher mh;
+            mh.scan(root, cfg);
+            REQUIRE(mh.duplicates().size() == 2);
+            CHECK(find_file(mh, e)->digest == find_file(th, e)->digest);
+        }
+
+        WHEN("including empty files") {
+            cfg.min_size = 0;
+            const auto empty2 = create_file(sub / PS_TEXT("empty2"));
+            PS_RAII_REMOVE(empty2);
+            tree_hasher eh;
+            eh.scan(root, cfg);
+            CHECK(eh.duplicates().size() == 3);
+        }
+
+        WHEN("files have hard links") {
+            const auto elink = sub / PS_TEXT("elink");
+            const auto dlink = sub / PS_TEXT("dlink");
+            REQUIRE(0 == ::link(e.c_str(), elink.c_str()));
+            REQUIRE(0 == ::link(d.c_str(), dlink.c_str()));
+            PS_RAII_REMOVE(elink);
+            PS_RAII_REMOVE(dlink);
+            tree_hasher lh;
+            lh.scan(root, cfg);
+            REQUIRE(lh.duplicates().size() == 2);
+            const auto paths = group_paths(lh, lh.duplicates()[0]);
+            CHECK(paths.size() == 2); // e or its link, and f
+            CHECK(std::find(paths.begin(), paths.end(), f) != paths.end());
+            CHECK(find_file(lh, elink)->digest == find_file(lh, e)->digest);
+            CHECK_FALSE(find_file(lh, d)->has_edge_digest); // only a link has the same size
+            CHECK_FALSE(find_file(lh, dlink)->has_edge_digest);
+        }
+        
+        WHEN("a file is sparse") {
+            const auto sp = root / PS_TEXT("sparse");
+            const auto sp2 = sub / PS_TEXT("sparse");
+            const file_size_type size = 4 * 1024 * 1024;
+            std::string content(static_cast<size_t>(size), '\0');
+            content.replace(1024 * 1024, 5, "hello");
+            for (const auto& p : {sp, sp2}) {
+                {
+                    std::ofstream s{p.c_str(), std::ios::binary};
+                    s.seekp(1024 * 1024);
+                    s << "hello";
+                }
+                REQUIRE(0 == ::truncate(p.c_str(), static_cast<::off_t>(size)));
+            }
+            PS_RAII_REMOVE(sp);
+            PS_RAII_REMOVE(sp2);
+            const auto expected = tree_hasher::hash(content.data(), content.size());
+            CHECK(tree_hasher::hash(sp) == expected);
+            
+            cfg.map_files = true;
+            tree_hasher sh;
+            sh.scan(root, cfg);
+            CHECK(find_file(sh, sp)->digest == expected);
+            CHECK(find_file(sh, sp2)->digest == expected);
+        }
+        
+        WHEN("scanning again") {
+            const auto g2 = write_file(sub / PS_TEXT("g2"), big2);
+            PS_RAII_REMOVE(g2);
+            th.scan(root, cfg);
+            CHECK(th.reused() == 7); // all but d
+            REQUIRE(th.duplicates().size() == 3);
+        }
+
+        WHEN("saving digests") {
+            const auto store = canonical(temp_directory_path()) / process_name("fs17hasher_store");
+            th.save(store);
+            PS_RAII_REMOVE(store);
+            auto loaded = tree_hasher::load(store);
+            CHECK(loaded.root() == root);
+            REQUIRE(loaded.files().size() == th.files().size());
+            REQUIRE(loaded.duplicates().size() == 2);
+            CHECK(group_paths(loaded, loaded.duplicates()[0]) == std::vector<path>({e, f}));
+
+            loaded.scan(root, cfg);
+            CHECK(loaded.reused() == 7);
+
+            write_file(e, big + "z"); // the mtime may not change, but the size does
+            loaded.scan(root, cfg);
+            CHECK(loaded.reused() == 6);
+            CHECK(loaded.duplicates().size() == 1);
+        }
+
+        error_code ec;
+        (void)tree_hasher::load(root / PS_TEXT("missing"), ec);
+        CHECK(ec.value());
+        (void)tree_hasher::load(a, ec); // not a store
+        CHECK(ec.value());
+        th.scan(root / PS_TEXT("missing"), cfg, ec);
+        CHECK(ec.value());
+    }
+#endif
+}
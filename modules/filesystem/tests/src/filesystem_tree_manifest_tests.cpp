@@ -0,0 +1,158 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <prosoft/core/config/config_platform.h>
+
+#include <algorithm>
+#include <fstream>
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_tree_manifest.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+#include <fstestutils.hpp>
+
+using namespace prosoft;
+using namespace prosoft::filesystem;
+
+namespace {
+
+const change_notification* find_note(const change_notifications& notes, const path& p) {
+    auto i = std::find_if(notes.begin(), notes.end(), [&p](const change_notification& n) {
+        return n.path() == p;
+    });
+    return i != notes.end() ? &*i : nullptr;
+}
+
+} // anon
+
+TEST_CASE("filesystem_tree_manifest") {
+    WHEN("manifests are empty") {
+        tree_manifest m;
+        CHECK(m.empty());
+        CHECK(m.find(PS_TEXT("a")) == m.size());
+        CHECK(diff(m, m).empty());
+    }
+
+#if !_WIN32
+    WHEN("capturing a tree") {
+        const auto root = canonical(temp_directory_path()) / process_name("fs17manifest");
+        REQUIRE(create_directory(root));
+        PS_RAII_REMOVE(root);
+        auto d = root / PS_TEXT("d");
+        REQUIRE(create_directory(d));
+        PS_RAII_REMOVE(d);
+        const auto a = create_file(root / PS_TEXT("a"));
+        PS_RAII_REMOVE(a);
+        const auto b = create_file(root / PS_TEXT("b"));
+        auto c = create_file(d / PS_TEXT("c"));
+        PS_RAII_REMOVE(c);
+
+        const auto m1 = tree_manifest::capture(root);
+        CHECK(m1.root() == root);
+        REQUIRE(m1.size() == 4);
+        auto i = m1.find(path{PS_TEXT("d")} / PS_TEXT("c"));
+        REQUIRE(i < m1.size());
+        CHECK(m1.type(i) == file_type::regular);
+        CHECK(m1.relative_path(i) == path{PS_TEXT("d")} / PS_TEXT("c"));
+        i = m1.find(PS_TEXT("d"));
+        REQUIRE(i < m1.size());
+        CHECK(m1.type(i) == file_type::directory);
+        CHECK(m1.find(PS_TEXT("e")) == m1.size());
+        CHECK(diff(m1, m1).empty());
+
+        const auto store = temp_directory_path() / process_name("fs17manifest.store");
+        PS_RAII_REMOVE(store);
+        REQUIRE_NOTHROW(m1.save(store));
+        const auto loaded = tree_manifest::load(store);
+        CHECK(loaded.root() == root);
+        CHECK(loaded.size() == m1.size());
+        CHECK(diff(m1, loaded).empty());
+
+        {
+            std::ofstream s{a.c_str(), std::ios::binary|std::ios::app};
+            s << "modified";
+        }
+        REQUIRE(remove(b));
+        const auto e = create_file(root / PS_TEXT("e"));
+        PS_RAII_REMOVE(e);
+        REQUIRE_NOTHROW(rename(d, root / PS_TEXT("x")));
+        d = root / PS_TEXT("x"); // cleanup the new location
+        c = d / PS_TEXT("c");
+
+        const auto notes = diff(m1, tree_manifest::capture(root));
+        CHECK(notes.size() == 4);
+        auto n = find_note(notes, a);
+        REQUIRE(n);
+        CHECK(content_modified(*n));
+        n = find_note(notes, b);
+        REQUIRE(n);
+        CHECK(removed(*n));
+        CHECK(n->type() == file_type::regular);
+        n = find_note(notes, e);
+        REQUIRE(n);
+        CHECK(created(*n));
+        n = find_note(notes, root / PS_TEXT("d"));
+        REQUIRE(n);
+        CHECK(renamed(*n));
+        CHECK(n->renamed_to_path() == root / PS_TEXT("x"));
+        CHECK(n->type() == file_type::directory);
+        CHECK_FALSE(find_note(notes, root / PS_TEXT("d") / PS_TEXT("c"))); // implied by the dir rename
+    }
+
+    WHEN("a callback throws") {
+        const auto root = canonical(temp_directory_path()) / process_name("fs17manifest");
+        REQUIRE(create_directory(root));
+        PS_RAII_REMOVE(root);
+        const auto a = create_file(root / PS_TEXT("a"));
+        PS_RAII_REMOVE(a);
+        const auto b = create_file(root / PS_TEXT("b"));
+        PS_RAII_REMOVE(b);
+
+        manifest_diff_config cfg;
+        cfg.batch_size = 1;
+        size_t calls = 0;
+        CHECK_THROWS_AS(diff(tree_manifest{}, tree_manifest::capture(root), cfg, [&calls](change_notifications&& notes) {
+            CHECK(notes.size() == 1);
+            ++calls;
+            throw std::runtime_error("stop");
+        }), std::runtime_error);
+        CHECK(calls == 1);
+    }
+
+    WHEN("a store is invalid") {
+        const auto p = create_file(temp_directory_path() / process_name("fs17manifest.store"));
+        PS_RAII_REMOVE(p);
+        error_code ec;
+        CHECK(tree_manifest::load(p, ec).empty());
+        CHECK(ec);
+        CHECK_THROWS(tree_manifest::load(p));
+    }
+#else
+    WHEN("capturing a tree") {
+        CHECK_THROWS(tree_manifest::capture(temp_directory_path()));
+    }
+#endif
+}
@@ -0,0 +1,142 @@
+// Copyright © 2024, Prosoft Engineering, Inc. (A.K.A "Prosoft")
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//     * Neither the name of Prosoft nor the names of its contributors may be
+//       used to endorse or promote products derived from this software without
+//       specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL PROSOFT ENGINEERING, INC. BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <prosoft/core/config/config_platform.h>
+
+#include <algorithm>
+
+#if !_WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <prosoft/core/modules/filesystem/filesystem.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_iterator.hpp>
+#include <prosoft/core/modules/filesystem/filesystem_xattr.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+#include <fstestutils.hpp>
+
+using namespace prosoft;
+using namespace prosoft::filesystem;
+
+namespace {
+
+bool contains(const std::vector<std::string>& names, const std::string& name) {
+    return std::find(names.begin(), names.end(), name) != names.end();
+}
+
+} // anon
+
+TEST_CASE("filesystem_xattr") {
+#if !_WIN32
+    const auto root = canonical(temp_directory_path()) / process_name("fs17xattr");
+    REQUIRE(create_directory(root));
+    PS_RAII_REMOVE(root);
+    const auto f = create_file(root / PS_TEXT("f"));
+    PS_RAII_REMOVE(f);
+    
+    error_code ec;
+    set_xattr(f, "user.ps.a", std::string{"alpha"}, ec);
+    if (ENOTSUP == ec.value()) {
+        WARN("Extended attributes are not supported by the temp volume");
+        return;
+    }
+    REQUIRE_FALSE(ec.value());
+    const std::string big(2000, 'b');
+    set_xattr(f, "user.ps.b", big);
+    set_xattr(f, "user.ps.empty", std::string{});
+    
+    WHEN("reading attributes") {
+        const auto names = list_xattrs(f);
+        CHECK(contains(names, "user.ps.a"));
+        CHECK(contains(names, "user.ps.b"));
+        CHECK(contains(names, "user.ps.empty"));
+        CHECK(get_xattr(f, "user.ps.a") == "alpha");
+        CHECK(get_xattr(f, "user.ps.b") == big);
+        CHECK(get_xattr(f, "user.ps.empty").empty());
+        
+        (void)get_xattr(f, "user.ps.missing", ec);
+        CHECK(ec.value());
+        CHECK_THROWS(get_xattr(f, "user.ps.missing"));
+    }
+    
+    WHEN("reading all attributes") {
+        auto xs = get_xattrs(f);
+        CHECK(xs.size() >= 3);
+        auto x = xs.find("user.ps.a");
+        REQUIRE(x);
+        CHECK(std::string(x->value, x->size) == "alpha");
+        x = xs.find("user.ps.b");
+        REQUIRE(x);
+        CHECK(std::string(x->value, x->size) == big);
+        x = xs.find("user.ps.empty");
+        REQUIRE(x);
+        CHECK(x->size == 0);
+        CHECK_FALSE(xs.find("user.ps.missing"));
+        
+        const auto moved = std::move(xs);
+        CHECK(moved.find("user.ps.b"));
+        
+        (void)get_xattrs(root / PS_TEXT("missing"), ec);
+        CHECK(ec.value());
+    }
+    
+    WHEN("removing an attribute") {
+        remove_xattr(f, "user.ps.a");
+        CHECK_FALSE(contains(list_xattrs(f), "user.ps.a"));
+        remove_xattr(f, "user.ps.a", ec);
+        CHECK(ec.value());
+    }
+    
+    WHEN("using a descriptor") {
+        const int fd = ::open(f.c_str(), O_RDONLY|O_CLOEXEC);
+        REQUIRE(fd >= 0);
+        set_xattr(fd, "user.ps.c", "cat", 3, ec);
+        CHECK_FALSE(ec.value());
+        CHECK(contains(list_xattrs(fd, ec), "user.ps.c"));
+        CHECK(get_xattr(fd, "user.ps.c", ec) == "cat");
+        const auto xs = get_xattrs(fd, ec);
+        CHECK_FALSE(ec.value());
+        CHECK(xs.find("user.ps.c"));
+        remove_xattr(fd, "user.ps.c", ec);
+        CHECK_FALSE(ec.value());
+        CHECK_FALSE(contains(list_xattrs(f), "user.ps.c"));
+        ::close(fd);
+    }
+    
+    WHEN("iterating with attributes") {
+        const auto g = create_file(root / PS_TEXT("g"));
+        PS_RAII_REMOVE(g);
+        for (const auto& e : directory_iterator{root, directory_options::include_xattrs}) {
+            REQUIRE(e.xattrs());
+            CHECK((e.path() == f) == (nullptr != e.xattrs()->find("user.ps.a")));
+        }
+        for (const auto& e : directory_iterator{root}) {
+            CHECK_FALSE(e.xattrs());
+        }
+    }
+#endif
+}